@@ -17,6 +17,16 @@ class CAny
 public:
 	CAny() : Type(FT_NONE) {}
 
+	CAny(const CAny& v) : Type(FT_NONE)
+	{
+		*this = v;
+	}
+
+	CAny(CAny&& v) : Type(FT_NONE)
+	{
+		*this = std::move(v);
+	}
+
 	CAny(const bool& v)
 	{
 		Type = FT_BOOL;
@@ -10,6 +10,10 @@ CMoonDbClient::CMoonDbClient(const string& host, uint16_t port, const string& db
 	ReceiveBufSize = 65536;
 	BytesPerRead = 8192;
 	Socket = INVALID_SOCKET;
+	FieldIds = false;
+	RequestSchema = nullptr;
+	BytesSent = 0;
+	BytesReceived = 0;
 	Content.Allocate(1048576);//1M
 	Connect();
 }
@@ -256,6 +260,7 @@ void CMoonDbClient::Send(const CPack& pack)
 		}
 		pos += static_cast<size_t>(bytes);
 	}
+	BytesSent += size;
 }
 
 ResponseType CMoonDbClient::Receive(CPack& pack)
@@ -305,9 +310,82 @@ ResponseType CMoonDbClient::Receive(CPack& pack)
 			}
 		}
 	}
+	BytesReceived += static_cast<uint64_t>(msg_len) + 8;
 	return static_cast<ResponseType>(rettype);
 }
 
+void CMoonDbClient::ReceiveResponses(CPack& pack, size_t count)
+{
+	// 一次尽量多读，直到收到count个完整的响应
+	pack.Clear();
+	size_t pos = 0;
+	size_t received = 0;
+	while(received < count) {
+		size_t need = pos + 8;
+		while(pack.GetSize() >= pos + 8) {
+			int64_t msg_len = 0;
+			::memcpy(&msg_len, static_cast<char*>(pack.GetPointer()) + pos, 8);
+			if(msg_len < 2) {
+				ThrowError(ERR_RECEIVE, "An error occor when recieving data (msg_len).");
+			}
+			need = pos + 8 + static_cast<size_t>(msg_len);
+			if(pack.GetSize() < need) {
+				break;
+			}
+			uint16_t rettype = 0;
+			::memcpy(&rettype, static_cast<char*>(pack.GetPointer()) + pos + 8, 2);
+			pos = need;
+			received++;
+			// 出错后服务器不再处理之后的请求并关闭连接
+			if(rettype <= RT_ERROR) {
+				received = count;
+				break;
+			}
+		}
+		if(received >= count) {
+			break;
+		}
+		pack.Reallocate(max(need, pack.GetSize() + static_cast<size_t>(BytesPerRead)));
+		int32_t cur_len = static_cast<int32_t>(min(pack.GetCapacity() - pack.GetSize(), static_cast<size_t>(numeric_limits<int32_t>::max())));
+		int32_t recv_len = MoonSockRecv(Socket, static_cast<char*>(pack.GetPointer()) + pack.GetSize(), cur_len);
+		if(SOCKET_ERROR == recv_len) {
+			ThrowError(ERR_RECEIVE, "Receive Error: " + MoonLastError());
+		}
+		else if(0 == recv_len) {
+			ThrowError(ERR_RECEIVE, "Connection is closed by server.");
+		}
+		pack.SetSize(pack.GetSize() + static_cast<size_t>(recv_len));
+	}
+	BytesReceived += pack.GetSize();
+	pack.Seek(0);
+}
+
+ResponseType CMoonDbClient::ParseResponse(CPack& pack)
+{
+	int64_t msg_len = 0;
+	pack.Get(msg_len);
+	uint16_t rettype = 0;
+	pack.Get(rettype);
+	if(rettype <= RT_ERROR) {
+		ThrowError(ERR_FROM_SERVER, "\"" + string(static_cast<char*>(pack.GetPointer()) + pack.Tell(), static_cast<size_t>(msg_len) - 2) + "\"");
+	}
+	return static_cast<ResponseType>(rettype);
+}
+
+ResponseType CMoonDbClient::Request(const string& table, const function<void()>& prepare)
+{
+	prepare();
+	Send(Content);
+	ResponseType rettype = Receive(Content);
+	if(RT_SCHEMA_CHANGED == rettype) {
+		GetSchema(table, true);
+		prepare();
+		Send(Content);
+		rettype = Receive(Content);
+	}
+	return rettype;
+}
+
 string CMoonDbClient::Quote(const string& src_str)
 {
 	string des_str;
@@ -360,26 +438,118 @@ string CMoonDbClient::Quote(const string& src_str)
 void CMoonDbClient::PrepareData(CPack& pack, OperationType oper, const string& table, const map<string, CAny>& data)
 {
 	pack.Clear();
+	AppendData(pack, oper, table, data);
+}
+
+void CMoonDbClient::AppendData(CPack& pack, OperationType oper, const string& table, const map<string, CAny>& data)
+{
+	// 请求追加在已有数据之后，多个请求可以一次发送
+	size_t start = BeginRequest(pack, oper, table);
+	PutFields(pack, data);
+	EndRequest(pack, start);
+}
+
+size_t CMoonDbClient::BeginRequest(CPack& pack, OperationType oper, const string& table)
+{
+	// 按字段序号时先取得表结构（未缓存时读取），GetSchema不使用pack
+	RequestSchema = FieldIds && OPER_RAW_SELECT != oper && OPER_SCHEMA != oper && OPER_STATS != oper ? &GetSchema(table) : nullptr;
+	size_t start = pack.GetSize();
+	pack.Seek(static_cast<int64_t>(start));
 	pack.Put(static_cast<int64_t>(0));
 	pack.Put(static_cast<uint8_t>(1));
-	pack.Put(static_cast<uint16_t>(oper));
+	pack.Put(static_cast<uint16_t>(nullptr == RequestSchema ? oper : oper | OPER_FIELD_IDS));
 	pack.Put<uint16_t>(DatabaseName);
 	pack.Put<uint16_t>(table);
+	if(nullptr != RequestSchema) {
+		pack.Put(RequestSchema->Stamp);
+	}
+	return start;
+}
+
+void CMoonDbClient::PutFields(CPack& pack, const map<string, CAny>& data)
+{
 	pack.Put(static_cast<uint16_t>(data.size()));
 	for(auto it = data.begin(); it != data.end(); it++) {
-		pack.Put<uint16_t>(it->first);
+		if(nullptr == RequestSchema) {
+			pack.Put<uint16_t>(it->first);
+		}
+		else {
+			auto oit = RequestSchema->Ordinals.find(it->first);
+			if(oit == RequestSchema->Ordinals.end()) {
+				ThrowError(ERR_DATA_INVALID, "The field " + it->first + " doesn't exist.");
+			}
+			pack.Put(oit->second);
+		}
 		pack.Put(it->second.GetType());
 		it->second.Store(pack);
 	}
-	int64_t length = static_cast<int64_t>(pack.GetSize()) - 8;
-	pack.Seek(0);
+}
+
+void CMoonDbClient::EndRequest(CPack& pack, size_t start)
+{
+	int64_t length = static_cast<int64_t>(pack.GetSize() - start) - 8;
+	pack.Seek(static_cast<int64_t>(start));
 	pack.Put(length);
+	pack.Seek(0, CPack::POS_END);
+}
+
+size_t CMoonDbClient::PrepareMultiData(CPack& pack, OperationType oper, const string& table, const vector<__uint128_t>& ids, const vector<map<string, CAny>>* data)
+{
+	// 读取和删除每行只写入rowid，插入只写入各行数据，更新和替换在各行数据中加入rowid
+	size_t count = nullptr == data ? ids.size() : data->size();
+	if(nullptr != data && OPER_MULTI_INSERT != oper && ids.size() != count) {
+		ThrowError(ERR_DATA_INVALID, "The numbers of ids and rows are different.");
+	}
+	pack.Clear();
+	size_t start = BeginRequest(pack, oper, table);
+	pack.Put(static_cast<uint32_t>(count));
+	for(size_t i = 0; i < count; i++) {
+		if(nullptr == data) {
+			CAny id(ids[i]);
+			pack.Put(id.GetType());
+			id.Store(pack);
+		}
+		else if(OPER_MULTI_INSERT == oper) {
+			PutFields(pack, (*data)[i]);
+		}
+		else {
+			map<string, CAny> row((*data)[i]);
+			row["rowid"] = ids[i];
+			PutFields(pack, row);
+		}
+	}
+	EndRequest(pack, start);
+	return count;
+}
+
+size_t CMoonDbClient::AffectedRowsResult(CPack& pack, vector<uint8_t>* affected)
+{
+	uint32_t count = 0;
+	pack.Get(count);
+	size_t total = 0;
+	if(nullptr != affected) {
+		affected->resize(count);
+	}
+	for(uint32_t i = 0; i < count; i++) {
+		uint8_t rows = 0;
+		pack.Get(rows);
+		total += rows;
+		if(nullptr != affected) {
+			(*affected)[i] = rows;
+		}
+	}
+	return total;
 }
 
 __uint128_t CMoonDbClient::IdNumResult(CPack& pack)
 {
 	uint16_t type;
 	pack.Get(type);
+	return IdValue(pack, type);
+}
+
+__uint128_t CMoonDbClient::IdValue(CPack& pack, uint16_t type)
+{
 	switch(type) {
 	case FT_INT8:
 	{
@@ -448,9 +618,9 @@ __uint128_t CMoonDbClient::IdNumResult(CPack& pack)
 
 __uint128_t CMoonDbClient::InsertData(const string& table, map<string, CAny>& data)
 {
-	PrepareData(Content, OPER_INSERT, table, data);
-	Send(Content);
-	ResponseType rettype = Receive(Content);
+	ResponseType rettype = Request(table, [&]() {
+		PrepareData(Content, OPER_INSERT, table, data);
+	});
 	if(RT_LAST_INSERT_ID == rettype) {
 		return IdNumResult(Content);
 	}
@@ -460,9 +630,9 @@ __uint128_t CMoonDbClient::InsertData(const string& table, map<string, CAny>& da
 __uint128_t CMoonDbClient::UpdateData(const string& table, __uint128_t id, map<string, CAny>& data)
 {
 	data["rowid"] = id;
-	PrepareData(Content, OPER_UPDATE, table, data);
-	Send(Content);
-	ResponseType rettype = Receive(Content);
+	ResponseType rettype = Request(table, [&]() {
+		PrepareData(Content, OPER_UPDATE, table, data);
+	});
 	if(RT_AFFECTED_ROWS == rettype) {
 		return IdNumResult(Content);
 	}
@@ -473,9 +643,9 @@ __uint128_t CMoonDbClient::DeleteData(const string& table, __uint128_t id)
 {
 	map<string, CAny> data;
 	data["rowid"] = id;
-	PrepareData(Content, OPER_DELETE, table, data);
-	Send(Content);
-	ResponseType rettype = Receive(Content);
+	ResponseType rettype = Request(table, [&]() {
+		PrepareData(Content, OPER_DELETE, table, data);
+	});
 	if(RT_AFFECTED_ROWS == rettype) {
 		return IdNumResult(Content);
 	}
@@ -485,9 +655,9 @@ __uint128_t CMoonDbClient::DeleteData(const string& table, __uint128_t id)
 __uint128_t CMoonDbClient::ReplaceData(const string& table, __uint128_t id, map<string, CAny>& data)
 {
 	data["rowid"] = id;
-	PrepareData(Content, OPER_REPLACE, table, data);
-	Send(Content);
-	ResponseType rettype = Receive(Content);
+	ResponseType rettype = Request(table, [&]() {
+		PrepareData(Content, OPER_REPLACE, table, data);
+	});
 	if(RT_AFFECTED_ROWS == rettype) {
 		return IdNumResult(Content);
 	}
@@ -496,33 +666,510 @@ __uint128_t CMoonDbClient::ReplaceData(const string& table, __uint128_t id, map<
 
 __uint128_t CMoonDbClient::GetData(const string& table, __uint128_t id, map<string, CAny>& data)
 {
+	map<string, CAny> cond;
+	cond["rowid"] = id;
 	data.clear();
-	data["rowid"] = id;
-	PrepareData(Content, OPER_SELECT, table, data);
-	Send(Content);
-	data.clear();
-	ResponseType rettype = Receive(Content);
+	ResponseType rettype = Request(table, [&]() {
+		PrepareData(Content, OPER_SELECT, table, cond);
+	});
 	if(RT_QUERY == rettype) {
-		uint16_t count = 0;
+		return QueryResult(Content, id, data);
+	}
+	// 按字段序号读取时返回一行的批量读取结果
+	if(RT_MULTI_QUERY == rettype) {
+		vector<map<string, CAny>> rows(1);
+		size_t found = MultiQueryResult(Content, vector<__uint128_t>{id}, rows);
+		data.swap(rows[0]);
+		return found;
+	}
+	return 0;
+}
+
+size_t CMoonDbClient::GetDataPipelined(const string& table, const vector<__uint128_t>& ids, vector<map<string, CAny>>& data)
+{
+	data.clear();
+	data.resize(ids.size());
+	if(ids.empty()) {
+		return 0;
+	}
+	map<string, CAny> cond;
+	for(int attempt = 0; attempt < 2; attempt++) {
+		Content.Clear();
+		for(size_t i = 0; i < ids.size(); i++) {
+			cond["rowid"] = ids[i];
+			AppendData(Content, OPER_SELECT, table, cond);
+		}
+		Send(Content);
+		ReceiveResponses(Content, ids.size());
+		// 表结构已改变时各请求都未执行，重新读取表结构后再发送一次
+		uint16_t rettype = 0;
+		::memcpy(&rettype, static_cast<char*>(Content.GetPointer()) + 8, 2);
+		if(RT_SCHEMA_CHANGED != rettype) {
+			break;
+		}
+		GetSchema(table, true);
+	}
+	size_t found = 0;
+	for(size_t i = 0; i < ids.size(); i++) {
+		uint64_t start = Content.Tell();
+		int64_t msg_len = 0;
+		Content.Get(msg_len);
+		Content.Seek(static_cast<int64_t>(start));
+		ResponseType rettype = ParseResponse(Content);
+		if(RT_QUERY == rettype) {
+			found += static_cast<size_t>(QueryResult(Content, ids[i], data[i]));
+		}
+		else if(RT_MULTI_QUERY == rettype) {
+			vector<map<string, CAny>> rows(1);
+			found += MultiQueryResult(Content, vector<__uint128_t>{ids[i]}, rows);
+			data[i].swap(rows[0]);
+		}
+		Content.Seek(static_cast<int64_t>(start + 8) + msg_len);
+	}
+	return found;
+}
+
+vector<__uint128_t> CMoonDbClient::InsertMultiData(const string& table, const vector<map<string, CAny>>& data)
+{
+	vector<__uint128_t> ids;
+	ResponseType rettype = Request(table, [&]() {
+		PrepareMultiData(Content, OPER_MULTI_INSERT, table, ids, &data);
+	});
+	if(RT_MULTI_INSERT_ID == rettype) {
+		uint16_t type = 0;
+		Content.Get(type);
+		uint32_t count = 0;
 		Content.Get(count);
-		if(count > 0) {
-			__uint128_t rid = IdNumResult(Content);
-			if(rid != id) {
-				ThrowError(ERR_DATA_INVALID, "Invaid data are retrived.");
+		ids.resize(count);
+		for(uint32_t i = 0; i < count; i++) {
+			ids[i] = IdValue(Content, type);
+		}
+	}
+	return ids;
+}
+
+size_t CMoonDbClient::UpdateMultiData(const string& table, const vector<__uint128_t>& ids, const vector<map<string, CAny>>& data, vector<uint8_t>* affected)
+{
+	ResponseType rettype = Request(table, [&]() {
+		PrepareMultiData(Content, OPER_MULTI_UPDATE, table, ids, &data);
+	});
+	if(RT_MULTI_AFFECTED_ROWS == rettype) {
+		return AffectedRowsResult(Content, affected);
+	}
+	return 0;
+}
+
+size_t CMoonDbClient::DeleteMultiData(const string& table, const vector<__uint128_t>& ids, vector<uint8_t>* affected)
+{
+	ResponseType rettype = Request(table, [&]() {
+		PrepareMultiData(Content, OPER_MULTI_DELETE, table, ids, nullptr);
+	});
+	if(RT_MULTI_AFFECTED_ROWS == rettype) {
+		return AffectedRowsResult(Content, affected);
+	}
+	return 0;
+}
+
+size_t CMoonDbClient::ReplaceMultiData(const string& table, const vector<__uint128_t>& ids, const vector<map<string, CAny>>& data, vector<uint8_t>* affected)
+{
+	ResponseType rettype = Request(table, [&]() {
+		PrepareMultiData(Content, OPER_MULTI_REPLACE, table, ids, &data);
+	});
+	if(RT_MULTI_AFFECTED_ROWS == rettype) {
+		return AffectedRowsResult(Content, affected);
+	}
+	return 0;
+}
+
+size_t CMoonDbClient::GetMultiData(const string& table, const vector<__uint128_t>& ids, vector<map<string, CAny>>& data)
+{
+	data.clear();
+	data.resize(ids.size());
+	ResponseType rettype = Request(table, [&]() {
+		PrepareMultiData(Content, OPER_MULTI_SELECT, table, ids, nullptr);
+	});
+	if(RT_MULTI_QUERY != rettype) {
+		return 0;
+	}
+	return MultiQueryResult(Content, ids, data);
+}
+
+size_t CMoonDbClient::MultiQueryResult(CPack& pack, const vector<__uint128_t>& ids, vector<map<string, CAny>>& data)
+{
+	// 请求的表结构在解析之前不会改变，RequestSchema仍是发送请求时使用的表结构
+	uint16_t type = 0;
+	pack.Get(type);
+	uint32_t count = 0;
+	pack.Get(count);
+	if(count != ids.size()) {
+		ThrowError(ERR_DATA_INVALID, "Invaid data are retrived.");
+	}
+	// 字段名只返回一次（按字段序号时不返回，使用表结构中的字段名），之后每行依次为id和各字段值
+	uint16_t fieldnum = 0;
+	pack.Get(fieldnum);
+	vector<const string*> fieldnames(fieldnum);
+	vector<string> names;
+	if(nullptr != RequestSchema) {
+		if(fieldnum != RequestSchema->Fields.size()) {
+			ThrowError(ERR_DATA_INVALID, "Invaid data are retrived.");
+		}
+		for(uint16_t i = 0; i < fieldnum; i++) {
+			fieldnames[i] = &RequestSchema->Fields[i].Name;
+		}
+	}
+	else {
+		names.resize(fieldnum);
+		for(uint16_t i = 0; i < fieldnum; i++) {
+			pack.Get<uint16_t>(names[i]);
+			fieldnames[i] = &names[i];
+		}
+	}
+	size_t found = 0;
+	for(uint32_t i = 0; i < count; i++) {
+		__uint128_t id = IdValue(pack, type);
+		if(0 == id) {
+			continue;
+		}
+		if(id != ids[i]) {
+			ThrowError(ERR_DATA_INVALID, "Invaid data are retrived.");
+		}
+		for(uint16_t j = 0; j < fieldnum; j++) {
+			CAny val;
+			val.Load(pack);
+			data[i][*fieldnames[j]] = std::move(val);
+		}
+		found++;
+	}
+	return found;
+}
+
+__uint128_t CMoonDbClient::GetRawData(const string& table, __uint128_t id, map<string, CAny>& data)
+{
+	const CTableSchema& schema = GetSchema(table);
+	data.clear();
+	map<string, CAny> cond;
+	cond["rowid"] = id;
+	PrepareData(Content, OPER_RAW_SELECT, table, cond);
+	Send(Content);
+	ResponseType rettype = Receive(Content);
+	if(RT_RAW_QUERY != rettype) {
+		return 0;
+	}
+	uint16_t type = 0;
+	Content.Get(type);
+	__uint128_t rid = IdValue(Content, type);
+	if(0 == rid) {
+		return 0;
+	}
+	if(rid != id) {
+		ThrowError(ERR_DATA_INVALID, "Invaid data are retrived.");
+	}
+	// 行长度与缓存的表结构不一致说明表结构已改变，下次重新读取
+	if(Content.GetSize() - Content.Tell() != schema.RowLength) {
+		Schemas.erase(DatabaseName + "." + table);
+		ThrowError(ERR_DATA_INVALID, "The schema of the table " + table + " has been changed.");
+	}
+	DecodeRawRow(schema, static_cast<const char*>(Content.GetPointer()) + Content.Tell(), data);
+	return 1;
+}
+
+void CMoonDbClient::GetStats(const string& table, map<string, uint64_t>& stats)
+{
+	stats.clear();
+	map<string, CAny> cond;
+	PrepareData(Content, OPER_STATS, table, cond);
+	Send(Content);
+	ResponseType rettype = Receive(Content);
+	if(RT_STATS != rettype) {
+		ThrowError(ERR_DATA_INVALID, "Invaid data are retrived.");
+	}
+	uint16_t count = 0;
+	Content.Get(count);
+	for(uint16_t i = 0; i < count; i++) {
+		string name;
+		Content.Get<uint16_t>(name);
+		uint64_t value = 0;
+		Content.Get(value);
+		stats[name] = value;
+	}
+}
+
+const CTableSchema& CMoonDbClient::GetSchema(const string& table, bool refresh)
+{
+	string key = DatabaseName + "." + table;
+	auto it = Schemas.find(key);
+	if(it != Schemas.end() && !refresh) {
+		return it->second;
+	}
+	// 使用单独的缓冲区，Content中可能有正在写入的请求
+	CPack pack(4096);
+	map<string, CAny> cond;
+	PrepareData(pack, OPER_SCHEMA, table, cond);
+	Send(pack);
+	ResponseType rettype = Receive(pack);
+	if(RT_SCHEMA != rettype) {
+		ThrowError(ERR_DATA_INVALID, "Invaid data are retrived.");
+	}
+	CTableSchema schema;
+	pack.Get(schema.IdType);
+	pack.Get(schema.RowLength);
+	uint16_t fieldnum = 0;
+	pack.Get(fieldnum);
+	schema.Fields.resize(fieldnum);
+	for(uint16_t i = 0; i < fieldnum; i++) {
+		CTableSchema::CField& field = schema.Fields[i];
+		pack.Get<uint16_t>(field.Name);
+		uint16_t fieldtype = 0;
+		pack.Get(fieldtype);
+		field.Type = static_cast<FieldType>(fieldtype);
+		pack.Get(field.Length);
+		uint32_t scale = 0;
+		pack.Get(scale);
+		field.Scale = static_cast<int32_t>(scale);
+		pack.Get(field.Position);
+		uint16_t valuenum = 0;
+		pack.Get(valuenum);
+		field.Values.resize(valuenum);
+		for(uint16_t j = 0; j < valuenum; j++) {
+			pack.Get<uint16_t>(field.Values[j]);
+		}
+		schema.Ordinals[field.Name] = static_cast<uint16_t>(i + 1);
+	}
+	schema.Ordinals["rowid"] = 0;
+	pack.Get(schema.Stamp);
+	return Schemas[key] = std::move(schema);
+}
+
+void CMoonDbClient::DecodeRawRow(const CTableSchema& schema, const char* row, map<string, CAny>& data)
+{
+	// 与GetData返回的类型相同：数值类型保持原类型，其余类型转换为字符串
+	for(const CTableSchema::CField& field : schema.Fields) {
+		const char* p = row + field.Position;
+		CAny& val = data[field.Name];
+		switch(field.Type) {
+		case FT_BOOL:
+			val = *p != 0;
+			break;
+		case FT_BIT:
+		{
+			size_t bytes = 1;
+			while(bytes * 8 < field.Length && bytes < 16) {
+				bytes <<= 1;
 			}
-			uint16_t fieldnum = 0;
-			Content.Get(fieldnum);
-			for(uint16_t i = 0; i < fieldnum; i++) {
-				string fieldname;
-				Content.Get<uint16_t>(fieldname);
-				CAny val;
-				val.Load(Content);
-				data[fieldname] = std::move(val);
+			__uint128_t bitint = 0;
+			::memcpy(&bitint, p, bytes);
+			string v(128, '0');
+			for(uint16_t i = 0; i < 128; ++i) {
+				if(bitint % 2 == 1) {
+					v[i] = '1';
+				}
+				bitint >>= 1;
 			}
+			v.erase(v.find_last_not_of('0') + 1);
+			val = v;
+			break;
+		}
+		case FT_INT8:
+		{
+			int8_t v;
+			::memcpy(&v, p, sizeof(v));
+			val = v;
+			break;
+		}
+		case FT_UINT8:
+		{
+			uint8_t v;
+			::memcpy(&v, p, sizeof(v));
+			val = v;
+			break;
+		}
+		case FT_INT16:
+		{
+			int16_t v;
+			::memcpy(&v, p, sizeof(v));
+			val = v;
+			break;
+		}
+		case FT_UINT16:
+		{
+			uint16_t v;
+			::memcpy(&v, p, sizeof(v));
+			val = v;
+			break;
+		}
+		case FT_INT32:
+		{
+			int32_t v;
+			::memcpy(&v, p, sizeof(v));
+			val = v;
+			break;
+		}
+		case FT_UINT32:
+		{
+			uint32_t v;
+			::memcpy(&v, p, sizeof(v));
+			val = v;
+			break;
+		}
+		case FT_INT64:
+		case FT_TIMESTAMP:
+		{
+			int64_t v;
+			::memcpy(&v, p, sizeof(v));
+			val = v;
+			break;
+		}
+		case FT_UINT64:
+		{
+			uint64_t v;
+			::memcpy(&v, p, sizeof(v));
+			val = v;
+			break;
+		}
+		case FT_INT128:
+		{
+			__int128_t v;
+			::memcpy(&v, p, sizeof(v));
+			val = v;
+			break;
+		}
+		case FT_UINT128:
+		{
+			__uint128_t v;
+			::memcpy(&v, p, sizeof(v));
+			val = v;
+			break;
+		}
+		case FT_FLOAT32:
+		{
+			float v;
+			::memcpy(&v, p, sizeof(v));
+			val = v;
+			break;
+		}
+		case FT_FLOAT64:
+		{
+			double v;
+			::memcpy(&v, p, sizeof(v));
+			val = v;
+			break;
+		}
+		case FT_FLOAT128:
+		{
+			__float128 v;
+			::memcpy(&v, p, sizeof(v));
+			val = num_to_string(v);
+			break;
+		}
+		case FT_DECIMAL64:
+		{
+			int64_t v;
+			::memcpy(&v, p, sizeof(v));
+			val = DecimalToString(num_to_string(v), field.Scale);
+			break;
+		}
+		case FT_DECIMAL128:
+		{
+			__int128_t v;
+			::memcpy(&v, p, sizeof(v));
+			val = DecimalToString(num_to_string(v), field.Scale);
+			break;
+		}
+		case FT_ENUM:
+		{
+			uint16_t v;
+			::memcpy(&v, p, sizeof(v));
+			val = v > 0 && v <= field.Values.size() ? field.Values[v - 1] : string();
+			break;
+		}
+		case FT_DATE:
+		{
+			CDate v;
+			::memset(&v, 0, sizeof(v));
+			::memcpy(&v, p, 3);
+			val = num_to_string(static_cast<int32_t>(v.Year)) + "-" + num_to_string(static_cast<uint32_t>(v.Month)) + "-" + num_to_string(static_cast<uint32_t>(v.Day));
+			break;
+		}
+		case FT_TIME:
+		{
+			int64_t v;
+			::memcpy(&v, p, sizeof(v));
+			__float128 ldv = static_cast<__float128>(v) / 1000000000;
+			v = static_cast<int64_t>(ldv);
+			double fraction = static_cast<double>(fabsq(ldv - v));
+			int64_t hour = v / 3600;
+			int32_t leftseconds = v % 3600;
+			int32_t minute = leftseconds / 60;
+			int32_t second = leftseconds % 60;
+			val = num_to_string(hour) + ":" + pad_left_copy(num_to_string(::abs(minute)), 2, '0') + ":" + pad_left_copy(num_to_string(::abs(second)), 2, '0') + "." + num_to_string(fraction);
+			break;
+		}
+		case FT_DATETIME:
+		{
+			CDateTime v;
+			::memset(&v, 0, sizeof(v));
+			::memcpy(&v, p, min(sizeof(v), static_cast<size_t>(9)));
+			uint32_t time = v.Time;
+			val = num_to_string(static_cast<int32_t>(v.Year)) + "-" + num_to_string(static_cast<uint32_t>(v.Month)) + "-" + num_to_string(static_cast<uint32_t>(v.Day)) + " " +
+				  pad_left_copy(num_to_string(time / 3600), 2, '0') + ":" + pad_left_copy(num_to_string(time % 3600 / 60), 2, '0') + ":" +
+				  pad_left_copy(num_to_string(time % 60), 2, '0') + "." + num_to_string(static_cast<uint32_t>(v.Fraction));
+			break;
+		}
+		case FT_CHAR:
+		case FT_VARCHAR:
+		{
+			// 2个字节字符数，2个字节实际长度
+			uint16_t size;
+			::memcpy(&size, p + 2, sizeof(size));
+			val = string(p + 4, min(static_cast<uint32_t>(size), field.Length));
+			break;
+		}
+		case FT_BINARY:
+		case FT_VARBINARY:
+		{
+			uint16_t size;
+			::memcpy(&size, p, sizeof(size));
+			val = string(p + 2, min(static_cast<uint32_t>(size), field.Length));
+			break;
+		}
+		default:
+			break;
 		}
-		return count;
 	}
-	return 0;
+}
+
+string CMoonDbClient::DecimalToString(const string& digits, int32_t scale)
+{
+	// 与服务器端CDecimal64::ToString(false)相同的科学计数法格式
+	if("0" == digits) {
+		return "0.E0";
+	}
+	size_t sign = '-' == digits[0] ? 1 : 0;
+	string fraction = digits.substr(sign + 1);
+	fraction.erase(fraction.find_last_not_of('0') + 1);
+	return digits.substr(0, sign + 1) + "." + fraction + "E" + num_to_string(static_cast<int64_t>(digits.size() - sign) - 1 + scale);
+}
+
+__uint128_t CMoonDbClient::QueryResult(CPack& pack, __uint128_t id, map<string, CAny>& data)
+{
+	uint16_t count = 0;
+	pack.Get(count);
+	if(count > 0) {
+		__uint128_t rid = IdNumResult(pack);
+		if(rid != id) {
+			ThrowError(ERR_DATA_INVALID, "Invaid data are retrived.");
+		}
+		uint16_t fieldnum = 0;
+		pack.Get(fieldnum);
+		for(uint16_t i = 0; i < fieldnum; i++) {
+			string fieldname;
+			pack.Get<uint16_t>(fieldname);
+			CAny val;
+			val.Load(pack);
+			data[fieldname] = std::move(val);
+		}
+	}
+	return count;
 }
 
 std::ostream & operator << (std::ostream & os, const map<string, CAny>& data)
@@ -5,6 +5,8 @@
 #include <cmath>
 #include <iostream>
 #include <map>
+#include <vector>
+#include <functional>
 using namespace std;
 
 #include "ctime.hpp"
@@ -43,6 +45,27 @@ using namespace std;
 
 namespace MoonDb {
 
+/**
+ * 表结构，用于解码服务器返回的原始行数据
+ */
+struct CTableSchema
+{
+	struct CField
+	{
+		string Name;				/**< 字段名称 */
+		FieldType Type;				/**< 字段类型 */
+		uint32_t Length;			/**< 长度或精度 */
+		int32_t Scale;				/**< 小数点后的位数 */
+		uint64_t Position;			/**< 字段在行中的位置 */
+		vector<string> Values;		/**< ENUM的选项值，编号从1开始 */
+	};
+	uint16_t IdType;				/**< rowid类型 */
+	uint64_t RowLength;				/**< 行数据长度 */
+	vector<CField> Fields;			/**< 除rowid外的字段 */
+	uint32_t Stamp;					/**< 表结构校验值，按字段序号发送的请求中带上 */
+	map<string, uint16_t> Ordinals;	/**< 字段名对应的序号，rowid为0，其他字段从1开始 */
+};
+
 class CMoonDbClient
 {
 public:
@@ -52,12 +75,59 @@ public:
 	{
 		DatabaseName = dbname;
 	}
+	/**
+	 * @brief UseFieldIds 为true时增删改查的请求按字段序号发送，读取结果不带字段名；第一次访问表时读取并缓存表结构，
+	 * 表结构改变后服务器不执行请求，重新读取表结构后重试一次
+	 */
+	void UseFieldIds(bool enable)
+	{
+		FieldIds = enable;
+	}
+	/**
+	 * @brief GetTraffic 本连接已发送和接收的字节数
+	 */
+	void GetTraffic(uint64_t& sent, uint64_t& received) const
+	{
+		sent = BytesSent;
+		received = BytesReceived;
+	}
 
 	__uint128_t InsertData(const string& table, map<string, CAny>& data);
 	__uint128_t UpdateData(const string& table, __uint128_t id, map<string, CAny>& data);
 	__uint128_t DeleteData(const string& table, __uint128_t id);
 	__uint128_t ReplaceData(const string& table, __uint128_t id, map<string, CAny>& data);
 	__uint128_t GetData(const string& table, __uint128_t id, map<string, CAny>& data);
+	/**
+	 * @brief GetDataPipelined 一次发送多个读取请求，服务器按顺序处理后一次返回，只需一次往返
+	 * @return 读取到的记录数，data中与ids对应，不存在的记录为空
+	 */
+	size_t GetDataPipelined(const string& table, const vector<__uint128_t>& ids, vector<map<string, CAny>>& data);
+
+	/**
+	 * 批量操作，一个请求处理多行数据，服务器只查找一次表、加锁一次。
+	 * affected不为空时返回每行的影响行数（0或1），函数返回影响行数之和
+	 */
+	vector<__uint128_t> InsertMultiData(const string& table, const vector<map<string, CAny>>& data);
+	size_t UpdateMultiData(const string& table, const vector<__uint128_t>& ids, const vector<map<string, CAny>>& data, vector<uint8_t>* affected = nullptr);
+	size_t DeleteMultiData(const string& table, const vector<__uint128_t>& ids, vector<uint8_t>* affected = nullptr);
+	size_t ReplaceMultiData(const string& table, const vector<__uint128_t>& ids, const vector<map<string, CAny>>& data, vector<uint8_t>* affected = nullptr);
+	/**
+	 * @brief GetMultiData 批量读取，data中与ids对应，不存在的记录为空
+	 * @return 读取到的记录数
+	 */
+	size_t GetMultiData(const string& table, const vector<__uint128_t>& ids, vector<map<string, CAny>>& data);
+	/**
+	 * @brief GetRawData 与GetData结果相同，服务器直接发送原始行数据，由客户端按表结构解码
+	 */
+	__uint128_t GetRawData(const string& table, __uint128_t id, map<string, CAny>& data);
+	/**
+	 * @brief GetSchema 读取表结构，第一次读取后缓存，refresh为true时重新读取
+	 */
+	const CTableSchema& GetSchema(const string& table, bool refresh = false);
+	/**
+	 * @brief GetStats 读取表的统计信息：行数、淘汰和到期删除的行数、内存预算的使用情况等
+	 */
+	void GetStats(const string& table, map<string, uint64_t>& stats);
 
 	static string Quote(const string& str);
 
@@ -70,8 +140,25 @@ protected:
 	inline uint32_t IPToLong(const string& ip);
 	void Send(const CPack& pack);
 	ResponseType Receive(CPack& pack);
+	void ReceiveResponses(CPack& pack, size_t count);
+	ResponseType ParseResponse(CPack& pack);
+	/**
+	 * @brief Request 调用prepare在Content中写入请求后发送并接收响应，表结构已改变时重新读取表结构后再发送一次
+	 */
+	ResponseType Request(const string& table, const function<void()>& prepare);
 	void PrepareData(CPack& pack, OperationType oper, const string& table, const map<string, CAny>& data);
+	void AppendData(CPack& pack, OperationType oper, const string& table, const map<string, CAny>& data);
+	size_t BeginRequest(CPack& pack, OperationType oper, const string& table);
+	void PutFields(CPack& pack, const map<string, CAny>& data);
+	void EndRequest(CPack& pack, size_t start);
+	size_t PrepareMultiData(CPack& pack, OperationType oper, const string& table, const vector<__uint128_t>& ids, const vector<map<string, CAny>>* data);
+	size_t AffectedRowsResult(CPack& pack, vector<uint8_t>* affected);
+	size_t MultiQueryResult(CPack& pack, const vector<__uint128_t>& ids, vector<map<string, CAny>>& data);
 	__uint128_t IdNumResult(CPack& pack);
+	__uint128_t IdValue(CPack& pack, uint16_t type);
+	__uint128_t QueryResult(CPack& pack, __uint128_t id, map<string, CAny>& data);
+	void DecodeRawRow(const CTableSchema& schema, const char* row, map<string, CAny>& data);
+	static string DecimalToString(const string& digits, int32_t scale);
 
 	string Host;
 	uint16_t Port;
@@ -85,6 +172,11 @@ protected:
 	int32_t ReceiveBufSize;
 	int32_t BytesPerRead;
 	CPack Content;
+	map<string, CTableSchema> Schemas;	/**< 已读取的表结构，键为“数据库.表” */
+	bool FieldIds;						/**< 增删改查是否按字段序号发送 */
+	const CTableSchema* RequestSchema;	/**< 正在写入的请求按字段序号时使用的表结构，否则为nullptr */
+	uint64_t BytesSent;
+	uint64_t BytesReceived;
 };
 
 std::ostream & operator << (std::ostream & os, const map<string, CAny>& data);
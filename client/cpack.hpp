@@ -382,6 +382,11 @@ public:
 		return Size;
 	}
 
+	inline size_t GetCapacity() const noexcept
+	{
+		return Capacity;
+	}
+
 	inline void SetSize(size_t newsize) noexcept
 	{
 		if(newsize <= Capacity) {
@@ -54,9 +54,19 @@ namespace MoonDb {
 		OPER_INSERT,
 		OPER_UPDATE,
 		OPER_DELETE,
-		OPER_REPLACE
+		OPER_REPLACE,
+		OPER_MULTI_SELECT,
+		OPER_MULTI_INSERT,
+		OPER_MULTI_UPDATE,
+		OPER_MULTI_DELETE,
+		OPER_MULTI_REPLACE,
+		OPER_RAW_SELECT,
+		OPER_SCHEMA,
+		OPER_STATS,
 	};
 
+	const uint16_t OPER_FIELD_IDS = 0x8000;	/**< 操作类型的标志位：字段按表结构中的序号表示，表名之后为表结构校验值 */
+
 	enum IndexType {
 		IT_NONE,
 		IT_ROWID,
@@ -87,6 +97,28 @@ namespace MoonDb {
 		RT_LAST_INSERT_ID,
 		RT_AFFECTED_ROWS,
 		RT_EXECUTE,
+		RT_MULTI_QUERY,			/**< 批量读取结果 */
+		RT_MULTI_INSERT_ID,		/**< 批量插入的各行id */
+		RT_MULTI_AFFECTED_ROWS,	/**< 批量更新、删除、替换各行的影响行数 */
+		RT_RAW_QUERY,			/**< 读取结果为按表结构存储的原始行数据，由客户端根据RT_SCHEMA解码 */
+		RT_SCHEMA,				/**< 表结构：各字段的类型、长度和在行中的位置 */
+		RT_STATS,				/**< 表的统计信息：名称和64位无符号整数值的列表 */
+		RT_SCHEMA_CHANGED,		/**< 表结构校验值与表不一致，请求未执行，之后为当前的校验值 */
+	};
+
+	// 与服务器端存储格式相同，用于解码原始行数据
+	struct CDate{
+		signed Year:15;
+		unsigned Month:4;
+		unsigned Day:5;
+	};
+
+	struct CDateTime{
+		signed Year: 16;
+		unsigned Month: 4;
+		unsigned Day: 5;
+		unsigned Time: 17;
+		unsigned Fraction: 30;
 	};
 
 	class CDefinition
@@ -1,5 +1,14 @@
 #include <future>
 #include <thread>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#if !defined(_WIN32)
+	#include <sys/resource.h>
+	#include <unistd.h>
+#endif
 
 #include "cmoondbclient.h"
 #include "crandom.hpp"
@@ -61,7 +70,479 @@ void generaltest()
 	}
 }
 
-int main()
+/**
+ * @brief serverjiffies 读取服务器进程累计占用的CPU时间（/proc/<pid>/stat中的utime+stime），单位为秒
+ */
+double serverjiffies(int serverpid)
+{
+#if defined(_WIN32)
+	return 0;
+#else
+	if(serverpid <= 0) {
+		return 0;
+	}
+	ifstream file("/proc/" + to_string(serverpid) + "/stat");
+	string stat((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+	size_t pos = stat.rfind(')');
+	if(pos == string::npos) {
+		return 0;
+	}
+	// ')'后依次为第3个字段state起，utime和stime为第14、15个字段
+	istringstream fields(stat.substr(pos + 2));
+	string field;
+	uint64_t utime = 0, stime = 0;
+	for(uint32_t i = 3; i <= 15 && fields >> field; i++) {
+		if(14 == i) {
+			utime = stoull(field);
+		}
+		else if(15 == i) {
+			stime = stoull(field);
+		}
+	}
+	return static_cast<double>(utime + stime) / ::sysconf(_SC_CLK_TCK);
+#endif
+}
+
+/**
+ * @brief idlebench 空闲连接测试：建立idleconns个空闲连接后，统计服务器空闲时的CPU占用，以及另一个连接上请求的延迟分布
+ * @param host 服务器地址
+ * @param port 服务器端口
+ * @param idleconns 空闲连接数
+ * @param requests 请求次数
+ * @param serverpid 服务器进程号，用于统计CPU占用（仅限本机），为0时不统计
+ */
+void idlebench(const string& host, uint16_t port, uint32_t idleconns, uint32_t requests, int serverpid)
+{
+#if !defined(_WIN32)
+	rlimit rl;
+	if(0 == ::getrlimit(RLIMIT_NOFILE, &rl) && rl.rlim_cur < idleconns + 64) {
+		rl.rlim_cur = min(static_cast<rlim_t>(idleconns + 64), rl.rlim_max);
+		::setrlimit(RLIMIT_NOFILE, &rl);
+	}
+#endif
+	sockaddr_in addr;
+	bzero(&addr, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	::inet_pton(AF_INET, host.c_str(), &addr.sin_addr);
+	vector<SOCKET> socks;
+	socks.reserve(idleconns);
+	for(uint32_t i = 0; i < idleconns; i++) {
+		SOCKET sock = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if(INVALID_SOCKET == sock || 0 != ::connect(sock, static_cast<sockaddr*>(static_cast<void*>(&addr)), sizeof(addr))) {
+			cout << "connect failed after " << i << " idle connections: " << MoonLastError() << endl;
+			if(INVALID_SOCKET != sock) {
+				MoonSockClose(sock);
+			}
+			break;
+		}
+		socks.push_back(sock);
+	}
+	cout << "idle connections: " << socks.size() << endl;
+
+	// 空闲时服务器CPU占用
+	double cpu1 = serverjiffies(serverpid);
+	auto time1 = CTime::Now();
+	::sleep(5);
+	double idlecpu = (serverjiffies(serverpid) - cpu1) / ((CTime::Now() - time1) * CTime::TimeRatio);
+
+	CMoonDbClient client(host, port, "test");
+	map<string, CAny> data;
+	data["title"] = "abc";
+	data["content"] = "hgdfgd";
+	data["price"] = 10.0;
+	data["hits"] = 2;
+	__uint128_t id = client.InsertData("testtable", data);
+	vector<int64_t> latencies;
+	latencies.reserve(requests);
+	cpu1 = serverjiffies(serverpid);
+	time1 = CTime::Now();
+	for(uint32_t i = 0; i < requests; i++) {
+		auto t1 = CTime::Now();
+		client.GetData("testtable", id, data);
+		latencies.push_back(CTime::Now() - t1);
+	}
+	double elapsed = (CTime::Now() - time1) * CTime::TimeRatio;
+	double busycpu = (serverjiffies(serverpid) - cpu1) / elapsed;
+	sort(latencies.begin(), latencies.end());
+	auto percentile = [&latencies](double p) {
+		return latencies.empty() ? 0 : latencies[min(latencies.size() - 1, static_cast<size_t>(latencies.size() * p))] * CTime::TimeRatio * 1000000;
+	};
+	cout << "requests: " << latencies.size() << ", qps: " << latencies.size() / elapsed << endl;
+	cout << "latency(us) p50: " << percentile(0.5) << ", p99: " << percentile(0.99) << ", p999: " << percentile(0.999) << ", max: " << percentile(1) << endl;
+	if(serverpid > 0) {
+		cout << "server cpu idle: " << idlecpu * 100 << "%, under load: " << busycpu * 100 << "%" << endl;
+	}
+
+	for(size_t i = 0; i < socks.size(); i++) {
+		MoonSockClose(socks[i]);
+	}
+}
+
+/**
+ * @brief qpsbench 吞吐量测试：threads个线程各自使用一个连接连续执行requests次GetData
+ * @param host 服务器地址
+ * @param port 服务器端口
+ * @param threads 线程（连接）数
+ * @param requests 每个线程的请求次数
+ */
+void qpsbench(const string& host, uint16_t port, uint32_t threads, uint32_t requests)
+{
+	__uint128_t id = 0;
+	{
+		CMoonDbClient client(host, port, "test");
+		map<string, CAny> data;
+		data["title"] = "abc";
+		data["content"] = "hgdfgd";
+		data["price"] = 10.0;
+		data["hits"] = 2;
+		id = client.InsertData("testtable", data);
+	}
+	vector<thread> pool;
+	atomic<uint64_t> finished(0);
+	auto time1 = CTime::Now();
+	for(uint32_t i = 0; i < threads; i++) {
+		pool.emplace_back([&]() {
+			try {
+				CMoonDbClient client(host, port, "test");
+				map<string, CAny> data;
+				for(uint32_t j = 0; j < requests; j++) {
+					client.GetData("testtable", id, data);
+					finished++;
+				}
+			}
+			catch(runtime_error& e) {
+				cout << e.what() << endl;
+			}
+		});
+	}
+	for(uint32_t i = 0; i < threads; i++) {
+		pool[i].join();
+	}
+	double elapsed = (CTime::Now() - time1) * CTime::TimeRatio;
+	cout << "connections: " << threads << ", requests: " << finished << ", seconds: " << elapsed << ", qps: " << finished / elapsed << endl;
+}
+
+/**
+ * @brief mixedbench 混合读写测试：threads个线程各自使用一个连接，对预先插入的不同记录执行requests次请求，其中writepercent%为UpdateData，其余为GetData
+ * @param host 服务器地址
+ * @param port 服务器端口
+ * @param threads 线程（连接）数
+ * @param requests 每个线程的请求次数
+ * @param writepercent 写入请求的百分比
+ */
+void mixedbench(const string& host, uint16_t port, uint32_t threads, uint32_t requests, uint32_t writepercent)
+{
+	const uint32_t rowsperthread = 64;
+	vector<__uint128_t> ids;
+	{
+		CMoonDbClient client(host, port, "test");
+		map<string, CAny> data;
+		data["title"] = "abc";
+		data["content"] = "hgdfgd";
+		data["price"] = 10.0;
+		data["hits"] = 2;
+		vector<map<string, CAny>> rows(rowsperthread, data);
+		for(uint32_t i = 0; i < threads; i++) {
+			vector<__uint128_t> batch = client.InsertMultiData("testtable", rows);
+			ids.insert(ids.end(), batch.begin(), batch.end());
+		}
+	}
+	vector<thread> pool;
+	atomic<uint64_t> reads(0), writes(0);
+	auto time1 = CTime::Now();
+	for(uint32_t i = 0; i < threads; i++) {
+		pool.emplace_back([&, i]() {
+			try {
+				CMoonDbClient client(host, port, "test");
+				map<string, CAny> data;
+				map<string, CAny> update;
+				update["hits"] = 3;
+				for(uint32_t j = 0; j < requests; j++) {
+					__uint128_t id = ids[i * rowsperthread + j % rowsperthread];
+					if(j % 100 < writepercent) {
+						client.UpdateData("testtable", id, update);
+						writes++;
+					}
+					else {
+						client.GetData("testtable", id, data);
+						reads++;
+					}
+				}
+			}
+			catch(runtime_error& e) {
+				cout << e.what() << endl;
+			}
+		});
+	}
+	for(uint32_t i = 0; i < threads; i++) {
+		pool[i].join();
+	}
+	double elapsed = (CTime::Now() - time1) * CTime::TimeRatio;
+	cout << "connections: " << threads << ", reads: " << reads << ", writes: " << writes << ", seconds: " << elapsed << ", qps: " << (reads + writes) / elapsed << endl;
+}
+
+/**
+ * @brief pipelinebench 流水线测试：比较逐个GetData与一次往返流水线读取batch条记录的耗时
+ * @param host 服务器地址
+ * @param port 服务器端口
+ * @param batch 每批读取的记录数
+ * @param rounds 批数
+ */
+void pipelinebench(const string& host, uint16_t port, uint32_t batch, uint32_t rounds)
+{
+	CMoonDbClient client(host, port, "test");
+	map<string, CAny> data;
+	data["title"] = "abc";
+	data["content"] = "hgdfgd";
+	data["price"] = 10.0;
+	data["hits"] = 2;
+	vector<__uint128_t> ids;
+	for(uint32_t i = 0; i < batch; i++) {
+		ids.push_back(client.InsertData("testtable", data));
+	}
+
+	auto time1 = CTime::Now();
+	size_t found = 0;
+	for(uint32_t i = 0; i < rounds; i++) {
+		for(uint32_t j = 0; j < batch; j++) {
+			found += static_cast<size_t>(client.GetData("testtable", ids[j], data));
+		}
+	}
+	double sequential = (CTime::Now() - time1) * CTime::TimeRatio;
+	cout << "sequential: " << found << " rows, " << sequential * 1000000 / rounds << " us per batch" << endl;
+
+	vector<map<string, CAny>> results;
+	time1 = CTime::Now();
+	found = 0;
+	for(uint32_t i = 0; i < rounds; i++) {
+		found += client.GetDataPipelined("testtable", ids, results);
+	}
+	double pipelined = (CTime::Now() - time1) * CTime::TimeRatio;
+	cout << "pipelined:  " << found << " rows, " << pipelined * 1000000 / rounds << " us per batch" << endl;
+	cout << "speedup: " << sequential / pipelined << endl;
+}
+
+/**
+ * @brief batchbench 批量操作测试：比较逐行请求与批量请求（一次请求rows行）的插入、读取、更新、替换、删除耗时
+ * @param host 服务器地址
+ * @param port 服务器端口
+ * @param rows 每批行数
+ * @param rounds 批数
+ */
+void batchbench(const string& host, uint16_t port, uint32_t rows, uint32_t rounds)
+{
+	CMoonDbClient client(host, port, "test");
+	map<string, CAny> row;
+	row["title"] = "abc";
+	row["content"] = "hgdfgd";
+	row["price"] = 10.0;
+	row["hits"] = 2;
+	vector<map<string, CAny>> data(rows, row);
+	vector<map<string, CAny>> results;
+	vector<__uint128_t> ids;
+	auto report = [rows, rounds](const char* name, double single, double multi) {
+		cout << name << ": single " << rows * rounds / single << " rows/s, multi " << rows * rounds / multi << " rows/s, speedup " << single / multi << endl;
+	};
+	double single, multi;
+
+	auto time1 = CTime::Now();
+	for(uint32_t i = 0; i < rounds; i++) {
+		for(uint32_t j = 0; j < rows; j++) {
+			ids.push_back(client.InsertData("testtable", row));
+		}
+	}
+	single = (CTime::Now() - time1) * CTime::TimeRatio;
+	vector<vector<__uint128_t>> batches;
+	time1 = CTime::Now();
+	for(uint32_t i = 0; i < rounds; i++) {
+		batches.push_back(client.InsertMultiData("testtable", data));
+	}
+	multi = (CTime::Now() - time1) * CTime::TimeRatio;
+	report("insert", single, multi);
+
+	time1 = CTime::Now();
+	for(size_t i = 0; i < ids.size(); i++) {
+		client.GetData("testtable", ids[i], row);
+	}
+	single = (CTime::Now() - time1) * CTime::TimeRatio;
+	time1 = CTime::Now();
+	for(uint32_t i = 0; i < rounds; i++) {
+		client.GetMultiData("testtable", batches[i], results);
+	}
+	multi = (CTime::Now() - time1) * CTime::TimeRatio;
+	report("select", single, multi);
+
+	row["hits"] = 3;
+	fill(data.begin(), data.end(), row);
+	time1 = CTime::Now();
+	for(size_t i = 0; i < ids.size(); i++) {
+		client.UpdateData("testtable", ids[i], row);
+	}
+	single = (CTime::Now() - time1) * CTime::TimeRatio;
+	time1 = CTime::Now();
+	for(uint32_t i = 0; i < rounds; i++) {
+		client.UpdateMultiData("testtable", batches[i], data);
+	}
+	multi = (CTime::Now() - time1) * CTime::TimeRatio;
+	report("update", single, multi);
+
+	time1 = CTime::Now();
+	for(size_t i = 0; i < ids.size(); i++) {
+		client.ReplaceData("testtable", ids[i], row);
+	}
+	single = (CTime::Now() - time1) * CTime::TimeRatio;
+	time1 = CTime::Now();
+	for(uint32_t i = 0; i < rounds; i++) {
+		client.ReplaceMultiData("testtable", batches[i], data);
+	}
+	multi = (CTime::Now() - time1) * CTime::TimeRatio;
+	report("replace", single, multi);
+
+	time1 = CTime::Now();
+	for(size_t i = 0; i < ids.size(); i++) {
+		client.DeleteData("testtable", ids[i]);
+	}
+	single = (CTime::Now() - time1) * CTime::TimeRatio;
+	time1 = CTime::Now();
+	size_t deleted = 0;
+	for(uint32_t i = 0; i < rounds; i++) {
+		deleted += client.DeleteMultiData("testtable", batches[i]);
+	}
+	multi = (CTime::Now() - time1) * CTime::TimeRatio;
+	report("delete", single, multi);
+	cout << "deleted by batch: " << deleted << endl;
+}
+
+/**
+ * @brief rawbench 原始行数据测试：比较GetData与GetRawData读取同一条记录的耗时，并检查两者结果相同
+ * @param host 服务器地址
+ * @param port 服务器端口
+ * @param requests 读取次数
+ */
+void rawbench(const string& host, uint16_t port, uint32_t requests)
+{
+	CMoonDbClient client(host, port, "test");
+	map<string, CAny> data;
+	data["title"] = "abc";
+	data["content"] = string(900, 'x');
+	data["price"] = 10.0;
+	data["hits"] = 2;
+	__uint128_t id = client.InsertData("testtable", data);
+	map<string, CAny> row, rawrow;
+	client.GetData("testtable", id, row);
+	client.GetRawData("testtable", id, rawrow);
+	auto text = [](const CAny& v) {
+		ostringstream os;
+		os << v;
+		return os.str();
+	};
+	for(auto it = row.begin(); it != row.end(); it++) {
+		if(rawrow.count(it->first) == 0 || text(rawrow[it->first]) != text(it->second)) {
+			cout << "mismatch: " << it->first << ": " << it->second << " != " << rawrow[it->first] << endl;
+		}
+	}
+
+	auto time1 = CTime::Now();
+	for(uint32_t i = 0; i < requests; i++) {
+		client.GetData("testtable", id, row);
+	}
+	double serialized = (CTime::Now() - time1) * CTime::TimeRatio;
+	time1 = CTime::Now();
+	for(uint32_t i = 0; i < requests; i++) {
+		client.GetRawData("testtable", id, rawrow);
+	}
+	double raw = (CTime::Now() - time1) * CTime::TimeRatio;
+	cout << "GetData: " << requests / serialized << " qps, GetRawData: " << requests / raw << " qps, speedup " << serialized / raw << endl;
+	client.DeleteData("testtable", id);
+}
+
+void evictbench(const string& host, uint16_t port, uint32_t rows, uint32_t hot)
+{
+	CMoonDbClient client(host, port, "test");
+	map<string, CAny> data;
+	data["title"] = "abc";
+	data["content"] = string(900, 'x');
+	data["price"] = 10.0;
+	data["hits"] = 2;
+	vector<__uint128_t> ids;
+	ids.reserve(rows);
+	map<string, CAny> row;
+	auto time1 = CTime::Now();
+	for(uint32_t i = 0; i < rows; i++) {
+		ids.push_back(client.InsertData("testtable", data));
+		// 前hot行为热点数据，每添加一行读取一次
+		if(i >= hot && hot > 0) {
+			client.GetData("testtable", ids[i % hot], row);
+		}
+	}
+	double seconds = (CTime::Now() - time1) * CTime::TimeRatio;
+	uint32_t hothits = 0, coldhits = 0;
+	for(uint32_t i = 0; i < rows; i++) {
+		if(client.GetData("testtable", ids[i], row) > 0) {
+			(i < hot ? hothits : coldhits)++;
+		}
+	}
+	map<string, uint64_t> stats;
+	client.GetStats("testtable", stats);
+	cout << "insert: " << rows / seconds << " rows/s, hot rows kept: " << hothits << "/" << hot << ", other rows kept: " << coldhits << "/" << rows - hot << endl;
+	for(auto it = stats.begin(); it != stats.end(); it++) {
+		cout << it->first << ": " << it->second << endl;
+	}
+	for(size_t i = 0; i < ids.size(); i += 1000) {
+		client.DeleteMultiData("testtable", vector<__uint128_t>(ids.begin() + i, ids.begin() + min(i + 1000, ids.size())));
+	}
+}
+
+/**
+ * @brief fieldidbench 比较按字段名和按字段序号发送的读取和更新请求：每秒请求数和每个请求收发的字节数
+ */
+void fieldidbench(const string& host, uint16_t port, uint32_t requests)
+{
+	CMoonDbClient client(host, port, "test");
+	map<string, CAny> data;
+	data["title"] = "abc";
+	data["content"] = "x";
+	data["price"] = 10.0;
+	data["hits"] = 2;
+	__uint128_t id = client.InsertData("testtable", data);
+	map<string, CAny> byname, byid;
+	client.GetData("testtable", id, byname);
+	for(int mode = 0; mode < 2; mode++) {
+		client.UseFieldIds(1 == mode);
+		map<string, CAny> row;
+		client.GetData("testtable", id, row);
+		if(1 == mode) {
+			byid = row;
+		}
+		uint64_t sent1, received1, sent2, received2;
+		client.GetTraffic(sent1, received1);
+		auto time1 = CTime::Now();
+		for(uint32_t i = 0; i < requests; i++) {
+			client.GetData("testtable", id, row);
+		}
+		auto time2 = CTime::Now();
+		client.GetTraffic(sent2, received2);
+		double getbytes = static_cast<double>(sent2 - sent1 + received2 - received1) / requests;
+		map<string, CAny> change;
+		for(uint32_t i = 0; i < requests; i++) {
+			change["hits"] = static_cast<int64_t>(i);
+			change["price"] = 10.0 + i % 10;
+			client.UpdateData("testtable", id, change);
+		}
+		auto time3 = CTime::Now();
+		client.GetTraffic(sent1, received1);
+		double updatebytes = static_cast<double>(sent1 - sent2 + received1 - received2) / requests;
+		cout << (0 == mode ? "field names: " : "field ids:   ") << "get " << requests / ((time2 - time1) * CTime::TimeRatio) << " qps " << getbytes << " bytes/request, update "
+			 << requests / ((time3 - time2) * CTime::TimeRatio) << " qps " << updatebytes << " bytes/request" << endl;
+	}
+	if(byname.size() != byid.size()) {
+		cout << "mismatch: " << byname.size() << " fields by name, " << byid.size() << " fields by id" << endl;
+	}
+	client.DeleteData("testtable", id);
+}
+
+int main(int argc, char* argv[])
 {
 //	string str = "ab";
 //	str.push_back('\0');
@@ -77,6 +558,71 @@ int main()
 #endif
 
 	try {
+		// 测试：client idle [空闲连接数] [请求数] [服务器进程号] [端口]
+		if(argc > 1 && string("idle") == argv[1]) {
+			idlebench("127.0.0.1", argc > 5 ? static_cast<uint16_t>(stoul(argv[5])) : 8888, argc > 2 ? stoul(argv[2]) : 10000, argc > 3 ? stoul(argv[3]) : 100000, argc > 4 ? stoi(argv[4]) : 0);
+#if defined(_WIN32)
+			::WSACleanup();
+#endif
+			return 0;
+		}
+		// 测试：client qps [连接数] [每个连接的请求数] [端口]
+		if(argc > 1 && string("qps") == argv[1]) {
+			qpsbench("127.0.0.1", argc > 4 ? static_cast<uint16_t>(stoul(argv[4])) : 8888, argc > 2 ? stoul(argv[2]) : 16, argc > 3 ? stoul(argv[3]) : 50000);
+#if defined(_WIN32)
+			::WSACleanup();
+#endif
+			return 0;
+		}
+		// 测试：client mixed [连接数] [每个连接的请求数] [写入百分比] [端口]
+		if(argc > 1 && string("mixed") == argv[1]) {
+			mixedbench("127.0.0.1", argc > 5 ? static_cast<uint16_t>(stoul(argv[5])) : 8888, argc > 2 ? stoul(argv[2]) : 16, argc > 3 ? stoul(argv[3]) : 50000, argc > 4 ? stoul(argv[4]) : 20);
+#if defined(_WIN32)
+			::WSACleanup();
+#endif
+			return 0;
+		}
+		// 测试：client batch [每批行数] [批数] [端口]
+		if(argc > 1 && string("batch") == argv[1]) {
+			batchbench("127.0.0.1", argc > 4 ? static_cast<uint16_t>(stoul(argv[4])) : 8888, argc > 2 ? stoul(argv[2]) : 100, argc > 3 ? stoul(argv[3]) : 500);
+#if defined(_WIN32)
+			::WSACleanup();
+#endif
+			return 0;
+		}
+		// 测试：client raw [请求数] [端口]
+		if(argc > 1 && string("raw") == argv[1]) {
+			rawbench("127.0.0.1", argc > 3 ? static_cast<uint16_t>(stoul(argv[3])) : 8888, argc > 2 ? stoul(argv[2]) : 100000);
+#if defined(_WIN32)
+			::WSACleanup();
+#endif
+			return 0;
+		}
+		// 测试：client evict [添加行数] [热点行数] [端口]，服务器需设置MaxMemory和EvictionPolicy
+		if(argc > 1 && string("evict") == argv[1]) {
+			evictbench("127.0.0.1", argc > 4 ? static_cast<uint16_t>(stoul(argv[4])) : 8888, argc > 2 ? stoul(argv[2]) : 100000, argc > 3 ? stoul(argv[3]) : 1000);
+#if defined(_WIN32)
+			::WSACleanup();
+#endif
+			return 0;
+		}
+		// 测试：client fieldid [请求数] [端口]
+		if(argc > 1 && string("fieldid") == argv[1]) {
+			fieldidbench("127.0.0.1", argc > 3 ? static_cast<uint16_t>(stoul(argv[3])) : 8888, argc > 2 ? stoul(argv[2]) : 100000);
+#if defined(_WIN32)
+			::WSACleanup();
+#endif
+			return 0;
+		}
+		// 测试：client pipeline [每批记录数] [批数] [端口]
+		if(argc > 1 && string("pipeline") == argv[1]) {
+			pipelinebench("127.0.0.1", argc > 4 ? static_cast<uint16_t>(stoul(argv[4])) : 8888, argc > 2 ? stoul(argv[2]) : 100, argc > 3 ? stoul(argv[3]) : 1000);
+#if defined(_WIN32)
+			::WSACleanup();
+#endif
+			return 0;
+		}
+
 //		// insert
 //		CMoonDbClient client("127.0.0.1", 8888, "test");
 //		map<string, CAny> data;
@@ -571,6 +571,582 @@ void test3()
 	cout << a[2] << endl;
 }
 
+size_t IndexBenchBytes = 0;
+
+/**
+ * 统计unordered_map占用内存的分配器
+ */
+template <typename T>
+struct CCountingAllocator
+{
+	typedef T value_type;
+	CCountingAllocator() = default;
+	template <typename U>
+	CCountingAllocator(const CCountingAllocator<U>&) noexcept {}
+	T* allocate(size_t n)
+	{
+		IndexBenchBytes += n * sizeof(T) + 16;	// 16为malloc每块的额外开销
+		return static_cast<T*>(::operator new(n * sizeof(T)));
+	}
+	void deallocate(T* p, size_t n) noexcept
+	{
+		IndexBenchBytes -= n * sizeof(T) + 16;
+		::operator delete(p);
+	}
+};
+template <typename T, typename U>
+bool operator==(const CCountingAllocator<T>&, const CCountingAllocator<U>&) noexcept { return true; }
+template <typename T, typename U>
+bool operator!=(const CCountingAllocator<T>&, const CCountingAllocator<U>&) noexcept { return false; }
+
+/**
+ * @brief indexbench 行索引测试：比较unordered_map与CFlatHashMap添加、查找、删除rows个随机id的耗时和每行占用的内存
+ */
+template <typename IdType>
+void indexbench(uint64_t rows)
+{
+	struct CValue {
+		uint64_t Position;
+		int64_t ExpiredTime;
+	};
+	vector<IdType> ids(rows);
+	mt19937_64 generator(rows);
+	for(uint64_t i = 0; i < rows; i++) {
+		ids[i] = static_cast<IdType>(generator());
+		if(sizeof(IdType) > sizeof(uint64_t)) {
+			ids[i] = ids[i] << 32 << 32 | static_cast<IdType>(generator());
+		}
+	}
+	cout << "id bytes: " << sizeof(IdType) << ", rows: " << rows << endl;
+	auto report = [rows](const char* name, double insert, double find, double erase, double bytes) {
+		cout << name << ": insert " << rows / insert << " ops/s, find " << rows / find << " ops/s, erase " << rows / erase
+			 << " ops/s, " << bytes / rows << " bytes/row" << endl;
+	};
+	uint64_t found = 0;
+	{
+		unordered_map<IdType, CValue, hash<IdType>, equal_to<IdType>, CCountingAllocator<pair<const IdType, CValue>>> index;
+		auto time1 = CTime::Now();
+		for(uint64_t i = 0; i < rows; i++) {
+			index.emplace(ids[i], CValue{i, 0});
+		}
+		auto time2 = CTime::Now();
+		for(uint64_t i = 0; i < rows; i++) {
+			found += index.find(ids[i]) != index.end();
+		}
+		auto time3 = CTime::Now();
+		double bytes = static_cast<double>(IndexBenchBytes);
+		for(uint64_t i = 0; i < rows; i++) {
+			index.erase(ids[i]);
+		}
+		auto time4 = CTime::Now();
+		report("unordered_map", (time2 - time1) * CTime::TimeRatio, (time3 - time2) * CTime::TimeRatio, (time4 - time3) * CTime::TimeRatio, bytes);
+	}
+	{
+		CFlatHashMap<IdType, CValue> index;
+		auto time1 = CTime::Now();
+		for(uint64_t i = 0; i < rows; i++) {
+			index.emplace(ids[i], CValue{i, 0});
+		}
+		auto time2 = CTime::Now();
+		for(uint64_t i = 0; i < rows; i++) {
+			found += nullptr != index.find(ids[i]);
+		}
+		auto time3 = CTime::Now();
+		double bytes = static_cast<double>(index.memory_usage());
+		for(uint64_t i = 0; i < rows; i++) {
+			index.erase(ids[i]);
+		}
+		auto time4 = CTime::Now();
+		report("CFlatHashMap", (time2 - time1) * CTime::TimeRatio, (time3 - time2) * CTime::TimeRatio, (time4 - time3) * CTime::TimeRatio, bytes);
+	}
+	cout << "found: " << found << endl;
+}
+
+/**
+ * @brief ResidentBytes 当前进程的常驻内存
+ */
+size_t ResidentBytes()
+{
+#if defined(__linux__)
+	long pages = 0, resident = 0;
+	FILE* fp = ::fopen("/proc/self/statm", "r");
+	if(nullptr != fp) {
+		if(::fscanf(fp, "%ld %ld", &pages, &resident) != 2) {
+			resident = 0;
+		}
+		::fclose(fp);
+	}
+	return static_cast<size_t>(resident) * static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+#else
+	return 0;
+#endif
+}
+
+/**
+ * @brief varmemorybench 变长内存表测试：在VARCHAR(4000)字段中存放20至180字节的数据，比较添加rows行后增加的常驻内存和读写速度
+ */
+template <typename T_Table>
+void varmemorybench(const string& path, TableType engine, uint64_t rows)
+{
+	vector<CRawField> fields;
+	fields.emplace_back(CRawField("id", FT_SERIAL64));
+	fields.emplace_back(CRawField("price", FT_FLOAT64));
+	fields.emplace_back(CRawField("title", FT_VARCHAR, true, false, "", false, "", 4000));
+	vector<CIndex> indexes{CIndex("id", IT_PRIMARY, IM_HASH, vector<string>{"id"})};
+	string name = "bench" + CDefinition::TableTypeToString(engine);
+	T_Table* table = new T_Table;
+	table->Create(path, name, engine, FT_SERIAL64, fields, indexes, rows, 100, 0);
+	table->Open(path, name);
+	size_t before = ResidentBytes();
+	mt19937_64 generator(rows);
+	CFieldMap data;
+	CPack ret(4096);
+	uint64_t payload = 0;
+	auto time1 = CTime::Now();
+	for(uint64_t i = 0; i < rows; i++) {
+		size_t length = 20 + generator() % 161;
+		payload += length;
+		data["price"] = 1.5;
+		data["title"] = string(length, static_cast<char>('a' + i % 26));
+		ret.Clear();
+		table->InsertData(data, ret);
+	}
+	auto time2 = CTime::Now();
+	for(uint64_t i = 1; i <= rows; i++) {
+		ret.Clear();
+		table->GetData(CAny(i), ret);
+	}
+	auto time3 = CTime::Now();
+	size_t after = ResidentBytes();
+	cout << CDefinition::TableTypeToString(engine) << ": insert " << rows / ((time2 - time1) * CTime::TimeRatio) << " rows/s, get "
+		 << rows / ((time3 - time2) * CTime::TimeRatio) << " rows/s, resident " << static_cast<double>(after - before) / rows
+		 << " bytes/row, payload " << static_cast<double>(payload) / rows << " bytes/row" << endl;
+	delete table;
+}
+
+/**
+ * @brief harddiskbench 硬盘表测试：与varmemorybench相同的数据，之后重新打开表，随机读取全部数据，检查数据是否保留
+ */
+void harddiskbench(const string& path, uint64_t rows)
+{
+	varmemorybench<CDiskStorage<uint64_t>>(path, TT_HARDDISK, rows);
+	string name = "bench" + CDefinition::TableTypeToString(TT_HARDDISK);
+	vector<uint64_t> ids(rows);
+	for(uint64_t i = 0; i < rows; i++) {
+		ids[i] = i + 1;
+	}
+	shuffle(ids.begin(), ids.end(), mt19937_64(rows));
+	auto time1 = CTime::Now();
+	CDiskStorage<uint64_t>* table = new CDiskStorage<uint64_t>;
+	table->Open(path, name);
+	auto time2 = CTime::Now();
+	CPack ret(4096);
+	uint64_t found = 0;
+	for(uint64_t i = 0; i < rows; i++) {
+		ret.Clear();
+		table->GetData(CAny(ids[i]), ret);
+		uint16_t count = 0;
+		ret.Seek(10);
+		ret.Get(count);
+		found += count;
+	}
+	auto time3 = CTime::Now();
+	cout << "HARDDISK reopened in " << (time2 - time1) * CTime::TimeRatio << " s, random get " << rows / ((time3 - time2) * CTime::TimeRatio)
+		 << " rows/s, found " << found << "/" << rows << " rows" << endl;
+	delete table;
+}
+
+/**
+ * @brief recoverybench 重做日志测试：启用日志的FIXMEMORY表添加rows行后生成快照，再修改rows/10行只写入日志，
+ * 之后重新打开表，从快照和日志恢复，输出各步耗时，检查恢复的行数和修改后的值
+ */
+void recoverybench(const string& path, uint64_t rows)
+{
+	CTable::RedoLogSettings.Enabled = true;
+	CTable::RedoLogSettings.Sync = CRedoLog::SP_NEVER;
+	CTable::RedoLogSettings.SnapshotInterval = 0;
+	CTable::RedoLogSettings.SnapshotLogSize = 0;
+	vector<CRawField> fields;
+	fields.emplace_back(CRawField("id", FT_SERIAL64));
+	fields.emplace_back(CRawField("price", FT_FLOAT64));
+	fields.emplace_back(CRawField("stock", FT_INT32));
+	fields.emplace_back(CRawField("code", FT_CHAR, true, false, "", false, "", 16));
+	vector<CIndex> indexes{CIndex("id", IT_PRIMARY, IM_HASH, vector<string>{"id"})};
+	string name = "benchrecovery";
+	CFixedMemoryStorage<uint64_t>* table = new CFixedMemoryStorage<uint64_t>;
+	table->Create(path, name, TT_FIXMEMORY, FT_SERIAL64, fields, indexes, 0, rows, 0);
+	table->Open(path, name);
+	CFieldMap data;
+	CPack ret(4096);
+	auto time1 = CTime::Now();
+	for(uint64_t i = 0; i < rows; i++) {
+		data["price"] = 1.5;
+		data["stock"] = static_cast<int32_t>(i % 1000);
+		data["code"] = "c" + num_to_string(i);
+		ret.Clear();
+		table->InsertData(data, ret);
+	}
+	auto time2 = CTime::Now();
+	table->Snapshot();
+	auto time3 = CTime::Now();
+	mt19937_64 generator(rows);
+	CFieldMap update;
+	update["stock"] = static_cast<int32_t>(-1);
+	uint64_t updates = rows / 10;
+	for(uint64_t i = 0; i < updates; i++) {
+		ret.Clear();
+		table->UpdateData(CAny(static_cast<uint64_t>(generator() % rows + 1)), update, ret);
+	}
+	auto time4 = CTime::Now();
+	delete table;
+	uint64_t snapshotbytes = CFileSystem::FileSize(path + DIRECTORY_SEPARATOR + name + DIRECTORY_SEPARATOR + "snapshot.moon");
+	uint64_t logbytes = CFileSystem::FileSize(path + DIRECTORY_SEPARATOR + name + DIRECTORY_SEPARATOR + "redo.1.log");
+	auto time5 = CTime::Now();
+	table = new CFixedMemoryStorage<uint64_t>;
+	table->Open(path, name);
+	auto time6 = CTime::Now();
+	uint64_t found = 0;
+	for(uint64_t i = 1; i <= rows; i++) {
+		ret.Clear();
+		table->GetData(CAny(i), ret);
+		uint16_t count = 0;
+		ret.Seek(10);
+		ret.Get(count);
+		found += count;
+	}
+	ret.Clear();
+	table->InsertData(data, ret);
+	uint64_t nextid = 0;
+	ret.Seek(12);
+	ret.Get(nextid);
+	cout << "FIXMEMORY with redo log: insert " << rows / ((time2 - time1) * CTime::TimeRatio) << " rows/s, snapshot " << (time3 - time2) * CTime::TimeRatio
+		 << " s (" << snapshotbytes << " bytes), update " << updates / ((time4 - time3) * CTime::TimeRatio) << " rows/s (" << logbytes << " bytes of log)" << endl
+		 << "recovered in " << (time6 - time5) * CTime::TimeRatio << " s (" << (rows + updates) / ((time6 - time5) * CTime::TimeRatio) << " records/s), found "
+		 << found << "/" << rows << " rows, next id " << nextid << endl;
+	delete table;
+}
+
+/**
+ * @brief snapshotbench 时间点快照测试：启用日志的FIXMEMORY表添加rows行，一个线程依次把第i % rows + 1行的stock改为i，
+ * 先不生成快照修改1秒，再在修改期间生成快照，输出两段时间修改的速度和延迟；之后删除日志只从快照恢复，
+ * 检查快照为某一时刻的一致数据：存在S使得编号不大于S的修改都在快照中，大于S的都不在
+ */
+void snapshotbench(const string& path, uint64_t rows)
+{
+	CTable::RedoLogSettings.Enabled = true;
+	CTable::RedoLogSettings.Sync = CRedoLog::SP_NEVER;
+	CTable::RedoLogSettings.SnapshotInterval = 0;
+	CTable::RedoLogSettings.SnapshotLogSize = 0;
+	vector<CRawField> fields;
+	fields.emplace_back(CRawField("id", FT_SERIAL64));
+	fields.emplace_back(CRawField("stock", FT_INT32));
+	fields.emplace_back(CRawField("code", FT_CHAR, true, false, "", false, "", 16));
+	vector<CIndex> indexes{CIndex("id", IT_PRIMARY, IM_HASH, vector<string>{"id"})};
+	string name = "benchsnapshot";
+	CFixedMemoryStorage<uint64_t>* table = new CFixedMemoryStorage<uint64_t>;
+	table->Create(path, name, TT_FIXMEMORY, FT_SERIAL64, fields, indexes, 0, rows, 0);
+	table->Open(path, name);
+	CFieldMap data;
+	CPack ret(4096);
+	for(uint64_t i = 0; i < rows; i++) {
+		data["stock"] = static_cast<int32_t>(-1);
+		data["code"] = "c" + num_to_string(i);
+		ret.Clear();
+		table->InsertData(data, ret);
+	}
+	// 0：未生成快照，1：生成快照期间，2：结束
+	atomic<int> phase(0);
+	vector<uint64_t> latencies[2];
+	thread writer([&]() {
+		CFieldMap update;
+		CPack wret(4096);
+		for(uint64_t i = 0; ; i++) {
+			int p = phase.load();
+			if(2 == p) {
+				break;
+			}
+			update["stock"] = static_cast<int32_t>(i);
+			wret.Clear();
+			auto start = CTime::Now();
+			table->UpdateData(CAny(static_cast<uint64_t>(i % rows + 1)), update, wret);
+			latencies[p].push_back(static_cast<uint64_t>(CTime::Now() - start));
+		}
+	});
+	this_thread::sleep_for(chrono::seconds(1));
+	phase = 1;
+	auto time1 = CTime::Now();
+	uint64_t copies = table->Snapshot();
+	auto time2 = CTime::Now();
+	phase = 2;
+	writer.join();
+	double seconds[2] = {1.0, (time2 - time1) * CTime::TimeRatio};
+	const char* titles[2] = {"without snapshot", "during snapshot"};
+	for(int p = 0; p < 2; p++) {
+		vector<uint64_t>& l = latencies[p];
+		sort(l.begin(), l.end());
+		if(l.empty()) {
+			continue;
+		}
+		cout << "update " << titles[p] << ": " << l.size() / seconds[p] << " rows/s, latency p50 " << l[l.size() / 2]
+			 << " ns, p99 " << l[l.size() * 99 / 100] << " ns, p99.9 " << l[l.size() * 999 / 1000] << " ns, max " << l.back() << " ns" << endl;
+	}
+	delete table;
+	string dir = path + DIRECTORY_SEPARATOR + name + DIRECTORY_SEPARATOR;
+	uint64_t snapshotbytes = CFileSystem::FileSize(dir + "snapshot.moon");
+	std::remove((dir + "redo.1.log").c_str());
+	table = new CFixedMemoryStorage<uint64_t>;
+	table->Open(path, name);
+	vector<int32_t> stocks(rows + 1, -1);
+	int64_t last = -1;
+	for(uint64_t i = 1; i <= rows; i++) {
+		ret.Clear();
+		table->GetRawData(CAny(i), ret, [&](const void* dp, uint64_t) {
+			::memcpy(&stocks[i], dp, sizeof(int32_t));
+		});
+		last = max(last, static_cast<int64_t>(stocks[i]));
+	}
+	uint64_t wrong = 0;
+	for(uint64_t i = 1; i <= rows; i++) {
+		// 编号不大于last的修改中最后一次修改该行的编号
+		int64_t expected = last >= static_cast<int64_t>(i - 1) ? last - (last - static_cast<int64_t>(i - 1)) % static_cast<int64_t>(rows) : -1;
+		if(stocks[i] != expected) {
+			wrong++;
+		}
+	}
+	cout << "snapshot of " << rows << " rows in " << seconds[1] << " s (" << snapshotbytes << " bytes), " << copies
+		 << " rows copied by the writer, " << wrong << " rows inconsistent with the update " << last << endl;
+	delete table;
+}
+
+/**
+ * @brief codecbench 行编解码测试：FIXMEMORY表的数值字段在前，CHAR、DATE、VARCHAR字段在后，按行计算添加、修改、读取和批量读取的耗时，
+ * 输出读取结果的校验和用于比较修改前后的结果是否相同
+ */
+void codecbench(const string& path, uint64_t rows)
+{
+	vector<CRawField> fields;
+	fields.emplace_back(CRawField("id", FT_SERIAL64));
+	fields.emplace_back(CRawField("stock", FT_INT32));
+	fields.emplace_back(CRawField("sales", FT_INT64));
+	fields.emplace_back(CRawField("price", FT_FLOAT64));
+	fields.emplace_back(CRawField("kind", FT_UINT16));
+	fields.emplace_back(CRawField("onsale", FT_BOOL));
+	fields.emplace_back(CRawField("rate", FT_FLOAT32));
+	fields.emplace_back(CRawField("level", FT_INT8));
+	fields.emplace_back(CRawField("owner", FT_UINT64));
+	fields.emplace_back(CRawField("code", FT_CHAR, true, false, "", false, "", 16));
+	fields.emplace_back(CRawField("day", FT_DATE));
+	fields.emplace_back(CRawField("note", FT_VARCHAR, true, false, "", false, "", 32));
+	vector<CIndex> indexes{CIndex("id", IT_PRIMARY, IM_HASH, vector<string>{"id"})};
+	string name = "benchcodec";
+	CFixedMemoryStorage<uint64_t>* table = new CFixedMemoryStorage<uint64_t>;
+	table->Create(path, name, TT_FIXMEMORY, FT_SERIAL64, fields, indexes, rows, 100, 0);
+	table->Open(path, name);
+	CFieldMap data;
+	CPack ret(4096);
+	auto time1 = CTime::Now();
+	for(uint64_t i = 0; i < rows; i++) {
+		data["stock"] = static_cast<int64_t>(i % 1000);
+		data["sales"] = static_cast<int64_t>(i * 7);
+		data["price"] = 1.5 + static_cast<double>(i % 100);
+		data["kind"] = static_cast<int64_t>(i % 9);
+		data["onsale"] = 0 == i % 2;
+		data["rate"] = 0.25;
+		data["level"] = static_cast<int64_t>(i % 100);
+		data["owner"] = static_cast<int64_t>(i);
+		data["code"] = "C" + num_to_string(i);
+		data["day"] = string("2020-01-02");
+		data["note"] = string("note");
+		ret.Clear();
+		table->InsertData(data, ret);
+	}
+	auto time2 = CTime::Now();
+	CFieldMap change;
+	for(uint64_t i = 1; i <= rows; i++) {
+		change["stock"] = static_cast<int64_t>(i % 500);
+		change["price"] = 2.5;
+		ret.Clear();
+		table->UpdateData(CAny(i), change, ret);
+	}
+	auto time3 = CTime::Now();
+	uint64_t checksum = 14695981039346656037ULL;
+	for(uint64_t i = 1; i <= rows; i++) {
+		ret.Clear();
+		table->GetData(CAny(i), ret);
+		const unsigned char* p = static_cast<const unsigned char*>(ret.GetPointer());
+		for(size_t j = 0; j < ret.GetSize(); j++) {
+			checksum = (checksum ^ p[j]) * 1099511628211ULL;
+		}
+	}
+	auto time4 = CTime::Now();
+	CRowIds ids;
+	for(uint64_t i = 1; i <= 100; i++) {
+		ids.emplace_back(CAny(i));
+	}
+	uint64_t batches = rows / 100 > 0 ? rows / 100 : 1;
+	for(uint64_t i = 0; i < batches; i++) {
+		ret.Clear();
+		table->GetMultiData(ids, ret);
+	}
+	auto time5 = CTime::Now();
+	const unsigned char* p = static_cast<const unsigned char*>(ret.GetPointer());
+	for(size_t j = 0; j < ret.GetSize(); j++) {
+		checksum = (checksum ^ p[j]) * 1099511628211ULL;
+	}
+	auto nsperrow = [](int64_t elapsed, uint64_t count) {
+		return static_cast<double>(elapsed) * CTime::TimeRatio * 1e9 / static_cast<double>(count);
+	};
+	cout << "insert " << nsperrow(time2 - time1, rows) << " ns/row, update " << nsperrow(time3 - time2, rows)
+		 << " ns/row, get " << nsperrow(time4 - time3, rows) << " ns/row, multiget " << nsperrow(time5 - time4, batches * 100)
+		 << " ns/row, checksum " << checksum << endl;
+	delete table;
+}
+
+#if defined(MOONDB_ALLOCATION_BENCH)
+/**
+ * 当前线程调用operator new的次数，用于allocationbench统计处理每个请求分配内存的次数。
+ * 替换全局的operator new/delete只用于测试，默认不编译，编译时定义MOONDB_ALLOCATION_BENCH才有-a选项
+ */
+thread_local uint64_t AllocationCount = 0;
+
+void* operator new(size_t size)
+{
+	AllocationCount++;
+	void* p = ::malloc(0 == size ? 1 : size);
+	if(nullptr == p) {
+		throw bad_alloc();
+	}
+	return p;
+}
+
+void* operator new[](size_t size)
+{
+	return ::operator new(size);
+}
+
+// 不内联，避免编译器把内联后的free与operator new误判为不匹配
+__attribute__((noinline)) void operator delete(void* p) noexcept
+{
+	::free(p);
+}
+
+__attribute__((noinline)) void operator delete[](void* p) noexcept
+{
+	::free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept
+{
+	::free(p);
+}
+
+__attribute__((noinline)) void operator delete[](void* p, size_t) noexcept
+{
+	::free(p);
+}
+
+/**
+ * @brief allocationbench 请求处理的内存分配测试：在临时数据目录中创建FIXMEMORY表，不经过网络直接调用CMoonDb::Query，
+ * 预热后按请求统计读取、修改数值字段、批量读取和添加（含VARCHAR字段）的operator new次数和耗时
+ */
+void allocationbench(const string& path, uint64_t requests)
+{
+	// 与CMoonDb中的操作类型相同
+	enum { SELECT = 1, INSERT = 2, UPDATE = 3, MULTI_SELECT = 6 };
+	CFileSystem::CreateDirectory(path);
+	CFileSystem::CreateDirectory(path + DIRECTORY_SEPARATOR + "data");
+	CFileSystem::CreateDirectory(path + DIRECTORY_SEPARATOR + "sqlite");
+	string configfile = path + DIRECTORY_SEPARATOR + "moondb.xml";
+	ofstream config(configfile);
+	config << "<MoonDb>" << endl
+		   << "<DataDirectory>" << path << DIRECTORY_SEPARATOR << "data</DataDirectory>" << endl
+		   << "<SQLiteDirectory>" << path << DIRECTORY_SEPARATOR << "sqlite</SQLiteDirectory>" << endl
+		   << "</MoonDb>" << endl;
+	config.close();
+	{
+		vector<CRawField> fields;
+		fields.emplace_back(CRawField("id", FT_SERIAL64));
+		fields.emplace_back(CRawField("stock", FT_INT32));
+		fields.emplace_back(CRawField("price", FT_FLOAT64));
+		fields.emplace_back(CRawField("title", FT_VARCHAR, true, false, "", false, "", 64));
+		vector<CIndex> indexes{CIndex("id", IT_PRIMARY, IM_HASH, vector<string>{"id"})};
+		string dbpath = path + DIRECTORY_SEPARATOR + "data" + DIRECTORY_SEPARATOR + "bench";
+		CDatabase db;
+		db.Create(dbpath);
+		db.Open(dbpath);
+		db.CreateTable("goods", TT_FIXMEMORY, fields, indexes, requests * 2 + 2000);
+		db.Close();
+	}
+	CMoonDb moondb;
+	moondb.LoadConfiguration(path, false, configfile);
+	auto header = [](CPack& req, uint16_t opertype) {
+		req.Clear();
+		req.Put(static_cast<uint8_t>(1));
+		req.Put(opertype);
+		req.Put<uint16_t>(string("bench"));
+		req.Put<uint16_t>(string("goods"));
+	};
+	auto key = [](CPack& req, const string& name, uint16_t type) {
+		req.Put<uint16_t>(name);
+		req.Put(type);
+	};
+	CPack insert(256), get(256), update(256), multiget(4096), ret(65536);
+	header(insert, INSERT);
+	insert.Put(static_cast<uint16_t>(3));
+	key(insert, "stock", FT_INT32);
+	insert.Put(static_cast<int32_t>(7));
+	key(insert, "price", FT_FLOAT64);
+	insert.Put(2.5);
+	key(insert, "title", FT_STRING);
+	insert.Put<uint32_t>(string("a title longer than the small string buffer"));
+	header(get, SELECT);
+	get.Put(static_cast<uint16_t>(1));
+	key(get, "rowid", FT_UINT64);
+	uint64_t getid = get.Tell();
+	get.Put(static_cast<uint64_t>(1));
+	header(update, UPDATE);
+	update.Put(static_cast<uint16_t>(3));
+	key(update, "rowid", FT_UINT64);
+	uint64_t updateid = update.Tell();
+	update.Put(static_cast<uint64_t>(1));
+	key(update, "stock", FT_INT32);
+	update.Put(static_cast<int32_t>(9));
+	key(update, "price", FT_FLOAT64);
+	update.Put(3.5);
+	header(multiget, MULTI_SELECT);
+	multiget.Put(static_cast<uint32_t>(100));
+	for(uint64_t i = 1; i <= 100; i++) {
+		multiget.Put(static_cast<uint16_t>(FT_UINT64));
+		multiget.Put(i);
+	}
+	auto run = [&](CPack& req, uint64_t idpos, uint64_t count) {
+		for(uint64_t i = 0; i < count; i++) {
+			if(idpos > 0) {
+				req.Seek(static_cast<int64_t>(idpos));
+				req.Put(i % 1000 + 1);
+			}
+			req.Seek(0);
+			ret.Clear();
+			moondb.Query(req, ret);
+		}
+	};
+	auto report = [&](const string& name, CPack& req, uint64_t idpos, uint64_t count) {
+		run(req, idpos, 1000);
+		uint64_t allocations = AllocationCount;
+		auto time1 = CTime::Now();
+		run(req, idpos, count);
+		auto time2 = CTime::Now();
+		cout << name << ": " << static_cast<double>(AllocationCount - allocations) / static_cast<double>(count) << " allocations/request, "
+			 << static_cast<double>(time2 - time1) * CTime::TimeRatio * 1e9 / static_cast<double>(count) << " ns/request" << endl;
+	};
+	report("insert", insert, 0, requests);
+	report("get", get, getid, requests);
+	report("update", update, updateid, requests);
+	report("multiget", multiget, 0, requests / 100 > 0 ? requests / 100 : 1);
+	cout << "arena chunks allocated: " << CArena::ThreadLocal().mallocs() << endl;
+}
+#endif
+
 int main(int argc, char *argv[])
 {
 	//test3();
@@ -605,12 +1181,25 @@ int main(int argc, char *argv[])
 		CLog::Instance(programdir);
 
 		int opt;
-		char short_options[] = "hi:s";
+#if defined(MOONDB_ALLOCATION_BENCH)
+		char short_options[] = "hi:sb:m:d:r:p:c:a:";
+#else
+		char short_options[] = "hi:sb:m:d:r:p:c:";
+#endif
 		static struct option long_options[] =
 		{
 			{"help", no_argument, nullptr, 'h'},
 			{"inifile", required_argument, nullptr, 'i'},
 			{"showinfo",  no_argument, nullptr, 's'},
+			{"benchindex",  required_argument, nullptr, 'b'},
+			{"benchvarmemory",  required_argument, nullptr, 'm'},
+			{"benchharddisk",  required_argument, nullptr, 'd'},
+			{"benchrecovery",  required_argument, nullptr, 'r'},
+			{"benchsnapshot",  required_argument, nullptr, 'p'},
+			{"benchcodec",  required_argument, nullptr, 'c'},
+#if defined(MOONDB_ALLOCATION_BENCH)
+			{"benchallocation",  required_argument, nullptr, 'a'},
+#endif
 #if defined(_WIN32)
 			{"install",  required_argument, nullptr, 1},
 			{"uninstall",  required_argument, nullptr, 2},
@@ -629,6 +1218,15 @@ int main(int argc, char *argv[])
 			case 'h':
 				cout << endl << "-h or --help: show command list" << endl
 					 << "-i or --inifile file: default ini file is under the path of moondb file." << endl
+					 << "-b or --benchindex rows: benchmark the row index with rows random ids and exit." << endl
+					 << "-m or --benchvarmemory rows: compare the memory of FIXMEMORY and VARMEMORY tables with rows short VARCHAR values and exit." << endl
+					 << "-d or --benchharddisk rows: benchmark a HARDDISK table with rows short VARCHAR values, reopen it and read them back, then exit." << endl
+					 << "-r or --benchrecovery rows: write rows to a FIXMEMORY table with the redo log, take a snapshot, update rows/10 of them, time the recovery and exit." << endl
+					 << "-p or --benchsnapshot rows: update a FIXMEMORY table with rows rows while taking a snapshot, show the update latency, check that the snapshot is consistent and exit." << endl
+					 << "-c or --benchcodec rows: write, update and read rows rows of a FIXMEMORY table with numeric and string fields, show the ns/row of each operation and exit." << endl
+#if defined(MOONDB_ALLOCATION_BENCH)
+					 << "-a or --benchallocation requests: send requests insert, get and update requests and requests/100 multi-get requests to CMoonDb::Query without the network, show the allocations and ns per request and exit." << endl
+#endif
 					 << "--install: install windows service" << endl
 					 << "--uninstall: uninstall windows service" << endl;
 				exit(0);
@@ -638,6 +1236,55 @@ int main(int argc, char *argv[])
 			case 's':
 				CService::ShowInfo = true;
 				break;
+			case 'b':
+				indexbench<uint64_t>(stoull(optarg));
+				indexbench<__uint128_t>(stoull(optarg));
+				return 0;
+			case 'm':
+			{
+				boost::filesystem::path path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+				varmemorybench<CFixedMemoryStorage<uint64_t>>(path.string(), TT_FIXMEMORY, stoull(optarg));
+				varmemorybench<CVarMemoryStorage<uint64_t>>(path.string(), TT_VARMEMORY, stoull(optarg));
+				boost::filesystem::remove_all(path);
+				return 0;
+			}
+			case 'd':
+			{
+				boost::filesystem::path path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+				harddiskbench(path.string(), stoull(optarg));
+				boost::filesystem::remove_all(path);
+				return 0;
+			}
+			case 'r':
+			{
+				boost::filesystem::path path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+				recoverybench(path.string(), stoull(optarg));
+				boost::filesystem::remove_all(path);
+				return 0;
+			}
+			case 'p':
+			{
+				boost::filesystem::path path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+				snapshotbench(path.string(), stoull(optarg));
+				boost::filesystem::remove_all(path);
+				return 0;
+			}
+			case 'c':
+			{
+				boost::filesystem::path path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+				codecbench(path.string(), stoull(optarg));
+				boost::filesystem::remove_all(path);
+				return 0;
+			}
+#if defined(MOONDB_ALLOCATION_BENCH)
+			case 'a':
+			{
+				boost::filesystem::path path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+				allocationbench(path.string(), stoull(optarg));
+				boost::filesystem::remove_all(path);
+				return 0;
+			}
+#endif
 #if defined(_WIN32)
 			case 1:
 			case 2:
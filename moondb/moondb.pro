@@ -74,6 +74,21 @@ HEADERS += \
 	src/cany.hpp \
 	src/clog.h \
 	src/cqueue.hpp \
+	src/cringqueue.hpp \
+	src/ctimerwheel.hpp \
+	src/creadmostlymutex.hpp \
+	src/cflathashmap.hpp \
+	src/cmemorybudget.hpp \
+	src/cslabheap.hpp \
+	src/cvarmemorystorage.hpp \
+	src/cmappedfile.hpp \
+	src/cdiskindex.hpp \
+	src/cdiskheap.hpp \
+	src/cdiskstorage.hpp \
+	src/credolog.hpp \
+	src/chandleregistry.hpp \
+	src/carena.hpp \
+	src/ciouring.hpp \
 	src/cservice.h \
 	src/csqlparser.h
 
@@ -2,6 +2,7 @@
 
 #include <string>
 #include <limits>
+#include <algorithm>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -18,14 +19,15 @@ namespace MoonDb {
 class CAny
 {
 public:
-	inline CAny() noexcept : Type(FT_NONE) {}
+	inline CAny() noexcept : Data(), Type(FT_NONE), Mode(SM_HEAP), InlineSize(0) {}
 
 	inline CAny(const CAny& v)
 	{
 		Type = v.Type;
 		switch(Type) {
 		case FT_STRING:
-			Data.String = new std::string(*v.Data.String);
+			// 复制的值可能比接收缓冲区存在得更久，引用的字符串也复制为自有
+			SetString(v.GetStringData(), v.GetStringSize());
 			break;
 		case FT_ICONVSTRING:
 			Data.IconvString = new CString(*v.Data.IconvString);
@@ -36,20 +38,12 @@ public:
 		}
 	}
 
-	inline CAny(CAny&& v)
+	inline CAny(CAny&& v) noexcept
 	{
 		Type = v.Type;
-		switch(Type) {
-		case FT_STRING:
-			Data.String = v.Data.String;
-			break;
-		case FT_ICONVSTRING:
-			Data.IconvString = v.Data.IconvString;
-			break;
-		default:
-			Data = v.Data;
-			break;
-		}
+		Mode = v.Mode;
+		InlineSize = v.InlineSize;
+		Data = v.Data;
 		v.Type = FT_NONE;
 	}
 
@@ -151,14 +145,12 @@ public:
 
 	inline CAny(const std::string& v) noexcept
 	{
-		Type = FT_STRING;
-		Data.String = new std::string(v);
+		SetString(v.data(), v.size());
 	}
 
 	inline CAny(const char* v) noexcept
 	{
-		Type = FT_STRING;
-		Data.String = new std::string(v);
+		SetString(v, ::strlen(v));
 	}
 
 	inline CAny(const CString& v) noexcept
@@ -167,9 +159,10 @@ public:
 		Data.IconvString = new CString(v);
 	}
 
-	// 用于处理接收到的字符串
-	inline void Load(CPack& pack)
+	// 用于处理接收到的字符串；reference为true时字符串值直接引用pack中的数据，不复制，在pack释放或改写之前有效
+	inline void Load(CPack& pack, bool reference = false)
 	{
+		Reset();
 		pack.Get(Type);
 		switch(Type) {
 		case FT_BOOL:
@@ -177,9 +170,7 @@ public:
 			break;
 		// 读取后类型改为字符串
 		case FT_BIT:
-			Data.String = new std::string;
-			pack.Get<uint8_t>(*Data.String);
-			Type = FT_STRING;
+			LoadString<uint8_t>(pack, 0, reference);
 			break;
 		case FT_INT8:
 			pack.Get(Data.Int8);
@@ -221,8 +212,7 @@ public:
 			pack.Get(Data.FLOAT128);
 			break;
 		case FT_STRING:
-			Data.String = new std::string;
-			pack.Get<uint32_t>(*Data.String);
+			LoadString<uint32_t>(pack, 0, reference);
 			break;
 		case FT_NULL:
 			break;
@@ -371,8 +361,7 @@ public:
 			break;
 		case FT_TIMESTAMP:
 			if(to_upper_copy(defval) == "CURRENT_TIMESTAMP") {
-				Type = FT_STRING;
-				Data.String = new std::string("CURRENT_TIMESTAMP");
+				SetString("CURRENT_TIMESTAMP", 17);
 			}
 			else {
 				Type = FT_INT64;
@@ -394,12 +383,10 @@ public:
 			break;
 		case FT_BINARY:
 		case FT_VARBINARY:
-			Type = FT_STRING;
-			Data.String = new std::string(defval, 0, length);
+			SetString(defval.data(), std::min(defval.size(), static_cast<size_t>(length)));
 			break;
 		case FT_BLOB:
-			Type = FT_STRING;
-			Data.String = new std::string(defval, 0, std::numeric_limits<uint32_t>::max());
+			SetString(defval.data(), std::min(defval.size(), static_cast<size_t>(std::numeric_limits<uint32_t>::max())));
 			break;
 		default:
 			break;
@@ -416,20 +403,21 @@ public:
 			break;
 		case FT_BIT:
 		{
-			Type = FT_STRING;
-			Data.String = new std::string(128, '\0');
+			char bits[128];
+			size_t size = 0;
 			__uint128_t bitint = 0;
 			pack.Get(bitint);
 			for(uint16_t i = 0; i < 128; ++i) {
 				if(bitint % 2 == 1) {
-					Data.String->at(i) = '1';
+					bits[i] = '1';
+					size = i + 1;
 				}
 				else {
-					Data.String->at(i) = '0';
+					bits[i] = '0';
 				}
 				bitint >>= 1;
 			}
-			rtrim(*Data.String, "0");
+			SetString(bits, size);
 			break;
 		}
 		case FT_INT8:
@@ -488,14 +476,13 @@ public:
 			break;
 		case FT_ENUM:
 			{
-				Type = FT_STRING;
 				uint16_t v;
 				pack.Get(v);
 				if(v > 0 && v <= flipvalues.size()) {
-					Data.String = new std::string(flipvalues[v - 1]);
+					SetString(flipvalues[v - 1].data(), flipvalues[v - 1].size());
 				}
 				else {
-					Data.String = new std::string;
+					SetString("", 0);
 				}
 			}
 			break;
@@ -534,19 +521,13 @@ public:
 			pack.Get<uint32_t>(Data.IconvString->Data);
 			break;
 		case FT_BINARY:
-			Type = FT_STRING;
-			Data.String = new std::string;
-			pack.Get<uint16_t>(*Data.String, length);
+			LoadString<uint16_t>(pack, length, false);
 			break;
 		case FT_VARBINARY:
-			Type = FT_STRING;
-			Data.String = new std::string;
-			pack.Get<uint16_t>(*Data.String);
+			LoadString<uint16_t>(pack, 0, false);
 			break;
 		case FT_BLOB:
-			Type = FT_STRING;
-			Data.String = new std::string;
-			pack.Get<uint32_t>(*Data.String);
+			LoadString<uint32_t>(pack, 0, false);
 			break;
 		default:
 			break;
@@ -632,7 +613,7 @@ public:
 			pack.Write(&Data.DateTime, sizeof(CDateTime));
 			break;
 		case FT_TIMESTAMP:
-			if(Type == FT_STRING && *Data.String == "CURRENT_TIMESTAMP") {
+			if(Type == FT_STRING && 17 == GetStringSize() && 0 == ::memcmp(GetStringData(), "CURRENT_TIMESTAMP", 17)) {
 				pack.Put(CTime::Now());
 			}
 			else {
@@ -652,13 +633,13 @@ public:
 			pack.Put<uint32_t>(Data.IconvString->Data);// 记录字节数和内容
 			break;
 		case FT_BINARY:
-			pack.Put<uint16_t>(*Data.String, length);
+			pack.PutString<uint16_t>(GetStringData(), GetStringSize(), length);
 			break;
 		case FT_VARBINARY:
-			pack.Put<uint16_t>(*Data.String);
+			pack.PutString<uint16_t>(GetStringData(), GetStringSize());
 			break;
 		case FT_BLOB:
-			pack.Put<uint32_t>(*Data.String);
+			pack.PutString<uint32_t>(GetStringData(), GetStringSize());
 			break;
 		default:
 			break;
@@ -674,7 +655,7 @@ public:
 				pack.Put(Data.Bool);
 			}
 			else if(FT_STRING == Type) {
-				std::string str = to_lower_copy(*Data.String);
+				std::string str = to_lower_copy(StringValue());
 				bool value;
 				if("true" == str || "1" == str) {
 					value = true;
@@ -696,8 +677,9 @@ public:
 			else if(FT_STRING == Type) {
 				__uint128_t bitint = 0;
 				//uint64_t bitint;
-				for(uint16_t i = 0; i < Data.String->size(); ++i) {
-					if('1' == (*Data.String)[i]) {
+				const char* bits = GetStringData();
+				for(uint16_t i = 0; i < GetStringSize(); ++i) {
+					if('1' == bits[i]) {
 						bitint += 1 << i;
 					}
 				}
@@ -715,7 +697,7 @@ public:
 				pack.Put(static_cast<int8_t>(Data.Int64));
 			}
 			else if(FT_STRING == Type) {
-				pack.Put(static_cast<int8_t>(std::stol(*Data.String)));
+				pack.Put(static_cast<int8_t>(std::stol(StringValue())));
 			}
 			else {
 				ThrowError(ERR_WRONG_DATA_TYPE, std::string("Wrong data type:") + CDefinition::FieldTypeToString(static_cast<FieldType>(Type)));
@@ -729,7 +711,7 @@ public:
 				pack.Put(static_cast<uint8_t>(Data.Int64));
 			}
 			else if(FT_STRING == Type) {
-				pack.Put(static_cast<uint8_t>(std::stoul(*Data.String)));
+				pack.Put(static_cast<uint8_t>(std::stoul(StringValue())));
 			}
 			else {
 				ThrowError(ERR_WRONG_DATA_TYPE, std::string("Wrong data type:") + CDefinition::FieldTypeToString(static_cast<FieldType>(Type)));
@@ -743,7 +725,7 @@ public:
 				pack.Put(static_cast<int16_t>(Data.Int64));
 			}
 			else if(FT_STRING == Type) {
-				pack.Put(static_cast<int16_t>(std::stol(*Data.String)));
+				pack.Put(static_cast<int16_t>(std::stol(StringValue())));
 			}
 			else {
 				ThrowError(ERR_WRONG_DATA_TYPE, std::string("Wrong data type:") + CDefinition::FieldTypeToString(static_cast<FieldType>(Type)));
@@ -757,7 +739,7 @@ public:
 				pack.Put(static_cast<uint16_t>(Data.Int64));
 			}
 			else if(FT_STRING == Type) {
-				pack.Put(static_cast<uint16_t>(std::stoul(*Data.String)));
+				pack.Put(static_cast<uint16_t>(std::stoul(StringValue())));
 			}
 			else {
 				ThrowError(ERR_WRONG_DATA_TYPE, std::string("Wrong data type:") + CDefinition::FieldTypeToString(static_cast<FieldType>(Type)));
@@ -771,7 +753,7 @@ public:
 				pack.Put(static_cast<int32_t>(Data.Int64));
 			}
 			else if(FT_STRING == Type) {
-				pack.Put(static_cast<int32_t>(std::stol(*Data.String)));
+				pack.Put(static_cast<int32_t>(std::stol(StringValue())));
 			}
 			else {
 				ThrowError(ERR_WRONG_DATA_TYPE, std::string("Wrong data type:") + CDefinition::FieldTypeToString(static_cast<FieldType>(Type)));
@@ -788,7 +770,7 @@ public:
 				pack.Put(static_cast<uint32_t>(Data.Int64));
 			}
 			else if(FT_STRING == Type) {
-				pack.Put(static_cast<uint32_t>(std::stoul(*Data.String)));
+				pack.Put(static_cast<uint32_t>(std::stoul(StringValue())));
 			}
 			else {
 				ThrowError(ERR_WRONG_DATA_TYPE, std::string("Wrong data type:") + CDefinition::FieldTypeToString(static_cast<FieldType>(Type)));
@@ -799,7 +781,7 @@ public:
 				pack.Put(Data.Int64);
 			}
 			else if(FT_STRING == Type) {
-				pack.Put(static_cast<int64_t>(std::stoll(*Data.String)));
+				pack.Put(static_cast<int64_t>(std::stoll(StringValue())));
 			}
 			else {
 				ThrowError(ERR_WRONG_DATA_TYPE, std::string("Wrong data type:") + CDefinition::FieldTypeToString(static_cast<FieldType>(Type)));
@@ -813,7 +795,7 @@ public:
 				pack.Put(static_cast<uint64_t>(Data.Int64));
 			}
 			else if(FT_STRING == Type) {
-				pack.Put(static_cast<uint64_t>(std::stoull(*Data.String)));
+				pack.Put(static_cast<uint64_t>(std::stoull(StringValue())));
 			}
 			else {
 				ThrowError(ERR_WRONG_DATA_TYPE, std::string("Wrong data type:") + CDefinition::FieldTypeToString(static_cast<FieldType>(Type)));
@@ -827,7 +809,7 @@ public:
 				pack.Put(static_cast<__int128_t>(Data.Int64));
 			}
 			else if(FT_STRING == Type) {
-				pack.Put(static_cast<__int128_t>(stolll(*Data.String)));
+				pack.Put(static_cast<__int128_t>(stolll(StringValue())));
 			}
 			else {
 				ThrowError(ERR_WRONG_DATA_TYPE, std::string("Wrong data type:") + CDefinition::FieldTypeToString(static_cast<FieldType>(Type)));
@@ -841,7 +823,7 @@ public:
 				pack.Put(static_cast<__uint128_t>(Data.Int64));
 			}
 			else if(FT_STRING == Type) {
-				pack.Put(static_cast<__uint128_t>(stoulll(*Data.String)));
+				pack.Put(static_cast<__uint128_t>(stoulll(StringValue())));
 			}
 			else {
 				ThrowError(ERR_WRONG_DATA_TYPE, std::string("Wrong data type:") + CDefinition::FieldTypeToString(static_cast<FieldType>(Type)));
@@ -859,7 +841,7 @@ public:
 				pack.Put(static_cast<float>(Data.Float64));
 			}
 			else if(FT_STRING == Type) {
-				pack.Put(static_cast<float>(std::stof(*Data.String)));
+				pack.Put(static_cast<float>(std::stof(StringValue())));
 			}
 			else {
 				ThrowError(ERR_WRONG_DATA_TYPE, std::string("Wrong data type:") + CDefinition::FieldTypeToString(static_cast<FieldType>(Type)));
@@ -870,7 +852,7 @@ public:
 				pack.Put(Data.Float64);
 			}
 			else if(FT_STRING == Type) {
-				pack.Put(static_cast<double>(std::stod(*Data.String)));
+				pack.Put(static_cast<double>(std::stod(StringValue())));
 			}
 			else {
 				ThrowError(ERR_WRONG_DATA_TYPE, std::string("Wrong data type:") + CDefinition::FieldTypeToString(static_cast<FieldType>(Type)));
@@ -884,7 +866,7 @@ public:
 				pack.Put(static_cast<__float128>(Data.Float64));
 			}
 			else if(FT_STRING == Type) {
-				pack.Put(static_cast<__float128>(strtoflt128(Data.String->c_str(), NULL)));
+				pack.Put(static_cast<__float128>(strtoflt128(StringValue().c_str(), NULL)));
 			}
 			else {
 				ThrowError(ERR_WRONG_DATA_TYPE, std::string("Wrong data type:") + CDefinition::FieldTypeToString(static_cast<FieldType>(Type)));
@@ -895,7 +877,7 @@ public:
 				CDecimal64 dec(scale);
 				switch(Type) {
 				case FT_STRING:
-					dec.Set(*Data.String);
+					dec.Set(StringValue());
 					break;
 				case FT_FLOAT32:
 					dec.Set(Data.Float32);
@@ -941,7 +923,7 @@ public:
 				CDecimal128 dec(scale);
 				switch(Type) {
 				case FT_STRING:
-					dec.Set(*Data.String);
+					dec.Set(StringValue());
 					break;
 				case FT_FLOAT32:
 					dec.Set(Data.Float32);
@@ -994,7 +976,7 @@ public:
 			}
 			else if(FT_STRING == Type) {
 				uint16_t value = 0;
-				auto it = values.find(*Data.String);
+				auto it = values.find(StringValue());
 				if(it != values.end()) {
 					value = it->second + 1;
 				}
@@ -1009,7 +991,7 @@ public:
 				pack.Write(&Data.Date, sizeof(CDate));
 			}
 			else if(FT_STRING == Type) {
-				std::vector<std::string> rawdate = explode(*Data.String, '-');
+				std::vector<std::string> rawdate = explode(StringValue(), '-');
 				CDate date(static_cast<int16_t>(std::stol(rawdate[0])), static_cast<uint8_t>(std::stoul(rawdate[1])), static_cast<uint8_t>(std::stoul(rawdate[2])));
 				pack.Write(&date, sizeof(CDate));
 			}
@@ -1023,12 +1005,13 @@ public:
 			}
 			else if(FT_STRING == Type) {
 				int64_t time;
-				if(is_digit(*Data.String)) {
-					time = std::stoll(*Data.String);
+				std::string str = StringValue();
+				if(is_digit(str)) {
+					time = std::stoll(str);
 				}
 				else {
-					std::vector<std::string> rawtime = explode(*Data.String, ':');
-					if((*Data.String)[0] != '-') {
+					std::vector<std::string> rawtime = explode(str, ':');
+					if(str[0] != '-') {
 						time = (stoll(rawtime[0]) * 3600 + stoul(rawtime[1]) * 60) * CTime::NanoTime + static_cast<int64_t>(std::stod(rawtime[2]) * CTime::NanoTime);
 					}
 					else {
@@ -1046,7 +1029,7 @@ public:
 				pack.Write(&Data.DateTime, sizeof(CDateTime));
 			}
 			else if(FT_STRING == Type) {
-				std::vector<std::string> rawdatetime = explode(*Data.String, ' ');
+				std::vector<std::string> rawdatetime = explode(StringValue(), ' ');
 				std::vector<std::string> rawdate = explode(rawdatetime[0], '-');
 				std::vector<std::string> rawtime = explode(rawdatetime[1], ':');
 				double seconds = std::stod(rawtime[2]);
@@ -1065,11 +1048,11 @@ public:
 			}
 			else if(FT_STRING == Type) {
 				int64_t value;
-				if(to_upper_copy(*Data.String) == "CURRENT_TIMESTAMP") {
+				if(to_upper_copy(StringValue()) == "CURRENT_TIMESTAMP") {
 					value = CTime::Now();
 				}
 				else {
-					value = stoll(*Data.String);
+					value = stoll(StringValue());
 				}
 				pack.Put(value);
 			}
@@ -1080,10 +1063,10 @@ public:
 		case FT_CHAR:
 			if(FT_STRING == Type) {
 				uint32_t charnum;
-				truncate(*Data.String, length, charnum, charset);
+				size_t size;
+				const char* str = TruncateString(length, charset, size, charnum);
 				pack.Put(static_cast<uint16_t>(charnum));// 记录字符数
-				pack.Put<uint16_t>(*Data.String, length);
-				//std::cout << *Data.String << std::endl;
+				pack.PutString<uint16_t>(str, size, length);
 			}
 			else {
 				ThrowError(ERR_WRONG_DATA_TYPE, std::string("Wrong data type:") + CDefinition::FieldTypeToString(static_cast<FieldType>(Type)));
@@ -1092,9 +1075,10 @@ public:
 		case FT_VARCHAR:
 			if(FT_STRING == Type) {
 				uint32_t charnum;
-				truncate(*Data.String, length, charnum, charset);
+				size_t size;
+				const char* str = TruncateString(length, charset, size, charnum);
 				pack.Put(static_cast<uint16_t>(charnum));// 记录字符数
-				pack.Put<uint16_t>(*Data.String);
+				pack.PutString<uint16_t>(str, size);
 			}
 			else {
 				ThrowError(ERR_WRONG_DATA_TYPE, std::string("Wrong data type:") + CDefinition::FieldTypeToString(static_cast<FieldType>(Type)));
@@ -1103,9 +1087,10 @@ public:
 		case FT_TEXT:
 			if(FT_STRING == Type) {
 				uint32_t charnum;
-				truncate(*Data.String, std::numeric_limits<uint32_t>::max(), charnum, charset);
+				size_t size;
+				const char* str = TruncateString(std::numeric_limits<uint32_t>::max(), charset, size, charnum);
 				pack.Put(static_cast<uint32_t>(charnum));// 记录字符数
-				pack.Put<uint32_t>(*Data.String);
+				pack.PutString<uint32_t>(str, size);
 			}
 			else {
 				ThrowError(ERR_WRONG_DATA_TYPE, std::string("Wrong data type:") + CDefinition::FieldTypeToString(static_cast<FieldType>(Type)));
@@ -1113,10 +1098,7 @@ public:
 			break;
 		case FT_BINARY:
 			if(FT_STRING == Type) {
-				if(Data.String->size() > length) {
-					Data.String->erase(length);
-				}
-				pack.Put<uint16_t>(*Data.String, length);
+				pack.PutString<uint16_t>(GetStringData(), std::min(GetStringSize(), static_cast<size_t>(length)), length);
 			}
 			else {
 				ThrowError(ERR_WRONG_DATA_TYPE, std::string("Wrong data type:") + CDefinition::FieldTypeToString(static_cast<FieldType>(Type)));
@@ -1124,10 +1106,7 @@ public:
 			break;
 		case FT_VARBINARY:
 			if(FT_STRING == Type) {
-				if(Data.String->size() > length) {
-					Data.String->erase(length);
-				}
-				pack.Put<uint16_t>(*Data.String);
+				pack.PutString<uint16_t>(GetStringData(), std::min(GetStringSize(), static_cast<size_t>(length)));
 			}
 			else {
 				ThrowError(ERR_WRONG_DATA_TYPE, std::string("Wrong data type:") + CDefinition::FieldTypeToString(static_cast<FieldType>(Type)));
@@ -1135,10 +1114,7 @@ public:
 			break;
 		case FT_BLOB:
 			if(FT_STRING == Type) {
-				if(Data.String->size() > std::numeric_limits<uint32_t>::max()) {
-					Data.String->erase(std::numeric_limits<uint32_t>::max());
-				}
-				pack.Put<uint32_t>(*Data.String);
+				pack.PutString<uint32_t>(GetStringData(), std::min(GetStringSize(), static_cast<size_t>(std::numeric_limits<uint32_t>::max())));
 			}
 			else {
 				ThrowError(ERR_WRONG_DATA_TYPE, std::string("Wrong data type:") + CDefinition::FieldTypeToString(static_cast<FieldType>(Type)));
@@ -1309,24 +1285,59 @@ public:
 		return Data.DateTime;
 	}
 
-	inline std::string ToString() noexcept
+	inline std::string ToString() const
 	{
-		return *Data.String;
+		return StringValue();
 	}
 
-	inline const std::string& ToString() const noexcept
+	// 引用接收缓冲区的字符串先复制为自有，短字符串以'\0'结尾存放在Data中
+	inline char* ToCharPointer()
 	{
-		return *Data.String;
+		if(SM_VIEW == Mode) {
+			SetString(Data.View.Pointer, Data.View.Size);
+		}
+		return SM_HEAP == Mode ? &Data.String->front() : Data.Chars;
 	}
 
-	inline char* ToCharPointer() noexcept
+	// 引用接收缓冲区的字符串不以'\0'结尾
+	const char* ToCharPointer() const noexcept
 	{
-		return &Data.String->front();
+		return GetStringData();
 	}
 
-	const char* ToCharPointer() const noexcept
+	/**
+	 * @brief GetStringData 字符串值的起始地址，Data中的短字符串和复制的长字符串以'\0'结尾，引用接收缓冲区的不是
+	 */
+	inline const char* GetStringData() const noexcept
+	{
+		switch(Mode) {
+		case SM_HEAP:
+			return Data.String->data();
+		case SM_INLINE:
+			return Data.Chars;
+		default:
+			return Data.View.Pointer;
+		}
+	}
+
+	inline size_t GetStringSize() const noexcept
+	{
+		switch(Mode) {
+		case SM_HEAP:
+			return Data.String->size();
+		case SM_INLINE:
+			return InlineSize;
+		default:
+			return Data.View.Size;
+		}
+	}
+
+	/**
+	 * @brief StringValue 字符串值的副本，不超过15字节时不分配内存，用于转换为其他类型
+	 */
+	inline std::string StringValue() const
 	{
-		return &Data.String->front();
+		return std::string(GetStringData(), GetStringSize());
 	}
 
 	inline CString ToIconvString() noexcept
@@ -1470,16 +1481,14 @@ public:
 	inline CAny& operator = (const std::string& v) noexcept
 	{
 		Reset();
-		Type = FT_STRING;
-		Data.String = new std::string(v);
+		SetString(v.data(), v.size());
 		return *this;
 	}
 
 	inline CAny& operator = (const char* v) noexcept
 	{
 		Reset();
-		Type = FT_STRING;
-		Data.String = new std::string(v);
+		SetString(v, ::strlen(v));
 		return *this;
 	}
 
@@ -1493,6 +1502,9 @@ public:
 
 	inline CAny& operator = (const CAny& v) noexcept
 	{
+		if(this == &v) {
+			return *this;
+		}
 		Reset();
 		Type = v.GetType();
 		switch(Type) {
@@ -1539,32 +1551,28 @@ public:
 			Data.FLOAT128 = v.ToFloat128();
 			break;
 		case FT_STRING:
-			Data.String = new std::string(v.ToString());
+			SetString(v.GetStringData(), v.GetStringSize());
 			break;
 		case FT_ICONVSTRING:
 			Data.IconvString = new CString(v.ToIconvString());
 			break;
 		default:
+			Data = v.Data;
 			break;
 		}
 		return *this;
 	}
 
-	inline CAny& operator = (CAny&& v)
+	inline CAny& operator = (CAny&& v) noexcept
 	{
+		if(this == &v) {
+			return *this;
+		}
 		Reset();
 		Type = v.Type;
-		switch(Type) {
-		case FT_STRING:
-			Data.String = v.Data.String;
-			break;
-		case FT_ICONVSTRING:
-			Data.IconvString = v.Data.IconvString;
-			break;
-		default:
-			Data = v.Data;
-			break;
-		}
+		Mode = v.Mode;
+		InlineSize = v.InlineSize;
+		Data = v.Data;
 		v.Type = FT_NONE;
 		return *this;
 	}
@@ -1606,13 +1614,21 @@ public:
 			os << v.ToDateTime().to_string();
 			break;
 		case FT_STRING:
-			os << v.ToString(); break;
+			os.write(v.GetStringData(), static_cast<std::streamsize>(v.GetStringSize())); break;
 		case FT_ICONVSTRING:
 			os << v.ToIconvString().Data; break;
 		}
 		return os;
 	}
 
+	/**
+	 * 引用的字符串：起始地址和字节数
+	 */
+	struct CStringView {
+		const char* Pointer;
+		size_t Size;
+	};
+
 	union {
 		bool Bool;
 		int8_t Int8;
@@ -1630,17 +1646,90 @@ public:
 		__float128 FLOAT128;
 		CDate Date;
 		CDateTime DateTime;
-		std::string* String;
+		std::string* String;				/**< SM_HEAP：超过INLINE_CAPACITY字节的字符串 */
+		char Chars[16];						/**< SM_INLINE：不超过INLINE_CAPACITY字节的字符串，以'\0'结尾 */
+		CStringView View;					/**< SM_VIEW：引用接收缓冲区中的字符串 */
 		CString* IconvString;
 	} Data;
 
 protected:
+	/**
+	 * FT_STRING的存放方式
+	 */
+	enum StringMode : uint8_t {
+		SM_HEAP,
+		SM_INLINE,
+		SM_VIEW
+	};
+	const static size_t INLINE_CAPACITY = 15;	/**< 存放在Data中的字符串的最大字节数 */
+
+	/**
+	 * @brief SetString 复制字符串，不超过INLINE_CAPACITY字节时存放在Data中，不分配内存；调用前已Reset
+	 */
+	inline void SetString(const char* data, size_t size) noexcept
+	{
+		Type = FT_STRING;
+		if(size <= INLINE_CAPACITY) {
+			Mode = SM_INLINE;
+			InlineSize = static_cast<uint8_t>(size);
+			::memcpy(Data.Chars, data, size);
+			Data.Chars[size] = '\0';
+		}
+		else {
+			Mode = SM_HEAP;
+			Data.String = new std::string(data, size);
+		}
+	}
+
+	/**
+	 * @brief LoadString 读取长度为SizeType的字符串，pad_length为定长字段占用的字节数；reference为true时引用pack中的数据
+	 */
+	template<typename SizeType>
+	inline void LoadString(CPack& pack, size_t pad_length, bool reference)
+	{
+		SizeType size;
+		pack.Get(size);
+		const char* data = pack.Skip(size);
+		if(reference) {
+			Type = FT_STRING;
+			Mode = SM_VIEW;
+			Data.View.Pointer = data;
+			Data.View.Size = size;
+		}
+		else {
+			SetString(data, size);
+		}
+		if(pad_length > size) {
+			pack.Skip(pad_length - size);
+		}
+	}
+
+	/**
+	 * @brief TruncateString 按字符集截断到length字节，返回截断后的内容、字节数和字符数，不修改自身；
+	 * ASCII直接使用原数据，UTF8和GBK与truncate相同按'\0'结尾处理，复制到线程内复用的缓冲区后截断
+	 */
+	inline const char* TruncateString(uint32_t length, CIconv::CharsetType charset, size_t& size, uint32_t& charnum) const
+	{
+		if(CIconv::CHARSET_UTF8 != charset && CIconv::CHARSET_GBK != charset) {
+			size = std::min(GetStringSize(), static_cast<size_t>(length));
+			charnum = static_cast<uint32_t>(size);
+			return GetStringData();
+		}
+		static thread_local std::string buffer;
+		buffer.assign(GetStringData(), GetStringSize());
+		truncate(buffer, length, charnum, charset);
+		size = buffer.size();
+		return buffer.data();
+	}
+
 	inline void Reset() noexcept
 	{
 		switch(Type) {
 		case FT_STRING:
-			delete Data.String;
-			Data.String = nullptr;
+			if(SM_HEAP == Mode) {
+				delete Data.String;
+				Data.String = nullptr;
+			}
 			break;
 		case FT_ICONVSTRING:
 			delete Data.IconvString;
@@ -1650,6 +1739,8 @@ protected:
 	}
 
 	uint16_t Type;
+	uint8_t Mode = SM_HEAP;	/**< Type为FT_STRING时的存放方式 */
+	uint8_t InlineSize = 0;	/**< SM_INLINE时字符串的字节数 */
 };
 
 }
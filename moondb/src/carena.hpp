@@ -0,0 +1,207 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstddef>
+#include <new>
+#include <vector>
+#include <algorithm>
+#include "crunningerror.hpp"
+#include "functions.hpp"
+
+namespace MoonDb {
+
+/**
+ * CArena处理请求用的线性内存池：从块中顺序切分，不单独释放，处理完一个请求后用rewind整体回到之前的位置。
+ * 块留给之后的请求继续使用，稳定后处理请求不再调用malloc；回到开始位置时只保留MAX_RETAINED_BYTES以内的块，
+ * 偶尔的大请求不会一直占用内存。不是线程安全的，每个工作线程使用自己的内存池
+ */
+class CArena
+{
+public:
+	const static size_t CHUNK_BYTES = 65536;			/**< 块的最小字节数 */
+	const static size_t MAX_RETAINED_BYTES = 1048576;	/**< 回到开始位置后保留的块的最大总字节数 */
+
+	/**
+	 * 内存池中的位置，rewind时回到该位置
+	 */
+	struct CMark {
+		size_t Chunk;
+		size_t Offset;
+	};
+
+	/**
+	 * 在作用域结束时（包括抛出异常）回到进入时的位置，作用域内分配的内存全部失效
+	 */
+	class CScope
+	{
+	public:
+		explicit CScope(CArena& arena) noexcept : Arena(arena), Mark(arena.mark())
+		{}
+
+		CScope(const CScope&) = delete;
+		CScope& operator=(const CScope&) = delete;
+
+		~CScope() noexcept
+		{
+			Arena.rewind(Mark);
+		}
+
+	protected:
+		CArena& Arena;
+		CMark Mark;
+	};
+
+	CArena() noexcept : Current(0), Offset(0), Mallocs(0)
+	{}
+
+	CArena(const CArena&) = delete;
+	CArena& operator=(const CArena&) = delete;
+
+	~CArena() noexcept
+	{
+		for(size_t i = 0; i < Chunks.size(); i++) {
+			::free(Chunks[i].Data);
+		}
+	}
+
+	/**
+	 * @brief allocate 分配size字节，按alignment（2的幂）对齐；已有的块都放不下时申请新块
+	 */
+	void* allocate(size_t size, size_t alignment = alignof(std::max_align_t))
+	{
+		while(Current < Chunks.size()) {
+			void* p = Carve(Chunks[Current], size, alignment);
+			if(nullptr != p) {
+				return p;
+			}
+			Current++;
+			Offset = 0;
+		}
+		size_t bytes = std::max(static_cast<size_t>(CHUNK_BYTES), size + alignment);
+		Chunks.reserve(Chunks.size() + 1);
+		char* data = static_cast<char*>(::malloc(bytes));
+		if(nullptr == data) {
+			ThrowError(ERR_MEMORY_ALLOCATE, "CArena failed to allocate " + num_to_string(uint64_t(bytes)) + " bytes.");
+			return nullptr;
+		}
+		Chunks.push_back(CChunk{data, bytes});
+		Mallocs++;
+		Current = Chunks.size() - 1;
+		Offset = 0;
+		return Carve(Chunks[Current], size, alignment);
+	}
+
+	inline CMark mark() const noexcept
+	{
+		return CMark{Current, Offset};
+	}
+
+	/**
+	 * @brief rewind 回到mark的位置，之后分配的内存全部失效；回到开始位置时释放超出MAX_RETAINED_BYTES的块
+	 */
+	void rewind(const CMark& mark) noexcept
+	{
+		Current = mark.Chunk;
+		Offset = mark.Offset;
+		if(0 != Current || 0 != Offset) {
+			return;
+		}
+		size_t retained = 0;
+		size_t keep = 0;
+		while(keep < Chunks.size() && retained + Chunks[keep].Size <= MAX_RETAINED_BYTES) {
+			retained += Chunks[keep].Size;
+			keep++;
+		}
+		for(size_t i = keep; i < Chunks.size(); i++) {
+			::free(Chunks[i].Data);
+		}
+		Chunks.resize(keep);
+	}
+
+	/**
+	 * @brief mallocs 申请块的次数，用于确认稳定后不再申请内存
+	 */
+	inline uint64_t mallocs() const noexcept
+	{
+		return Mallocs;
+	}
+
+	/**
+	 * @brief ThreadLocal 当前线程处理请求用的内存池
+	 */
+	static CArena& ThreadLocal() noexcept
+	{
+		static thread_local CArena arena;
+		return arena;
+	}
+
+protected:
+	struct CChunk {
+		char* Data;
+		size_t Size;
+	};
+
+	std::vector<CChunk> Chunks;
+	size_t Current;		/**< 正在切分的块 */
+	size_t Offset;		/**< 当前块中下一次切分的位置 */
+	uint64_t Mallocs;
+
+	inline void* Carve(const CChunk& chunk, size_t size, size_t alignment) noexcept
+	{
+		uintptr_t base = reinterpret_cast<uintptr_t>(chunk.Data);
+		size_t start = static_cast<size_t>(((base + Offset + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1)) - base);
+		if(start + size > chunk.Size) {
+			return nullptr;
+		}
+		Offset = start + size;
+		return chunk.Data + start;
+	}
+};
+
+/**
+ * 从CArena分配内存的STL分配器，Arena为nullptr时使用operator new；内存池中的内存不单独释放，由内存池rewind统一回收
+ */
+template <typename T>
+struct CArenaAllocator
+{
+	typedef T value_type;
+
+	CArena* Arena;
+
+	CArenaAllocator(CArena* arena = nullptr) noexcept : Arena(arena)
+	{}
+
+	template <typename U>
+	CArenaAllocator(const CArenaAllocator<U>& other) noexcept : Arena(other.Arena)
+	{}
+
+	T* allocate(size_t n)
+	{
+		if(nullptr == Arena) {
+			return static_cast<T*>(::operator new(n * sizeof(T)));
+		}
+		return static_cast<T*>(Arena->allocate(n * sizeof(T), alignof(T)));
+	}
+
+	void deallocate(T* p, size_t) noexcept
+	{
+		if(nullptr == Arena) {
+			::operator delete(p);
+		}
+	}
+};
+
+template <typename T, typename U>
+inline bool operator==(const CArenaAllocator<T>& a, const CArenaAllocator<U>& b) noexcept
+{
+	return a.Arena == b.Arena;
+}
+
+template <typename T, typename U>
+inline bool operator!=(const CArenaAllocator<T>& a, const CArenaAllocator<U>& b) noexcept
+{
+	return a.Arena != b.Arena;
+}
+
+}
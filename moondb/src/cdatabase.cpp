@@ -62,6 +62,7 @@ void CDatabase::Open(const string& path)
 void CDatabase::Close() noexcept
 {
 	Users.clear();
+	TableHandles.clear();
 	for(auto it = Tables.begin(); it != Tables.end(); it++)	{
 		delete it->second;
 	}
@@ -69,6 +70,24 @@ void CDatabase::Close() noexcept
 	Path.clear();
 }
 
+size_t CDatabase::ExpireRows(size_t limit)
+{
+	size_t busy = 0;
+	for(auto it = Tables.begin(); it != Tables.end(); it++)	{
+		if(it->second->ExpireRows(limit) >= limit) {
+			busy++;
+		}
+	}
+	return busy;
+}
+
+void CDatabase::Persist()
+{
+	for(auto it = Tables.begin(); it != Tables.end(); it++)	{
+		it->second->Persist();
+	}
+}
+
 void CDatabase::Create(const string& path)
 {
 	Path = path;
@@ -117,6 +136,12 @@ CTable* CDatabase::CreateTableObject(const string& name, TableType engine, Field
 		case TT_FIXMEMORY:
 			table = new CFixedMemoryStorage<uint8_t>();
 			break;
+		case TT_VARMEMORY:
+			table = new CVarMemoryStorage<uint8_t>();
+			break;
+		case TT_HARDDISK:
+			table = new CDiskStorage<uint8_t>();
+			break;
 		default:
 			ThrowError(ERR_WRONG_ENGINE, "The table engine " + CDefinition::TableTypeToString(engine) + " of the table " + name + " isn't correct.");
 		}
@@ -127,6 +152,12 @@ CTable* CDatabase::CreateTableObject(const string& name, TableType engine, Field
 		case TT_FIXMEMORY:
 			table = new CFixedMemoryStorage<uint16_t>();
 			break;
+		case TT_VARMEMORY:
+			table = new CVarMemoryStorage<uint16_t>();
+			break;
+		case TT_HARDDISK:
+			table = new CDiskStorage<uint16_t>();
+			break;
 		default:
 			ThrowError(ERR_WRONG_ENGINE, "The table engine " + CDefinition::TableTypeToString(engine) + " of the table " + name + " isn't correct.");
 		}
@@ -137,6 +168,12 @@ CTable* CDatabase::CreateTableObject(const string& name, TableType engine, Field
 		case TT_FIXMEMORY:
 			table = new CFixedMemoryStorage<uint32_t>();
 			break;
+		case TT_VARMEMORY:
+			table = new CVarMemoryStorage<uint32_t>();
+			break;
+		case TT_HARDDISK:
+			table = new CDiskStorage<uint32_t>();
+			break;
 		default:
 			ThrowError(ERR_WRONG_ENGINE, "The table engine " + CDefinition::TableTypeToString(engine) + " of the table " + name + " isn't correct.");
 		}
@@ -147,6 +184,12 @@ CTable* CDatabase::CreateTableObject(const string& name, TableType engine, Field
 		case TT_FIXMEMORY:
 			table = new CFixedMemoryStorage<uint64_t>();
 			break;
+		case TT_VARMEMORY:
+			table = new CVarMemoryStorage<uint64_t>();
+			break;
+		case TT_HARDDISK:
+			table = new CDiskStorage<uint64_t>();
+			break;
 		default:
 			ThrowError(ERR_WRONG_ENGINE, "The table engine " + CDefinition::TableTypeToString(engine) + " of the table " + name + " isn't correct.");
 		}
@@ -157,6 +200,12 @@ CTable* CDatabase::CreateTableObject(const string& name, TableType engine, Field
 		case TT_FIXMEMORY:
 			table = new CFixedMemoryStorage<__uint128_t>();
 			break;
+		case TT_VARMEMORY:
+			table = new CVarMemoryStorage<__uint128_t>();
+			break;
+		case TT_HARDDISK:
+			table = new CDiskStorage<__uint128_t>();
+			break;
 		default:
 			ThrowError(ERR_WRONG_ENGINE, "The table engine " + CDefinition::TableTypeToString(engine) + " of the table " + name + " isn't correct.");
 		}
@@ -200,6 +249,7 @@ void CDatabase::CreateTable(const string& name, TableType engine, vector<CRawFie
 		table = CreateTableObject(name, engine, rowidtype);
 		table->Create(Path, name, engine, rowidtype, fields, indexes, maxrows, minrows, lifetime);
 		Tables[name] = table;
+		TableHandles.insert(name, table);
 	}
 	catch(exception& e) {
 		if(table != nullptr) {
@@ -226,6 +276,7 @@ void CDatabase::LoadTable(const string& name)
 		return;
 	}
 	Tables[name] = table;
+	TableHandles.insert(name, table);
 }
 
 }
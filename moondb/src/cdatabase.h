@@ -1,7 +1,9 @@
 #pragma once
 
 #include "header.h"
-#include "cfixedmemorystorage.hpp"
+#include "cvarmemorystorage.hpp"
+#include "cdiskstorage.hpp"
+#include "chandleregistry.hpp"
 
 using namespace std;
 
@@ -41,11 +43,11 @@ public:
 	CDatabase() = default;
 	CDatabase(const string& path);
 	~CDatabase();
-	inline void SetMutex(shared_timed_mutex* mutex) noexcept
+	inline void SetMutex(CReadMostlyMutex* mutex) noexcept
 	{
 		Mutex = mutex;
 	}
-	inline shared_timed_mutex* GetMutex() noexcept
+	inline CReadMostlyMutex* GetMutex() noexcept
 	{
 		return Mutex;
 	}
@@ -55,15 +57,24 @@ public:
 	void AddUser(const string& username, const string& password, uint8_t status, const string& hostname, const bitset<64>& privileges);
 	void CreateTable(const string& name, TableType engine, vector<CRawField>& fields, vector<CIndex>& indexes, uint64_t maxrows = 0,
 					 uint64_t minrows = 0, uint32_t lifetime = 0);
-	inline CTable* GetTable(const string& name) noexcept
+	/**
+	 * @brief ExpireRows 删除各表中到期的数据，调用时持有数据库读锁
+	 * @param limit 每个表最多处理的到期项数
+	 * @return 未处理完的表数
+	 */
+	size_t ExpireRows(size_t limit);
+	/**
+	 * @brief Persist 各表写入重做日志和生成快照，调用时持有数据库读锁
+	 */
+	void Persist();
+	/**
+	 * @brief GetTable 返回表对象指针，不加锁，表不存在时返回nullptr
+	 */
+	inline CTable* GetTable(const string& name) const noexcept
 	{
-		auto it = Tables.find(name);
-		if(it == Tables.end()) {
-			return nullptr;
-		}
-		else {
-			return it->second;
-		}
+		CTable* table = nullptr;
+		TableHandles.find(name, table);
+		return table;
 	}
 
 protected:
@@ -74,11 +85,12 @@ protected:
 	string Path;
 	unordered_map<string, CUser> Users;
 	unordered_map<string, CTable*> Tables;
+	CHandleRegistry<CTable> TableHandles;	/**< 供请求查找的表，与Tables相同 */
 
 	CTable* CreateTableObject(const string& name, TableType engine, FieldType rowidtype);
 	void LoadTable(const string& name);
 
-	shared_timed_mutex* Mutex;
+	CReadMostlyMutex* Mutex;
 };
 
 }
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include "cmappedfile.hpp"
+
+namespace MoonDb {
+
+/**
+ * CDiskHeap存放在映射文件中的变长数据堆：块按大小分为CLASSES级，16字节以内为一级，之后每翻一倍分4级（每块最多浪费约1/4），
+ * 块从文件末尾顺序分配，释放后放入该级的空闲链表（链表头在文件头中，每个空闲块的前8个字节为下一块的位置），重新打开后继续使用。
+ * 块没有头部，释放时由调用者提供申请时的大小；位置0表示空。扩大文件时之前取得的地址失效，不支持并发修改
+ */
+class CDiskHeap
+{
+public:
+	const static uint64_t HEADER_LENGTH = 4096;	/**< 文件头的字节数，之后为各块 */
+	const static uint32_t CLASSES = 113;			/**< 级数，最大一级可以容纳4GB */
+
+	CDiskHeap() noexcept : Header(nullptr)
+	{}
+
+	CDiskHeap(const CDiskHeap&) = delete;
+	CDiskHeap& operator=(const CDiskHeap&) = delete;
+
+	void open(const std::string& filename)
+	{
+		File.Open(filename, HEADER_LENGTH + (static_cast<uint64_t>(1) << 20));
+		Header = reinterpret_cast<CHeader*>(File.GetPointer());
+		if(0 == Header->Magic[0]) {
+			::memcpy(Header->Magic, Magic(), sizeof(Header->Magic));
+			Header->Version = 1;
+			Header->Tail = HEADER_LENGTH;
+			Header->Used = 0;
+		}
+		else if(::memcmp(Header->Magic, Magic(), sizeof(Header->Magic)) != 0 || Header->Tail > File.GetSize()) {
+			ThrowError(ERR_FILE_READ, "The heap file " + filename + " is damaged.");
+		}
+	}
+
+	void close() noexcept
+	{
+		File.Close();
+		Header = nullptr;
+	}
+
+	void sync()
+	{
+		File.Sync();
+	}
+
+	/**
+	 * @brief allocate 分配size字节，size为0时返回0
+	 * @return 块在文件中的位置
+	 */
+	uint64_t allocate(uint64_t size)
+	{
+		if(0 == size) {
+			return 0;
+		}
+		uint32_t index = ClassIndex(size);
+		uint64_t bytes = ClassSize(index);
+		uint64_t offset = Header->FreeHeads[index];
+		if(0 != offset) {
+			::memcpy(&Header->FreeHeads[index], File.GetPointer() + offset, sizeof(uint64_t));
+		}
+		else {
+			offset = Header->Tail;
+			if(offset + bytes > File.GetSize()) {
+				File.Resize(CMappedFile::GrowSize(File.GetSize(), offset + bytes));
+				Header = reinterpret_cast<CHeader*>(File.GetPointer());
+			}
+			Header->Tail = offset + bytes;
+		}
+		Header->Used += bytes;
+		return offset;
+	}
+
+	/**
+	 * @brief free 释放allocate(size)分配的块
+	 */
+	void free(uint64_t offset, uint64_t size) noexcept
+	{
+		if(0 == offset) {
+			return;
+		}
+		uint32_t index = ClassIndex(size);
+		::memcpy(File.GetPointer() + offset, &Header->FreeHeads[index], sizeof(uint64_t));
+		Header->FreeHeads[index] = offset;
+		Header->Used -= ClassSize(index);
+	}
+
+	inline char* pointer(uint64_t offset) noexcept
+	{
+		return File.GetPointer() + offset;
+	}
+
+	inline const char* pointer(uint64_t offset) const noexcept
+	{
+		return File.GetPointer() + offset;
+	}
+
+	/**
+	 * @brief used 已分配块的字节数
+	 */
+	inline uint64_t used() const noexcept
+	{
+		return Header->Used;
+	}
+
+	/**
+	 * @brief reserved 文件的字节数
+	 */
+	inline uint64_t reserved() const noexcept
+	{
+		return File.GetSize();
+	}
+
+protected:
+	static inline const char* Magic() noexcept
+	{
+		return "MOONVAR";
+	}
+
+	struct CHeader {
+		char Magic[8];
+		uint64_t Version;
+		uint64_t Tail;					/**< 未分配部分的开始位置 */
+		uint64_t Used;
+		uint64_t FreeHeads[CLASSES];	/**< 各级空闲链表的第一块，0表示空 */
+	};
+
+	CMappedFile File;
+	CHeader* Header;
+
+	static inline uint32_t ClassIndex(uint64_t size) noexcept
+	{
+		if(size <= 16) {
+			return 0;
+		}
+		// size在(2^p, 2^(p+1)]之间，该区间每2^(p-2)字节一级
+		uint32_t p = 63 - static_cast<uint32_t>(__builtin_clzll(size - 1));
+		return 1 + (p - 4) * 4 + static_cast<uint32_t>((size - 1 - (static_cast<uint64_t>(1) << p)) >> (p - 2));
+	}
+
+	static inline uint64_t ClassSize(uint32_t index) noexcept
+	{
+		if(0 == index) {
+			return 16;
+		}
+		uint32_t p = 4 + (index - 1) / 4;
+		return (static_cast<uint64_t>(1) << p) + ((index - 1) % 4 + 1) * (static_cast<uint64_t>(1) << (p - 2));
+	}
+};
+
+}
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <cstdio>
+#include "cmappedfile.hpp"
+#include "cflathashmap.hpp"
+
+namespace MoonDb {
+
+/**
+ * CDiskIndex存放在映射文件中的哈希表（开放寻址，线性探测），键为整数，值为uint64_t，重新打开后不需要重建。
+ * 装载率超过3/4时在临时文件中按新容量重建再替换原文件，之前取得的地址失效；不支持并发修改
+ */
+template <typename T_Key, typename T_Hash = CFlatHash<T_Key>>
+class CDiskIndex
+{
+public:
+	const static uint64_t NPOS = ~0ULL;
+	const static uint64_t HEADER_LENGTH = 4096;	/**< 文件头的字节数，之后为各项 */
+
+	CDiskIndex() noexcept : Header(nullptr), Entries(nullptr)
+	{}
+
+	CDiskIndex(const CDiskIndex&) = delete;
+	CDiskIndex& operator=(const CDiskIndex&) = delete;
+
+	/**
+	 * @brief open 打开或创建索引文件，新建时容量不小于capacity
+	 */
+	void open(const std::string& filename, uint64_t capacity)
+	{
+		Filename = filename;
+		uint64_t cap = 16;
+		while(cap < capacity) {
+			cap *= 2;
+		}
+		File.Open(Filename, HEADER_LENGTH + cap * sizeof(CEntry), true);
+		Attach();
+		if(0 == Header->Magic[0]) {
+			::memcpy(Header->Magic, Magic(), sizeof(Header->Magic));
+			Header->Version = 1;
+			Header->EntryLength = sizeof(CEntry);
+			Header->Capacity = cap;
+			Header->Size = 0;
+			Header->Deleted = 0;
+		}
+		else if(::memcmp(Header->Magic, Magic(), sizeof(Header->Magic)) != 0 || Header->EntryLength != sizeof(CEntry)
+				|| HEADER_LENGTH + Header->Capacity * sizeof(CEntry) > File.GetSize()) {
+			ThrowError(ERR_FILE_READ, "The index file " + Filename + " is damaged.");
+		}
+	}
+
+	void close() noexcept
+	{
+		File.Close();
+		Header = nullptr;
+		Entries = nullptr;
+	}
+
+	void sync()
+	{
+		File.Sync();
+	}
+
+	inline uint64_t find(const T_Key& key) const noexcept
+	{
+		uint64_t pos = FindPosition(key);
+		return NPOS == pos ? NPOS : Entries[pos].Value - VALUE_BASE;
+	}
+
+	/**
+	 * @brief insert 添加或修改键对应的值
+	 */
+	void insert(const T_Key& key, uint64_t value)
+	{
+		uint64_t pos = FindPosition(key);
+		if(NPOS != pos) {
+			Entries[pos].Value = value + VALUE_BASE;
+			return;
+		}
+		if((Header->Size + Header->Deleted + 1) * 4 > Header->Capacity * 3) {
+			uint64_t cap = Header->Capacity;
+			while((Header->Size + 1) * 2 > cap) {
+				cap *= 2;
+			}
+			Rehash(cap);
+		}
+		uint64_t mask = Header->Capacity - 1;
+		for(pos = T_Hash()(key) & mask; Entries[pos].Value > DELETED; pos = (pos + 1) & mask) {
+		}
+		if(DELETED == Entries[pos].Value) {
+			Header->Deleted--;
+		}
+		Entries[pos].Key = key;
+		Entries[pos].Value = value + VALUE_BASE;
+		Header->Size++;
+	}
+
+	bool erase(const T_Key& key) noexcept
+	{
+		uint64_t pos = FindPosition(key);
+		if(NPOS == pos) {
+			return false;
+		}
+		// 下一项为空时查找不会越过此项，可以直接置为空
+		if(EMPTY == Entries[(pos + 1) & (Header->Capacity - 1)].Value) {
+			Entries[pos].Value = EMPTY;
+		}
+		else {
+			Entries[pos].Value = DELETED;
+			Header->Deleted++;
+		}
+		Header->Size--;
+		return true;
+	}
+
+	void clear() noexcept
+	{
+		::memset(Entries, 0, Header->Capacity * sizeof(CEntry));
+		Header->Size = 0;
+		Header->Deleted = 0;
+	}
+
+	inline uint64_t size() const noexcept
+	{
+		return Header->Size;
+	}
+
+	inline uint64_t capacity() const noexcept
+	{
+		return Header->Capacity;
+	}
+
+protected:
+	const static uint64_t EMPTY = 0;		/**< 值：空 */
+	const static uint64_t DELETED = 1;		/**< 值：已删除，查找时不能在此停止 */
+	const static uint64_t VALUE_BASE = 2;	/**< 存储的值为实际的值加上VALUE_BASE */
+	static inline const char* Magic() noexcept
+	{
+		return "MOONIDX";
+	}
+
+	struct CHeader {
+		char Magic[8];
+		uint32_t Version;
+		uint32_t EntryLength;
+		uint64_t Capacity;		/**< 项数，为2的幂 */
+		uint64_t Size;
+		uint64_t Deleted;
+	};
+
+	struct CEntry {
+		T_Key Key;
+		uint64_t Value;
+	};
+
+	std::string Filename;
+	CMappedFile File;
+	CHeader* Header;
+	CEntry* Entries;
+
+	inline void Attach() noexcept
+	{
+		Header = reinterpret_cast<CHeader*>(File.GetPointer());
+		Entries = reinterpret_cast<CEntry*>(File.GetPointer() + HEADER_LENGTH);
+	}
+
+	uint64_t FindPosition(const T_Key& key) const noexcept
+	{
+		uint64_t mask = Header->Capacity - 1;
+		for(uint64_t pos = T_Hash()(key) & mask; ; pos = (pos + 1) & mask) {
+			uint64_t value = Entries[pos].Value;
+			if(EMPTY == value) {
+				return NPOS;
+			}
+			if(value > DELETED && Entries[pos].Key == key) {
+				return pos;
+			}
+		}
+	}
+
+	/**
+	 * @brief Rehash 在临时文件中按capacity重建，完成后替换原文件
+	 */
+	void Rehash(uint64_t capacity)
+	{
+		std::string tmpname = Filename + ".tmp";
+		std::remove(tmpname.c_str());
+		{
+			CMappedFile tmp;
+			tmp.Open(tmpname, HEADER_LENGTH + capacity * sizeof(CEntry), true);
+			CHeader* header = reinterpret_cast<CHeader*>(tmp.GetPointer());
+			CEntry* entries = reinterpret_cast<CEntry*>(tmp.GetPointer() + HEADER_LENGTH);
+			*header = *Header;
+			header->Capacity = capacity;
+			header->Deleted = 0;
+			for(uint64_t i = 0; i < Header->Capacity; i++) {
+				if(Entries[i].Value > DELETED) {
+					uint64_t pos = T_Hash()(Entries[i].Key) & (capacity - 1);
+					while(EMPTY != entries[pos].Value) {
+						pos = (pos + 1) & (capacity - 1);
+					}
+					entries[pos] = Entries[i];
+				}
+			}
+		}
+		File.Close();
+		if(std::rename(tmpname.c_str(), Filename.c_str()) != 0) {
+			ThrowError(ERR_FILE_WRITE, "Can't rename the file " + tmpname + " to " + Filename + ".");
+		}
+		File.Open(Filename, 0, true);
+		Attach();
+	}
+};
+
+}
@@ -0,0 +1,685 @@
+#pragma once
+
+#include <ctime>
+#include "ctable.h"
+#include "creadmostlymutex.hpp"
+#include "cdiskindex.hpp"
+#include "cdiskheap.hpp"
+
+namespace MoonDb {
+
+/**
+ * CDiskStorage硬盘表（TT_HARDDISK）：数据存放在表目录中的三个映射文件，数据量可以超过内存，常用的行由系统页缓存保留。
+ * rows.moon为固定长度的行，文件头中有行数、空闲行链表和自增id；VARCHAR、VARBINARY、TEXT、BLOB在行内只存放引用（位置和字节数），
+ * 数据存放在堆文件var.moon；index.moon为rowid到行号的哈希索引。
+ * 读取加表的读锁，修改加写锁；各字段在加锁之前编码到线程内的缓冲区，编码出错时不修改文件。
+ * 文件头记录是否正常关闭，非正常关闭后打开时按各行重建索引和空闲行链表
+ */
+template <typename IdType>
+class CDiskStorage : public CTable
+{
+public:
+	CDiskStorage() : AutoInc(0), Header(nullptr), SlotLength(0), HasVarFields(false), ExpireCursor(0), Expired(0)
+	{}
+
+	~CDiskStorage()
+	{
+		Close();
+	}
+
+	bool Open(const string& path, const string& name)
+	{
+		CTable::Open(path, name);
+		SlotLength = (sizeof(CSlot) + RowLength + 7) & ~static_cast<uint64_t>(7);
+		FieldLengths.resize(FieldNum);
+		for(uint16_t i = 1; i < FieldNum; i ++) {
+			FieldLengths[i] = static_cast<uint32_t>(GetFieldLength(Fields[i]));
+			HasVarFields = HasVarFields || IsVarField(Fields[i].Type);
+		}
+		uint64_t minrows = MinRows > 0 ? MinRows : 100;
+		string rowsfile = Path + DIRECTORY_SEPARATOR + "rows.moon";
+		Rows.Open(rowsfile, HEADER_LENGTH + minrows * SlotLength, true);
+		Header = reinterpret_cast<CHeader*>(Rows.GetPointer());
+		if(0 == Header->Magic[0]) {
+			::memcpy(Header->Magic, "MOONROW", sizeof(Header->Magic));
+			Header->Version = 1;
+			Header->Clean = 1;
+			Header->SlotLength = SlotLength;
+		}
+		else if(::memcmp(Header->Magic, "MOONROW", sizeof(Header->Magic)) != 0 || Header->SlotLength != SlotLength
+				|| HEADER_LENGTH + Header->Slots * SlotLength > Rows.GetSize()) {
+			ThrowError(ERR_FILE_READ, "The data file " + rowsfile + " is damaged or doesn't match the schema of the table " + Name + ".");
+			return false;
+		}
+		Heap.open(Path + DIRECTORY_SEPARATOR + "var.moon");
+		Index.open(Path + DIRECTORY_SEPARATOR + "index.moon", minrows * 2);
+		if(0 == Header->Clean || Index.size() != Header->Count) {
+			Rebuild();
+		}
+		::memcpy(&AutoInc, Header->AutoInc, sizeof(IdType));
+		Header->Clean = 0;
+		return true;
+	}
+
+	/**
+	 * @brief Close 把三个文件同步写回磁盘并标记为正常关闭
+	 */
+	void Close() noexcept
+	{
+		if(nullptr == Header) {
+			return;
+		}
+		try {
+			Index.sync();
+			Heap.sync();
+			Rows.Sync();
+			Header->Clean = 1;
+			Rows.Sync();
+		}
+		catch(exception& e) {
+			CLog::Instance()->Put(CLog::L_WARNING, e.what());
+		}
+		Header = nullptr;
+		Index.close();
+		Heap.close();
+		Rows.Close();
+	}
+
+	void InsertData(CFieldMap& data, CPack& ret)
+	{
+		InsertResult<IdType>(ret, InsertRow(data));
+	}
+
+	void UpdateData(const CAny& rowid, CFieldMap& data, CPack& ret)
+	{
+		ExecuteResult<IdType>(ret, UpdateRow(GetRowId<IdType>(false, rowid), data) ? 1 : 0);
+	}
+
+	void ReplaceData(const CAny& rowid, CFieldMap& data, CPack& ret)
+	{
+		ReplaceRow(GetRowId<IdType>(false, rowid), data);
+		ExecuteResult<IdType>(ret, 1);
+	}
+
+	void DeleteData(const CAny& rowid, CPack& ret)
+	{
+		ExecuteResult<IdType>(ret, DeleteRow(GetRowId<IdType>(false, rowid)) ? 1 : 0);
+	}
+
+	void GetData(const CAny& rowid, CPack& ret)
+	{
+		IdType id = GetRowId<IdType>(false, rowid);
+		shared_lock<CReadMostlyMutex> lck(Mutex);
+		const char* dp = FindRow(id);
+		if(nullptr == dp) {
+			CPack row;
+			GetResult<IdType>(ret, 0, row);
+			return;
+		}
+		uint64_t start = ret.Tell();
+		ret.Put(static_cast<int64_t>(4));
+		ret.Put(static_cast<uint16_t>(RT_QUERY));
+		ret.Put(static_cast<uint16_t>(1));
+		ret.Put(static_cast<uint16_t>(GetIdType()));
+		ret.Put(id);
+		ret.Put(static_cast<uint16_t>(FieldNum - 1));
+		PutRow(ret, dp, true);
+		EndResult(ret, start);
+	}
+
+	bool GetRawData(const CAny& rowid, CPack& ret, const function<void(const void*, uint64_t)>& sender)
+	{
+		if(HasVarFields) {
+			ThrowError(ERR_WRONG_ENGINE, "The table " + Name + " with variable-length fields in the engine HARDDISK doesn't support raw reading.");
+			return false;
+		}
+		IdType id = GetRowId<IdType>(false, rowid);
+		shared_lock<CReadMostlyMutex> lck(Mutex);
+		const char* dp = FindRow(id);
+		if(nullptr == dp) {
+			RawResultHeader<IdType>(ret, 0, 0);
+			return false;
+		}
+		RawResultHeader<IdType>(ret, id, RowLength);
+		sender(dp, RowLength);
+		return true;
+	}
+
+	/**
+	 * @brief ExpireRows 从上次结束的位置继续检查最多limit * EXPIRE_SCAN_FACTOR行，删除到期的行
+	 */
+	size_t ExpireRows(size_t limit)
+	{
+		if(0 == LifeTime) {
+			return 0;
+		}
+		unique_lock<CReadMostlyMutex> lck(Mutex);
+		uint32_t now = Now();
+		size_t count = 0;
+		uint64_t scan = std::min(Header->Slots, static_cast<uint64_t>(limit) * EXPIRE_SCAN_FACTOR);
+		for(uint64_t i = 0; i < scan && count < limit; i++) {
+			if(ExpireCursor >= Header->Slots) {
+				ExpireCursor = 0;
+			}
+			uint64_t slot = ExpireCursor++;
+			CSlot* sp = SlotAt(slot);
+			if(sp->Used && IsExpired(sp, now)) {
+				IdType id;
+				::memcpy(&id, sp->Id, sizeof(IdType));
+				FreeSlot(id, slot);
+				count++;
+			}
+		}
+		Expired += count;
+		return count;
+	}
+
+	void StatsResult(CPack& ret)
+	{
+		shared_lock<CReadMostlyMutex> lck(Mutex);
+		uint64_t start = BeginResult(ret, RT_STATS);
+		uint64_t countpos = ret.Tell();
+		uint16_t count = 0;
+		ret.Put(count);
+		StatsItem(ret, count, "rows", Header->Count);
+		StatsItem(ret, count, "slots", Header->Slots);
+		StatsItem(ret, count, "free_slots", Header->FreeSlots);
+		StatsItem(ret, count, "slot_bytes", SlotLength);
+		StatsItem(ret, count, "rows_file_bytes", Rows.GetSize());
+		StatsItem(ret, count, "heap_used", Heap.used());
+		StatsItem(ret, count, "heap_file_bytes", Heap.reserved());
+		StatsItem(ret, count, "index_capacity", Index.capacity());
+		StatsItem(ret, count, "expired", Expired);
+		ret.Seek(static_cast<int64_t>(countpos));
+		ret.Put(count);
+		EndResult(ret, start);
+	}
+
+	void InsertMultiData(CFieldMaps& rows, CPack& ret)
+	{
+		uint64_t start = BeginResult(ret, RT_MULTI_INSERT_ID);
+		ret.Put(static_cast<uint16_t>(GetIdType()));
+		ret.Put(static_cast<uint32_t>(rows.size()));
+		for(size_t i = 0; i < rows.size(); i++) {
+			try {
+				ret.Put(InsertRow(rows[i]));
+			}
+			catch(runtime_error& e) {
+				TraceError(e, "Row " + num_to_string(i) + " of the batch failed, the rows before it have been inserted.");
+			}
+		}
+		EndResult(ret, start);
+	}
+
+	void UpdateMultiData(const CRowIds& rowids, CFieldMaps& rows, CPack& ret)
+	{
+		uint64_t start = BeginResult(ret, RT_MULTI_AFFECTED_ROWS);
+		ret.Put(static_cast<uint32_t>(rows.size()));
+		for(size_t i = 0; i < rows.size(); i++) {
+			try {
+				ret.Put(static_cast<uint8_t>(UpdateRow(GetRowId<IdType>(false, rowids[i]), rows[i])));
+			}
+			catch(runtime_error& e) {
+				TraceError(e, "Row " + num_to_string(i) + " of the batch failed, the rows before it have been updated.");
+			}
+		}
+		EndResult(ret, start);
+	}
+
+	void ReplaceMultiData(const CRowIds& rowids, CFieldMaps& rows, CPack& ret)
+	{
+		uint64_t start = BeginResult(ret, RT_MULTI_AFFECTED_ROWS);
+		ret.Put(static_cast<uint32_t>(rows.size()));
+		for(size_t i = 0; i < rows.size(); i++) {
+			try {
+				ReplaceRow(GetRowId<IdType>(false, rowids[i]), rows[i]);
+				ret.Put(static_cast<uint8_t>(1));
+			}
+			catch(runtime_error& e) {
+				TraceError(e, "Row " + num_to_string(i) + " of the batch failed, the rows before it have been replaced.");
+			}
+		}
+		EndResult(ret, start);
+	}
+
+	void DeleteMultiData(const CRowIds& rowids, CPack& ret)
+	{
+		uint64_t start = BeginResult(ret, RT_MULTI_AFFECTED_ROWS);
+		ret.Put(static_cast<uint32_t>(rowids.size()));
+		for(size_t i = 0; i < rowids.size(); i++) {
+			try {
+				ret.Put(static_cast<uint8_t>(DeleteRow(GetRowId<IdType>(false, rowids[i]))));
+			}
+			catch(runtime_error& e) {
+				TraceError(e, "Row " + num_to_string(i) + " of the batch failed, the rows before it have been deleted.");
+			}
+		}
+		EndResult(ret, start);
+	}
+
+	void GetMultiData(const CRowIds& rowids, CPack& ret, bool withnames = true)
+	{
+		uint64_t start = MultiGetResultHeader(ret, static_cast<uint32_t>(rowids.size()), withnames);
+		shared_lock<CReadMostlyMutex> lck(Mutex);
+		for(size_t i = 0; i < rowids.size(); i++) {
+			IdType id = GetRowId<IdType>(false, rowids[i]);
+			const char* dp = FindRow(id);
+			if(nullptr == dp) {
+				ret.Put(static_cast<IdType>(0));
+				continue;
+			}
+			ret.Put(id);
+			PutRow(ret, dp, false);
+		}
+		EndResult(ret, start);
+	}
+
+protected:
+	const static uint64_t HEADER_LENGTH = 4096;		/**< 行文件头的字节数，之后为各行 */
+	const static uint64_t EXPIRE_SCAN_FACTOR = 16;	/**< 删除到期数据时每项最多检查的行数 */
+
+	/**
+	 * 行文件头
+	 */
+	struct CHeader {
+		char Magic[8];
+		uint32_t Version;
+		uint32_t Clean;			/**< 是否正常关闭 */
+		uint64_t SlotLength;
+		uint64_t Slots;			/**< 文件中已使用过的行数 */
+		uint64_t Count;			/**< 数据行数 */
+		uint64_t FreeHead;		/**< 空闲行链表的第一行（行号加1），0表示空 */
+		uint64_t FreeSlots;		/**< 空闲行数 */
+		uint8_t AutoInc[16];	/**< 已使用的最大id */
+	};
+
+	/**
+	 * 每行的头部，之后为RowLength字节的行数据
+	 */
+	struct CSlot {
+		uint64_t NextFree;		/**< 空闲时为空闲行链表中的下一行（行号加1） */
+		uint32_t ExpiredTime;	/**< 到期时间（Unix时间，秒），0表示长期有效 */
+		uint8_t Used;
+		uint8_t Reserved[3];
+		uint8_t Id[sizeof(IdType)];
+	};
+
+	/**
+	 * 变长字段在行内的引用
+	 */
+	struct CVarRef {
+		uint64_t Offset;
+		uint32_t Length;
+	};
+
+	/**
+	 * 加锁之前编码的字段：固定长度的字段按位置写入Row，变长字段依次写入Values
+	 */
+	struct CStagedField {
+		bool Set;
+		uint64_t Start;
+		uint32_t Length;
+	};
+	struct CStage {
+		CPack Row;
+		CPack Values;
+		vector<CStagedField> Fields;
+	};
+
+	IdType AutoInc;						/**< 自增id数值 */
+	mutex AutoIncMutex;
+	CReadMostlyMutex Mutex;				/**< 表锁，读取加读锁，修改加写锁 */
+	CMappedFile Rows;
+	CHeader* Header;
+	CDiskHeap Heap;
+	CDiskIndex<IdType> Index;
+	uint64_t SlotLength;				/**< 每行的字节数（头部和行数据，8字节对齐） */
+	vector<uint32_t> FieldLengths;		/**< 各字段在行内的字节数 */
+	bool HasVarFields;
+	uint64_t ExpireCursor;				/**< 下次检查到期数据的行号 */
+	uint64_t Expired;					/**< 删除的到期行数 */
+
+	static inline uint32_t Now() noexcept
+	{
+		return static_cast<uint32_t>(::time(nullptr));
+	}
+
+	inline CSlot* SlotAt(uint64_t slot) noexcept
+	{
+		return reinterpret_cast<CSlot*>(Rows.GetPointer() + HEADER_LENGTH + slot * SlotLength);
+	}
+
+	inline char* RowData(uint64_t slot) noexcept
+	{
+		return reinterpret_cast<char*>(SlotAt(slot)) + sizeof(CSlot);
+	}
+
+	inline bool IsExpired(const CSlot* sp, uint32_t now) const noexcept
+	{
+		return 0 != sp->ExpiredTime && sp->ExpiredTime <= now;
+	}
+
+	/**
+	 * @brief FindRow 数据存在且未到期时返回行数据的地址，调用时持有表锁
+	 */
+	const char* FindRow(IdType id) noexcept
+	{
+		uint64_t slot = Index.find(id);
+		if(CDiskIndex<IdType>::NPOS == slot || IsExpired(SlotAt(slot), Now())) {
+			return nullptr;
+		}
+		return RowData(slot);
+	}
+
+	static inline CVarRef GetRef(const char* dp, uint64_t position) noexcept
+	{
+		CVarRef ref;
+		::memcpy(&ref.Offset, dp + position, sizeof(uint64_t));
+		::memcpy(&ref.Length, dp + position + sizeof(uint64_t), sizeof(uint32_t));
+		return ref;
+	}
+
+	static inline void SetRef(char* dp, uint64_t position, uint64_t offset, uint32_t length) noexcept
+	{
+		::memcpy(dp + position, &offset, sizeof(uint64_t));
+		::memcpy(dp + position + sizeof(uint64_t), &length, sizeof(uint32_t));
+	}
+
+	/**
+	 * @brief StageRow 编码各字段，update为false时为整行（缺少的字段使用默认值），为true时只编码data中有的字段和定义了更新时值的字段
+	 */
+	CStage& StageRow(CFieldMap& data, bool update)
+	{
+		static thread_local CStage stage;
+		stage.Row.Reallocate(RowLength);
+		::memset(stage.Row.GetPointer(), 0, RowLength);
+		stage.Row.SetSize(RowLength);
+		stage.Values.Clear();
+		stage.Fields.assign(FieldNum, CStagedField{false, 0, 0});
+		for(uint16_t i = 1; i < FieldNum; i ++) {
+			const CField& field = Fields[i];
+			auto dit = data.find(field.Name);
+			bool ifexist = dit != data.end();
+			bool defdef = update ? field.OnUpdateDefined : field.DefaultDefined;
+			if(update && !ifexist && !defdef) {
+				continue;
+			}
+			const CAny& defval = update ? field.ValueOnUpdate : field.DefaultValue;
+			CStagedField& staged = stage.Fields[i];
+			if(IsVarField(field.Type)) {
+				staged.Start = stage.Values.GetSize();
+				GetInputValue(stage.Values, ifexist, ifexist ? &dit->second : nullptr, field.Name, field.Type, field.Length, field.Scale, field.Charset, defdef, defval, field.Values);
+				staged.Length = static_cast<uint32_t>(stage.Values.GetSize() - staged.Start);
+			}
+			else {
+				stage.Row.Seek(static_cast<int64_t>(field.Position));
+				GetInputValue(stage.Row, ifexist, ifexist ? &dit->second : nullptr, field.Name, field.Type, field.Length, field.Scale, field.Charset, defdef, defval, field.Values);
+			}
+			staged.Set = true;
+		}
+		return stage;
+	}
+
+	/**
+	 * @brief WriteFields 把编码的字段写入行，变长字段写入堆并释放原来的数据，调用时持有写锁
+	 */
+	void WriteFields(uint64_t slot, CStage& stage)
+	{
+		const char* row = static_cast<const char*>(stage.Row.GetPointer());
+		const char* values = static_cast<const char*>(stage.Values.GetPointer());
+		for(uint16_t i = 1; i < FieldNum; i ++) {
+			const CStagedField& staged = stage.Fields[i];
+			if(!staged.Set) {
+				continue;
+			}
+			const CField& field = Fields[i];
+			if(IsVarField(field.Type)) {
+				uint64_t offset = Heap.allocate(staged.Length);
+				::memcpy(Heap.pointer(offset), values + staged.Start, staged.Length);
+				char* dp = RowData(slot);
+				CVarRef old = GetRef(dp, field.Position);
+				SetRef(dp, field.Position, offset, staged.Length);
+				Heap.free(old.Offset, old.Length);
+			}
+			else {
+				::memcpy(RowData(slot) + field.Position, row + field.Position, FieldLengths[i]);
+			}
+		}
+	}
+
+	/**
+	 * @brief ReleaseFields 释放行中各变长字段的数据
+	 */
+	void ReleaseFields(uint64_t slot) noexcept
+	{
+		if(!HasVarFields) {
+			return;
+		}
+		char* dp = RowData(slot);
+		for(uint16_t i = 1; i < FieldNum; i ++) {
+			const CField& field = Fields[i];
+			if(IsVarField(field.Type)) {
+				CVarRef ref = GetRef(dp, field.Position);
+				Heap.free(ref.Offset, ref.Length);
+				SetRef(dp, field.Position, 0, 0);
+			}
+		}
+	}
+
+	/**
+	 * @brief AllocateSlot 从空闲行链表或文件末尾取得一行，行的内容清零
+	 */
+	uint64_t AllocateSlot()
+	{
+		if(MaxRows > 0 && Header->Count >= MaxRows) {
+			ThrowError(ERR_EXCEED_MAXSIZE, "Reach maximal rows(" + num_to_string(MaxRows) + ") in the table " + Name + ".");
+		}
+		uint64_t slot;
+		if(0 != Header->FreeHead) {
+			slot = Header->FreeHead - 1;
+			Header->FreeHead = SlotAt(slot)->NextFree;
+			Header->FreeSlots--;
+		}
+		else {
+			slot = Header->Slots;
+			uint64_t end = HEADER_LENGTH + (slot + 1) * SlotLength;
+			if(end > Rows.GetSize()) {
+				Rows.Resize(CMappedFile::GrowSize(Rows.GetSize(), end));
+				Header = reinterpret_cast<CHeader*>(Rows.GetPointer());
+			}
+			Header->Slots++;
+		}
+		::memset(SlotAt(slot), 0, SlotLength);
+		return slot;
+	}
+
+	/**
+	 * @brief PushFreeSlot 把行放入空闲行链表
+	 */
+	inline void PushFreeSlot(uint64_t slot) noexcept
+	{
+		CSlot* sp = SlotAt(slot);
+		sp->Used = 0;
+		sp->NextFree = Header->FreeHead;
+		Header->FreeHead = slot + 1;
+		Header->FreeSlots++;
+	}
+
+	/**
+	 * @brief FreeSlot 删除一行，先清除使用标记再删除索引，中途退出时重建索引不会恢复已删除的行
+	 */
+	void FreeSlot(IdType id, uint64_t slot) noexcept
+	{
+		SlotAt(slot)->Used = 0;
+		Index.erase(id);
+		ReleaseFields(slot);
+		PushFreeSlot(slot);
+		Header->Count--;
+	}
+
+	/**
+	 * @brief AddRow 在新的一行写入数据并加入索引，调用时持有写锁
+	 */
+	void AddRow(IdType id, CStage& stage)
+	{
+		uint64_t slot = AllocateSlot();
+		try {
+			WriteFields(slot, stage);
+		}
+		catch(...) {
+			ReleaseFields(slot);
+			PushFreeSlot(slot);
+			throw;
+		}
+		CSlot* sp = SlotAt(slot);
+		::memcpy(sp->Id, &id, sizeof(IdType));
+		sp->ExpiredTime = LifeTime > 0 ? Now() + LifeTime : 0;
+		sp->Used = 1;
+		Index.insert(id, slot);
+		Header->Count++;
+		IdType maxid;
+		::memcpy(&maxid, Header->AutoInc, sizeof(IdType));
+		if(id > maxid) {
+			::memcpy(Header->AutoInc, &id, sizeof(IdType));
+		}
+	}
+
+	/**
+	 * @brief InsertRow 插入一行数据
+	 * @return 插入数据的id
+	 */
+	IdType InsertRow(CFieldMap& data)
+	{
+		auto dit = data.find(RowIdField);
+		IdType id = GetRowId<IdType>(dit == data.end(), dit->second);
+		CStage& stage = StageRow(data, false);
+		unique_lock<CReadMostlyMutex> lck(Mutex);
+		uint64_t slot = Index.find(id);
+		if(CDiskIndex<IdType>::NPOS != slot) {
+			if(!IsExpired(SlotAt(slot), Now())) {
+				ThrowError(ERR_DUPLICATE_ID, "Duplicate rowid:" + num_to_string(static_cast<__uint128_t>(id)) + " when inserting data in the table " + Name + ".");
+				return 0;
+			}
+			FreeSlot(id, slot);
+		}
+		AddRow(id, stage);
+		return id;
+	}
+
+	/**
+	 * @brief UpdateRow 更新一行数据
+	 * @return 数据不存在时返回false
+	 */
+	bool UpdateRow(IdType id, CFieldMap& data)
+	{
+		CStage& stage = StageRow(data, true);
+		unique_lock<CReadMostlyMutex> lck(Mutex);
+		uint64_t slot = Index.find(id);
+		if(CDiskIndex<IdType>::NPOS == slot || IsExpired(SlotAt(slot), Now())) {
+			return false;
+		}
+		WriteFields(slot, stage);
+		if(LifeTime > 0) {
+			SlotAt(slot)->ExpiredTime = Now() + LifeTime;
+		}
+		return true;
+	}
+
+	void ReplaceRow(IdType id, CFieldMap& data)
+	{
+		CStage& stage = StageRow(data, false);
+		unique_lock<CReadMostlyMutex> lck(Mutex);
+		uint64_t slot = Index.find(id);
+		if(CDiskIndex<IdType>::NPOS == slot) {
+			AddRow(id, stage);
+			return;
+		}
+		WriteFields(slot, stage);
+		SlotAt(slot)->ExpiredTime = LifeTime > 0 ? Now() + LifeTime : 0;
+	}
+
+	/**
+	 * @brief DeleteRow 删除一行数据
+	 * @return 数据不存在或已到期时返回false
+	 */
+	bool DeleteRow(IdType id)
+	{
+		unique_lock<CReadMostlyMutex> lck(Mutex);
+		uint64_t slot = Index.find(id);
+		if(CDiskIndex<IdType>::NPOS == slot) {
+			return false;
+		}
+		bool alive = !IsExpired(SlotAt(slot), Now());
+		FreeSlot(id, slot);
+		return alive;
+	}
+
+	/**
+	 * @brief PutRow 按返回给客户端的类型写入各字段的值，withnames为true时每个值之前写入字段名
+	 */
+	void PutRow(CPack& ret, const char* dp, bool withnames)
+	{
+		CPack row(const_cast<char*>(dp), RowLength);
+		row.SetSize(RowLength);
+		for(uint16_t i = 1; i < FieldNum; i ++) {
+			const CField& field = Fields[i];
+			if(withnames) {
+				ret.Put<uint16_t>(field.Name);
+			}
+			if(IsVarField(field.Type)) {
+				CVarRef ref = GetRef(dp, field.Position);
+				CPack value(Heap.pointer(ref.Offset), ref.Length);
+				value.SetSize(ref.Length);
+				PutFieldValue(ret, field, value);
+			}
+			else {
+				row.Seek(static_cast<int64_t>(field.Position));
+				PutFieldValue(ret, field, row);
+			}
+		}
+	}
+
+	/**
+	 * @brief Rebuild 非正常关闭后按各行的使用标记重建索引、空闲行链表和行数，自增id不小于已有的最大id
+	 */
+	void Rebuild()
+	{
+		Index.clear();
+		Header->FreeHead = 0;
+		Header->FreeSlots = 0;
+		Header->Count = 0;
+		IdType maxid;
+		::memcpy(&maxid, Header->AutoInc, sizeof(IdType));
+		for(uint64_t slot = Header->Slots; slot > 0; slot--) {
+			CSlot* sp = SlotAt(slot - 1);
+			if(sp->Used) {
+				IdType id;
+				::memcpy(&id, sp->Id, sizeof(IdType));
+				Index.insert(id, slot - 1);
+				Header->Count++;
+				if(id > maxid) {
+					maxid = id;
+				}
+			}
+			else {
+				PushFreeSlot(slot - 1);
+			}
+		}
+		::memcpy(Header->AutoInc, &maxid, sizeof(IdType));
+		CLog::Instance()->Put(CLog::L_WARNING, "The table " + Name + " wasn't closed normally, rebuilt the index of " + num_to_string(Header->Count) + " rows.");
+	}
+
+	inline IdType MaxIdValue() const noexcept
+	{
+		return num_limits<IdType>::max();
+	}
+
+	void IncreaseAutoInc(void* id) noexcept
+	{
+		lock_guard<mutex> lck(AutoIncMutex);
+		++AutoInc;
+		::memcpy(id, &AutoInc, sizeof(IdType));
+	}
+};
+
+}
@@ -1,244 +1,1071 @@
 #pragma once
 
 #include <vector>
-#include <unordered_map>
+#include <algorithm>
 #include <queue>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <memory>
+#include <thread>
+#include <functional>
 #include "crunningerror.hpp"
 #include "ctime.hpp"
-#include "crandom.hpp"
+#include "ctimerwheel.hpp"
+#include "cmemorybudget.hpp"
+#include "creadmostlymutex.hpp"
+#include "cflathashmap.hpp"
 #include "functions.hpp"
 
 namespace MoonDb {
 
 /**
- * CFixedMap类包含vector和map两个数组，可以同时用T_Key或编号访问元素，主要用于存储字段等，仅当添加或修改数据时才更新过期时间，读取时不修改
+ * CFixedMap类包含行数组和键到行位置的开放寻址哈希表，可以同时用T_Key或编号访问元素，主要用于存储字段等，仅当添加或修改数据时才更新过期时间，读取时不修改。
+ * 键按哈希分为STRIPES个分段，每个分段有自己的键表、读多写少的读写锁和序列号，不同分段的读写可以并行：
+ * 读取（copy）加分段读锁，按序列号乐观复制行数据，有并发修改时重试，读者之间不修改共享的缓存行；
+ * 修改已有数据（update）加分段读锁和分段的写互斥锁，修改前后各增加一次序列号；
+ * 添加、删除等改变键表的操作加分段写锁；
+ * 需要较长时间读取一行（例如直接从行数据发送）时用pin标记该行后不持有锁读取，标记期间修改该行的写者先把行复制到新位置（写时复制），
+ * 删除的行在读者结束后才回收位置。
+ * 行数据按位置分段存放，每段SegmentRows行，扩容时只分配新的段，已有的行不移动，行地址在删除或写时复制之前保持不变；
+ * 只有达到最大行数需要清理全部过期数据时才锁定全部分段。
+ * 有生存期的数据添加时放入时间轮，由后台线程调用expire分批删除到期的数据。
+ * 指定内存预算时，添加数据超过预算或达到最大行数时按预算的淘汰策略从随机分段中抽样淘汰一行，读取时只在行的键表项中记录访问信息。
+ * snapshot导出某一时刻的一致数据：尚未导出的分段中的数据被修改之前由修改者保存原数据（按键写时复制），不需要暂停写入
  */
 template <typename T_Key>
 class CFixedMap
 {
 public:
-	CFixedMap() noexcept : Size(0), Capacity(0), MaxSize(0), RowLength(0), Contents(nullptr), IfCollectGarbage(false)
+	const static uint32_t STRIPES = 64;				/**< 分段数，必须为2的幂 */
+	const static uint64_t SEGMENT_BYTES = 1 << 20;	/**< 每段行数据的目标字节数 */
+	const static uint64_t MAX_SEGMENT_ROWS = 65536;	/**< 每段最多行数 */
+	const static uint32_t POSITION_BITS = 40;		/**< 行位置的位数，最多2^40行 */
+	const static uint64_t SNAPSHOT_BATCH = 4096;	/**< 快照每次加锁遍历的键表位置数 */
+
+	CFixedMap() noexcept : Size(0), Capacity(0), MaxSize(0), RowLength(0), SegmentShift(0), SegmentMask(0),
+		Segments(nullptr), SegmentNum(0), SegmentCapacity(0), IfCollectGarbage(false), Count(0), Generation(0),
+		Budget(nullptr), RowBytes(0), Evicted(0), Expired(0), SnapshotTime(0), SnapshotCopies(0)
 	{}
 
-	CFixedMap(uint64_t maxsize, uint64_t rowlength, uint64_t capacity)
+	CFixedMap(uint64_t maxsize, uint64_t rowlength, uint64_t capacity, CMemoryBudget* budget = nullptr) : CFixedMap()
 	{
-		initialize(maxsize, rowlength, capacity);
+		initialize(maxsize, rowlength, capacity, budget);
 	}
 
+	CFixedMap(const CFixedMap&) = delete;
+	CFixedMap& operator=(const CFixedMap&) = delete;
+
 	~CFixedMap() noexcept
 	{
-		free(Contents);
+		if(nullptr != Budget) {
+			Budget->Release(Count * RowBytes);
+		}
+		FreeSegments();
 	}
 
-	inline void initialize(uint64_t maxsize, uint64_t rowlength, uint64_t capacity)
+	/**
+	 * @param budget 内存预算，为nullptr表示不计入预算、不淘汰
+	 */
+	inline void initialize(uint64_t maxsize, uint64_t rowlength, uint64_t capacity, CMemoryBudget* budget = nullptr)
 	{
+		if(nullptr != Budget) {
+			Budget->Release(Count * RowBytes);
+		}
+		FreeSegments();
+		Budget = budget;
+		// 每行计入预算的字节数：行数据加键表中的一项（含控制位）
+		RowBytes = rowlength + sizeof(T_Key) + sizeof(CValue) + 1;
+		Evicted = 0;
+		Expired = 0;
 		Size = 0;
-		MaxSize = maxsize;
+		Capacity = 0;
+		MaxSize = std::min(maxsize, static_cast<uint64_t>(1) << POSITION_BITS);
 		RowLength = rowlength;
-		Capacity = capacity;
 		IfCollectGarbage = false;
-		Contents = ::malloc(uint64_t(capacity) * uint64_t(rowlength));
-		if(nullptr == Contents) {
-			ThrowError(ERR_MEMORY_ALLOCATE, "CFixedMap failed to allocate " + num_to_string(uint64_t(capacity) * uint64_t(rowlength)) + " bytes.");
+		Count = 0;
+		Expiries.initialize(CTime::Now(), CTime::NanoTime / 1000);
+		// 每段行数为2的幂，位置右移SegmentShift位即为段号
+		SegmentShift = 0;
+		while(SegmentShift < 63 && (2ULL << SegmentShift) <= MAX_SEGMENT_ROWS && (2ULL << SegmentShift) * rowlength <= SEGMENT_BYTES) {
+			SegmentShift++;
+		}
+		SegmentMask = (1ULL << SegmentShift) - 1;
+		capacity = std::min(capacity, MaxSize);
+		while(Capacity < capacity) {
+			AddSegment();
 		}
 	}
 
-	inline void reserve(uint64_t capacity)
+	/**
+	 * @brief copy 乐观读取：把行数据复制到buffer（长度至少为RowLength），复制期间数据被修改则重新复制
+	 * @return 数据是否存在，已过期视为不存在
+	 */
+	inline bool copy(const T_Key& key, void* buffer) const
 	{
-		capacity = std::min(capacity, MaxSize);
-		if(capacity == MaxSize && Capacity == MaxSize) {
-			ThrowError(ERR_MEMORY_ALLOCATE, "Reach maximal rows(" + num_to_string(uint64_t(capacity)) + ") in the class CFixedMap.");
-			return;
+		const CStripe& stripe = GetStripe(key);
+		std::shared_lock<CReadMostlyMutex> lck(stripe.Mutex);
+		const CValue* value = stripe.Keys.find(key);
+		if(nullptr == value) {
+			return false;
 		}
-		if(capacity > Capacity) {
-			void* more_mem = ::realloc(Contents, uint64_t(capacity) * uint64_t(RowLength));
-			if(nullptr == more_mem) {
-				ThrowError(ERR_MEMORY_ALLOCATE, "Reallocate memory (function::realloc, " + num_to_string(uint64_t(capacity) * uint64_t(RowLength)) + ") in the class CFixedMap failed.");
-				return;
+		while(true) {
+			uint64_t seq = stripe.Sequence.load(std::memory_order_acquire);
+			if(seq & 1) {
+				std::this_thread::yield();
+				continue;
+			}
+			std::chrono::high_resolution_clock::rep expiredtime = value->ExpiredTime.load(std::memory_order_relaxed);
+			// 行位置在写时复制时由update改变，与行数据一起由序列号校验
+			::memcpy(buffer, GetRowPointer(value->Position), RowLength);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if(stripe.Sequence.load(std::memory_order_relaxed) == seq) {
+				if(nullptr != Budget) {
+					Budget->Touch(value->Access);
+				}
+				// 读取时不删除过期数据，由之后的写操作或清理回收
+				return expiredtime <= 0 || expiredtime > CTime::Now();
 			}
-			Contents = more_mem;
-			Capacity = capacity;
 		}
 	}
 
-	inline void* at(const T_Key& key)
+	/**
+	 * @brief find 加锁读取：持有分段的写互斥锁调用func(const void* row)，期间行数据不会被修改，数据不存在或已过期时不调用
+	 * @return 数据是否存在
+	 */
+	template <typename T_Func>
+	inline bool find(const T_Key& key, T_Func func) const
 	{
-		auto it = Keys.find(key);
-		if(it != Keys.end()) {
-			if(0 == it->second.ExpiredTime || it->second.ExpiredTime > CTime::Now()) {
-				return GetRowPointer(it->second.Position);
-			}
-			else {
-				Delete(it);
-			}
+		const CStripe& stripe = GetStripe(key);
+		std::shared_lock<CReadMostlyMutex> lck(stripe.Mutex);
+		const CValue* value = stripe.Keys.find(key);
+		if(nullptr == value) {
+			return false;
+		}
+		std::lock_guard<std::mutex> wlck(stripe.WriteMutex);
+		if(IsExpired(*value, CTime::Now())) {
+			return false;
 		}
-		return nullptr;
+		if(nullptr != Budget) {
+			Budget->Touch(value->Access);
+		}
+		func(static_cast<const void*>(GetRowPointer(value->Position)));
+		return true;
 	}
 
-	inline const void* at(const T_Key& key) const
+	/**
+	 * @brief pin 不持有锁读取：在分段的写互斥锁内标记该行，之后不持有任何锁调用func(const void* row)，返回后取消标记；
+	 * 期间修改该行的写者改为修改副本，删除后行位置也不会被重新使用，func读到的行数据不变
+	 * @return 数据是否存在，不存在或已过期时不调用func
+	 */
+	template <typename T_Func>
+	inline bool pin(const T_Key& key, T_Func func)
 	{
-		auto it = Keys.find(key);
-		if(it != Keys.end()) {
-			if(0 == it->second.ExpiredTime || it->second.ExpiredTime > CTime::Now()) {
-				return GetRowPointer(it->second.Position);
+		CStripe& stripe = GetStripe(key);
+		uint64_t pos;
+		{
+			std::shared_lock<CReadMostlyMutex> lck(stripe.Mutex);
+			const CValue* value = stripe.Keys.find(key);
+			if(nullptr == value) {
+				return false;
+			}
+			std::lock_guard<std::mutex> wlck(stripe.WriteMutex);
+			if(IsExpired(*value, CTime::Now())) {
+				return false;
+			}
+			if(nullptr != Budget) {
+				Budget->Touch(value->Access);
 			}
+			pos = value->Position;
+			stripe.Pins.emplace(pos, CPin{0, false}).first->Readers++;
 		}
-		return nullptr;
+		try {
+			func(static_cast<const void*>(GetRowPointer(pos)));
+		}
+		catch(...) {
+			Unpin(stripe, pos);
+			throw;
+		}
+		Unpin(stripe, pos);
+		return true;
 	}
 
-	inline void* operator [](const T_Key& key)
+	/**
+	 * @brief update 调用func(void* row)修改已存在的数据，并更新过期时间
+	 * @return 数据不存在时返回false
+	 */
+	template <typename T_Func>
+	inline bool update(const T_Key& key, uint32_t lifetime, T_Func func)
 	{
-		return at(key);
+		CStripe& stripe = GetStripe(key);
+		while(true) {
+			{
+				std::shared_lock<CReadMostlyMutex> lck(stripe.Mutex);
+				CValue* value = stripe.Keys.find(key);
+				if(nullptr == value) {
+					return false;
+				}
+				std::lock_guard<std::mutex> wlck(stripe.WriteMutex);
+				Preserve(stripe, key);
+				CWriteSequence wseq(stripe.Sequence);
+				if(Unshare(stripe, key, *value)) {
+					value->ExpiredTime.store(lifetime > 0 ? CTime::Now() + lifetime * CTime::NanoTime : 0, std::memory_order_relaxed);
+					if(nullptr != Budget) {
+						Budget->Touch(value->Access);
+					}
+					func(GetRowPointer(value->Position));
+					return true;
+				}
+			}
+			// 行被pin又没有空闲位置复制，等读者结束
+			std::this_thread::yield();
+		}
 	}
 
-	inline const void* operator [](const T_Key& key) const
+	/**
+	 * @brief insert 添加数据，在分段写锁内调用func(void* row)写入新行，func抛出异常时不添加
+	 * @return 数据已存在时返回false
+	 */
+	template <typename T_Func>
+	inline bool insert(const T_Key& key, uint32_t lifetime, T_Func func)
 	{
-		return at(key);
+		if(lifetime > 0) {
+			IfCollectGarbage = true;
+		}
+		std::chrono::high_resolution_clock::rep expiredtime = lifetime > 0 ? CTime::Now() + lifetime * CTime::NanoTime : 0;
+		while(true) {
+			{
+				CStripe& stripe = GetStripe(key);
+				std::unique_lock<CReadMostlyMutex> lck(stripe.Mutex);
+				if(nullptr != stripe.Keys.find(key)) {
+					return false;
+				}
+				Preserve(stripe, key);
+				uint64_t pos;
+				if(!OverBudget() && Allocate(pos)) {
+					Emplace(stripe, key, pos, expiredtime);
+					try {
+						func(GetRowPointer(pos));
+					}
+					catch(...) {
+						Delete(stripe, key, pos);
+						throw;
+					}
+					return true;
+				}
+			}
+			MakeRoom();
+		}
 	}
 
-	inline void* insert(const T_Key& key, uint32_t lifetime = 0)
+	/**
+	 * @brief replace 数据存在时更新过期时间，不存在时添加，之后在分段写锁内调用func(void* row)写入整行
+	 */
+	template <typename T_Func>
+	inline void replace(const T_Key& key, uint32_t lifetime, T_Func func)
 	{
 		if(lifetime > 0) {
 			IfCollectGarbage = true;
 		}
-		auto it = Keys.find(key);
-		if(it != Keys.end()) {
-			return nullptr;
-		}
-		else {
-			uint64_t pos = 0;
-			if(IfCollectGarbage && (CRandom()(0, 1000) == 500 || (Deleted.empty() && Size == MaxSize))) {
-				collect_garbage();
-			}
-			std::chrono::high_resolution_clock::rep expiredtime = lifetime > 0 ? CTime::Now() + lifetime * CTime::NanoTime : 0;
-			if(Deleted.empty()) {
-				if(Capacity == Size) {
-					reserve(static_cast<uint64_t>(::ceil(Size + 1) * 1.5));
+		std::chrono::high_resolution_clock::rep expiredtime = lifetime > 0 ? CTime::Now() + lifetime * CTime::NanoTime : 0;
+		while(true) {
+			bool pinned = false;
+			{
+				CStripe& stripe = GetStripe(key);
+				std::unique_lock<CReadMostlyMutex> lck(stripe.Mutex);
+				Preserve(stripe, key);
+				CValue* value = stripe.Keys.find(key);
+				uint64_t pos;
+				if(nullptr != value) {
+					if(Unshare(stripe, key, *value)) {
+						value->ExpiredTime.store(expiredtime, std::memory_order_relaxed);
+						if(nullptr != Budget) {
+							Budget->Touch(value->Access);
+						}
+						func(GetRowPointer(value->Position));
+						return;
+					}
+					pinned = true;
 				}
-				pos = Size;
-				Keys.emplace(key, CValue(Size, expiredtime));
-				Size++;
+				else if(!OverBudget() && Allocate(pos)) {
+					Emplace(stripe, key, pos, expiredtime);
+					try {
+						func(GetRowPointer(pos));
+					}
+					catch(...) {
+						Delete(stripe, key, pos);
+						throw;
+					}
+					return;
+				}
+			}
+			if(pinned) {
+				std::this_thread::yield();
 			}
 			else {
-				pos = Deleted.front();
-				Deleted.pop();
-				Keys.emplace(key, CValue(pos, expiredtime));
+				MakeRoom();
 			}
-			return GetRowPointer(pos);
 		}
 	}
 
-	inline void* update(const T_Key& key, uint32_t lifetime = 0)
-	{
-		auto it = Keys.find(key);
-		if(it != Keys.end()) {
-			it->second.ExpiredTime = lifetime > 0 ? CTime::Now() + lifetime * CTime::NanoTime : 0;
-			return GetRowPointer(it->second.Position);
-		}
-		else {
-			return nullptr;
-		}
-	}
+	/**
+	 * 批量修改的一项
+	 */
+	struct CBatchItem {
+		T_Key Key;
+		uint32_t Stripe;		/**< 分段号，由replace_batch设置 */
+		uint32_t LifeTime;
+		bool Erase;				/**< 为true时删除，否则与replace相同 */
+		uint64_t Offset;		/**< 调用者使用的数据位置 */
+		uint64_t Length;		/**< 调用者使用的数据字节数 */
+	};
 
-	inline void* replace(const T_Key& key, uint32_t lifetime = 0)
+	/**
+	 * @brief replace_batch 按顺序替换或删除items中的各项：按分段稳定排序后每个分段只加一次写锁，同一个键的修改顺序不变；
+	 * 替换时在分段写锁内调用func(const CBatchItem& item, void* row)写入整行，用于打开表时重放日志
+	 */
+	template <typename T_Func>
+	void replace_batch(std::vector<CBatchItem>& items, T_Func func)
 	{
-		if(lifetime > 0) {
-			IfCollectGarbage = true;
-		}
-		uint64_t pos;
-		std::chrono::high_resolution_clock::rep expiredtime = lifetime > 0 ? CTime::Now() + lifetime * CTime::NanoTime : 0;
-		auto it = Keys.find(key);
-		if(it != Keys.end()) {
-			pos = it->second.Position;
-			it->second.ExpiredTime = expiredtime;
-		}
-		else {
-			if(IfCollectGarbage && (CRandom()(0, 1000) == 500 || (Deleted.empty() && Size == MaxSize))) {
-				collect_garbage();
+		for(size_t i = 0; i < items.size(); i++) {
+			items[i].Stripe = StripeIndex(items[i].Key);
+			if(!items[i].Erase && items[i].LifeTime > 0) {
+				IfCollectGarbage = true;
 			}
-			if(Deleted.empty()) {
-				if(Capacity == Size) {
-					reserve(static_cast<uint64_t>(::ceil(Size + 1) * 1.5));
+		}
+		std::stable_sort(items.begin(), items.end(), [](const CBatchItem& a, const CBatchItem& b) {
+			return a.Stripe < b.Stripe;
+		});
+		auto timestamp = CTime::Now();
+		for(size_t i = 0; i < items.size();) {
+			CStripe& stripe = Stripes[items[i].Stripe];
+			bool full = false;
+			bool pinned = false;
+			{
+				std::unique_lock<CReadMostlyMutex> lck(stripe.Mutex);
+				for(; i < items.size() && &Stripes[items[i].Stripe] == &stripe; i++) {
+					const CBatchItem& item = items[i];
+					Preserve(stripe, item.Key);
+					CValue* value = stripe.Keys.find(item.Key);
+					if(item.Erase) {
+						if(nullptr != value) {
+							Delete(stripe, item.Key, value->Position);
+						}
+						continue;
+					}
+					std::chrono::high_resolution_clock::rep expiredtime = item.LifeTime > 0 ? timestamp + item.LifeTime * CTime::NanoTime : 0;
+					if(nullptr != value) {
+						if(!Unshare(stripe, item.Key, *value)) {
+							pinned = true;
+							break;
+						}
+						value->ExpiredTime.store(expiredtime, std::memory_order_relaxed);
+						func(item, GetRowPointer(value->Position));
+						continue;
+					}
+					uint64_t pos;
+					if(OverBudget() || !Allocate(pos)) {
+						full = true;
+						break;
+					}
+					Emplace(stripe, item.Key, pos, expiredtime);
+					try {
+						func(item, GetRowPointer(pos));
+					}
+					catch(...) {
+						Delete(stripe, item.Key, pos);
+						throw;
+					}
 				}
-				pos = Size;
-				Keys.emplace(key, CValue(Size, expiredtime));
-				Size++;
 			}
-			else {
-				pos = Deleted.front();
-				Deleted.pop();
-				Keys.emplace(key, CValue(pos, expiredtime));
+			if(pinned) {
+				std::this_thread::yield();
+			}
+			else if(full) {
+				MakeRoom();
 			}
 		}
-
-		return GetRowPointer(pos);
 	}
 
 	inline size_t size() const noexcept
 	{
-		return Keys.size();
+		return Count;
 	}
 
 	inline bool empty() const noexcept
 	{
-		return Keys.size() == 0;
+		return 0 == Count;
+	}
+
+	/**
+	 * @brief set_releaser 设置删除行（包括淘汰和到期）时调用的函数，用于释放行中引用的其他内存；
+	 * 设置后新行在写入前清零。调用时持有该行所在分段的写锁，行位置尚未回收
+	 */
+	inline void set_releaser(const std::function<void(void*)>& releaser)
+	{
+		Releaser = releaser;
+	}
+
+	/**
+	 * @brief capacity 已分配的行数
+	 */
+	inline uint64_t capacity()
+	{
+		std::lock_guard<std::mutex> slotlck(SlotMutex);
+		return Capacity;
+	}
+
+	/**
+	 * @brief row_bytes 每行计入内存预算的字节数
+	 */
+	inline uint64_t row_bytes() const noexcept
+	{
+		return RowBytes;
+	}
+
+	/**
+	 * @brief evicted 因超过内存预算或最大行数被淘汰的行数
+	 */
+	inline uint64_t evicted() const noexcept
+	{
+		return Evicted;
+	}
+
+	/**
+	 * @brief expired 到期被删除的行数
+	 */
+	inline uint64_t expired() const noexcept
+	{
+		return Expired;
 	}
 
 	inline bool erase(const T_Key& key)
 	{
-		auto it = Keys.find(key);
-		if(it != Keys.end()) {
-			Delete(it);
-			return true;
+		CStripe& stripe = GetStripe(key);
+		std::unique_lock<CReadMostlyMutex> lck(stripe.Mutex);
+		const CValue* value = stripe.Keys.find(key);
+		if(nullptr == value) {
+			return false;
 		}
-		return false;
+		Delete(stripe, key, value->Position);
+		return true;
 	}
 
-	inline void collect_garbage()
+	/**
+	 * @brief erase 删除数据，删除之前在分段写锁内调用func(const void* row)，用于记录日志
+	 * @return 数据不存在时返回false
+	 */
+	template <typename T_Func>
+	inline bool erase(const T_Key& key, T_Func func)
 	{
+		CStripe& stripe = GetStripe(key);
+		std::unique_lock<CReadMostlyMutex> lck(stripe.Mutex);
+		const CValue* value = stripe.Keys.find(key);
+		if(nullptr == value) {
+			return false;
+		}
+		func(static_cast<const void*>(GetRowPointer(value->Position)));
+		Delete(stripe, key, value->Position);
+		return true;
+	}
+
+	/**
+	 * @brief for_each 对第stripe个分段中未过期的数据调用func(const T_Key& key, const void* row, expiredtime)，
+	 * 持有该分段的读锁和写互斥锁，期间该分段的数据不会被修改，其他分段不受影响
+	 */
+	template <typename T_Func>
+	inline void for_each(uint32_t stripe, T_Func func) const
+	{
+		const CStripe& s = Stripes[stripe];
+		std::shared_lock<CReadMostlyMutex> lck(s.Mutex);
+		std::lock_guard<std::mutex> wlck(s.WriteMutex);
 		auto timestamp = CTime::Now();
-		for(auto it = Keys.begin(); it != Keys.end();) {
-			if(it->second.ExpiredTime > 0 && it->second.ExpiredTime <= timestamp) {
-				Deleted.emplace(it->second.Position);
-				auto del_it = it;
-				it++;
-				Keys.erase(del_it);
+		s.Keys.for_each([&](const T_Key& key, const CValue& value) {
+			if(!IsExpired(value, timestamp)) {
+				func(key, static_cast<const void*>(GetRowPointer(value.Position)), value.ExpiredTime.load(std::memory_order_relaxed));
 			}
-			else {
-				++it;
+		});
+	}
+
+	/**
+	 * @brief snapshot 导出开始时刻的一致数据，期间可以正常读写：开始时短暂锁定全部分段，之后逐个分段分批遍历，每批只持有该分段的读锁和写互斥锁；
+	 * 未导出的分段中的数据第一次被修改（包括删除、淘汰和到期）之前，由修改者调用encode保存开始时刻的数据，开始之后添加的键不导出。
+	 * 开始时未过期的数据由encode(const T_Key& key, const void* row, expiredtime, std::string& out)追加到缓冲区，
+	 * 每批之后不持有锁调用write(const std::string& data)，同时只能有一个快照
+	 * @return 由修改者保存的行数
+	 */
+	template <typename T_Write>
+	uint64_t snapshot(const std::function<void(const T_Key&, const void*, std::chrono::high_resolution_clock::rep, std::string&)>& encode, T_Write write)
+	{
+		std::lock_guard<std::mutex> snapshotlck(SnapshotMutex);
+		for(uint32_t i = 0; i < STRIPES; i++) {
+			Stripes[i].Mutex.lock();
+		}
+		try {
+			SnapshotEncoder = encode;
+			SnapshotTime = CTime::Now();
+			SnapshotCopies = 0;
+			for(uint32_t i = 0; i < STRIPES; i++) {
+				Stripes[i].SnapshotKeys.reset(new CSnapshotKeys);
 			}
 		}
+		catch(...) {
+			for(uint32_t i = STRIPES; i > 0; i--) {
+				Stripes[i - 1].SnapshotKeys.reset();
+				Stripes[i - 1].Mutex.unlock();
+			}
+			throw;
+		}
+		for(uint32_t i = STRIPES; i > 0; i--) {
+			Stripes[i - 1].Mutex.unlock();
+		}
+		std::string buffer;
+		try {
+			for(uint32_t i = 0; i < STRIPES; i++) {
+				CStripe& stripe = Stripes[i];
+				uint64_t cursor = 0;
+				uint64_t resizes = 0;
+				bool done = false;
+				while(!done) {
+					{
+						std::shared_lock<CReadMostlyMutex> lck(stripe.Mutex);
+						std::lock_guard<std::mutex> wlck(stripe.WriteMutex);
+						// 键表重新分配后各键的位置改变，从头遍历，已导出的键有记录，不会重复
+						if(0 == cursor || stripe.Keys.resizes() != resizes) {
+							cursor = 0;
+							resizes = stripe.Keys.resizes();
+						}
+						cursor = stripe.Keys.for_each(cursor, SNAPSHOT_BATCH, [&](const T_Key& key, const CValue& value) {
+							// 已记录的键在开始之后被修改过（已保存原数据）或者是之后添加的
+							if(!IsExpired(value, SnapshotTime) && nullptr == stripe.SnapshotKeys->find(key)) {
+								encode(key, GetRowPointer(value.Position), value.ExpiredTime.load(std::memory_order_relaxed), buffer);
+								stripe.SnapshotKeys->emplace(key, SK_DUMPED);
+							}
+						});
+						if(cursor >= stripe.Keys.capacity()) {
+							buffer.append(stripe.SnapshotImages);
+							std::string().swap(stripe.SnapshotImages);
+							stripe.SnapshotKeys.reset();
+							done = true;
+						}
+					}
+					write(static_cast<const std::string&>(buffer));
+					buffer.clear();
+				}
+			}
+		}
+		catch(...) {
+			for(uint32_t i = 0; i < STRIPES; i++) {
+				std::unique_lock<CReadMostlyMutex> lck(Stripes[i].Mutex);
+				std::string().swap(Stripes[i].SnapshotImages);
+				Stripes[i].SnapshotKeys.reset();
+			}
+			SnapshotEncoder = nullptr;
+			throw;
+		}
+		SnapshotEncoder = nullptr;
+		return SnapshotCopies;
+	}
+
+	/**
+	 * @brief expire 从时间轮中取出到期的项并删除仍然过期的数据，过期时间已被延长的重新放入时间轮
+	 * @param limit 最多取出的项数（同一毫秒到期的项总是全部取出）
+	 * @return 取出的项数，不小于limit时可能还有到期的项
+	 */
+	inline size_t expire(size_t limit)
+	{
+		if(!IfCollectGarbage) {
+			return 0;
+		}
+		std::vector<CExpiry> due;
+		{
+			std::lock_guard<std::mutex> lck(ExpiryMutex);
+			Expiries.update(CTime::Now());
+			Expiries.expire([&due](const CExpiry& expiry, int64_t) {
+				due.push_back(expiry);
+			}, limit);
+		}
+		if(due.empty()) {
+			return 0;
+		}
+		// 按分段排序，每个分段只加一次写锁
+		std::sort(due.begin(), due.end(), [this](const CExpiry& a, const CExpiry& b) {
+			return StripeIndex(a.Key) < StripeIndex(b.Key);
+		});
+		std::vector<std::pair<CExpiry, std::chrono::high_resolution_clock::rep>> later;
+		auto timestamp = CTime::Now();
+		for(size_t i = 0; i < due.size();) {
+			CStripe& stripe = GetStripe(due[i].Key);
+			std::unique_lock<CReadMostlyMutex> lck(stripe.Mutex);
+			for(; i < due.size() && &GetStripe(due[i].Key) == &stripe; i++) {
+				const CValue* value = stripe.Keys.find(due[i].Key);
+				// 数据已删除，或者删除后又添加了同一个键（新数据另有一项）
+				if(nullptr == value || value->Tag() != due[i].Tag) {
+					continue;
+				}
+				std::chrono::high_resolution_clock::rep expiredtime = value->ExpiredTime.load(std::memory_order_relaxed);
+				if(expiredtime > timestamp) {
+					later.emplace_back(due[i], expiredtime);
+				}
+				else if(expiredtime > 0) {
+					Delete(stripe, due[i].Key, value->Position);
+					Expired++;
+				}
+			}
+		}
+		if(!later.empty()) {
+			std::lock_guard<std::mutex> lck(ExpiryMutex);
+			for(size_t i = 0; i < later.size(); i++) {
+				Expiries.schedule(later[i].first, later[i].second);
+			}
+		}
+		return due.size();
+	}
+
+	/**
+	 * @brief collect_garbage 逐个分段清理过期数据
+	 */
+	inline void collect_garbage()
+	{
+		auto timestamp = CTime::Now();
+		for(uint32_t i = 0; i < STRIPES; i++) {
+			std::unique_lock<CReadMostlyMutex> lck(Stripes[i].Mutex);
+			CollectGarbage(Stripes[i], timestamp);
+		}
 	}
 
 protected:
 	struct CValue {
-		uint64_t Position;
-		std::chrono::high_resolution_clock::rep ExpiredTime;
-		CValue() = default;
-		CValue(uint64_t pos, std::chrono::high_resolution_clock::rep exptime)
-			: Position(pos), ExpiredTime(exptime) {}
+		uint64_t Position : POSITION_BITS;
+		uint64_t Generation : 64 - POSITION_BITS;	/**< 添加时的编号，区分删除后又添加的同一个键 */
+		std::atomic<std::chrono::high_resolution_clock::rep> ExpiredTime;	/**< update时修改，与乐观读取并发 */
+		mutable std::atomic<uint32_t> Access;		/**< 淘汰策略的访问信息，读取时修改 */
+		CValue(uint64_t pos, uint64_t generation, std::chrono::high_resolution_clock::rep exptime, uint32_t access)
+			: Position(pos), Generation(generation), ExpiredTime(exptime), Access(access) {}
+		// 哈希表扩容时复制，此时持有分段写锁
+		CValue(const CValue& v)
+			: Position(v.Position), Generation(v.Generation), ExpiredTime(v.ExpiredTime.load(std::memory_order_relaxed)),
+			  Access(v.Access.load(std::memory_order_relaxed)) {}
+		inline uint64_t Tag() const noexcept
+		{
+			return static_cast<uint64_t>(Generation) << POSITION_BITS | Position;
+		}
+	};
+	/**
+	 * 时间轮中的项，Tag与键表中的不同时表示该项已失效
+	 */
+	struct CExpiry {
+		T_Key Key;
+		uint64_t Tag;
+		CExpiry(const T_Key& key, uint64_t tag) : Key(key), Tag(tag)
+		{}
+	};
+	typedef CFlatHashMap<T_Key, CValue> CKeys;
+	/**
+	 * 快照期间已处理的键
+	 */
+	enum SnapshotKeyState : uint8_t {
+		SK_DUMPED,		/**< 已由快照导出 */
+		SK_SAVED,		/**< 修改前已保存开始时刻的数据 */
+		SK_ABSENT		/**< 开始时不存在或已过期 */
+	};
+	typedef CFlatHashMap<T_Key, uint8_t> CSnapshotKeys;
+	/**
+	 * 被pin的行位置
+	 */
+	struct CPin {
+		uint32_t Readers;	/**< 正在读取的读者数 */
+		bool Retired;		/**< 该位置已不属于任何键（已复制或删除），最后一个读者结束时回收 */
 	};
-	std::unordered_map<T_Key, CValue> Keys;
+	typedef CFlatHashMap<uint64_t, CPin> CPins;
+	struct CStripe {
+		mutable CReadMostlyMutex Mutex;				/**< 改变键表时加写锁，其他操作加读锁 */
+		mutable std::mutex WriteMutex;				/**< 修改已有行数据的互斥锁 */
+		std::atomic<uint64_t> Sequence{0};			/**< 序列号，为奇数时行数据正在被修改 */
+		CKeys Keys;
+		std::unique_ptr<CSnapshotKeys> SnapshotKeys;	/**< 快照尚未导出该分段时不为空，记录已处理的键 */
+		std::string SnapshotImages;					/**< 修改者保存的开始时刻的数据，导出该分段时追加在最后 */
+		CPins Pins;									/**< 被pin的行位置，持有分段写锁，或者读锁和写互斥锁时访问 */
+	};
+	/**
+	 * 修改行数据期间序列号为奇数，结束（包括抛出异常）时恢复为偶数
+	 */
+	struct CWriteSequence {
+		std::atomic<uint64_t>& Sequence;
+		uint64_t Start;
+		CWriteSequence(std::atomic<uint64_t>& seq) noexcept : Sequence(seq), Start(seq.load(std::memory_order_relaxed))
+		{
+			Sequence.store(Start + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+		}
+		~CWriteSequence() noexcept
+		{
+			Sequence.store(Start + 2, std::memory_order_release);
+		}
+	};
+	CStripe Stripes[STRIPES];
+	std::mutex SlotMutex;					/**< 分配和回收行位置（Size、Deleted）以及分配新段的互斥锁 */
 	std::queue<uint64_t> Deleted;
 	uint64_t Size;
 	uint64_t Capacity;
 	uint64_t MaxSize;
 	uint64_t RowLength;
-	void* Contents;
-	bool IfCollectGarbage;
+	uint32_t SegmentShift;					/**< 每段行数的位数 */
+	uint64_t SegmentMask;
+	std::atomic<void**> Segments;			/**< 段地址数组，满时换为两倍大小的新数组 */
+	uint64_t SegmentNum;
+	uint64_t SegmentCapacity;
+	std::vector<void**> RetiredSegments;	/**< 换下的段地址数组，读者可能仍在使用，析构时释放 */
+	std::atomic<bool> IfCollectGarbage;		/**< 是否有带生存期的数据 */
+	std::atomic<uint64_t> Count;			/**< 数据条数 */
+	std::atomic<uint64_t> Generation;
+	std::mutex ExpiryMutex;					/**< 时间轮的互斥锁，持有分段锁时可以加锁，反之不行 */
+	CTimerWheel<CExpiry> Expiries;			/**< 带生存期数据的到期时间，精度1毫秒 */
+	CMemoryBudget* Budget;					/**< 内存预算，为nullptr时不淘汰 */
+	uint64_t RowBytes;						/**< 每行计入预算的字节数 */
+	std::atomic<uint64_t> Evicted;			/**< 淘汰的行数 */
+	std::atomic<uint64_t> Expired;			/**< 到期删除的行数 */
+	std::function<void(void*)> Releaser;	/**< 删除行时释放行中引用的内存 */
+	std::mutex SnapshotMutex;				/**< 同时只能有一个快照 */
+	std::function<void(const T_Key&, const void*, std::chrono::high_resolution_clock::rep, std::string&)> SnapshotEncoder;
+	std::chrono::high_resolution_clock::rep SnapshotTime;	/**< 快照开始的时间，此时已过期的数据不导出 */
+	std::atomic<uint64_t> SnapshotCopies;	/**< 快照期间修改者保存的行数 */
+
+	inline CStripe& GetStripe(const T_Key& key) noexcept
+	{
+		return Stripes[StripeIndex(key)];
+	}
+
+	inline const CStripe& GetStripe(const T_Key& key) const noexcept
+	{
+		return Stripes[StripeIndex(key)];
+	}
+
+	inline uint32_t StripeIndex(const T_Key& key) const noexcept
+	{
+		// 取哈希值的最高位，哈希表内部使用低位
+		return static_cast<uint32_t>(CFlatHash<T_Key>()(key) >> 58) & (STRIPES - 1);
+	}
+
+	/**
+	 * @brief Preserve 添加、修改或删除键对应的数据之前调用，调用时持有分段的写锁，或者读锁和写互斥锁：
+	 * 快照尚未导出该分段并且该键还没有处理过时，保存开始时刻的数据，开始时不存在的键记录为不导出
+	 */
+	inline void Preserve(CStripe& stripe, const T_Key& key)
+	{
+		if(nullptr == stripe.SnapshotKeys || nullptr != stripe.SnapshotKeys->find(key)) {
+			return;
+		}
+		const CValue* value = stripe.Keys.find(key);
+		if(nullptr == value || IsExpired(*value, SnapshotTime)) {
+			stripe.SnapshotKeys->emplace(key, SK_ABSENT);
+			return;
+		}
+		size_t length = stripe.SnapshotImages.size();
+		try {
+			SnapshotEncoder(key, GetRowPointer(value->Position), value->ExpiredTime.load(std::memory_order_relaxed), stripe.SnapshotImages);
+			stripe.SnapshotKeys->emplace(key, SK_SAVED);
+		}
+		catch(...) {
+			stripe.SnapshotImages.resize(length);
+			throw;
+		}
+		SnapshotCopies++;
+	}
+
+	inline bool IsExpired(const CValue& value, std::chrono::high_resolution_clock::rep timestamp) const noexcept
+	{
+		std::chrono::high_resolution_clock::rep expiredtime = value.ExpiredTime.load(std::memory_order_relaxed);
+		return expiredtime > 0 && expiredtime <= timestamp;
+	}
+
+	inline void* GetRowPointer(uint64_t pos) const noexcept
+	{
+		// 位置在分配新段之后才会出现在键表中，此时Segments已包含该段
+		return static_cast<char*>(Segments.load(std::memory_order_acquire)[pos >> SegmentShift]) + (pos & SegmentMask) * RowLength;
+	}
+
+	inline void Emplace(CStripe& stripe, const T_Key& key, uint64_t pos, std::chrono::high_resolution_clock::rep expiredtime)
+	{
+		CValue value(pos, Generation.fetch_add(1, std::memory_order_relaxed), expiredtime, nullptr != Budget ? Budget->InitialAccess() : 0);
+		if(expiredtime > 0) {
+			std::lock_guard<std::mutex> lck(ExpiryMutex);
+			Expiries.schedule(CExpiry(key, value.Tag()), expiredtime);
+		}
+		stripe.Keys.emplace(key, value);
+		Count++;
+		if(nullptr != Budget) {
+			Budget->Charge(RowBytes);
+		}
+		if(Releaser) {
+			::memset(GetRowPointer(pos), 0, RowLength);
+		}
+	}
+
+	inline bool OverBudget() const noexcept
+	{
+		return nullptr != Budget && Budget->Exceeded(RowBytes);
+	}
+
+	/**
+	 * @brief MakeRoom 添加数据超过内存预算或达到最大行数时调用，调用时不持有分段锁：
+	 * 有淘汰策略时淘汰一行，超过预算又不能淘汰时抛出异常，否则清理过期数据
+	 */
+	inline void MakeRoom()
+	{
+		bool evictable = nullptr != Budget && CMemoryBudget::EP_NONE != Budget->Policy;
+		if(evictable && Evict()) {
+			return;
+		}
+		if(OverBudget()) {
+			// 本表没有数据可以淘汰时，预算被其他表占用
+			ThrowError(ERR_MEMORY_ALLOCATE, "Reach maximal memory(" + num_to_string(uint64_t(Budget->Limit)) + " bytes) in the class CFixedMap.");
+			return;
+		}
+		Grow();
+	}
+
+	/**
+	 * @brief Evict 从随机的分段开始，在第一个有数据的分段中抽样Samples行，淘汰其中已过期的或按淘汰策略最先淘汰的一行
+	 * @return 没有数据时返回false
+	 */
+	inline bool Evict()
+	{
+		uint32_t start = CMemoryBudget::Random();
+		for(uint32_t i = 0; i < STRIPES; i++) {
+			CStripe& stripe = Stripes[(start + i) & (STRIPES - 1)];
+			std::unique_lock<CReadMostlyMutex> lck(stripe.Mutex);
+			if(stripe.Keys.empty()) {
+				continue;
+			}
+			auto timestamp = CTime::Now();
+			const T_Key* victim = nullptr;
+			uint64_t position = 0;
+			uint64_t rank = 0;
+			stripe.Keys.sample(static_cast<uint64_t>(CMemoryBudget::Random()) << 32 | CMemoryBudget::Random(), Budget->Samples,
+							   [&](const T_Key& key, const CValue& value) {
+				uint64_t r = IsExpired(value, timestamp) ? 0 : static_cast<uint64_t>(Budget->Rank(value.Access.load(std::memory_order_relaxed))) + 1;
+				if(nullptr == victim || r < rank) {
+					victim = &key;
+					position = value.Position;
+					rank = r;
+				}
+			});
+			// 删除之前复制键，删除会析构键表中的项
+			T_Key key = *victim;
+			Delete(stripe, key, position);
+			Evicted++;
+			Budget->Evicted++;
+			return true;
+		}
+		return false;
+	}
+
+	/**
+	 * @brief Unshare 修改已有行之前调用，调用时持有分段的写锁，或者读锁、写互斥锁并且序列号为奇数：
+	 * 行被pin时复制到新位置，键改为指向副本，原位置留给读者。副本在读者结束前临时多占一行，不计入内存预算
+	 * @return 行被pin又没有空闲位置时返回false，调用者释放锁等待读者结束后重试
+	 */
+	inline bool Unshare(CStripe& stripe, const T_Key& key, CValue& value)
+	{
+		if(stripe.Pins.empty()) {
+			return true;
+		}
+		CPin* pin = stripe.Pins.find(value.Position);
+		if(nullptr == pin) {
+			return true;
+		}
+		uint64_t pos;
+		if(!Allocate(pos)) {
+			return false;
+		}
+		::memcpy(GetRowPointer(pos), GetRowPointer(value.Position), RowLength);
+		pin->Retired = true;
+		value.Position = pos;
+		// 时间轮中的项按Tag（包含行位置）识别，位置改变后原来的项失效，重新放入
+		std::chrono::high_resolution_clock::rep expiredtime = value.ExpiredTime.load(std::memory_order_relaxed);
+		if(expiredtime > 0) {
+			std::lock_guard<std::mutex> lck(ExpiryMutex);
+			Expiries.schedule(CExpiry(key, value.Tag()), expiredtime);
+		}
+		return true;
+	}
 
-	inline void* GetRowPointer(uint64_t pos) noexcept
+	/**
+	 * @brief Unpin 读者结束读取，调用时不持有分段锁；最后一个读者回收已复制或删除的行位置
+	 */
+	inline void Unpin(CStripe& stripe, uint64_t pos)
 	{
-		return static_cast<char*>(Contents) + pos * RowLength;
+		std::shared_lock<CReadMostlyMutex> lck(stripe.Mutex);
+		std::lock_guard<std::mutex> wlck(stripe.WriteMutex);
+		CPin* pin = stripe.Pins.find(pos);
+		if(0 != --pin->Readers) {
+			return;
+		}
+		bool retired = pin->Retired;
+		stripe.Pins.erase(pos);
+		if(retired) {
+			std::lock_guard<std::mutex> slotlck(SlotMutex);
+			Deleted.emplace(pos);
+		}
 	}
 
-	inline void Delete(typename std::unordered_map<T_Key, CValue>::iterator& it)
+	/**
+	 * @brief Recycle 回收删除的行的位置，调用时持有分段的写锁；行被pin时等最后一个读者结束后回收
+	 */
+	inline void Recycle(CStripe& stripe, uint64_t pos)
 	{
-		Deleted.emplace(it->second.Position);
-		Keys.erase(it);
-		if(IfCollectGarbage && CRandom()(0, 1000) == 500) {
-			collect_garbage();
+		if(!stripe.Pins.empty()) {
+			CPin* pin = stripe.Pins.find(pos);
+			if(nullptr != pin) {
+				pin->Retired = true;
+				return;
+			}
+		}
+		std::lock_guard<std::mutex> slotlck(SlotMutex);
+		Deleted.emplace(pos);
+	}
+
+	/**
+	 * @brief Allocate 分配一个行位置，调用时持有分段的写锁，或者读锁和写互斥锁（Unshare）
+	 * @return 达到最大行数时返回false
+	 */
+	inline bool Allocate(uint64_t& pos)
+	{
+		std::lock_guard<std::mutex> slotlck(SlotMutex);
+		if(!Deleted.empty()) {
+			pos = Deleted.front();
+			Deleted.pop();
+			return true;
 		}
+		if(Size == Capacity && Capacity < MaxSize) {
+			AddSegment();
+		}
+		if(Size < Capacity) {
+			pos = Size++;
+			return true;
+		}
+		return false;
+	}
+
+	/**
+	 * @brief Grow 达到最大行数时锁定全部分段清理过期数据，仍然没有空闲位置则抛出异常
+	 */
+	inline void Grow()
+	{
+		for(uint32_t i = 0; i < STRIPES; i++) {
+			Stripes[i].Mutex.lock();
+		}
+		try {
+			// 可能已由其他线程清理
+			if(Deleted.empty()) {
+				if(IfCollectGarbage) {
+					auto timestamp = CTime::Now();
+					for(uint32_t i = 0; i < STRIPES; i++) {
+						CollectGarbage(Stripes[i], timestamp);
+					}
+				}
+				if(Deleted.empty()) {
+					ThrowError(ERR_MEMORY_ALLOCATE, "Reach maximal rows(" + num_to_string(uint64_t(MaxSize)) + ") in the class CFixedMap.");
+				}
+			}
+		}
+		catch(...) {
+			for(uint32_t i = STRIPES; i > 0; i--) {
+				Stripes[i - 1].Mutex.unlock();
+			}
+			throw;
+		}
+		for(uint32_t i = STRIPES; i > 0; i--) {
+			Stripes[i - 1].Mutex.unlock();
+		}
+	}
+
+	/**
+	 * @brief AddSegment 分配新的一段，调用时持有SlotMutex或者在初始化时调用
+	 */
+	inline void AddSegment()
+	{
+		uint64_t rows = std::min(SegmentMask + 1, MaxSize - Capacity);
+		void* segment = ::malloc(rows * RowLength);
+		if(nullptr == segment) {
+			ThrowError(ERR_MEMORY_ALLOCATE, "CFixedMap failed to allocate " + num_to_string(uint64_t(rows * RowLength)) + " bytes.");
+			return;
+		}
+		void** segments = Segments.load(std::memory_order_relaxed);
+		if(SegmentNum == SegmentCapacity) {
+			uint64_t capacity = 0 == SegmentCapacity ? 16 : SegmentCapacity * 2;
+			void** more = static_cast<void**>(::malloc(capacity * sizeof(void*)));
+			if(nullptr == more) {
+				::free(segment);
+				ThrowError(ERR_MEMORY_ALLOCATE, "CFixedMap failed to allocate " + num_to_string(uint64_t(capacity * sizeof(void*))) + " bytes.");
+				return;
+			}
+			if(nullptr != segments) {
+				::memcpy(more, segments, SegmentNum * sizeof(void*));
+				RetiredSegments.push_back(segments);
+			}
+			segments = more;
+			SegmentCapacity = capacity;
+		}
+		segments[SegmentNum++] = segment;
+		Segments.store(segments, std::memory_order_release);
+		Capacity += rows;
+	}
+
+	inline void FreeSegments() noexcept
+	{
+		void** segments = Segments.load(std::memory_order_relaxed);
+		for(uint64_t i = 0; i < SegmentNum; i++) {
+			::free(segments[i]);
+		}
+		::free(segments);
+		for(size_t i = 0; i < RetiredSegments.size(); i++) {
+			::free(RetiredSegments[i]);
+		}
+		RetiredSegments.clear();
+		Segments.store(nullptr, std::memory_order_relaxed);
+		SegmentNum = 0;
+		SegmentCapacity = 0;
+	}
+
+	inline void Delete(CStripe& stripe, const T_Key& key, uint64_t pos)
+	{
+		Preserve(stripe, key);
+		if(Releaser) {
+			Releaser(GetRowPointer(pos));
+		}
+		Recycle(stripe, pos);
+		stripe.Keys.erase(key);
+		Count--;
+		if(nullptr != Budget) {
+			Budget->Release(RowBytes);
+		}
+	}
+
+	/**
+	 * @brief CollectGarbage 清理一个分段中的过期数据，调用时持有该分段的写锁
+	 */
+	inline void CollectGarbage(CStripe& stripe, std::chrono::high_resolution_clock::rep timestamp)
+	{
+		stripe.Keys.erase_if([&](const T_Key& key, const CValue& value) {
+			if(!IsExpired(value, timestamp)) {
+				return false;
+			}
+			Preserve(stripe, key);
+			if(Releaser) {
+				Releaser(GetRowPointer(value.Position));
+			}
+			Recycle(stripe, value.Position);
+			Count--;
+			Expired++;
+			if(nullptr != Budget) {
+				Budget->Release(RowBytes);
+			}
+			return true;
+		});
 	}
 };
 
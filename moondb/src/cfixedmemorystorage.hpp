@@ -1,154 +1,624 @@
 #pragma once
 
+#include <memory>
 #include "cfixedmap.hpp"
 #include "ctable.h"
 
 namespace MoonDb {
 
+/**
+ * CFixedMemoryStorage定长内存表（TT_FIXMEMORY）。启用重做日志（CTable::RedoLogSettings）时，表目录中的snapshot.moon为快照，
+ * redo.<编号>.log为快照之后的修改：添加、修改和替换记录整行数据和过期时间，删除记录rowid，记录在持有行锁期间写入日志缓冲区，
+ * 重放时与修改的顺序一致，重复重放同一条记录结果不变。生成快照时先换到下一个编号的日志，再逐个分段复制各行，
+ * 写完后改名为snapshot.moon并删除之前的日志；打开表时重放快照和编号不小于快照中编号的日志，自增id恢复为出现过的最大rowid。
+ * 到期和淘汰不记录日志，到期的数据重放时跳过，淘汰的数据重放时按内存预算重新淘汰
+ */
 template <typename IdType>
 class CFixedMemoryStorage : public CTable
 {
 public:
-	CFixedMemoryStorage() : AutoInc(0)
+	CFixedMemoryStorage() : AutoInc(0), Generation(0), OldLogBytes(0), LastSnapshot(0)
 	{}
 
-	~CFixedMemoryStorage(){}
+	~CFixedMemoryStorage()
+	{
+		if(nullptr != Log) {
+			try {
+				Log->Flush(true);
+			}
+			catch(runtime_error& e) {
+				CLog::Instance()->Put(CLog::L_WARNING, e.what());
+			}
+		}
+	}
 
 	bool Open(const string& path, const string& name)
 	{
 		CTable::Open(path, name);
 		// 如果不指定，最大行数为32位无符号整数的最大值，最小行数为100
-		Contents.initialize(MaxRows > 0 ? MaxRows : num_limits<uint32_t>::max(), RowLength, MinRows > 0 ? MinRows : 100);
+		Contents.initialize(MaxRows > 0 ? MaxRows : num_limits<uint32_t>::max(), RowLength, MinRows > 0 ? MinRows : 100, &MemoryBudget);
+		if(RedoLogSettings.Enabled) {
+			Recover();
+		}
 		return true;
 	}
 
-	void InsertData(unordered_map<string, CAny>& data, CPack& ret)
+	void InsertData(CFieldMap& data, CPack& ret)
 	{
-		auto dit = data.find(RowIdField);
-		//Mutex.lock();
-		IdType id = GetRowId<IdType>(dit == data.end(), dit->second);
-		void* dp = Contents.insert(id, LifeTime);
-		if(nullptr == dp) {
-			//Mutex.unlock();
-			ThrowError(ERR_DUPLICATE_ID, "Duplicate rowid:" + num_to_string(static_cast<__uint128_t>(id)) + " when inserting data in the table " + Name + ".");
+		uint64_t lsn = 0;
+		IdType id = InsertRow(data, lsn);
+		CommitLog(lsn);
+		InsertResult<IdType>(ret, id);
+	}
+
+	void UpdateData(const CAny& rowid, CFieldMap& data, CPack& ret)
+	{
+		uint64_t lsn = 0;
+		bool updated = UpdateRow(GetRowId<IdType>(false, rowid), data, lsn);
+		CommitLog(lsn);
+		ExecuteResult<IdType>(ret, updated ? 1 : 0);
+	}
+
+	void ReplaceData(const CAny& rowid, CFieldMap& data, CPack& ret)
+	{
+		uint64_t lsn = 0;
+		ReplaceRow(GetRowId<IdType>(false, rowid), data, lsn);
+		CommitLog(lsn);
+		ExecuteResult<IdType>(ret, 1);
+	}
+
+	void DeleteData(const CAny& rowid, CPack& ret)
+	{
+		uint64_t lsn = 0;
+		bool deleted = DeleteRow(GetRowId<IdType>(false, rowid), lsn);
+		CommitLog(lsn);
+		ExecuteResult<IdType>(ret, deleted ? 1 : 0);
+	}
+
+	void GetData(const CAny& rowid, CPack& ret)
+	{
+		IdType id = GetRowId<IdType>(false, rowid);
+		void* dp = RowBuffer();
+		CPack row(dp, RowLength);
+		if(!Contents.copy(id, dp)) {
+			GetResult<IdType>(ret, 0, row);
 			return;
 		}
-		CPack pack(dp, RowLength);
+		row.SetSize(RowLength);
+		GetResult<IdType>(ret, id, row);
+	}
 
-		/*auto it = Contents.emplace(id, CPack());
-		if(!it.second) {
-			ThrowError(ERR_DUPLICATE_ID, "Duplicate rowid:" + num_to_string(static_cast<__uint128_t>(id)) + " when inserting data in the table " + Name + ".");
+	bool GetRawData(const CAny& rowid, CPack& ret, const function<void(const void*, uint64_t)>& sender)
+	{
+		IdType id = GetRowId<IdType>(false, rowid);
+		// 发送期间不持有分段锁，该行被修改时写者修改副本
+		bool found = Contents.pin(id, [&](const void* dp) {
+			RawResultHeader<IdType>(ret, id, RowLength);
+			sender(dp, RowLength);
+		});
+		if(!found) {
+			RawResultHeader<IdType>(ret, 0, 0);
+		}
+		return found;
+	}
+
+	size_t ExpireRows(size_t limit)
+	{
+		return LifeTime > 0 ? Contents.expire(limit) : 0;
+	}
+
+	void Persist()
+	{
+		if(nullptr == Log) {
+			return;
+		}
+		Log->FlushIfDue();
+		uint64_t bytes = Log->GetSize() + OldLogBytes;
+		if(0 == bytes) {
 			return;
 		}
-		CPack& pack = it.first->second;
-		pack.Allocate(RowLength);*/
+		if((RedoLogSettings.SnapshotInterval > 0 && CTime::Now() - LastSnapshot >= static_cast<int64_t>(RedoLogSettings.SnapshotInterval) * CTime::NanoTime)
+				|| (RedoLogSettings.SnapshotLogSize > 0 && bytes >= RedoLogSettings.SnapshotLogSize)) {
+			Snapshot();
+		}
+	}
 
-		for(uint16_t i = 1; i < FieldNum; i ++) {
-			const CField* field = &Fields[i];
-			auto dit = data.find(field->Name);
-			bool ifexist = dit != data.end();
-			GetInputValue(pack, ifexist, ifexist ? &dit->second : nullptr, field->Name, field->Type, field->Length, field->Scale, field->Charset, field->DefaultDefined, field->DefaultValue, field->Values);
+	/**
+	 * @brief Snapshot 生成快照并删除快照之前的日志：快照为开始时刻的一致数据，生成期间可以正常读写，修改者只在第一次修改某行时复制一次原数据
+	 * @return 生成期间由修改者复制的行数
+	 */
+	uint64_t Snapshot()
+	{
+		lock_guard<mutex> lck(SnapshotMutex);
+		uint64_t generation = Generation + 1;
+		// 换文件之后、快照开始之前的修改同时在快照和新日志中，恢复时重放整行数据的结果不变
+		Log->Rotate(LogFileName(generation));
+		Generation = generation;
+		string filename = Path + DIRECTORY_SEPARATOR + "snapshot.moon";
+		string tmpname = filename + ".tmp";
+		std::remove(tmpname.c_str());
+		CRedoLog writer;
+		writer.Open(tmpname, CRedoLog::SP_NEVER, 0);
+		CPack& record = Record();
+		record.Clear();
+		record.Put(static_cast<uint8_t>(LO_SNAPSHOT));
+		record.Put(generation);
+		{
+			lock_guard<mutex> autolck(AutoIncMutex);
+			record.Put(AutoInc);
 		}
+		writer.Append(record.GetPointer(), static_cast<uint32_t>(record.GetSize()));
+		auto now = CTime::Now();
+		int64_t wallnow = static_cast<int64_t>(CTime::CurrentTime());
+		// 由快照线程和修改数据的线程调用，都使用各自线程的Record()
+		uint64_t copies = Contents.snapshot([this, now, wallnow](const IdType& id, const void* dp, std::chrono::high_resolution_clock::rep expiredtime, string& out) {
+			// 快照中的过期时间换算为时间戳，与日志相同
+			int64_t exptime = expiredtime > 0 ? wallnow + (expiredtime - now + CTime::NanoTime - 1) / CTime::NanoTime : 0;
+			CPack& rec = Record();
+			rec.Clear();
+			rec.Put(static_cast<uint8_t>(LO_PUT));
+			rec.Put(id);
+			rec.Put(exptime);
+			EncodeRow(rec, dp);
+			CRedoLog::Frame(out, rec.GetPointer(), static_cast<uint32_t>(rec.GetSize()));
+		}, [&writer](const string& records) {
+			// 写入文件时不持有分段锁
+			writer.Append(records);
+			writer.Flush(false);
+		});
+		writer.Flush(true);
+		writer.Close();
+		if(std::rename(tmpname.c_str(), filename.c_str()) != 0) {
+			ThrowError(ERR_FILE_WRITE, "Can't rename the file " + tmpname + " to " + filename + ".");
+			return copies;
+		}
+		CRedoLog::SyncDirectory(Path);
+		RemoveLogsBefore(generation);
+		OldLogBytes = 0;
+		LastSnapshot = CTime::Now();
+		return copies;
+	}
 
-		//Mutex.unlock();
+	void StatsResult(CPack& ret)
+	{
+		uint64_t start = BeginResult(ret, RT_STATS);
+		uint64_t countpos = ret.Tell();
+		uint16_t count = 0;
+		ret.Put(count);
+		StatsItems(ret, count);
+		ret.Seek(static_cast<int64_t>(countpos));
+		ret.Put(count);
+		EndResult(ret, start);
+	}
 
-		InsertResult<IdType>(ret, id);
+	void InsertMultiData(CFieldMaps& rows, CPack& ret)
+	{
+		uint64_t start = BeginResult(ret, RT_MULTI_INSERT_ID);
+		ret.Put(static_cast<uint16_t>(GetIdType()));
+		ret.Put(static_cast<uint32_t>(rows.size()));
+		uint64_t lsn = 0;
+		for(size_t i = 0; i < rows.size(); i++) {
+			try {
+				ret.Put(InsertRow(rows[i], lsn));
+			}
+			catch(runtime_error& e) {
+				CommitLog(lsn);
+				TraceError(e, "Row " + num_to_string(i) + " of the batch failed, the rows before it have been inserted.");
+			}
+		}
+		CommitLog(lsn);
+		EndResult(ret, start);
 	}
 
-	void UpdateData(const CAny& rowid, unordered_map<string, CAny>& data, CPack& ret)
+	void UpdateMultiData(const CRowIds& rowids, CFieldMaps& rows, CPack& ret)
 	{
-		IdType id = GetRowId<IdType>(false, rowid);
-		//Mutex.lock();
-		void* dp = Contents.update(id, LifeTime);
-		if(nullptr == dp) {
-			//Mutex.unlock();
-			ExecuteResult<IdType>(ret, 0);
-			return;
+		uint64_t start = BeginResult(ret, RT_MULTI_AFFECTED_ROWS);
+		ret.Put(static_cast<uint32_t>(rows.size()));
+		uint64_t lsn = 0;
+		for(size_t i = 0; i < rows.size(); i++) {
+			try {
+				ret.Put(static_cast<uint8_t>(UpdateRow(GetRowId<IdType>(false, rowids[i]), rows[i], lsn)));
+			}
+			catch(runtime_error& e) {
+				CommitLog(lsn);
+				TraceError(e, "Row " + num_to_string(i) + " of the batch failed, the rows before it have been updated.");
+			}
 		}
-		CPack row(dp, RowLength);
-		row.SetSize(RowLength);
-		/*auto it = Contents.find(id);
-		if(it == Contents.end()) {
-			return;
+		CommitLog(lsn);
+		EndResult(ret, start);
+	}
+
+	void ReplaceMultiData(const CRowIds& rowids, CFieldMaps& rows, CPack& ret)
+	{
+		uint64_t start = BeginResult(ret, RT_MULTI_AFFECTED_ROWS);
+		ret.Put(static_cast<uint32_t>(rows.size()));
+		uint64_t lsn = 0;
+		for(size_t i = 0; i < rows.size(); i++) {
+			try {
+				ReplaceRow(GetRowId<IdType>(false, rowids[i]), rows[i], lsn);
+				ret.Put(static_cast<uint8_t>(1));
+			}
+			catch(runtime_error& e) {
+				CommitLog(lsn);
+				TraceError(e, "Row " + num_to_string(i) + " of the batch failed, the rows before it have been replaced.");
+			}
+		}
+		CommitLog(lsn);
+		EndResult(ret, start);
+	}
+
+	void DeleteMultiData(const CRowIds& rowids, CPack& ret)
+	{
+		uint64_t start = BeginResult(ret, RT_MULTI_AFFECTED_ROWS);
+		ret.Put(static_cast<uint32_t>(rowids.size()));
+		uint64_t lsn = 0;
+		for(size_t i = 0; i < rowids.size(); i++) {
+			try {
+				ret.Put(static_cast<uint8_t>(DeleteRow(GetRowId<IdType>(false, rowids[i]), lsn)));
+			}
+			catch(runtime_error& e) {
+				CommitLog(lsn);
+				TraceError(e, "Row " + num_to_string(i) + " of the batch failed, the rows before it have been deleted.");
+			}
 		}
-		CPack& pack = it->second;*/
+		CommitLog(lsn);
+		EndResult(ret, start);
+	}
+
+	void GetMultiData(const CRowIds& rowids, CPack& ret, bool withnames = true)
+	{
+		uint64_t start = MultiGetResultHeader(ret, static_cast<uint32_t>(rowids.size()), withnames);
+		for(size_t i = 0; i < rowids.size(); i++) {
+			IdType id = GetRowId<IdType>(false, rowids[i]);
+			void* dp = RowBuffer();
+			CPack row(dp, RowLength);
+			if(!Contents.copy(id, dp)) {
+				MultiGetResultRow<IdType>(ret, 0, row);
+				continue;
+			}
+			row.SetSize(RowLength);
+			MultiGetResultRow<IdType>(ret, id, row);
+		}
+		EndResult(ret, start);
+	}
+
+protected:
+	/**
+	 * 日志记录的类型，记录的第一个字节
+	 */
+	enum LogOperation {
+		LO_PUT = 1,			/**< rowid、过期时间戳（秒，0为不过期）和EncodeRow编码的整行数据 */
+		LO_DELETE = 2,		/**< rowid */
+		LO_SNAPSHOT = 3		/**< 快照的第一条记录：快照之后的日志编号和自增id */
+	};
+
+	IdType AutoInc;		/**< 自增id数值 */
+	mutex AutoIncMutex;	/**< 自增id的互斥锁，写操作不再独占数据库锁 */
+	unique_ptr<CRedoLog> Log;	/**< 重做日志，未启用时为nullptr */
+	atomic<uint64_t> Generation;	/**< 当前日志的编号 */
+	uint64_t OldLogBytes;		/**< 快照之后、当前日志之前的日志的字节数，上次生成快照未完成时不为0 */
+	std::chrono::high_resolution_clock::rep LastSnapshot;	/**< 上次生成快照或打开表的时间 */
+	mutex SnapshotMutex;
 
+	/**
+	 * @brief InsertRow 插入一行数据
+	 * @param lsn 启用日志时为日志记录结束的位置
+	 * @return 插入数据的id
+	 */
+	IdType InsertRow(CFieldMap& data, uint64_t& lsn)
+	{
+		auto dit = data.find(RowIdField);
+		IdType id = GetRowId<IdType>(dit == data.end(), dit->second);
+		bool inserted = Contents.insert(id, LifeTime, [&](void* dp) {
+			CPack pack(dp, RowLength);
+			FillRow(pack, data);
+			if(nullptr != Log) {
+				lsn = LogRow(LO_PUT, id, dp);
+			}
+		});
+		if(!inserted) {
+			ThrowError(ERR_DUPLICATE_ID, "Duplicate rowid:" + num_to_string(static_cast<__uint128_t>(id)) + " when inserting data in the table " + Name + ".");
+			return 0;
+		}
+		return id;
+	}
+
+	/**
+	 * @brief UpdateRow 更新一行数据
+	 * @return 数据不存在时返回false
+	 */
+	bool UpdateRow(IdType id, CFieldMap& data, uint64_t& lsn)
+	{
+		return Contents.update(id, LifeTime, [&](void* dp) {
+			UpdateFields(dp, data);
+			if(nullptr != Log) {
+				lsn = LogRow(LO_PUT, id, dp);
+			}
+		});
+	}
+
+	/**
+	 * @brief DeleteRow 删除一行数据
+	 * @return 数据不存在时返回false
+	 */
+	bool DeleteRow(IdType id, uint64_t& lsn)
+	{
+		if(nullptr == Log) {
+			return Contents.erase(id);
+		}
+		return Contents.erase(id, [&](const void*) {
+			lsn = LogRow(LO_DELETE, id, nullptr);
+		});
+	}
+
+	/**
+	 * @brief UpdateFields 写入data中有的字段和定义了更新时值的字段
+	 */
+	virtual void UpdateFields(void* dp, CFieldMap& data)
+	{
+		CPack row(dp, RowLength);
+		row.SetSize(RowLength);
 		for(uint16_t i = 1; i < FieldNum; i ++) {
 			const CField* field = &Fields[i];
 			auto dit = data.find(field->Name);
 			bool ifexist = dit != data.end();
 			if(!ifexist && !field->OnUpdateDefined) {
-				//pack.MoveAhead(GetFieldLength(*field));
+				continue;
+			}
+			const CCodecField& cf = Codec[i - 1];
+			if(ifexist && nullptr != cf.Store && cf.Store(dit->second, static_cast<char*>(dp) + cf.Offset)) {
 				continue;
 			}
 			row.Seek(static_cast<int64_t>(field->Position));
 			GetInputValue(row, ifexist, ifexist ? &dit->second : nullptr, field->Name, field->Type, field->Length, field->Scale, field->Charset, field->OnUpdateDefined, field->ValueOnUpdate, field->Values);
 		}
-		//Mutex.unlock();
-		ExecuteResult<IdType>(ret, 1);
 	}
 
-	void ReplaceData(const CAny& rowid, unordered_map<string, CAny>& data, CPack& ret)
+	void ReplaceRow(IdType id, CFieldMap& data, uint64_t& lsn)
 	{
-		IdType id = GetRowId<IdType>(false, rowid);
-		//Mutex.lock();
-		CPack pack(Contents.replace(id, LifeTime), RowLength);
+		Contents.replace(id, LifeTime, [&](void* dp) {
+			CPack pack(dp, RowLength);
+			FillRow(pack, data);
+			if(nullptr != Log) {
+				lsn = LogRow(LO_PUT, id, dp);
+			}
+		});
+	}
+
+	/**
+	 * @brief FillRow 按顺序写入整行数据，缺少的字段使用默认值
+	 */
+	virtual void FillRow(CPack& pack, CFieldMap& data)
+	{
+		// 偏移固定的数值字段按Codec直接写入，其余字段定位后按类型写入
+		char* dp = static_cast<char*>(pack.GetPointer());
+		pack.SetSize(RowLength);
 		for(uint16_t i = 1; i < FieldNum; i ++) {
 			const CField* field = &Fields[i];
 			auto dit = data.find(field->Name);
 			bool ifexist = dit != data.end();
+			const CCodecField& cf = Codec[i - 1];
+			if(ifexist && nullptr != cf.Store && cf.Store(dit->second, dp + cf.Offset)) {
+				continue;
+			}
+			if(cf.Fixed) {
+				pack.Seek(static_cast<int64_t>(cf.Offset));
+			}
 			GetInputValue(pack, ifexist, ifexist ? &dit->second : nullptr, field->Name, field->Type, field->Length, field->Scale, field->Charset, field->DefaultDefined, field->DefaultValue, field->Values);
 		}
-		//Mutex.unlock();
-		ExecuteResult<IdType>(ret, 1);
 	}
 
-	void DeleteData(const CAny& rowid, CPack& ret)
+	/**
+	 * @brief StatsItems 写入统计信息的各项
+	 */
+	virtual void StatsItems(CPack& ret, uint16_t& count)
 	{
-		IdType id = GetRowId<IdType>(false, rowid);
-		IdType affectedrows;
-		//Mutex.lock();
-		if(Contents.erase(id)) {
-			affectedrows = 1;
+		StatsItem(ret, count, "rows", Contents.size());
+		StatsItem(ret, count, "capacity", Contents.capacity());
+		StatsItem(ret, count, "row_bytes", Contents.row_bytes());
+		StatsItem(ret, count, "evicted", Contents.evicted());
+		StatsItem(ret, count, "expired", Contents.expired());
+		StatsItem(ret, count, "memory_used", MemoryBudget.Used);
+		StatsItem(ret, count, "memory_limit", MemoryBudget.Limit);
+		StatsItem(ret, count, "memory_evicted", MemoryBudget.Evicted);
+		if(nullptr != Log) {
+			StatsItem(ret, count, "log_bytes", Log->GetSize());
+			StatsItem(ret, count, "log_generation", Generation);
 		}
-		else {
-			affectedrows = 0;
-		}
-		//Mutex.unlock();
-		ExecuteResult<IdType>(ret, affectedrows);
 	}
 
-	void GetData(const CAny& rowid, CPack& ret)
+	/**
+	 * @brief EncodeRow 在日志记录中写入整行数据，与DecodeRow对应
+	 */
+	virtual void EncodeRow(CPack& record, const void* dp)
 	{
-		IdType id = GetRowId<IdType>(false, rowid);
-		//Mutex.lock_shared();
-		void* dp = Contents.at(id);
-		CPack row(dp, RowLength);
-		if(nullptr == dp) {
-			//Mutex.unlock_shared();
-			GetResult<IdType>(ret, 0, row);
+		record.Write(dp, RowLength);
+	}
+
+	/**
+	 * @brief DecodeRow 重放日志时用EncodeRow编码的数据覆盖行数据
+	 */
+	virtual void DecodeRow(void* dp, const char* data, uint64_t length)
+	{
+		if(length != RowLength) {
+			ThrowError(ERR_FILE_READ, "The redo log of the table " + Name + " doesn't match its fields.");
 			return;
 		}
-		row.SetSize(RowLength);
-		/*auto it = Contents.find(id);
-		if(it == Contents.end()) {
+		::memcpy(dp, data, RowLength);
+	}
+
+	/**
+	 * @brief LogRow 在日志缓冲区中追加一条记录，调用时持有该行的锁
+	 * @return 记录结束的位置
+	 */
+	uint64_t LogRow(LogOperation op, IdType id, const void* dp)
+	{
+		CPack& record = Record();
+		record.Clear();
+		record.Put(static_cast<uint8_t>(op));
+		record.Put(id);
+		if(LO_PUT == op) {
+			record.Put(static_cast<int64_t>(LifeTime > 0 ? CTime::CurrentTime() + LifeTime : 0));
+			EncodeRow(record, dp);
+		}
+		return Log->Append(record.GetPointer(), static_cast<uint32_t>(record.GetSize()));
+	}
+
+	/**
+	 * @brief CommitLog 修改之后不再持有行锁时调用，按同步策略等待日志写入
+	 */
+	inline void CommitLog(uint64_t lsn)
+	{
+		if(0 != lsn) {
+			Log->Commit(lsn);
+		}
+	}
+
+	inline string LogFileName(uint64_t generation) const
+	{
+		return Path + DIRECTORY_SEPARATOR + "redo." + num_to_string(generation) + ".log";
+	}
+
+	/**
+	 * @brief RemoveLogsBefore 删除编号小于generation的日志，它们的修改已经包含在快照中
+	 */
+	void RemoveLogsBefore(uint64_t generation)
+	{
+		for(uint64_t i = generation; i > 0 && CFileSystem::IsFile(LogFileName(i - 1)); i--) {
+			CFileSystem::RemoveFile(LogFileName(i - 1));
+		}
+	}
+
+	/**
+	 * @brief Recover 打开表时重放快照和之后的日志，末尾不完整的日志记录截去，之后的修改追加在最后一个日志中
+	 */
+	void Recover()
+	{
+		CBatch batch;
+		auto apply = [&](const char* data, uint32_t length) {
+			ApplyRecord(data, length, batch);
+		};
+		string snapshot = Path + DIRECTORY_SEPARATOR + "snapshot.moon";
+		Generation = 0;
+		if(CFileSystem::IsFile(snapshot) && !CRedoLog::Replay(snapshot, apply, false)) {
+			ThrowError(ERR_FILE_READ, "The snapshot file " + snapshot + " is damaged.");
 			return;
 		}
-		CPack& pack = it->second;*/
+		ApplyBatch(batch);
+		RemoveLogsBefore(Generation);
+		uint64_t generation = Generation;
+		uint64_t bytes = 0;
+		OldLogBytes = 0;
+		while(CFileSystem::IsFile(LogFileName(generation))) {
+			if(!CRedoLog::Replay(LogFileName(generation), apply, true)) {
+				CLog::Instance()->Put(CLog::L_WARNING, "The redo log " + LogFileName(generation) + " ends with an incomplete record, truncated it.");
+			}
+			ApplyBatch(batch);
+			OldLogBytes += bytes;
+			bytes = CFileSystem::FileSize(LogFileName(generation));
+			generation++;
+		}
+		if(generation > Generation) {
+			Generation = generation - 1;
+		}
+		Log.reset(new CRedoLog);
+		Log->Open(LogFileName(Generation), RedoLogSettings.Sync, RedoLogSettings.SyncInterval);
+		LastSnapshot = CTime::Now();
+	}
 
-		GetResult<IdType>(ret, id, row);
+	/**
+	 * 重放时积累的修改，行数据复制在Rows中，每BATCH_ROWS项按分段批量写入
+	 */
+	struct CBatch {
+		const static size_t BATCH_ROWS = 65536;
+		vector<typename CFixedMap<IdType>::CBatchItem> Items;
+		string Rows;
+	};
 
-		/*map<string, CAny> data;
-		for(uint16_t i = 1; i < FieldNum; i ++) {
-			const CField* field = &Fields[i];
-			data.emplace(field->Name, CAny(pack, field->Type, field->Length, field->FlipValues));
-		}*/
+	void ApplyBatch(CBatch& batch)
+	{
+		Contents.replace_batch(batch.Items, [&](const typename CFixedMap<IdType>::CBatchItem& item, void* dp) {
+			DecodeRow(dp, &batch.Rows[item.Offset], item.Length);
+		});
+		batch.Items.clear();
+		batch.Rows.clear();
+	}
+
+	/**
+	 * @brief ApplyRecord 重放一条快照或日志记录，修改放入batch
+	 */
+	void ApplyRecord(const char* data, uint32_t length, CBatch& batch)
+	{
+		IdType id;
+		if(length < 1 + sizeof(IdType)) {
+			ThrowError(ERR_FILE_READ, "Wrong record in the redo log of the table " + Name + ".");
+			return;
+		}
+		::memcpy(&id, data + 1, sizeof(IdType));
+		switch(static_cast<uint8_t>(data[0])) {
+		case LO_PUT:
+		{
+			int64_t exptime;
+			if(length < 1 + sizeof(IdType) + sizeof(int64_t)) {
+				ThrowError(ERR_FILE_READ, "Wrong record in the redo log of the table " + Name + ".");
+				return;
+			}
+			::memcpy(&exptime, data + 1 + sizeof(IdType), sizeof(int64_t));
+			int64_t lifetime = exptime > 0 ? exptime - static_cast<int64_t>(CTime::CurrentTime()) : 0;
+			const char* row = data + 1 + sizeof(IdType) + sizeof(int64_t);
+			uint64_t rowlength = length - 1 - sizeof(IdType) - sizeof(int64_t);
+			// 已过期的数据按删除处理
+			batch.Items.push_back({id, 0, static_cast<uint32_t>(lifetime > 0 ? lifetime : 0), exptime > 0 && lifetime <= 0, batch.Rows.size(), rowlength});
+			batch.Rows.append(row, rowlength);
+			break;
+		}
+		case LO_DELETE:
+			batch.Items.push_back({id, 0, 0, true, 0, 0});
+			break;
+		case LO_SNAPSHOT:
+		{
+			uint64_t generation;
+			if(length != 1 + sizeof(uint64_t) + sizeof(IdType)) {
+				ThrowError(ERR_FILE_READ, "Wrong record in the redo log of the table " + Name + ".");
+				return;
+			}
+			::memcpy(&generation, data + 1, sizeof(uint64_t));
+			::memcpy(&id, data + 1 + sizeof(uint64_t), sizeof(IdType));
+			Generation = generation;
+			break;
+		}
+		default:
+			ThrowError(ERR_FILE_READ, "Wrong record in the redo log of the table " + Name + ".");
+			return;
+		}
+		if(id > AutoInc) {
+			AutoInc = id;
+		}
+		if(batch.Items.size() >= CBatch::BATCH_ROWS) {
+			ApplyBatch(batch);
+		}
+	}
 
-		//Mutex.unlock_shared();
+	/**
+	 * @brief Record 线程内复用的日志记录缓冲区
+	 */
+	static CPack& Record()
+	{
+		static thread_local CPack record(256);
+		return record;
 	}
 
-protected:
-	IdType AutoInc;		/**< 自增id数值 */
+	/**
+	 * @brief RowBuffer 线程内复用的行缓冲区，乐观读取先把行数据复制到这里再解析
+	 */
+	void* RowBuffer()
+	{
+		static thread_local string buffer;
+		if(buffer.size() < RowLength) {
+			buffer.resize(RowLength);
+		}
+		return &buffer[0];
+	}
 
 	inline IdType MaxIdValue() const noexcept
 	{
@@ -157,6 +627,7 @@ protected:
 
 	void IncreaseAutoInc(void* id) noexcept
 	{
+		lock_guard<mutex> lck(AutoIncMutex);
 		++AutoInc;
 		::memcpy(id, &AutoInc, sizeof(IdType));
 	}
@@ -0,0 +1,393 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <utility>
+#include <algorithm>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "crunningerror.hpp"
+#include "functions.hpp"
+
+namespace MoonDb {
+
+/**
+ * CFlatHash整数键的哈希函数，各位充分混合，高位和低位都可以直接使用
+ */
+template <typename T_Key>
+struct CFlatHash
+{
+	inline uint64_t operator()(const T_Key& key) const noexcept
+	{
+		return Mix(static_cast<uint64_t>(key));
+	}
+
+	static inline uint64_t Mix(uint64_t h) noexcept
+	{
+		h ^= h >> 33;
+		h *= 0xFF51AFD7ED558CCDULL;
+		h ^= h >> 33;
+		h *= 0xC4CEB9FE1A85EC53ULL;
+		h ^= h >> 33;
+		return h;
+	}
+};
+
+template <>
+struct CFlatHash<__uint128_t>
+{
+	inline uint64_t operator()(const __uint128_t& key) const noexcept
+	{
+		return CFlatHash<uint64_t>::Mix(static_cast<uint64_t>(key) ^ CFlatHash<uint64_t>::Mix(static_cast<uint64_t>(key >> 64)));
+	}
+};
+
+/**
+ * CFlatHashMap开放寻址的哈希表（SwissTable方式）：每16个位置为一组，每个位置有一个字节的控制位，
+ * 为空、已删除或哈希值的低7位，查找时一次比较一组的控制位（SSE2），键和值直接存放在连续的数组中。
+ * 添加数据可能重新分配数组，之前返回的指针失效；不支持并发修改
+ */
+template <typename T_Key, typename T_Value, typename T_Hash = CFlatHash<T_Key>>
+class CFlatHashMap
+{
+public:
+	CFlatHashMap() noexcept : Groups(nullptr), Slots(nullptr), Capacity(0), Size(0), GrowthLeft(0), Resizes(0)
+	{}
+
+	CFlatHashMap(const CFlatHashMap&) = delete;
+	CFlatHashMap& operator=(const CFlatHashMap&) = delete;
+
+	~CFlatHashMap() noexcept
+	{
+		clear();
+		delete[] Groups;
+		::free(Slots);
+	}
+
+	inline T_Value* find(const T_Key& key) noexcept
+	{
+		uint64_t pos = FindPosition(key);
+		return NPOS == pos ? nullptr : &Slots[pos].Value;
+	}
+
+	inline const T_Value* find(const T_Key& key) const noexcept
+	{
+		uint64_t pos = FindPosition(key);
+		return NPOS == pos ? nullptr : &Slots[pos].Value;
+	}
+
+	/**
+	 * @brief emplace 添加数据，键已存在时不修改
+	 * @return 值的地址和是否添加
+	 */
+	std::pair<T_Value*, bool> emplace(const T_Key& key, const T_Value& value)
+	{
+		uint64_t pos = FindPosition(key);
+		if(NPOS != pos) {
+			return std::make_pair(&Slots[pos].Value, false);
+		}
+		if(0 == GrowthLeft) {
+			// 已删除的位置较多时按原大小重新整理，否则扩大一倍
+			Resize(0 == Capacity ? GROUP : (Size >= MaxLoad(Capacity) / 2 ? Capacity * 2 : Capacity));
+		}
+		uint64_t hash = T_Hash()(key);
+		pos = FindFreePosition(hash);
+		if(EMPTY == GetControl(pos)) {
+			GrowthLeft--;
+		}
+		SetControl(pos, H2(hash));
+		new(&Slots[pos]) CSlot(key, value);
+		Size++;
+		return std::make_pair(&Slots[pos].Value, true);
+	}
+
+	inline bool erase(const T_Key& key) noexcept
+	{
+		uint64_t pos = FindPosition(key);
+		if(NPOS == pos) {
+			return false;
+		}
+		EraseAt(pos);
+		return true;
+	}
+
+	/**
+	 * @brief erase_if 删除所有func(const T_Key& key, T_Value& value)返回true的数据
+	 */
+	template <typename T_Func>
+	void erase_if(T_Func func)
+	{
+		for(uint64_t pos = 0; pos < Capacity && Size > 0; pos++) {
+			if(GetControl(pos) >= 0 && func(static_cast<const T_Key&>(Slots[pos].Key), Slots[pos].Value)) {
+				EraseAt(pos);
+			}
+		}
+	}
+
+	/**
+	 * @brief for_each 对所有数据调用func(const T_Key& key, const T_Value& value)
+	 */
+	template <typename T_Func>
+	void for_each(T_Func func) const
+	{
+		for(uint64_t pos = 0; pos < Capacity; pos++) {
+			if(GetControl(pos) >= 0) {
+				func(Slots[pos].Key, Slots[pos].Value);
+			}
+		}
+	}
+
+	/**
+	 * @brief for_each 对位置[start, start + n)中的数据调用func(const T_Key& key, const T_Value& value)，用于分批遍历，
+	 * 两批之间resizes()改变时各数据的位置已经改变
+	 * @return 下一批的开始位置，不小于capacity()时已遍历完
+	 */
+	template <typename T_Func>
+	uint64_t for_each(uint64_t start, uint64_t n, T_Func func) const
+	{
+		uint64_t end = std::min(start + n, Capacity);
+		for(uint64_t pos = start; pos < end; pos++) {
+			if(GetControl(pos) >= 0) {
+				func(Slots[pos].Key, Slots[pos].Value);
+			}
+		}
+		return end;
+	}
+
+	/**
+	 * @brief sample 从位置start（对容量取模）开始依次对最多n个数据调用func(const T_Key& key, const T_Value& value)，
+	 * 各位置的键按哈希值分布，从随机位置开始即为随机抽样
+	 */
+	template <typename T_Func>
+	void sample(uint64_t start, size_t n, T_Func func) const
+	{
+		for(uint64_t i = 0, pos = start & (Capacity - 1); i < Capacity && n > 0 && Size > 0; i++, pos = (pos + 1) & (Capacity - 1)) {
+			if(GetControl(pos) >= 0) {
+				func(Slots[pos].Key, Slots[pos].Value);
+				n--;
+			}
+		}
+	}
+
+	void clear() noexcept
+	{
+		for(uint64_t pos = 0; pos < Capacity; pos++) {
+			if(GetControl(pos) >= 0) {
+				Slots[pos].~CSlot();
+			}
+			SetControl(pos, EMPTY);
+		}
+		Size = 0;
+		GrowthLeft = MaxLoad(Capacity);
+	}
+
+	inline size_t size() const noexcept
+	{
+		return Size;
+	}
+
+	inline bool empty() const noexcept
+	{
+		return 0 == Size;
+	}
+
+	inline size_t capacity() const noexcept
+	{
+		return Capacity;
+	}
+
+	/**
+	 * @brief resizes 重新分配位置数组的次数
+	 */
+	inline uint64_t resizes() const noexcept
+	{
+		return Resizes;
+	}
+
+	/**
+	 * @brief memory_usage 控制位和键值数组占用的字节数
+	 */
+	inline size_t memory_usage() const noexcept
+	{
+		return Capacity * (1 + sizeof(CSlot));
+	}
+
+protected:
+	const static uint32_t GROUP = 16;		/**< 每组位置数 */
+	const static int8_t EMPTY = -128;		/**< 控制位：空 */
+	const static int8_t DELETED = -2;		/**< 控制位：已删除，查找时不能在此停止 */
+	const static uint64_t NPOS = ~0ULL;
+
+	struct alignas(16) CGroup {
+		int8_t Controls[GROUP];
+
+		/**
+		 * @brief Match 控制位等于h的位置组成的位掩码
+		 */
+		inline uint32_t Match(int8_t h) const noexcept
+		{
+#if defined(__SSE2__)
+			__m128i ctrl = _mm_load_si128(reinterpret_cast<const __m128i*>(Controls));
+			return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h), ctrl)));
+#else
+			uint32_t mask = 0;
+			for(uint32_t i = 0; i < GROUP; i++) {
+				if(Controls[i] == h) {
+					mask |= 1U << i;
+				}
+			}
+			return mask;
+#endif
+		}
+
+		/**
+		 * @brief MatchFree 空或已删除（最高位为1）的位置组成的位掩码
+		 */
+		inline uint32_t MatchFree() const noexcept
+		{
+#if defined(__SSE2__)
+			return static_cast<uint32_t>(_mm_movemask_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(Controls))));
+#else
+			uint32_t mask = 0;
+			for(uint32_t i = 0; i < GROUP; i++) {
+				if(Controls[i] < 0) {
+					mask |= 1U << i;
+				}
+			}
+			return mask;
+#endif
+		}
+	};
+
+	struct CSlot {
+		T_Key Key;
+		T_Value Value;
+		CSlot(const T_Key& key, const T_Value& value) : Key(key), Value(value)
+		{}
+	};
+
+	CGroup* Groups;
+	CSlot* Slots;
+	uint64_t Capacity;		/**< 位置数，为GROUP乘以2的幂 */
+	uint64_t Size;
+	uint64_t GrowthLeft;	/**< 不扩容还可以使用的空位置数 */
+	uint64_t Resizes;		/**< 重新分配的次数 */
+
+	static inline uint64_t MaxLoad(uint64_t capacity) noexcept
+	{
+		// 最大装载率7/8，保证每次查找都能遇到空位置而停止
+		return capacity - capacity / 8;
+	}
+
+	static inline int8_t H2(uint64_t hash) noexcept
+	{
+		return static_cast<int8_t>(hash & 0x7F);
+	}
+
+	inline uint64_t FirstGroup(uint64_t hash) const noexcept
+	{
+		return (hash >> 7) & (Capacity / GROUP - 1);
+	}
+
+	inline int8_t GetControl(uint64_t pos) const noexcept
+	{
+		return Groups[pos / GROUP].Controls[pos % GROUP];
+	}
+
+	inline void SetControl(uint64_t pos, int8_t h) noexcept
+	{
+		Groups[pos / GROUP].Controls[pos % GROUP] = h;
+	}
+
+	uint64_t FindPosition(const T_Key& key) const noexcept
+	{
+		if(0 == Size) {
+			return NPOS;
+		}
+		uint64_t hash = T_Hash()(key);
+		int8_t h = H2(hash);
+		uint64_t mask = Capacity / GROUP - 1;
+		uint64_t g = FirstGroup(hash);
+		// 按三角数跳跃，组数为2的幂时可以遍历所有组
+		for(uint64_t step = 1; ; step++) {
+			const CGroup& group = Groups[g];
+			for(uint32_t match = group.Match(h); match != 0; match &= match - 1) {
+				uint64_t pos = g * GROUP + static_cast<uint32_t>(__builtin_ctz(match));
+				if(Slots[pos].Key == key) {
+					return pos;
+				}
+			}
+			if(group.Match(EMPTY) != 0) {
+				return NPOS;
+			}
+			g = (g + step) & mask;
+		}
+	}
+
+	uint64_t FindFreePosition(uint64_t hash) const noexcept
+	{
+		uint64_t mask = Capacity / GROUP - 1;
+		uint64_t g = FirstGroup(hash);
+		for(uint64_t step = 1; ; step++) {
+			uint32_t match = Groups[g].MatchFree();
+			if(match != 0) {
+				return g * GROUP + static_cast<uint32_t>(__builtin_ctz(match));
+			}
+			g = (g + step) & mask;
+		}
+	}
+
+	void EraseAt(uint64_t pos) noexcept
+	{
+		Slots[pos].~CSlot();
+		// 所在组仍有空位置时，查找不会越过此组，可以直接置为空
+		if(Groups[pos / GROUP].Match(EMPTY) != 0) {
+			SetControl(pos, EMPTY);
+			GrowthLeft++;
+		}
+		else {
+			SetControl(pos, DELETED);
+		}
+		Size--;
+	}
+
+	void Resize(uint64_t capacity)
+	{
+		CGroup* groups = new(std::nothrow) CGroup[capacity / GROUP];
+		CSlot* slots = static_cast<CSlot*>(::malloc(capacity * sizeof(CSlot)));
+		if(nullptr == groups || nullptr == slots) {
+			delete[] groups;
+			::free(slots);
+			ThrowError(ERR_MEMORY_ALLOCATE, "CFlatHashMap failed to allocate " + num_to_string(uint64_t(capacity * (1 + sizeof(CSlot)))) + " bytes.");
+			return;
+		}
+		for(uint64_t i = 0; i < capacity / GROUP; i++) {
+			for(uint32_t j = 0; j < GROUP; j++) {
+				groups[i].Controls[j] = EMPTY;
+			}
+		}
+		CGroup* oldgroups = Groups;
+		CSlot* oldslots = Slots;
+		uint64_t oldcapacity = Capacity;
+		Groups = groups;
+		Slots = slots;
+		Capacity = capacity;
+		GrowthLeft = MaxLoad(capacity) - Size;
+		Resizes++;
+		for(uint64_t pos = 0; pos < oldcapacity; pos++) {
+			if(oldgroups[pos / GROUP].Controls[pos % GROUP] >= 0) {
+				uint64_t hash = T_Hash()(oldslots[pos].Key);
+				uint64_t newpos = FindFreePosition(hash);
+				SetControl(newpos, H2(hash));
+				new(&Slots[newpos]) CSlot(oldslots[pos].Key, oldslots[pos].Value);
+				oldslots[pos].~CSlot();
+			}
+		}
+		delete[] oldgroups;
+		::free(oldslots);
+	}
+};
+
+}
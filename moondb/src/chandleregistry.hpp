@@ -0,0 +1,248 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include "ctime.hpp"
+#include "creadmostlymutex.hpp"
+
+namespace MoonDb {
+
+/**
+ * CHandleRegistry按名称查找已打开的对象（数据库、表）的注册表，读多写少：
+ * 查找时原子读取当前的不可变哈希表，不加锁、不访问文件系统；添加新名称时复制出新表后原子替换，换下的表读者可能仍在使用，析构时释放。
+ * 名称对应的项添加后不删除，关闭对象时只清空项中的句柄；项也可以记录名称不存在（负缓存），MISSING_TTL之内再次查找时直接返回不存在，
+ * 负缓存的名称最多MAX_MISSING个，超过后不再缓存新的名称。修改由调用者或内部的互斥锁串行化。
+ * 请求用acquire取得的句柄在释放之前持有项的读锁（读多写少的锁，读者之间不修改共享的缓存行），invalidate等待这些句柄释放后才返回，之后可以安全地删除对象
+ */
+template <typename T>
+class CHandleRegistry
+{
+public:
+	const static size_t MAX_MISSING = 256;				/**< 负缓存最多的名称数 */
+	const static int64_t MISSING_TTL = 1000000000;		/**< 负缓存的有效时间，单位为纳秒 */
+
+	enum LookupResult {
+		LR_FOUND,		/**< 对象已打开 */
+		LR_MISSING,		/**< 近期确认过名称不存在 */
+		LR_UNKNOWN		/**< 没有记录或负缓存已过期，需要检查 */
+	};
+
+protected:
+	struct CEntry;
+
+public:
+	/**
+	 * CHandle由acquire取得的句柄，释放（析构或reset）之前对象不会被关闭；必须在取得句柄的线程中释放
+	 */
+	class CHandle
+	{
+	public:
+		CHandle() noexcept : Entry(nullptr), Handle(nullptr)
+		{}
+
+		CHandle(const CHandle&) = delete;
+		CHandle& operator=(const CHandle&) = delete;
+
+		~CHandle() noexcept
+		{
+			reset();
+		}
+
+		inline T* get() const noexcept
+		{
+			return Handle;
+		}
+
+		inline void reset() noexcept
+		{
+			if(nullptr != Entry) {
+				Entry->Readers.unlock_shared();
+				Entry = nullptr;
+				Handle = nullptr;
+			}
+		}
+
+	protected:
+		friend class CHandleRegistry;
+		CEntry* Entry;
+		T* Handle;
+	};
+
+	CHandleRegistry() : Current(nullptr), Missing(0)
+	{}
+
+	CHandleRegistry(const CHandleRegistry&) = delete;
+	CHandleRegistry& operator=(const CHandleRegistry&) = delete;
+
+	/**
+	 * @brief find 查找名称对应的句柄，不是LR_FOUND时handle为nullptr；不持有句柄，invalidate不等待
+	 */
+	inline LookupResult find(const std::string& name, T*& handle) const noexcept
+	{
+		handle = nullptr;
+		const CMap* map = Current.load(std::memory_order_acquire);
+		if(nullptr == map) {
+			return LR_UNKNOWN;
+		}
+		auto it = map->find(name);
+		if(it == map->end()) {
+			return LR_UNKNOWN;
+		}
+		handle = it->second->Handle.load(std::memory_order_acquire);
+		if(nullptr != handle) {
+			return LR_FOUND;
+		}
+		return IsMissing(*it->second) ? LR_MISSING : LR_UNKNOWN;
+	}
+
+	/**
+	 * @brief acquire 与find相同，LR_FOUND时handle持有找到的句柄，释放之前invalidate等待，对象不会被关闭
+	 */
+	inline LookupResult acquire(const std::string& name, CHandle& handle) const
+	{
+		handle.reset();
+		const CMap* map = Current.load(std::memory_order_acquire);
+		if(nullptr == map) {
+			return LR_UNKNOWN;
+		}
+		auto it = map->find(name);
+		if(it == map->end()) {
+			return LR_UNKNOWN;
+		}
+		CEntry* entry = it->second;
+		entry->Readers.lock_shared();
+		T* object = entry->Handle.load(std::memory_order_acquire);
+		if(nullptr != object) {
+			handle.Entry = entry;
+			handle.Handle = object;
+			return LR_FOUND;
+		}
+		entry->Readers.unlock_shared();
+		return IsMissing(*entry) ? LR_MISSING : LR_UNKNOWN;
+	}
+
+	/**
+	 * @brief insert 打开对象后登记句柄
+	 */
+	void insert(const std::string& name, T* handle)
+	{
+		std::lock_guard<std::mutex> lck(Mutex);
+		CEntry* entry = GetEntry(name, true);
+		entry->MissingTime.store(0, std::memory_order_relaxed);
+		entry->Handle.store(handle, std::memory_order_release);
+	}
+
+	/**
+	 * @brief invalidate 关闭对象之前清空句柄，之后的查找返回LR_UNKNOWN；等待acquire取得的该名称的句柄全部释放后返回，
+	 * 调用者不能持有该名称的句柄。find得到的句柄不受保护，只能在持有其他保证对象存在的锁时使用
+	 */
+	void invalidate(const std::string& name)
+	{
+		std::lock_guard<std::mutex> lck(Mutex);
+		CEntry* entry = GetEntry(name, false);
+		if(nullptr != entry) {
+			std::unique_lock<CReadMostlyMutex> rlck(entry->Readers);
+			entry->Handle.store(nullptr, std::memory_order_release);
+			entry->MissingTime.store(0, std::memory_order_relaxed);
+		}
+	}
+
+	/**
+	 * @brief set_missing 记录名称不存在，负缓存已满时只更新已有的项
+	 */
+	void set_missing(const std::string& name)
+	{
+		std::lock_guard<std::mutex> lck(Mutex);
+		CEntry* entry = GetEntry(name, false);
+		if(nullptr == entry) {
+			if(Missing >= MAX_MISSING) {
+				return;
+			}
+			entry = GetEntry(name, true);
+			Missing++;
+		}
+		entry->Handle.store(nullptr, std::memory_order_release);
+		entry->MissingTime.store(CTime::Now(), std::memory_order_relaxed);
+	}
+
+	/**
+	 * @brief for_each 对已登记的句柄调用func(const std::string& name, T* handle)
+	 */
+	template <typename T_Func>
+	void for_each(T_Func func) const
+	{
+		const CMap* map = Current.load(std::memory_order_acquire);
+		if(nullptr == map) {
+			return;
+		}
+		for(auto it = map->begin(); it != map->end(); it++) {
+			T* handle = it->second->Handle.load(std::memory_order_acquire);
+			if(nullptr != handle) {
+				func(it->first, handle);
+			}
+		}
+	}
+
+	/**
+	 * @brief clear 删除全部项并释放各版本的哈希表，调用时不能有并发的查找和未释放的句柄
+	 */
+	void clear() noexcept
+	{
+		std::lock_guard<std::mutex> lck(Mutex);
+		Current.store(nullptr, std::memory_order_release);
+		Versions.clear();
+		Entries.clear();
+		Missing = 0;
+	}
+
+protected:
+	struct CEntry {
+		std::atomic<T*> Handle{nullptr};
+		std::atomic<int64_t> MissingTime{0};	/**< 确认名称不存在的时间，0表示没有确认过 */
+		mutable CReadMostlyMutex Readers;		/**< acquire取得的句柄持有读锁，invalidate加写锁等待句柄释放 */
+	};
+	typedef std::unordered_map<std::string, CEntry*> CMap;
+
+	std::mutex Mutex;									/**< 修改的互斥锁 */
+	std::atomic<const CMap*> Current;					/**< 当前的哈希表，替换后不再修改 */
+	std::vector<std::unique_ptr<const CMap>> Versions;	/**< 各版本的哈希表，读者可能仍在使用旧版本，析构或clear时释放 */
+	std::vector<std::unique_ptr<CEntry>> Entries;		/**< 各版本共用的项 */
+	size_t Missing;										/**< 负缓存添加的名称数 */
+
+	static inline bool IsMissing(const CEntry& entry) noexcept
+	{
+		int64_t missing = entry.MissingTime.load(std::memory_order_relaxed);
+		return missing > 0 && CTime::Now() - missing < MISSING_TTL;
+	}
+
+	/**
+	 * @brief GetEntry 返回名称对应的项，不存在并且create为true时复制出包含新项的哈希表并替换，调用时持有Mutex
+	 */
+	CEntry* GetEntry(const std::string& name, bool create)
+	{
+		const CMap* map = Current.load(std::memory_order_relaxed);
+		if(nullptr != map) {
+			auto it = map->find(name);
+			if(it != map->end()) {
+				return it->second;
+			}
+		}
+		if(!create) {
+			return nullptr;
+		}
+		std::unique_ptr<CMap> more(nullptr == map ? new CMap : new CMap(*map));
+		Entries.emplace_back(new CEntry);
+		CEntry* entry = Entries.back().get();
+		more->emplace(name, entry);
+		Versions.emplace_back(more.get());
+		Current.store(more.release(), std::memory_order_release);
+		return entry;
+	}
+};
+
+}
@@ -0,0 +1,219 @@
+#pragma once
+
+#if defined(__linux__) && defined(__has_include)
+	#if __has_include(<linux/io_uring.h>)
+		#define MOONDB_IO_URING 1
+	#endif
+#endif
+
+#if defined(MOONDB_IO_URING)
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+namespace MoonDb {
+
+/**
+ * CIoUring为io_uring的简单封装，直接使用系统调用，不依赖liburing。
+ * 提交和完成队列都只能在同一个线程中操作
+ */
+class CIoUring
+{
+public:
+	CIoUring() noexcept
+		: Fd(-1), SqRing(nullptr), CqRing(nullptr), Sqes(nullptr), SqRingSize(0), CqRingSize(0), SqesSize(0),
+		  SqHead(nullptr), SqTail(nullptr), SqArray(nullptr), SqMask(0), SqEntries(0), SqLocalTail(0),
+		  CqHead(nullptr), CqTail(nullptr), Cqes(nullptr), CqMask(0)
+	{}
+
+	CIoUring(const CIoUring&) = delete;
+	CIoUring& operator=(const CIoUring&) = delete;
+
+	~CIoUring()
+	{
+		Close();
+	}
+
+	/**
+	 * @brief Initialize 创建io_uring并映射提交、完成队列
+	 * @param entries 提交队列长度
+	 * @return 成功返回0，失败返回-errno
+	 */
+	inline int Initialize(uint32_t entries) noexcept
+	{
+		io_uring_params params;
+		::memset(&params, 0, sizeof(params));
+		Fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+		if(Fd < 0) {
+			Fd = -1;
+			return -errno;
+		}
+		SqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+		CqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		bool singlemmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+		if(singlemmap) {
+			SqRingSize = CqRingSize = std::max(SqRingSize, CqRingSize);
+		}
+		SqRing = ::mmap(nullptr, SqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Fd, IORING_OFF_SQ_RING);
+		if(MAP_FAILED == SqRing) {
+			SqRing = nullptr;
+			return Fail();
+		}
+		if(singlemmap) {
+			CqRing = SqRing;
+		}
+		else {
+			CqRing = ::mmap(nullptr, CqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Fd, IORING_OFF_CQ_RING);
+			if(MAP_FAILED == CqRing) {
+				CqRing = nullptr;
+				return Fail();
+			}
+		}
+		SqesSize = params.sq_entries * sizeof(io_uring_sqe);
+		void* sqes = ::mmap(nullptr, SqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Fd, IORING_OFF_SQES);
+		if(MAP_FAILED == sqes) {
+			return Fail();
+		}
+		Sqes = static_cast<io_uring_sqe*>(sqes);
+
+		char* sq = static_cast<char*>(SqRing);
+		SqHead = reinterpret_cast<uint32_t*>(sq + params.sq_off.head);
+		SqTail = reinterpret_cast<uint32_t*>(sq + params.sq_off.tail);
+		SqMask = *reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_mask);
+		SqEntries = params.sq_entries;
+		SqArray = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+		SqLocalTail = *SqTail;
+		// 按顺序使用提交项，索引数组一次设置即可
+		for(uint32_t i = 0; i < SqEntries; i++) {
+			SqArray[i] = i;
+		}
+
+		char* cq = static_cast<char*>(CqRing);
+		CqHead = reinterpret_cast<uint32_t*>(cq + params.cq_off.head);
+		CqTail = reinterpret_cast<uint32_t*>(cq + params.cq_off.tail);
+		CqMask = *reinterpret_cast<uint32_t*>(cq + params.cq_off.ring_mask);
+		Cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+		return 0;
+	}
+
+	inline void Close() noexcept
+	{
+		if(nullptr != Sqes) {
+			::munmap(Sqes, SqesSize);
+			Sqes = nullptr;
+		}
+		if(nullptr != CqRing && CqRing != SqRing) {
+			::munmap(CqRing, CqRingSize);
+		}
+		CqRing = nullptr;
+		if(nullptr != SqRing) {
+			::munmap(SqRing, SqRingSize);
+			SqRing = nullptr;
+		}
+		if(Fd >= 0) {
+			::close(Fd);
+			Fd = -1;
+		}
+	}
+
+	inline bool IsOpen() const noexcept
+	{
+		return Fd >= 0;
+	}
+
+	/**
+	 * @brief GetSqe 取得一个空闲的提交项，已清零
+	 * @return 提交队列已满返回nullptr，需先调用Submit
+	 */
+	inline io_uring_sqe* GetSqe() noexcept
+	{
+		if(SqLocalTail - __atomic_load_n(SqHead, __ATOMIC_ACQUIRE) >= SqEntries) {
+			return nullptr;
+		}
+		io_uring_sqe* sqe = &Sqes[SqLocalTail & SqMask];
+		SqLocalTail++;
+		::memset(sqe, 0, sizeof(io_uring_sqe));
+		return sqe;
+	}
+
+	/**
+	 * @brief SpaceLeft 提交队列中剩余的空闲提交项个数
+	 */
+	inline uint32_t SpaceLeft() const noexcept
+	{
+		return SqEntries - (SqLocalTail - __atomic_load_n(SqHead, __ATOMIC_ACQUIRE));
+	}
+
+	/**
+	 * @brief Submit 提交所有准备好的提交项，并等待至少waitnr个完成事件
+	 * @return 成功返回提交的个数，失败返回-errno
+	 */
+	inline int Submit(uint32_t waitnr) noexcept
+	{
+		uint32_t tosubmit = SqLocalTail - *SqTail;
+		__atomic_store_n(SqTail, SqLocalTail, __ATOMIC_RELEASE);
+		int ret = static_cast<int>(::syscall(__NR_io_uring_enter, Fd, tosubmit, waitnr, waitnr > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+		return ret < 0 ? -errno : ret;
+	}
+
+	/**
+	 * @brief ForEachCompletion 依次处理已完成的事件
+	 * @param func 处理函数，参数为(user_data, res, flags)，处理函数中可以继续调用GetSqe和Submit
+	 * @return 处理的事件个数
+	 */
+	template <typename T_Func>
+	inline uint32_t ForEachCompletion(T_Func func)
+	{
+		uint32_t count = 0;
+		uint32_t head = *CqHead;
+		while(head != __atomic_load_n(CqTail, __ATOMIC_ACQUIRE)) {
+			const io_uring_cqe* cqe = &Cqes[head & CqMask];
+			uint64_t userdata = cqe->user_data;
+			int32_t res = cqe->res;
+			uint32_t flags = cqe->flags;
+			head++;
+			__atomic_store_n(CqHead, head, __ATOMIC_RELEASE);
+			func(userdata, res, flags);
+			count++;
+		}
+		return count;
+	}
+
+protected:
+	inline int Fail() noexcept
+	{
+		int err = -errno;
+		Close();
+		return err;
+	}
+
+	int Fd;
+	void* SqRing;
+	void* CqRing;
+	io_uring_sqe* Sqes;
+	size_t SqRingSize;
+	size_t CqRingSize;
+	size_t SqesSize;
+
+	uint32_t* SqHead;
+	uint32_t* SqTail;
+	uint32_t* SqArray;
+	uint32_t SqMask;
+	uint32_t SqEntries;
+	uint32_t SqLocalTail;		/**< 本地写位置，Submit时写回SqTail */
+
+	uint32_t* CqHead;
+	uint32_t* CqTail;
+	io_uring_cqe* Cqes;
+	uint32_t CqMask;
+};
+
+}
+
+#endif
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "crunningerror.hpp"
+#include "functions.hpp"
+
+namespace MoonDb {
+
+/**
+ * CMappedFile映射到内存的文件（MAP_SHARED）：修改直接写入页缓存，由系统写回磁盘，Sync时同步写回。
+ * 文件只增长，Resize扩大文件后重新映射，之前取得的地址失效，调用者需要保证此时没有其他线程访问
+ */
+class CMappedFile
+{
+public:
+	CMappedFile() noexcept : Fd(-1), Data(nullptr), Size(0), Random(false)
+	{}
+
+	CMappedFile(const CMappedFile&) = delete;
+	CMappedFile& operator=(const CMappedFile&) = delete;
+
+	~CMappedFile() noexcept
+	{
+		Close();
+	}
+
+	/**
+	 * @brief Open 打开或创建文件并映射，文件小于minsize时扩大到minsize（新增部分为0）
+	 * @param random 是否随机访问，为true时不预读
+	 */
+	bool Open(const std::string& filename, uint64_t minsize, bool random = false)
+	{
+		Close();
+		Filename = filename;
+		Random = random;
+#if defined(_WIN32)
+		ThrowError(ERR_FILE_OPEN, "Memory-mapped file " + Filename + " isn't supported on this platform.");
+		return false;
+#else
+		Fd = ::open(Filename.c_str(), O_RDWR | O_CREAT, 0644);
+		if(Fd < 0) {
+			ThrowError(ERR_FILE_OPEN, "Can't open the file " + Filename + ": " + ::strerror(errno));
+			return false;
+		}
+		struct stat st;
+		if(::fstat(Fd, &st) != 0) {
+			ThrowError(ERR_FILE_OPEN, "Can't stat the file " + Filename + ": " + ::strerror(errno));
+			return false;
+		}
+		Size = static_cast<uint64_t>(st.st_size);
+		return Resize(Size < minsize ? minsize : Size);
+#endif
+	}
+
+	/**
+	 * @brief Resize 把文件扩大到size字节并重新映射，size不大于当前大小时只在未映射时映射
+	 */
+	bool Resize(uint64_t size)
+	{
+#if !defined(_WIN32)
+		if(size > Size) {
+			if(::ftruncate(Fd, static_cast<off_t>(size)) != 0) {
+				ThrowError(ERR_FILE_WRITE, "Can't extend the file " + Filename + " to " + num_to_string(size) + " bytes: " + ::strerror(errno));
+				return false;
+			}
+		}
+		else if(nullptr != Data) {
+			return true;
+		}
+		else {
+			size = Size;
+		}
+		if(nullptr != Data) {
+			::munmap(Data, Size);
+			Data = nullptr;
+		}
+		Size = size;
+		if(0 == Size) {
+			return true;
+		}
+		void* p = ::mmap(nullptr, Size, PROT_READ | PROT_WRITE, MAP_SHARED, Fd, 0);
+		if(MAP_FAILED == p) {
+			ThrowError(ERR_FILE_OPEN, "Can't map the file " + Filename + " (" + num_to_string(Size) + " bytes): " + ::strerror(errno));
+			return false;
+		}
+		Data = static_cast<char*>(p);
+		if(Random) {
+			::posix_madvise(Data, Size, POSIX_MADV_RANDOM);
+		}
+#endif
+		return true;
+	}
+
+	/**
+	 * @brief Sync 把修改同步写回磁盘
+	 */
+	void Sync()
+	{
+#if !defined(_WIN32)
+		if(nullptr != Data && ::msync(Data, Size, MS_SYNC) != 0) {
+			ThrowError(ERR_FILE_WRITE, "Can't sync the file " + Filename + ": " + ::strerror(errno));
+		}
+#endif
+	}
+
+	void Close() noexcept
+	{
+#if !defined(_WIN32)
+		if(nullptr != Data) {
+			::munmap(Data, Size);
+			Data = nullptr;
+		}
+		if(Fd >= 0) {
+			::close(Fd);
+			Fd = -1;
+		}
+#endif
+		Size = 0;
+	}
+
+	inline char* GetPointer() noexcept
+	{
+		return Data;
+	}
+
+	inline const char* GetPointer() const noexcept
+	{
+		return Data;
+	}
+
+	inline uint64_t GetSize() const noexcept
+	{
+		return Size;
+	}
+
+	inline bool IsOpen() const noexcept
+	{
+		return nullptr != Data;
+	}
+
+	/**
+	 * @brief GrowSize 容纳needed字节时扩大后的大小：加倍，每次最多增加1GB，按4KB对齐
+	 */
+	static inline uint64_t GrowSize(uint64_t current, uint64_t needed) noexcept
+	{
+		const uint64_t step = static_cast<uint64_t>(1) << 30;
+		uint64_t size = current + (current < step ? current : step);
+		if(size < needed) {
+			size = needed;
+		}
+		return (size + 4095) & ~static_cast<uint64_t>(4095);
+	}
+
+protected:
+	std::string Filename;
+	int Fd;
+	char* Data;
+	uint64_t Size;
+	bool Random;
+};
+
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include "ctime.hpp"
+
+namespace MoonDb {
+
+/**
+ * CMemoryBudget所有内存表共用的内存预算：添加数据时计入行和键表项的字节数，删除时扣除，超过预算时由添加数据的表按淘汰策略淘汰自己的数据。
+ * 读取数据时调用Touch记录访问信息，只读取粗略时钟Clock并修改行自己的访问字段，不加锁、不分配内存；Clock由后台线程调用Tick更新
+ */
+class CMemoryBudget
+{
+public:
+	enum PolicyType {
+		EP_NONE,		/**< 不淘汰，超过预算时添加数据出错 */
+		EP_LRU,			/**< 近似LRU：抽样若干行，淘汰最久未访问的 */
+		EP_LFU			/**< 近似LFU：抽样若干行，淘汰访问计数（按分钟衰减）最小的 */
+	};
+
+	const static uint32_t LFU_INIT = 5;			/**< 新数据的访问计数，避免刚添加就被淘汰 */
+	const static uint32_t LFU_LOG_FACTOR = 10;	/**< 访问计数按对数增长，计数越大增加的概率越小 */
+
+	CMemoryBudget() noexcept : Limit(0), Policy(EP_NONE), Samples(5), Start(CTime::Now()), Clock(0), Used(0), Evicted(0)
+	{}
+
+	CMemoryBudget(const CMemoryBudget&) = delete;
+	CMemoryBudget& operator=(const CMemoryBudget&) = delete;
+
+	/**
+	 * @brief Initialize 在加载数据之前设置
+	 * @param limit 最大字节数，为0表示不限制
+	 * @param samples 每次淘汰抽样的行数
+	 */
+	inline void Initialize(uint64_t limit, PolicyType policy, uint32_t samples) noexcept
+	{
+		Limit = limit;
+		Policy = policy;
+		Samples = samples;
+	}
+
+	/**
+	 * @brief Tick 更新时钟，单位为毫秒
+	 */
+	inline void Tick() noexcept
+	{
+		Clock.store(static_cast<uint64_t>((CTime::Now() - Start) / (CTime::NanoTime / 1000)), std::memory_order_relaxed);
+	}
+
+	inline bool Exceeded(uint64_t bytes) const noexcept
+	{
+		return Limit > 0 && Used.load(std::memory_order_relaxed) + bytes > Limit;
+	}
+
+	inline void Charge(uint64_t bytes) noexcept
+	{
+		Used.fetch_add(bytes, std::memory_order_relaxed);
+	}
+
+	inline void Release(uint64_t bytes) noexcept
+	{
+		Used.fetch_sub(bytes, std::memory_order_relaxed);
+	}
+
+	/**
+	 * @brief InitialAccess 新数据的访问字段
+	 */
+	inline uint32_t InitialAccess() const noexcept
+	{
+		return EP_LFU == Policy ? (Minutes() << 8 | LFU_INIT) : Milliseconds();
+	}
+
+	/**
+	 * @brief Touch 记录一次访问，与其他读者并发时可能丢失一次更新；值不变时不写，热点数据的缓存行不在读者之间来回传递
+	 */
+	inline void Touch(std::atomic<uint32_t>& access) const noexcept
+	{
+		uint32_t old = access.load(std::memory_order_relaxed);
+		uint32_t now;
+		switch(Policy) {
+		case EP_LRU:
+			now = Milliseconds();
+			break;
+		case EP_LFU:
+			{
+				uint32_t counter = Decay(old);
+				if(counter < 255 && Random() < (static_cast<uint64_t>(1) << 32) / ((counter > LFU_INIT ? counter - LFU_INIT : 0) * LFU_LOG_FACTOR + 1)) {
+					counter++;
+				}
+				now = Minutes() << 8 | counter;
+			}
+			break;
+		default:
+			return;
+		}
+		if(now != old) {
+			access.store(now, std::memory_order_relaxed);
+		}
+	}
+
+	/**
+	 * @brief Rank 淘汰顺序，越小越先淘汰
+	 */
+	inline uint32_t Rank(uint32_t access) const noexcept
+	{
+		// LRU记录毫秒数的低32位，按未访问的时间排序，回绕（约49天）后仍然正确
+		return EP_LFU == Policy ? Decay(access) : ~(Milliseconds() - access);
+	}
+
+	/**
+	 * @brief Random 线程内的伪随机数（xorshift），用于抽样和LFU计数
+	 */
+	static inline uint32_t Random() noexcept
+	{
+		static thread_local uint64_t state = static_cast<uint64_t>(CTime::Now()) | 1;
+		state ^= state >> 12;
+		state ^= state << 25;
+		state ^= state >> 27;
+		return static_cast<uint32_t>((state * 0x2545F4914F6CDD1DULL) >> 32);
+	}
+
+	uint64_t Limit;					/**< 最大字节数，为0表示不限制 */
+	PolicyType Policy;				/**< 淘汰策略 */
+	uint32_t Samples;				/**< 每次淘汰抽样的行数 */
+	std::chrono::high_resolution_clock::rep Start;
+	std::atomic<uint64_t> Clock;	/**< 启动后的毫秒数 */
+	std::atomic<uint64_t> Used;		/**< 已使用的字节数 */
+	std::atomic<uint64_t> Evicted;	/**< 淘汰的总行数 */
+
+protected:
+	inline uint32_t Milliseconds() const noexcept
+	{
+		return static_cast<uint32_t>(Clock.load(std::memory_order_relaxed));
+	}
+
+	inline uint32_t Minutes() const noexcept
+	{
+		return static_cast<uint32_t>(Clock.load(std::memory_order_relaxed) / 60000) & 0xFFFFFF;
+	}
+
+	/**
+	 * @brief Decay 按上次访问后经过的分钟数衰减的访问计数（低8位为计数，高24位为上次访问的分钟数）
+	 */
+	inline uint32_t Decay(uint32_t access) const noexcept
+	{
+		uint32_t counter = access & 0xFF;
+		uint32_t elapsed = (Minutes() - (access >> 8)) & 0xFFFFFF;
+		return elapsed >= counter ? 0 : counter - elapsed;
+	}
+};
+
+}
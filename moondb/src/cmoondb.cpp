@@ -5,18 +5,26 @@ namespace MoonDb {
 
 CMoonDb::CMoonDb()
 {
-	BytesPerRead = 8192;
 
 	Started = false;
 	Stopped = false;
+	BackgroundStarted = false;
+	DataSeverSocket = INVALID_SOCKET;
 	Restart = false;
 	AsyncThreadNum = 0;
 	SynchThreadNum = 0;
 	GroupConnectionNum = 0;
 
 	GroupConnectionNumPerThread = nullptr;
+#if defined(__linux__)
+	EpollFd = -1;
+	EpollEventFd = -1;
+	GroupWorkers = nullptr;
+#endif
 
 	LoadAllSchemasOnLoading = false;
+	ReusePort = false;
+	IoUring = false;
 
 #if defined(_WIN32)
 	WSADATA ws;
@@ -373,7 +381,11 @@ void CMoonDb::LoadConfiguration(const string& programdir, bool showinfo, const s
 			TriggerError("Wrong Async:" + content);
 		}
 		Async = stoul(content);
+#if defined(__linux__)
+		if(Async > 3) {
+#else
 		if(Async > 2) {
+#endif
 			TriggerError("Wrong Async:" + content);
 		}
 	}
@@ -385,6 +397,56 @@ void CMoonDb::LoadConfiguration(const string& programdir, bool showinfo, const s
 #endif
 	}
 
+	if(params.find("ReusePort") != params.end()) {
+		string content = to_lower_copy(params["ReusePort"].content);
+		if("1" == content || "true" == content) {
+			ReusePort = true;
+		}
+		else if("0" == content || "false" == content){
+			ReusePort = false;
+		}
+		else {
+			TriggerError("Wrong ReusePort:" + content);
+		}
+#if defined(__linux__) && defined(SO_REUSEPORT)
+		if(ReusePort && 2 != Async) {
+			TriggerError("ReusePort only works with Async=2");
+		}
+#else
+		if(ReusePort) {
+			TriggerError("ReusePort isn't supported on this platform");
+		}
+#endif
+	}
+	else {
+		ReusePort = false;
+	}
+
+	if(params.find("IoUring") != params.end()) {
+		string content = to_lower_copy(params["IoUring"].content);
+		if("1" == content || "true" == content) {
+			IoUring = true;
+		}
+		else if("0" == content || "false" == content){
+			IoUring = false;
+		}
+		else {
+			TriggerError("Wrong IoUring:" + content);
+		}
+#if defined(MOONDB_IO_URING)
+		if(IoUring && 3 != Async) {
+			TriggerError("IoUring only works with Async=3");
+		}
+#else
+		if(IoUring) {
+			TriggerError("IoUring isn't supported on this platform");
+		}
+#endif
+	}
+	else {
+		IoUring = false;
+	}
+
 	if(params.find("LoadAllSchemasOnLoading") != params.end()) {
 		string content = to_lower_copy(params["LoadAllSchemasOnLoading"].content);
 		if("1" == content || "true" == content) {
@@ -398,35 +460,143 @@ void CMoonDb::LoadConfiguration(const string& programdir, bool showinfo, const s
 		}
 	}
 
-	//cout << DataDirectory << "," << Port << "," << MaxThreads << "," << BackLog << "," << MaxConnections << "," << MaxAllowedPacket << endl;
-}
+	if(params.find("ExpireInterval") != params.end()) {
+		string content = params["ExpireInterval"].content;
+		if(!is_digit(content)) {
+			TriggerError("Wrong ExpireInterval:" + content);
+		}
+		ExpireInterval = stoul(content);
+		if(0 == ExpireInterval || ExpireInterval > 60000) {
+			TriggerError("Wrong ExpireInterval (1-60000):" + content);
+		}
+	}
+	else {
+		ExpireInterval = 100;
+	}
 
-uint32_t CMoonDb::SynchGetNewThreadNum()
-{
-	if(MaxThreads > 1) {
-		ThreadMutex.lock();
+	if(params.find("ExpireBatch") != params.end()) {
+		string content = params["ExpireBatch"].content;
+		if(!is_digit(content)) {
+			TriggerError("Wrong ExpireBatch:" + content);
+		}
+		ExpireBatch = stoul(content);
+		if(0 == ExpireBatch) {
+			TriggerError("Wrong ExpireBatch (1-4294967295):" + content);
+		}
 	}
-	SynchThreadNum ++;
-	uint32_t num = SynchIdleThreads.front();
-	SynchIdleThreads.pop();
-	if(MaxThreads > 1) {
-		ThreadMutex.unlock();
+	else {
+		ExpireBatch = 10000;
 	}
-	return num;
-}
 
-void CMoonDb::SynchDeleteThread(uint32_t threadid)
-{
-	if(MaxThreads > 1) {
-		ThreadMutex.lock();
+	uint64_t maxmemory = 0;
+	if(params.find("MaxMemory") != params.end()) {
+		string content = params["MaxMemory"].content;
+		if(!is_capacity(content)) {
+			TriggerError("Wrong MaxMemory:" + content);
+		}
+		char unit = content[content.size() - 1];
+		maxmemory = stoull(::isdigit(unit) ? content : content.substr(0, content.size() - 1));
+		switch(::toupper(unit)) {
+		case 'K':
+			maxmemory *= 1024;
+			break;
+		case 'M':
+			maxmemory *= 1048576;
+			break;
+		}
 	}
-	SynchIdleThreads.push(threadid);
-	if(SynchThreadNum > 0) {
-		SynchThreadNum --;
+
+	CMemoryBudget::PolicyType policy = CMemoryBudget::EP_NONE;
+	if(params.find("EvictionPolicy") != params.end()) {
+		string content = to_lower_copy(params["EvictionPolicy"].content);
+		if("lru" == content) {
+			policy = CMemoryBudget::EP_LRU;
+		}
+		else if("lfu" == content) {
+			policy = CMemoryBudget::EP_LFU;
+		}
+		else if("none" != content) {
+			TriggerError("Wrong EvictionPolicy (none, lru, lfu):" + content);
+		}
 	}
-	if(MaxThreads > 1) {
-		ThreadMutex.unlock();
+
+	uint32_t samples = 5;
+	if(params.find("EvictionSamples") != params.end()) {
+		string content = params["EvictionSamples"].content;
+		if(!is_digit(content)) {
+			TriggerError("Wrong EvictionSamples:" + content);
+		}
+		samples = stoul(content);
+		if(0 == samples || samples > 64) {
+			TriggerError("Wrong EvictionSamples (1-64):" + content);
+		}
+	}
+	// 超过MaxMemory或表的最大行数时按EvictionPolicy淘汰数据，为none时添加数据出错
+	CTable::MemoryBudget.Initialize(maxmemory, policy, samples);
+
+	CRedoLog::CSettings redolog;
+	if(params.find("RedoLog") != params.end()) {
+		string content = to_lower_copy(params["RedoLog"].content);
+		if("1" == content || "true" == content) {
+			redolog.Enabled = true;
+		}
+		else if("0" == content || "false" == content){
+			redolog.Enabled = false;
+		}
+		else {
+			TriggerError("Wrong RedoLog:" + content);
+		}
+	}
+
+	// always：每次修改同步写入磁盘；毫秒数：每隔该时间写入并同步一次；never：写入文件，由系统写回磁盘
+	if(params.find("RedoLogSync") != params.end()) {
+		string content = to_lower_copy(params["RedoLogSync"].content);
+		if("always" == content) {
+			redolog.Sync = CRedoLog::SP_ALWAYS;
+		}
+		else if("never" == content) {
+			redolog.Sync = CRedoLog::SP_NEVER;
+		}
+		else if(is_digit(content)) {
+			redolog.Sync = CRedoLog::SP_INTERVAL;
+			redolog.SyncInterval = stoul(content);
+			if(0 == redolog.SyncInterval || redolog.SyncInterval > 60000) {
+				TriggerError("Wrong RedoLogSync (always, never, 1-60000):" + content);
+			}
+		}
+		else {
+			TriggerError("Wrong RedoLogSync (always, never, 1-60000):" + content);
+		}
+	}
+
+	if(params.find("SnapshotInterval") != params.end()) {
+		string content = params["SnapshotInterval"].content;
+		if(!is_digit(content)) {
+			TriggerError("Wrong SnapshotInterval:" + content);
+		}
+		redolog.SnapshotInterval = stoul(content);
+	}
+
+	if(params.find("SnapshotLogSize") != params.end()) {
+		string content = params["SnapshotLogSize"].content;
+		if(!is_capacity(content)) {
+			TriggerError("Wrong SnapshotLogSize:" + content);
+		}
+		char unit = content[content.size() - 1];
+		redolog.SnapshotLogSize = stoull(::isdigit(unit) ? content : content.substr(0, content.size() - 1));
+		switch(::toupper(unit)) {
+		case 'K':
+			redolog.SnapshotLogSize *= 1024;
+			break;
+		case 'M':
+			redolog.SnapshotLogSize *= 1048576;
+			break;
+		}
 	}
+	// 启用RedoLog时内存表在打开时从快照和日志恢复数据，后台线程按RedoLogSync写入日志，每隔SnapshotInterval秒或日志超过SnapshotLogSize时生成快照
+	CTable::RedoLogSettings = redolog;
+
+	//cout << DataDirectory << "," << Port << "," << MaxThreads << "," << BackLog << "," << MaxConnections << "," << MaxAllowedPacket << endl;
 }
 
 SOCKET CMoonDb::_CreateSocket(bool asyn)
@@ -456,6 +626,13 @@ SOCKET CMoonDb::_CreateSocket(bool asyn)
 	if(setsockopt(socksvr, SOL_SOCKET, SO_REUSEADDR, static_cast<char*>(static_cast<void*>(&on)), sizeof(on))) {
 		CLog::Instance()->Put(CLog::L_WARNING, "setsockopt() failed (SO_REUSEADDR): " + MoonLastError());
 	}
+#if defined(SO_REUSEPORT)
+	// 多个线程各自绑定同一端口，由内核分配新连接
+	if(ReusePort && setsockopt(socksvr, SOL_SOCKET, SO_REUSEPORT, static_cast<char*>(static_cast<void*>(&on)), sizeof(on))) {
+		Clear();
+		TriggerError("setsockopt() failed (SO_REUSEPORT): " + MoonLastError());
+	}
+#endif
 
 	return socksvr;
 }
@@ -616,7 +793,7 @@ void CMoonDb::Start()
 	}
 
 	if(Async) {
-		if(1 == Async) {
+		if(1 == Async || 3 == Async) {
 			AsyncConnections.initialize(MaxConnections, MaxConnections);
 		}
 		else if(2 == Async) {
@@ -628,10 +805,10 @@ void CMoonDb::Start()
 		}
 	}
 	else {
-		SynchBuffers.resize(MaxThreads);
+		SynchConnections.resize(MaxThreads);
 		for(uint32_t i = 0; i < MaxThreads; i++) {
-			SynchBuffers[i].Reallocate(static_cast<size_t>(max(ReceiveBufSize, SendBufSize)));
-			SynchIdleThreads.push(i);
+			SynchConnections[i].Buffer.Reallocate(static_cast<size_t>(SendBufSize));
+			SynchConnections[i].Input.Reallocate(static_cast<size_t>(ReceiveBufSize));
 		}
 	}
 
@@ -645,18 +822,24 @@ void CMoonDb::Start()
 
 void CMoonDb::Clear() noexcept
 {
-	MoonSockClose(DataSeverSocket);
+	// 后台线程遍历数据库，删除数据库之前结束
+	StopBackground();
+	if(INVALID_SOCKET != DataSeverSocket) {
+		MoonSockClose(DataSeverSocket);
+		DataSeverSocket = INVALID_SOCKET;
+	}
 //	MoonSockClose(ManagementSeverSocket);
+	DatabaseHandles.clear();
 	if(Databases.size() > 0) {
+		// 互斥锁由DatabaseMutexes管理，最后放入DeletedDbMutexes备用，析构时统一释放
 		for(auto it = Databases.begin(); it != Databases.end(); it++)	{
-			delete it->second->GetMutex();
 			delete it->second;
 		}
 		Databases.clear();
 	}
 	if(Async) {
 		AsyncThreadNum = 0;
-		if(1 == Async) {
+		if(1 == Async || 3 == Async) {
 			AsyncConnections.clear();
 			while(!AsyncNewConnections.empty()) {
 				AsyncNewConnections.pop();
@@ -665,18 +848,52 @@ void CMoonDb::Clear() noexcept
 		else if(2 == Async) {
 			GroupConnectionNum = 0;
 			delete [] GroupConnectionNumPerThread;
+			GroupConnectionNumPerThread = nullptr;
 			GroupNewConnections.clear();
+#if defined(__linux__)
+			if(nullptr != GroupWorkers) {
+				for(uint32_t i = 0; i < MaxThreads; i++) {
+					if(GroupWorkers[i].EpollFd >= 0) {
+						::close(GroupWorkers[i].EpollFd);
+					}
+					if(GroupWorkers[i].EventFd >= 0) {
+						::close(GroupWorkers[i].EventFd);
+					}
+					if(INVALID_SOCKET != GroupWorkers[i].Listener && DataSeverSocket != GroupWorkers[i].Listener) {
+						MoonSockClose(GroupWorkers[i].Listener);
+					}
+				}
+				delete [] GroupWorkers;
+				GroupWorkers = nullptr;
+			}
+#endif
 //			while(!GroupNewConnections.empty()) {
 //				GroupNewConnections.pop();
 //			}
 		}
+#if defined(__linux__)
+		if(EpollFd >= 0) {
+			::close(EpollFd);
+			EpollFd = -1;
+		}
+		if(3 == Async) {
+#if defined(MOONDB_IO_URING)
+			Uring.Close();
+#endif
+			if(EpollEventFd >= 0) {
+				::close(EpollEventFd);
+				EpollEventFd = -1;
+			}
+			while(!EpollDoneConnections.empty()) {
+				EpollDoneConnections.pop();
+			}
+			EpollClosedConnections.clear();
+		}
+#endif
 	}
 	else {
 		SynchThreadNum = 0;
-		SynchBuffers.clear();
-		while(!SynchIdleThreads.empty()) {
-			SynchIdleThreads.pop();
-		}
+		SynchConnections.clear();
 	}
 	DeletedDbMutexes.clear();
 	for(auto it = DatabaseMutexes.begin(); it != DatabaseMutexes.end(); it++) {
@@ -694,8 +911,33 @@ bool CMoonDb::IsStopped() const noexcept
 	return Stopped;
 }
 
+void CMoonDb::StopBackground() noexcept
+{
+	BackgroundStarted = false;
+	try {
+		if(Expirer.joinable()) {
+			Expirer.join();
+		}
+		if(Persister.joinable()) {
+			Persister.join();
+		}
+	}
+	catch(system_error& e) {
+		CLog::Instance()->Put(CLog::L_WARNING, e.what());
+	}
+}
+
 void CMoonDb::Run()
 {
+	BackgroundStarted = true;
+	Expirer = thread([this]() {
+		this->ExpireRun();
+	});
+	if(CTable::RedoLogSettings.Enabled) {
+		Persister = thread([this]() {
+			this->PersistRun();
+		});
+	}
 	switch(Async) {
 	case 0:
 		SynchRun();
@@ -704,11 +946,28 @@ void CMoonDb::Run()
 		AsyncRun();
 		break;
 	case 2:
+#if defined(__linux__)
+		EpollGroupRun();
+#else
 		GroupRun();
+#endif
+		break;
+#if defined(__linux__)
+	case 3:
+#if defined(MOONDB_IO_URING)
+		if(IoUring) {
+			UringRun();
+			break;
+		}
+#endif
+		EpollRun();
 		break;
+#endif
 	default:
 		exit(1);
 	}
+	// 各运行方式结束时已在Clear中结束后台线程
+	StopBackground();
 	Stopped = true;
 	if(Restart) {
 		Restart = false;
@@ -718,6 +977,59 @@ void CMoonDb::Run()
 	}
 }
 
+void CMoonDb::ExpireRun()
+{
+	while(BackgroundStarted) {
+		bool busy = false;
+		try {
+			shared_lock<shared_timed_mutex> schemalck(SchemaMutex);
+			for(auto it = Databases.begin(); it != Databases.end(); it++) {
+				shared_lock<CReadMostlyMutex> lck(*it->second->GetMutex());
+				if(it->second->ExpireRows(ExpireBatch) > 0) {
+					busy = true;
+				}
+			}
+		}
+		catch(runtime_error& e) {
+			if(ShowInfo) {
+				cout << e.what() << endl;
+			}
+		}
+		if(busy) {
+			this_thread::yield();
+			continue;
+		}
+		for(uint32_t waited = 0; waited < ExpireInterval && BackgroundStarted; waited += 10) {
+			CTable::MemoryBudget.Tick();
+			msleep(min(10U, ExpireInterval - waited));
+		}
+	}
+}
+
+void CMoonDb::PersistRun()
+{
+	// 收到停止通知后再执行一遍，把停止前的修改写入重做日志
+	for(bool running = true; running;) {
+		running = BackgroundStarted;
+		try {
+			shared_lock<shared_timed_mutex> schemalck(SchemaMutex);
+			for(auto it = Databases.begin(); it != Databases.end(); it++) {
+				shared_lock<CReadMostlyMutex> lck(*it->second->GetMutex());
+				it->second->Persist();
+			}
+		}
+		catch(runtime_error& e) {
+			if(ShowInfo) {
+				cout << e.what() << endl;
+			}
+			CLog::Instance()->Put(CLog::L_WARNING, e.what());
+		}
+		if(running) {
+			msleep(10);
+		}
+	}
+}
+
 void CMoonDb::AsyncRun()
 {
 	if(MaxThreads > 1) {
@@ -731,11 +1043,18 @@ void CMoonDb::AsyncRun()
 	}
 
 	unique_lock<mutex> lck(ThreadMutex, defer_lock);
+	AsyncTimers.initialize(CTime::Now());
+	auto expired = [this](CConnection* conn, int64_t due) {
+		this->AsyncTimerExpired(conn, due);
+	};
 	while (true) {
 		if(!Started) {
 			break;
 		}
 		AsyncAccept();
+		// 每轮只读取一次时钟，超时的连接由时间轮取出并关闭，之后在遍历中回收
+		AsyncTimers.update(CTime::Now());
+		AsyncTimers.expire(expired);
 		// 循环遍历
 		for(auto it = AsyncConnections.begin(); it != AsyncConnections.end();) {
 			if(!Started) {
@@ -748,13 +1067,6 @@ void CMoonDb::AsyncRun()
 				AsyncConnections.erase(del_it);
 				continue;
 			}
-			if((SESS_CONNECTED == conn->Status || SESS_SENT == conn->Status) && conn->Time + NanoWaitTimeout < CTime::Now()) {
-				MoonSockClose(conn->Socket);
-				auto del_it = it;
-				it++;
-				AsyncConnections.erase(del_it);
-				continue;
-			}
 			if(SESS_CONNECTED == conn->Status || SESS_SENT == conn->Status || SESS_RECEIVING == conn->Status) {
 				AsyncReceive(conn);
 			}
@@ -764,7 +1076,7 @@ void CMoonDb::AsyncRun()
 			if(AsyncThreadNum < MaxThreads && SESS_RECEIVED == conn->Status) {
 				conn->Status = SESS_PROCESSING;
 				if(1 == MaxThreads) {
-					_AsyncQuery(conn);
+					_AsyncQuery(conn, true);
 				}
 				else {
 					AsyncThreadNum++;
@@ -856,7 +1168,7 @@ void CMoonDb::GroupRun()
 		if(::select(maxfd, &fdread, nullptr, nullptr, &tv) > 0) {
 			if(FD_ISSET(DataSeverSocket, &fdread)) {
 				for(uint32_t i = 0; i < BackLog && GroupConnectionNum < MaxConnections; i++) {
-					SOCKET sock_client = Accept(wrongip);
+					SOCKET sock_client = Accept(DataSeverSocket, wrongip);
 					if(sock_client == INVALID_SOCKET) {
 						if(wrongip) {
 							continue;
@@ -902,9 +1214,15 @@ void CMoonDb::GroupQuery(uint32_t threadid)
 {
 	AsyncThreadNum++;
 	unique_lock<mutex> lck(ThreadMutex, defer_lock);
-	CQueue<CConnection> connections(MaxConnections, static_cast<uint32_t>(ceil(static_cast<double>(MaxConnections) / MaxThreads) * 1.2));
+	// 容量一次分配到位，保证连接对象地址不变（时间轮中保存的是连接指针）
+	CQueue<CConnection> connections(MaxConnections, MaxConnections);
 	vector<SOCKET> newconns;
 	atomic<uint32_t>& curconnum = GroupConnectionNumPerThread[threadid];
+	CTimerWheel<CConnection*> timers;
+	timers.initialize(CTime::Now());
+	auto expired = [this](CConnection* conn, int64_t due) {
+		this->AsyncTimerExpired(conn, due);
+	};
 	while(true) {
 		if(!Started) {
 			break;
@@ -924,16 +1242,16 @@ void CMoonDb::GroupQuery(uint32_t threadid)
 		GroupNewConnections[threadid].clear();
 		lck.unlock();
 
+		timers.update(CTime::Now());
 		for(uint32_t i = 0; i < newconns.size(); i++) {
 			CConnection* conn = connections.push();
-			if(conn->Buffer.GetSize() == 0) {
-				conn->Buffer.Allocate(static_cast<size_t>(max(ReceiveBufSize, SendBufSize)));
-			}
-			conn->Initialize(newconns[i]);
+			conn->Initialize(newconns[i], static_cast<size_t>(max(ReceiveBufSize, SendBufSize)), &timers, NanoWaitTimeout);
 		}
 		newconns.clear();
 
 		while(!connections.empty()) {
+			timers.update(CTime::Now());
+			timers.expire(expired);
 			for(auto it = connections.begin(); it != connections.end();) {
 				if(!Started) {
 					break;
@@ -947,21 +1265,12 @@ void CMoonDb::GroupQuery(uint32_t threadid)
 					curconnum--;
 					continue;
 				}
-				if((SESS_CONNECTED == conn->Status || SESS_SENT == conn->Status) && conn->Time + NanoWaitTimeout < CTime::Now()) {
-					MoonSockClose(conn->Socket);
-					auto del_it = it;
-					it++;
-					connections.erase(del_it);
-					GroupConnectionNum--;
-					curconnum--;
-					continue;
-				}
 				if(SESS_CONNECTED == conn->Status || SESS_SENT == conn->Status || SESS_RECEIVING == conn->Status) {
 					AsyncReceive(conn);
 				}
 				if(SESS_RECEIVED == conn->Status) {
 					conn->Status = SESS_PROCESSING;
-					_AsyncQuery(conn);
+					_AsyncQuery(conn, true);
 				}
 				if(SESS_PROCESSED == conn->Status || SESS_SENDING == conn->Status) {
 					AsyncSend(conn);
@@ -984,10 +1293,7 @@ void CMoonDb::GroupQuery(uint32_t threadid)
 
 					for(uint32_t i = 0; i < newconns.size(); i++) {
 						CConnection* conn = connections.push();
-						if(conn->Buffer.GetSize() == 0) {
-							conn->Buffer.Allocate(static_cast<size_t>(max(ReceiveBufSize, SendBufSize)));
-						}
-						conn->Initialize(newconns[i]);
+						conn->Initialize(newconns[i], static_cast<size_t>(max(ReceiveBufSize, SendBufSize)), &timers, NanoWaitTimeout);
 					}
 					newconns.clear();
 				}
@@ -1018,51 +1324,25 @@ void CMoonDb::GroupQuery(uint32_t threadid)
 
 void CMoonDb::SynchRun()
 {
-	//循环接收数据
-	fd_set fdread;
-//	int maxfd = static_cast<int>(max(DataSeverSocket, ManagementSeverSocket) + 1);
-	int maxfd = static_cast<int>(DataSeverSocket + 1);
-	timeval tv;
-	tv.tv_sec = static_cast<int32_t>(SelectTimeout / 1000000);
-	tv.tv_usec = static_cast<int32_t>(SelectTimeout % 1000000);
-	while (true) {
-		if(!Started) {
-			break;
-		}
-		if(SynchThreadNum >= MaxThreads) {
-			continue;
+	// 预先启动MaxThreads个工作线程，当前线程作为第一个
+	for(uint32_t i = 1; i < MaxThreads; i++) {
+		try {
+			thread th([this, i]() {
+				this->SynchWorker(i);
+			});
+			th.detach();
 		}
-		FD_ZERO(&fdread);//初始化fd_set
-		FD_SET(DataSeverSocket, &fdread);//分配套接字句柄到相应的fd_set
-//		FD_SET(ManagementSeverSocket, &fdread);
-		if (::select(maxfd, &fdread, nullptr, nullptr, &tv) > 0) {
-			//cout << ThreadNum << ",";
-			if(FD_ISSET(DataSeverSocket, &fdread)) {
-				uint32_t tn = SynchGetNewThreadNum();
-				if(1 == MaxThreads) {
-					SynchAcceptAndQuery(tn);
-				}
-				else {
-					try {
-						thread th([this, tn]() {
-							this->SynchAcceptAndQuery(tn);
-						});
-						th.detach();
-					}
-					catch(exception& e) {
-						string error = string("The query thread error: ") + e.what();
-						if(ShowInfo) {
-							CLog::Instance()->Put(CLog::L_WARNING, error);
-						}
-						else {
-							cout << error << endl;
-						}
-						SynchDeleteThread(tn);
-					}
-				}
+		catch(exception& e) {
+			string error = string("The query thread error: ") + e.what();
+			if(ShowInfo) {
+				CLog::Instance()->Put(CLog::L_WARNING, error);
+			}
+			else {
+				cout << error << endl;
 			}
 		}
 	}
+	SynchWorker(0);
 
 	if(!Started) {
 		while(SynchThreadNum > 0) {
@@ -1072,47 +1352,71 @@ void CMoonDb::SynchRun()
 	}
 }
 
-void CMoonDb::SynchAcceptAndQuery(uint32_t threadid)
+void CMoonDb::SynchWorker(uint32_t threadid)
 {
+	SynchThreadNum++;
+	fd_set fdread;
+	int maxfd = static_cast<int>(DataSeverSocket + 1);
+	timeval tv;
 	bool wrongip;
-	SOCKET sock_client = Accept(wrongip);
-	if(INVALID_SOCKET == sock_client) {
-		SynchDeleteThread(threadid);
-		return;
+	while(Started) {
+		// 同一时间只有一个空闲线程等待新连接，其余空闲线程阻塞在锁上；
+		// 所有线程都在处理连接时不再接受连接，新连接留在监听队列中
+		SOCKET sock_client = INVALID_SOCKET;
+		ThreadMutex.lock();
+		if(Started) {
+			FD_ZERO(&fdread);
+			FD_SET(DataSeverSocket, &fdread);
+			tv.tv_sec = static_cast<int32_t>(SelectTimeout / 1000000);
+			tv.tv_usec = static_cast<int32_t>(SelectTimeout % 1000000);
+			if(::select(maxfd, &fdread, nullptr, nullptr, &tv) > 0 && FD_ISSET(DataSeverSocket, &fdread)) {
+				sock_client = Accept(DataSeverSocket, wrongip);
+			}
+		}
+		ThreadMutex.unlock();
+		if(INVALID_SOCKET != sock_client) {
+			SynchQuery(sock_client, threadid);
+		}
 	}
+	SynchThreadNum--;
+}
 
+void CMoonDb::SynchQuery(SOCKET sock_client, uint32_t threadid)
+{
 	/*__int128_t msg_len = 0;
 	cout << MoonSockRecv(sock_client, static_cast<char*>(static_cast<void*>(&msg_len)), 16) << endl;
 	cout << msg_len << endl;
 	MoonSockSend(sock_client, static_cast<const char*>(static_cast<const void*>(&msg_len)), 16);*/
 
-	CPack* buf = &SynchBuffers[threadid];
+	// 与异步方式使用同样的接收缓冲区，一次接收尽可能多的数据，客户端连续发送的多个请求一并处理
+	CConnection* conn = &SynchConnections[threadid];
+	conn->Socket = sock_client;
+	conn->Input.Clear();
+	conn->InputPos = 0;
+	conn->Buffer.Clear();
+	conn->Error = false;
 	chrono::high_resolution_clock::rep time = CTime::Now();
 	try {
 		while(true) {
-			int64_t bytes = SynchReceive(sock_client, *buf);
+			int64_t bytes = SynchReceive(conn);
 //			if(ShowInfo) {
 //				cout << "Received bytes: " << bytes << endl;
 //			}
 			if(bytes <= 0) {
-				if(SOCKET_TIMEOUT == MoonLastErrno() && time + NanoWaitTimeout >= CTime::Now()) {
+				if(!conn->Error && SOCKET_TIMEOUT == MoonLastErrno() && time + NanoWaitTimeout >= CTime::Now()) {
 					continue;
 				}
+				// 请求长度错误时发送错误信息
+				if(conn->Error) {
+					SynchSend(sock_client, conn->Buffer);
+				}
 				break;
 			}
 
-			uint8_t apitype = 0;
-			buf->Get(apitype);
-			if(1 == apitype) {
-				NoSQLQuery(*buf);
-				SynchSend(sock_client, *buf);
-			}
-			else if(2 == apitype) {
-				SQLQuery(*buf);
-				SynchSend(sock_client, *buf);
-			}
-			else {
-				ThrowError(ERR_WRONG_API_TYPE, "Wrong API type: " + num_to_string(apitype));
+			_AsyncQuery(conn, true);
+			SynchSend(sock_client, conn->Buffer);
+			conn->Buffer.Clear();
+			if(conn->Error) {
 				break;
 			}
 
@@ -1120,10 +1424,10 @@ void CMoonDb::SynchAcceptAndQuery(uint32_t threadid)
 		}
 	}
 	catch(runtime_error& e) {
-		SynchSendError(sock_client, *buf, e.what());
+		SynchSendError(sock_client, conn->Buffer, e.what());
 	}
 	MoonSockClose(sock_client);
-	SynchDeleteThread(threadid);
+	conn->Socket = INVALID_SOCKET;
 }
 
 void CMoonDb::SynchSend(SOCKET sock_client, CPack& pack)
@@ -1143,52 +1447,29 @@ void CMoonDb::SynchSend(SOCKET sock_client, CPack& pack)
 	}
 }
 
-int64_t CMoonDb::SynchReceive(SOCKET sock_client, CPack& pack)
+int64_t CMoonDb::SynchReceive(CConnection* conn)
 {
-	// 获取本次数据数量
-	int64_t msg_len = 0;
-	int32_t recv_len = MoonSockRecv(sock_client, static_cast<char*>(static_cast<void*>(&msg_len)), 8);
-	if(8 != recv_len || msg_len <= 0) {
-		if(SOCKET_ERROR == recv_len && ShowInfo) {
-			cout << "Receive Error: " + MoonLastError() << endl;
-		}
-		return 0 == recv_len ? 0 : -1;
-	}
-	if(msg_len > MaxAllowedPacket) {
-		// 这里接收剩余全部数据，是因为不这样话的无法正常将错误信息发送至客户端，客户端在接收8个字节长度后不能再继续接收剩余数据，
-		// 不过如果一次接收比较多的数据倒是可以成功，目前这里暂时这样处理。
-//		pack.Reallocate(8192);
-//		while(true) {
-//			if(MoonSockRecv(sock_client, static_cast<char*>(pack.GetPointer()), 8192) <= 0) {
-//				break;
-//			}
-//		}
-		ThrowError(ERR_SOCKET, "Exceed maximum bytes of allowed packet (" + num_to_string(MaxAllowedPacket) + " < " + num_to_string(msg_len) + ")");
-		return -1;
-	}
-	// 读取数据
-	pack.Reallocate(static_cast<size_t>(msg_len));
-	int64_t read_len = 0;
+	CPack& input = conn->Input;
 	while(true) {
-		int32_t cur_len = static_cast<int32_t>(min(static_cast<int64_t>(BytesPerRead), msg_len - read_len));
-		int32_t recv_len = MoonSockRecv(sock_client, static_cast<char*>(pack.GetPointer()) + read_len, cur_len);
-		if(recv_len > 0)
-		{
-			read_len += recv_len;
-			if(msg_len == read_len) {
-				break;
-			}
+		// 已接收的数据中有完整的请求时不再接收
+		int64_t msg_len = AsyncFrameLength(conn);
+		if(0 != msg_len) {
+			return msg_len;
+		}
+		// 长度头和请求一起接收，较大的请求直接接收到缓冲区中的最终位置
+		uint64_t space = AsyncInputSpace(conn);
+		int32_t cur_len = static_cast<int32_t>(min(space, static_cast<uint64_t>(numeric_limits<int32_t>::max())));
+		int32_t recv_len = MoonSockRecv(conn->Socket, static_cast<char*>(input.GetPointer()) + input.GetSize(), cur_len);
+		if(recv_len > 0) {
+			input.SetSize(input.GetSize() + static_cast<size_t>(recv_len));
 		}
 		else {
 			if(SOCKET_ERROR == recv_len && ShowInfo) {
 				cout << "Receive Error: " + MoonLastError() << endl;
 			}
-			return -1;
+			return 0 == recv_len ? 0 : -1;
 		}
 	}
-	pack.SetSize(static_cast<size_t>(msg_len));
-	pack.Seek(0);
-	return msg_len;
 }
 
 void CMoonDb::SynchSendError(SOCKET sock_client, CPack& pack, const string& text)
@@ -1202,7 +1483,7 @@ void CMoonDb::SynchSendError(SOCKET sock_client, CPack& pack, const string& text
 	SynchSend(sock_client, pack);
 }
 
-SOCKET CMoonDb::Accept(bool& wrongip) const noexcept
+SOCKET CMoonDb::Accept(SOCKET socksvr, bool& wrongip) const noexcept
 {
 	SOCKET sock_client;
 	wrongip = false;
@@ -1210,7 +1491,12 @@ SOCKET CMoonDb::Accept(bool& wrongip) const noexcept
 		sockaddr_in remoteAddr;
 		socklen_t nAddrlen = sizeof(sockaddr_in);
 		uint32_t curclientip;
-		sock_client = ::accept(DataSeverSocket, static_cast<sockaddr*>(static_cast<void*>(&remoteAddr)), &nAddrlen);
+#if defined(__linux__)
+		// epoll方式（Async为2或3）下新连接直接设为非阻塞，否则recv/send会阻塞整个事件循环
+		sock_client = ::accept4(socksvr, static_cast<sockaddr*>(static_cast<void*>(&remoteAddr)), &nAddrlen, Async >= 2 ? SOCK_NONBLOCK : 0);
+#else
+		sock_client = ::accept(socksvr, static_cast<sockaddr*>(static_cast<void*>(&remoteAddr)), &nAddrlen);
+#endif
 		if(sock_client == INVALID_SOCKET)
 		{
 //			if(MoonLastErrno() == SOCKET_WOULDBLOCK) {
@@ -1236,7 +1522,12 @@ SOCKET CMoonDb::Accept(bool& wrongip) const noexcept
 		sockaddr_in6 remoteAddr;
 		socklen_t nAddrlen = sizeof(sockaddr_in6);
 		in6_addr curclientip;
-		sock_client = ::accept(DataSeverSocket, static_cast<sockaddr*>(static_cast<void*>(&remoteAddr)), &nAddrlen);
+#if defined(__linux__)
+		// epoll方式（Async为2或3）下新连接直接设为非阻塞，否则recv/send会阻塞整个事件循环
+		sock_client = ::accept4(socksvr, static_cast<sockaddr*>(static_cast<void*>(&remoteAddr)), &nAddrlen, Async >= 2 ? SOCK_NONBLOCK : 0);
+#else
+		sock_client = ::accept(socksvr, static_cast<sockaddr*>(static_cast<void*>(&remoteAddr)), &nAddrlen);
+#endif
 		if(sock_client == INVALID_SOCKET)
 		{
 //			if(MoonLastErrno() == SOCKET_WOULDBLOCK) {
@@ -1259,25 +1550,59 @@ SOCKET CMoonDb::Accept(bool& wrongip) const noexcept
 	return sock_client;
 }
 
-void CMoonDb::AsyncAccept() noexcept
+bool CMoonDb::CheckClientAddress(SOCKET sock) const noexcept
 {
-	if(AsyncConnections.size() >= MaxConnections) {
-		return;
-	}
-	fd_set fdread;
-	int maxfd = static_cast<int>(DataSeverSocket + 1);
-	timeval tv{0, 0};
-	bool wrongip;
-	if(AsyncConnections.size() == 0) {
-		tv.tv_sec = static_cast<int32_t>(SelectTimeout / 1000000);
-		tv.tv_usec = static_cast<int32_t>(SelectTimeout % 1000000);
+	if(IF_IPv4 == InternetFamily) {
+		sockaddr_in remoteAddr;
+		socklen_t nAddrlen = sizeof(sockaddr_in);
+		if(0 != ::getpeername(sock, static_cast<sockaddr*>(static_cast<void*>(&remoteAddr)), &nAddrlen)) {
+			return false;
+		}
+		if(ShowInfo) {
+			printf("Recieve a connection: %s:%u \r\n", ::inet_ntoa(remoteAddr.sin_addr), remoteAddr.sin_port);
+		}
+#if defined(_WIN32)
+		return DataClientIPv4 == INADDR_ANY || remoteAddr.sin_addr.S_un.S_addr == DataClientIPv4;
+#else
+		return DataClientIPv4 == INADDR_ANY || remoteAddr.sin_addr.s_addr == DataClientIPv4;
+#endif
 	}
-	FD_ZERO(&fdread);//初始化fd_set
+	else {
+		sockaddr_in6 remoteAddr;
+		socklen_t nAddrlen = sizeof(sockaddr_in6);
+		if(0 != ::getpeername(sock, static_cast<sockaddr*>(static_cast<void*>(&remoteAddr)), &nAddrlen)) {
+			return false;
+		}
+		if(ShowInfo) {
+			char buf[1024];
+			::inet_ntop(AF_INET6, &remoteAddr.sin6_addr, buf, 1024);
+			printf("Recieved a connection: %s:%u \r\n", buf, remoteAddr.sin6_port);
+		}
+		return ::memcmp(&DataClientIPv6, &in6addr_any, sizeof(in6_addr)) == 0 || ::memcmp(&DataClientIPv6, &remoteAddr.sin6_addr, sizeof(in6_addr)) == 0;
+	}
+}
+
+void CMoonDb::AsyncAccept() noexcept
+{
+	if(AsyncConnections.size() >= MaxConnections) {
+		return;
+	}
+	fd_set fdread;
+	int maxfd = static_cast<int>(DataSeverSocket + 1);
+	timeval tv{0, 0};
+	bool wrongip;
+	if(AsyncConnections.size() == 0) {
+		tv.tv_sec = static_cast<int32_t>(SelectTimeout / 1000000);
+		tv.tv_usec = static_cast<int32_t>(SelectTimeout % 1000000);
+	}
+	FD_ZERO(&fdread);//初始化fd_set
 	FD_SET(DataSeverSocket, &fdread);//分配套接字句柄到相应的fd_set
 	if(::select(maxfd, &fdread, nullptr, nullptr, &tv) > 0) {
 		if(FD_ISSET(DataSeverSocket, &fdread)) {
+			// select可能等待了较长时间
+			AsyncTimers.update(CTime::Now());
 			for(uint32_t i = 0; i < BackLog && AsyncConnections.size() < MaxConnections; i++) {
-				SOCKET sock_client = Accept(wrongip);
+				SOCKET sock_client = Accept(DataSeverSocket, wrongip);
 				if(sock_client == INVALID_SOCKET) {
 					if(wrongip) {
 						continue;
@@ -1287,189 +1612,1063 @@ void CMoonDb::AsyncAccept() noexcept
 					}
 				}
 				CConnection* conn = AsyncConnections.push();
-				if(conn->Buffer.GetSize() == 0) {
-					conn->Buffer.Allocate(static_cast<size_t>(max(ReceiveBufSize, SendBufSize)));
-				}
-				conn->Initialize(sock_client);
+				conn->Initialize(sock_client, static_cast<size_t>(max(ReceiveBufSize, SendBufSize)), &AsyncTimers, NanoWaitTimeout);
 				AsyncReceive(conn);
 			}
 		}
 	}
 }
 
-void CMoonDb::AsyncCloseClient(CConnection* conn)
+void CMoonDb::AsyncCloseClient(CConnection* conn)
+{
+	conn->Status = SESS_DISCONNECTED;
+	// 先shutdown，使io_uring中该连接未完成的请求立即返回
+	::shutdown(conn->Socket, 2);
+	MoonSockClose(conn->Socket);
+	conn->Socket = INVALID_SOCKET;
+}
+
+bool CMoonDb::AsyncTimerExpired(CConnection* conn, int64_t due)
+{
+	// 连接已关闭、已被复用或者已重新加入时间轮，该项已失效
+	if(due != conn->TimerDue || SESS_DISCONNECTED == conn->Status) {
+		return false;
+	}
+	conn->TimerDue = numeric_limits<int64_t>::max();
+	if(0 == conn->Deadline) {
+		return false;
+	}
+	// 期间超时时间被延后，按新的时间重新加入
+	if(conn->Deadline > conn->Timers->now()) {
+		conn->TimerDue = conn->Deadline;
+		conn->Timers->schedule(conn, conn->Deadline);
+		return false;
+	}
+	AsyncCloseClient(conn);
+	return true;
+}
+
+void CMoonDb::AsyncSend(CConnection* conn)
+{
+	if(SESS_PROCESSED == conn->Status) {
+		conn->BufPos = 0;
+		conn->Status = SESS_SENDING;
+		conn->SetTimeout(AsyncSendTimeout);
+	}
+	size_t size = conn->Buffer.GetSize();
+	while(size > conn->BufPos) {
+		int32_t bytes = static_cast<int32_t>(min(static_cast<size_t>(SendBufSize), size - conn->BufPos));
+		bytes = MoonSockSend(conn->Socket, static_cast<char*>(conn->Buffer.GetPointer()) + conn->BufPos, bytes);
+		if(SOCKET_ERROR == bytes) {
+			if(MoonLastErrno() == SOCKET_AGAIN) {
+				return;
+			}
+			if(ShowInfo) {
+				cout << "Send Error: " + MoonLastError() << endl;
+			}
+			AsyncCloseClient(conn);
+			return;
+		}
+		conn->BufPos += static_cast<size_t>(bytes);
+		conn->SetTimeout(AsyncSendTimeout);
+	}
+	if(conn->Error || size != conn->BufPos) {
+		AsyncCloseClient(conn);
+	}
+	else {
+		conn->Buffer.Clear();
+		conn->Status = SESS_SENT;
+		conn->SetTimeout(NanoWaitTimeout);
+	}
+}
+
+void CMoonDb::AsyncReceive(CConnection* conn)
+{
+	CPack& input = conn->Input;
+	while(true) {
+		// 先检查已接收的数据，有完整的请求就开始处理，客户端连续发送的其余请求一并处理
+		int64_t msg_len = AsyncFrameLength(conn);
+		if(msg_len > 0) {
+			conn->Status = SESS_RECEIVED;
+			// 处理期间不计超时
+			conn->Deadline = 0;
+			return;
+		}
+		if(msg_len < 0) {
+			// 发送错误信息后关闭连接
+			conn->Status = SESS_PROCESSED;
+			return;
+		}
+		if(input.GetSize() > conn->InputPos) {
+			conn->Status = SESS_RECEIVING;
+		}
+		// 接收数据，一次尽可能多地接收
+		uint64_t space = AsyncInputSpace(conn);
+		int32_t cur_len = static_cast<int32_t>(min(space, static_cast<uint64_t>(numeric_limits<int32_t>::max())));
+		int32_t recv_len = MoonSockRecv(conn->Socket, static_cast<char*>(input.GetPointer()) + input.GetSize(), cur_len);
+		if(recv_len > 0) {
+			conn->SetTimeout(AsyncRecvTimeout);
+			input.SetSize(input.GetSize() + static_cast<size_t>(recv_len));
+		}
+		else if(0 == recv_len) {
+			// 对方已关闭连接
+			AsyncCloseClient(conn);
+			return;
+		}
+		else if(SOCKET_ERROR == recv_len) {
+			if(MoonLastErrno() == SOCKET_WOULDBLOCK) {
+				return;
+			}
+			else {
+				if(ShowInfo) {
+					cout << "Receive Error: " << MoonLastError() << endl;
+				}
+				AsyncCloseClient(conn);
+				return;
+			}
+		}
+	}
+}
+
+int64_t CMoonDb::AsyncFrameLength(CConnection* conn)
+{
+	uint64_t available = conn->Input.GetSize() - conn->InputPos;
+	if(available < 8) {
+		return 0;
+	}
+	int64_t msg_len = 0;
+	::memcpy(&msg_len, static_cast<char*>(conn->Input.GetPointer()) + conn->InputPos, 8);
+	if(msg_len <= 0) {
+		conn->Error = true;
+		return -1;
+	}
+	if(msg_len > MaxAllowedPacket) {
+		SynchGenerateError(conn, "Exceed maximum bytes of allowed packet (" + num_to_string(MaxAllowedPacket) + " < " + num_to_string(msg_len) + ")");
+		return -1;
+	}
+	return available - 8 >= static_cast<uint64_t>(msg_len) ? msg_len : 0;
+}
+
+uint64_t CMoonDb::AsyncInputSpace(CConnection* conn)
+{
+	CPack& input = conn->Input;
+	char* data = static_cast<char*>(input.GetPointer());
+	uint64_t available = input.GetSize() - conn->InputPos;
+	// 下一个请求需要的空间，长度头已由AsyncFrameLength检查过
+	uint64_t need = 8;
+	if(available >= 8) {
+		int64_t msg_len = 0;
+		::memcpy(&msg_len, data + conn->InputPos, 8);
+		need += static_cast<uint64_t>(msg_len);
+	}
+	// 已处理的数据移出缓冲区，未处理的部分移到开头
+	if(0 == available) {
+		input.Clear();
+		conn->InputPos = 0;
+	}
+	else if(conn->InputPos > 0 && conn->InputPos + need > input.GetCapacity()) {
+		::memmove(data, data + conn->InputPos, available);
+		input.SetSize(available);
+		conn->InputPos = 0;
+	}
+	if(conn->InputPos + need > input.GetCapacity()) {
+		input.Reallocate(conn->InputPos + need);
+	}
+	return input.GetCapacity() - input.GetSize();
+}
+
+void CMoonDb::SynchGenerateError(CConnection* conn, const string& text)
+{
+	// 追加在之前请求的响应之后，发送后关闭连接
+	size_t size = text.size();
+	conn->Error = true;
+	conn->Buffer.Seek(0, CPack::POS_END);
+	conn->Buffer.Put(static_cast<int64_t>(size + 2));
+	conn->Buffer.Put(static_cast<uint16_t>(RT_ERROR));
+	conn->Buffer.Write(text.c_str(), size);
+}
+
+void CMoonDb::_AsyncQuery(CConnection* conn, bool direct)
+{
+	/*__int128_t msg_len = 0;
+	cout << MoonSockRecv(sock_client, static_cast<char*>(static_cast<void*>(&msg_len)), 16) << endl;
+	cout << msg_len << endl;
+	MoonSockSend(sock_client, static_cast<const char*>(static_cast<const void*>(&msg_len)), 16);*/
+
+	// 依次处理接收缓冲区中全部完整的请求，响应按顺序追加到发送缓冲区，之后一次发送
+	int64_t msg_len;
+	while((msg_len = AsyncFrameLength(conn)) > 0) {
+		CPack request(static_cast<char*>(conn->Input.GetPointer()) + conn->InputPos + 8, static_cast<size_t>(msg_len));
+		request.SetSize(static_cast<size_t>(msg_len));
+		conn->InputPos += static_cast<uint64_t>(msg_len) + 8;
+		uint64_t start = conn->Buffer.GetSize();
+		uint64_t sent = 0;
+		try {
+			// 只有负责该连接读写的线程直接发送原始行数据，工作线程只复制到发送缓冲区，由事件循环发送
+			Query(request, conn->Buffer, direct ? conn->Socket : INVALID_SOCKET, &sent);
+		}
+		catch(exception& e) {
+			if(sent > start) {
+				// 之前请求的结果已全部发送，出错请求的部分结果也已发送，无法再返回错误响应，丢弃其余部分并关闭连接
+				conn->Buffer.Clear();
+				conn->Error = true;
+				break;
+			}
+			// 去掉出错请求已写入的部分结果（之前请求的结果可能已直接发送一部分），其余照常发送，之后的请求不再处理
+			conn->Buffer.SetSize(start - sent);
+			SynchGenerateError(conn, e.what());
+			break;
+		}
+	}
+	conn->Status = SESS_PROCESSED;
+}
+
+void CMoonDb::Query(CPack& request, CPack& ret, SOCKET sock, uint64_t* sent)
+{
+	uint8_t apitype = 0;
+	request.Get(apitype);
+	if(1 == apitype) {
+		NoSQLQuery(request, ret, sock, sent);
+	}
+	else if(2 == apitype) {
+		SQLQuery(request, ret);
+	}
+	else {
+		ThrowError(ERR_WRONG_API_TYPE, "Wrong API type: " + num_to_string(apitype));
+	}
+}
+
+void CMoonDb::AsyncQuery()
+{
+	unique_lock<mutex> lck(ThreadMutex, defer_lock);
+	while(true) {
+		if(!Started) {
+			AsyncThreadNum--;
+			break;
+		}
+		lck.lock();
+		while(AsyncNewConnections.size() == 0) {
+			if(!Started) {
+				break;
+			}
+			AsyncCondVar.wait(lck);
+		}
+		if(!Started) {
+			AsyncThreadNum--;
+			break;
+		}
+		CConnection* conn = AsyncNewConnections.front();
+		AsyncNewConnections.pop();
+		lck.unlock();
+		_AsyncQuery(conn, false);
+		AsyncThreadNum--;
+	}
+}
+
+#if defined(__linux__)
+int CMoonDb::EpollWaitMilliseconds() const noexcept
+{
+	return static_cast<int>(max(min(SelectTimeout / 1000, static_cast<uint64_t>(numeric_limits<int32_t>::max())), static_cast<uint64_t>(1)));
+}
+
+void CMoonDb::EpollRun()
+{
+	EpollFd = ::epoll_create1(EPOLL_CLOEXEC);
+	EpollEventFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(EpollFd < 0 || EpollEventFd < 0) {
+		Clear();
+		TriggerError("Create epoll Failed:" + MoonLastError());
+	}
+	epoll_event ev;
+	// 监听socket使用水平触发，一次最多接受BackLog个连接，剩余的下一轮继续处理
+	ev.events = EPOLLIN;
+	ev.data.ptr = nullptr;
+	if(::epoll_ctl(EpollFd, EPOLL_CTL_ADD, DataSeverSocket, &ev) < 0) {
+		Clear();
+		TriggerError("epoll_ctl Error:" + MoonLastError());
+	}
+	EpollAccepting = true;
+	ev.events = EPOLLIN;
+	ev.data.ptr = &EpollEventFd;
+	if(::epoll_ctl(EpollFd, EPOLL_CTL_ADD, EpollEventFd, &ev) < 0) {
+		Clear();
+		TriggerError("epoll_ctl Error:" + MoonLastError());
+	}
+
+	if(MaxThreads > 1) {
+		for(uint32_t i = 0; i < MaxThreads; i++) {
+			thread tn([this]() {
+				this->EpollQuery();
+			});
+			tn.detach();
+		}
+		msleep(10);
+	}
+
+	vector<epoll_event> events(min(MaxConnections, static_cast<uint32_t>(1024)) + 2);
+	int waitms = EpollWaitMilliseconds();
+	queue<CConnection*> doneconns;
+	unique_lock<mutex> lck(ThreadMutex, defer_lock);
+	AsyncTimers.initialize(CTime::Now());
+	auto expired = [this](CConnection* conn, int64_t due) {
+		if(this->AsyncTimerExpired(conn, due)) {
+			this->EpollClosedConnections.push_back(conn);
+		}
+	};
+	while(true) {
+		if(!Started) {
+			break;
+		}
+		int num = ::epoll_wait(EpollFd, events.data(), static_cast<int>(events.size()), waitms);
+		// 每轮只读取一次时钟
+		AsyncTimers.update(CTime::Now());
+		for(int i = 0; i < num; i++) {
+			void* ptr = events[i].data.ptr;
+			if(nullptr == ptr) {
+				EpollAccept();
+			}
+			else if(&EpollEventFd == ptr) {
+				uint64_t count;
+				if(::read(EpollEventFd, &count, sizeof(count)) < 0 && MoonLastErrno() != SOCKET_AGAIN && ShowInfo) {
+					cout << "eventfd read Error: " << MoonLastError() << endl;
+				}
+				lck.lock();
+				swap(doneconns, EpollDoneConnections);
+				lck.unlock();
+				while(!doneconns.empty()) {
+					EpollHandle(doneconns.front(), EPOLLOUT, EpollClosedConnections, 1 == MaxThreads);
+					doneconns.pop();
+				}
+			}
+			else {
+				EpollHandle(static_cast<CConnection*>(ptr), events[i].events, EpollClosedConnections, 1 == MaxThreads);
+			}
+		}
+
+		AsyncTimers.expire(expired);
+		// 本轮事件全部处理完后再回收连接，避免同一轮中连接位置被新连接复用
+		for(size_t i = 0; i < EpollClosedConnections.size(); i++) {
+			AsyncConnections.erase(EpollClosedConnections[i]->Slot);
+		}
+		EpollClosedConnections.clear();
+		if(!EpollAccepting && AsyncConnections.size() < MaxConnections) {
+			ev.events = EPOLLIN;
+			ev.data.ptr = nullptr;
+			if(0 == ::epoll_ctl(EpollFd, EPOLL_CTL_ADD, DataSeverSocket, &ev)) {
+				EpollAccepting = true;
+			}
+		}
+	}
+
+	if(!Started) {
+		lck.lock();
+		AsyncCondVar.notify_all();
+		lck.unlock();
+		while(AsyncThreadNum > 0) {
+			msleep(1);
+		}
+		EpollCloseAll(AsyncConnections);
+		Clear();
+	}
+}
+
+void CMoonDb::EpollGroupRun()
+{
+	EpollFd = ::epoll_create1(EPOLL_CLOEXEC);
+	if(EpollFd < 0) {
+		Clear();
+		TriggerError("Create epoll Failed:" + MoonLastError());
+	}
+	GroupWorkers = new CGroupWorker[MaxThreads];
+	epoll_event ev;
+	for(uint32_t i = 0; i < MaxThreads; i++) {
+		CGroupWorker& worker = GroupWorkers[i];
+		worker.EpollFd = ::epoll_create1(EPOLL_CLOEXEC);
+		worker.EventFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if(worker.EpollFd < 0 || worker.EventFd < 0) {
+			Clear();
+			TriggerError("Create epoll Failed:" + MoonLastError());
+		}
+		ev.events = EPOLLIN;
+		ev.data.ptr = &worker.EventFd;
+		if(::epoll_ctl(worker.EpollFd, EPOLL_CTL_ADD, worker.EventFd, &ev) < 0) {
+			Clear();
+			TriggerError("epoll_ctl Error:" + MoonLastError());
+		}
+		if(ReusePort) {
+			// 每个线程一个监听socket，第一个线程使用已创建的DataSeverSocket
+			if(0 == i) {
+				worker.Listener = DataSeverSocket;
+			}
+			else if(IF_IPv4 == InternetFamily) {
+				worker.Listener = CreateSocketv4(DataServerIPv4, DataServerPort, true);
+			}
+			else {
+				worker.Listener = CreateSocketv6(DataServerIPv6, DataServerPort, true);
+			}
+		}
+		else {
+			// 所有线程的连接总数不超过MaxConnections，因此队列不会写满
+			worker.NewConnections.initialize(MaxConnections);
+		}
+	}
+
+	for(uint32_t i = 0; i < MaxThreads; i++) {
+		thread tn([this, i]() {
+			this->EpollGroupQuery(i);
+		});
+		tn.detach();
+	}
+	msleep(10);
+
+	// 各线程自行接收连接，这里只等待停止
+	if(ReusePort) {
+		while(Started) {
+			msleep(100);
+		}
+		while(AsyncThreadNum > 0) {
+			msleep(1);
+		}
+		Clear();
+		return;
+	}
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = nullptr;
+	if(::epoll_ctl(EpollFd, EPOLL_CTL_ADD, DataSeverSocket, &ev) < 0) {
+		Clear();
+		TriggerError("epoll_ctl Error:" + MoonLastError());
+	}
+	EpollAccepting = true;
+
+	int waitms = EpollWaitMilliseconds();
+	bool wrongip;
+	uint64_t one = 1;
+	vector<bool> woken(MaxThreads, false);
+	while(true) {
+		if(!Started) {
+			break;
+		}
+		// 连接数已满时暂停监听，短时间后再检查
+		if(!EpollAccepting && GroupConnectionNum < MaxConnections) {
+			if(0 == ::epoll_ctl(EpollFd, EPOLL_CTL_ADD, DataSeverSocket, &ev)) {
+				EpollAccepting = true;
+			}
+		}
+		if(::epoll_wait(EpollFd, &ev, 1, EpollAccepting ? waitms : 10) <= 0) {
+			continue;
+		}
+		for(uint32_t i = 0; i < BackLog && GroupConnectionNum < MaxConnections; i++) {
+			SOCKET sock_client = Accept(DataSeverSocket, wrongip);
+			if(sock_client == INVALID_SOCKET) {
+				if(wrongip) {
+					continue;
+				}
+				else {
+					break;
+				}
+			}
+			// 分配给连接数最少的线程
+			uint32_t threadid = 0;
+			uint32_t minconnnum = GroupConnectionNumPerThread[0];
+			for(uint32_t j = 1; j < MaxThreads && minconnnum > 0; j++) {
+				uint32_t connnum = GroupConnectionNumPerThread[j];
+				if(connnum < minconnnum) {
+					minconnnum = connnum;
+					threadid = j;
+				}
+			}
+			if(!GroupWorkers[threadid].NewConnections.push(sock_client)) {
+				MoonSockClose(sock_client);
+				continue;
+			}
+			GroupConnectionNum++;
+			GroupConnectionNumPerThread[threadid]++;
+			woken[threadid] = true;
+		}
+		// 只唤醒分配到新连接的线程
+		for(uint32_t i = 0; i < MaxThreads; i++) {
+			if(woken[i]) {
+				woken[i] = false;
+				if(::write(GroupWorkers[i].EventFd, &one, sizeof(one)) < 0 && ShowInfo) {
+					cout << "eventfd write Error: " << MoonLastError() << endl;
+				}
+			}
+		}
+		if(GroupConnectionNum >= MaxConnections) {
+			if(0 == ::epoll_ctl(EpollFd, EPOLL_CTL_DEL, DataSeverSocket, nullptr)) {
+				EpollAccepting = false;
+			}
+		}
+	}
+
+	if(!Started) {
+		for(uint32_t i = 0; i < MaxThreads; i++) {
+			if(::write(GroupWorkers[i].EventFd, &one, sizeof(one)) < 0 && ShowInfo) {
+				cout << "eventfd write Error: " << MoonLastError() << endl;
+			}
+		}
+		while(AsyncThreadNum > 0) {
+			msleep(1);
+		}
+		Clear();
+	}
+}
+
+void CMoonDb::EpollGroupQuery(uint32_t threadid)
+{
+	AsyncThreadNum++;
+	CGroupWorker& worker = GroupWorkers[threadid];
+	atomic<uint32_t>& curconnum = GroupConnectionNumPerThread[threadid];
+	// 容量一次分配到位，保证连接对象地址不变（epoll中保存的是连接指针）
+	CQueue<CConnection> connections(MaxConnections, MaxConnections);
+	vector<CConnection*> closed;
+	vector<epoll_event> events(min(MaxConnections, static_cast<uint32_t>(1024)) + 1);
+	int waitms = EpollWaitMilliseconds();
+	worker.Timers.initialize(CTime::Now());
+	auto expired = [this, &closed](CConnection* conn, int64_t due) {
+		if(this->AsyncTimerExpired(conn, due)) {
+			closed.push_back(conn);
+		}
+	};
+	bool wrongip;
+	bool accepting = false;
+	epoll_event lev;
+	lev.events = EPOLLIN;
+	lev.data.ptr = &worker.Listener;
+	while(true) {
+		if(!Started) {
+			break;
+		}
+		// ReusePort方式下本线程直接接收连接，连接数已满时暂停监听
+		if(INVALID_SOCKET != worker.Listener && !accepting && GroupConnectionNum < MaxConnections) {
+			accepting = 0 == ::epoll_ctl(worker.EpollFd, EPOLL_CTL_ADD, worker.Listener, &lev);
+		}
+		int num = ::epoll_wait(worker.EpollFd, events.data(), static_cast<int>(events.size()), waitms);
+		worker.Timers.update(CTime::Now());
+		for(int i = 0; i < num; i++) {
+			void* ptr = events[i].data.ptr;
+			if(&worker.EventFd == ptr) {
+				uint64_t count;
+				if(::read(worker.EventFd, &count, sizeof(count)) < 0 && MoonLastErrno() != SOCKET_AGAIN && ShowInfo) {
+					cout << "eventfd read Error: " << MoonLastError() << endl;
+				}
+				SOCKET sock_client;
+				while(worker.NewConnections.pop(sock_client)) {
+					EpollGroupAdd(worker, connections, sock_client, closed);
+				}
+			}
+			else if(&worker.Listener == ptr) {
+				for(uint32_t j = 0; j < BackLog && GroupConnectionNum < MaxConnections; j++) {
+					SOCKET sock_client = Accept(worker.Listener, wrongip);
+					if(sock_client == INVALID_SOCKET) {
+						if(wrongip) {
+							continue;
+						}
+						else {
+							break;
+						}
+					}
+					GroupConnectionNum++;
+					curconnum++;
+					EpollGroupAdd(worker, connections, sock_client, closed);
+				}
+				if(GroupConnectionNum >= MaxConnections && 0 == ::epoll_ctl(worker.EpollFd, EPOLL_CTL_DEL, worker.Listener, nullptr)) {
+					accepting = false;
+				}
+			}
+			else {
+				EpollHandle(static_cast<CConnection*>(ptr), events[i].events, closed, true);
+			}
+		}
+
+		worker.Timers.expire(expired);
+		for(size_t i = 0; i < closed.size(); i++) {
+			connections.erase(closed[i]->Slot);
+		}
+		GroupConnectionNum -= static_cast<uint32_t>(closed.size());
+		curconnum -= static_cast<uint32_t>(closed.size());
+		closed.clear();
+	}
+
+	EpollCloseAll(connections);
+	GroupConnectionNum -= static_cast<uint32_t>(connections.size());
+	curconnum -= static_cast<uint32_t>(connections.size());
+	connections.clear();
+	SOCKET sock_client;
+	while(worker.NewConnections.pop(sock_client)) {
+		MoonSockClose(sock_client);
+		GroupConnectionNum--;
+		curconnum--;
+	}
+	AsyncThreadNum--;
+}
+
+void CMoonDb::EpollGroupAdd(CGroupWorker& worker, CQueue<CConnection>& connections, SOCKET sock_client, vector<CConnection*>& closed)
+{
+	CConnection* conn = connections.push();
+	conn->Slot = connections.last();
+	conn->Initialize(sock_client, static_cast<size_t>(max(ReceiveBufSize, SendBufSize)), &worker.Timers, NanoWaitTimeout);
+	epoll_event ev;
+	ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+	ev.data.ptr = conn;
+	if(::epoll_ctl(worker.EpollFd, EPOLL_CTL_ADD, sock_client, &ev) < 0) {
+		if(ShowInfo) {
+			cout << "epoll_ctl Error: " << MoonLastError() << endl;
+		}
+		AsyncCloseClient(conn);
+		closed.push_back(conn);
+	}
+}
+
+void CMoonDb::EpollAccept()
+{
+	bool wrongip;
+	for(uint32_t i = 0; i < BackLog && AsyncConnections.size() < MaxConnections; i++) {
+		SOCKET sock_client = Accept(DataSeverSocket, wrongip);
+		if(sock_client == INVALID_SOCKET) {
+			if(wrongip) {
+				continue;
+			}
+			else {
+				break;
+			}
+		}
+		CConnection* conn = AsyncConnections.push();
+		conn->Slot = AsyncConnections.last();
+		conn->Initialize(sock_client, static_cast<size_t>(max(ReceiveBufSize, SendBufSize)), &AsyncTimers, NanoWaitTimeout);
+		// 边缘触发，注册时如果已有数据epoll_wait会立即返回
+		epoll_event ev;
+		ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+		ev.data.ptr = conn;
+		if(::epoll_ctl(EpollFd, EPOLL_CTL_ADD, sock_client, &ev) < 0) {
+			if(ShowInfo) {
+				cout << "epoll_ctl Error: " << MoonLastError() << endl;
+			}
+			AsyncCloseClient(conn);
+			AsyncConnections.erase(conn->Slot);
+		}
+	}
+	// 连接数已满时暂停监听，否则水平触发的监听socket会不断返回
+	if(AsyncConnections.size() >= MaxConnections && EpollAccepting) {
+		if(0 == ::epoll_ctl(EpollFd, EPOLL_CTL_DEL, DataSeverSocket, nullptr)) {
+			EpollAccepting = false;
+		}
+	}
+}
+
+void CMoonDb::EpollHandle(CConnection* conn, uint32_t events, vector<CConnection*>& closed, bool inlinequery)
+{
+	if(SESS_DISCONNECTED == conn->Status || SESS_PROCESSING == conn->Status) {
+		return;
+	}
+	if((events & (EPOLLERR | EPOLLHUP)) && !(events & EPOLLIN)) {
+		AsyncCloseClient(conn);
+		closed.push_back(conn);
+		return;
+	}
+	bool readable = (events & EPOLLIN) != 0;
+	while(true) {
+		if(SESS_PROCESSED == conn->Status || SESS_SENDING == conn->Status) {
+			AsyncSend(conn);
+			if(SESS_SENT != conn->Status) {
+				break;
+			}
+			// 边缘触发：处理期间到达的数据不会再次通知，发送完成后立即继续读取
+			readable = true;
+		}
+		if(!readable) {
+			break;
+		}
+		AsyncReceive(conn);
+		if(SESS_PROCESSED == conn->Status) {
+			continue;
+		}
+		if(SESS_RECEIVED != conn->Status) {
+			break;
+		}
+		conn->Status = SESS_PROCESSING;
+		if(inlinequery) {
+			_AsyncQuery(conn, true);
+			continue;
+		}
+		ThreadMutex.lock();
+		AsyncNewConnections.push(conn);
+		AsyncCondVar.notify_one();
+		ThreadMutex.unlock();
+		break;
+	}
+	if(SESS_DISCONNECTED == conn->Status) {
+		closed.push_back(conn);
+	}
+}
+
+void CMoonDb::EpollCloseAll(CQueue<CConnection>& connections)
+{
+	// 停止前将数据发送出去
+	bool sending = true;
+	while(sending) {
+		sending = false;
+		for(auto it = connections.begin(); it != connections.end(); it++) {
+			CConnection* conn = connections.at(it);
+			if(SESS_PROCESSED == conn->Status || SESS_SENDING == conn->Status) {
+				AsyncSend(conn);
+				if(SESS_SENDING == conn->Status) {
+					sending = true;
+				}
+			}
+		}
+	}
+	for(auto it = connections.begin(); it != connections.end(); it++) {
+		CConnection* conn = connections.at(it);
+		if(SESS_DISCONNECTED != conn->Status) {
+			AsyncCloseClient(conn);
+		}
+	}
+}
+
+void CMoonDb::EpollQuery()
+{
+	AsyncThreadNum++;
+	unique_lock<mutex> lck(ThreadMutex, defer_lock);
+	uint64_t one = 1;
+	while(true) {
+		lck.lock();
+		while(AsyncNewConnections.empty() && Started) {
+			AsyncCondVar.wait(lck);
+		}
+		if(!Started) {
+			lck.unlock();
+			break;
+		}
+		CConnection* conn = AsyncNewConnections.front();
+		AsyncNewConnections.pop();
+		lck.unlock();
+		_AsyncQuery(conn, false);
+		// 交回事件循环线程发送，所有socket读写都在事件循环线程中进行
+		lck.lock();
+		EpollDoneConnections.push(conn);
+		lck.unlock();
+		if(::write(EpollEventFd, &one, sizeof(one)) < 0 && ShowInfo) {
+			cout << "eventfd write Error: " << MoonLastError() << endl;
+		}
+	}
+	AsyncThreadNum--;
+}
+#endif
+
+#if defined(MOONDB_IO_URING)
+void CMoonDb::UringRun()
+{
+	// 每个连接最多同时有一个发送和一个接收请求
+	uint32_t entries = 64;
+	while(entries < MaxConnections * 2 && entries < 4096) {
+		entries <<= 1;
+	}
+	int ret = Uring.Initialize(entries);
+	if(ret < 0) {
+		Clear();
+		TriggerError("io_uring isn't available:" + string(::strerror(-ret)));
+	}
+	EpollEventFd = ::eventfd(0, EFD_CLOEXEC);
+	if(EpollEventFd < 0) {
+		Clear();
+		TriggerError("Create eventfd Failed:" + MoonLastError());
+	}
+#if defined(IORING_ACCEPT_MULTISHOT)
+	UringMultishotAccept = true;
+#else
+	UringMultishotAccept = false;
+#endif
+	uint64_t waitns = static_cast<uint64_t>(EpollWaitMilliseconds()) * 1000000;
+	UringTimeout.tv_sec = static_cast<int64_t>(waitns / 1000000000);
+	UringTimeout.tv_nsec = static_cast<long long>(waitns % 1000000000);
+	AsyncTimers.initialize(CTime::Now());
+	UringArmAccept();
+	UringArmTimeout();
+
+	if(MaxThreads > 1) {
+		UringArmEvent();
+		for(uint32_t i = 0; i < MaxThreads; i++) {
+			thread tn([this]() {
+				this->EpollQuery();
+			});
+			tn.detach();
+		}
+		msleep(10);
+	}
+
+	auto handler = [this](uint64_t userdata, int32_t res, uint32_t flags) {
+		this->UringCompletion(userdata, res, flags);
+	};
+	auto expired = [this](CConnection* conn, int64_t due) {
+		if(this->AsyncTimerExpired(conn, due)) {
+			this->UringRelease(conn);
+		}
+	};
+	while(true) {
+		if(!Started) {
+			break;
+		}
+		// 一次系统调用完成全部提交并等待完成事件
+		ret = Uring.Submit(1);
+		if(ret < 0 && -EINTR != ret && -EBUSY != ret && -EAGAIN != ret) {
+			CLog::Instance()->Put(CLog::L_WARNING, "io_uring_enter Error: " + string(::strerror(-ret)));
+			msleep(1);
+		}
+		// 每轮只读取一次时钟
+		AsyncTimers.update(CTime::Now());
+		Uring.ForEachCompletion(handler);
+		AsyncTimers.expire(expired);
+	}
+
+	if(!Started) {
+		ThreadMutex.lock();
+		AsyncCondVar.notify_all();
+		ThreadMutex.unlock();
+		while(AsyncThreadNum > 0) {
+			msleep(1);
+		}
+		// 停止前将数据发送出去
+		while(!EpollDoneConnections.empty()) {
+			UringSend(EpollDoneConnections.front());
+			EpollDoneConnections.pop();
+		}
+		auto starttime = CTime::Now();
+		while(starttime + AsyncSendTimeout > CTime::Now()) {
+			bool sending = false;
+			for(auto it = AsyncConnections.begin(); it != AsyncConnections.end(); it++) {
+				if(SESS_SENDING == AsyncConnections.at(it)->Status) {
+					sending = true;
+					break;
+				}
+			}
+			if(!sending) {
+				break;
+			}
+			Uring.Submit(1);
+			Uring.ForEachCompletion(handler);
+		}
+		for(auto it = AsyncConnections.begin(); it != AsyncConnections.end(); it++) {
+			CConnection* conn = AsyncConnections.at(it);
+			if(SESS_DISCONNECTED != conn->Status) {
+				AsyncCloseClient(conn);
+			}
+		}
+		Uring.Close();
+		Clear();
+	}
+}
+
+io_uring_sqe* CMoonDb::UringGetSqe(uint32_t reserve)
+{
+	// 链接的请求必须在同一次提交中，剩余空间不够时先提交已准备好的请求
+	if(Uring.SpaceLeft() < reserve) {
+		Uring.Submit(0);
+	}
+	io_uring_sqe* sqe = Uring.GetSqe();
+	while(nullptr == sqe) {
+		Uring.Submit(0);
+		sqe = Uring.GetSqe();
+	}
+	return sqe;
+}
+
+void CMoonDb::UringArmAccept()
+{
+	io_uring_sqe* sqe = UringGetSqe();
+	sqe->opcode = IORING_OP_ACCEPT;
+	sqe->fd = DataSeverSocket;
+#if defined(IORING_ACCEPT_MULTISHOT)
+	if(UringMultishotAccept) {
+		sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+	}
+#endif
+	sqe->accept_flags = SOCK_CLOEXEC;
+	sqe->user_data = UOP_ACCEPT;
+}
+
+void CMoonDb::UringArmEvent()
 {
-	conn->Status = SESS_DISCONNECTED;
-	MoonSockClose(conn->Socket);
-	conn->Socket = INVALID_SOCKET;
+	io_uring_sqe* sqe = UringGetSqe();
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = EpollEventFd;
+	sqe->addr = reinterpret_cast<uint64_t>(&UringEventValue);
+	sqe->len = sizeof(UringEventValue);
+	sqe->user_data = UOP_EVENT;
 }
 
-void CMoonDb::AsyncSend(CConnection* conn)
+void CMoonDb::UringArmTimeout()
 {
-	if(SESS_PROCESSED == conn->Status) {
-		conn->BufPos = 0;
-		conn->Status = SESS_SENDING;
-		conn->Time = CTime::Now();
-	}
-	// 发送超时检测
-	else if(conn->Time + AsyncSendTimeout < CTime::Now()) {
-		AsyncCloseClient(conn);
-		return;
-	}
-	size_t size = conn->Buffer.GetSize();
-	while(size > conn->BufPos) {
-		int32_t bytes = static_cast<int32_t>(min(static_cast<size_t>(SendBufSize), size - conn->BufPos));
-		bytes = MoonSockSend(conn->Socket, static_cast<char*>(conn->Buffer.GetPointer()) + conn->BufPos, bytes);
-		if(SOCKET_ERROR == bytes) {
-			if(MoonLastErrno() == SOCKET_AGAIN) {
-				return;
-			}
-			if(ShowInfo) {
-				cout << "Send Error: " + MoonLastError() << endl;
-			}
-			AsyncCloseClient(conn);
-			return;
+	io_uring_sqe* sqe = UringGetSqe();
+	sqe->opcode = IORING_OP_TIMEOUT;
+	sqe->fd = -1;
+	sqe->addr = reinterpret_cast<uint64_t>(&UringTimeout);
+	sqe->len = 1;
+	sqe->user_data = UOP_TIMEOUT;
+}
+
+void CMoonDb::UringAccepted(int32_t res, uint32_t flags)
+{
+	if(res >= 0) {
+		SOCKET sock_client = res;
+		if(AsyncConnections.size() >= MaxConnections || !CheckClientAddress(sock_client)) {
+			MoonSockClose(sock_client);
+		}
+		else {
+			CConnection* conn = AsyncConnections.push();
+			conn->Slot = AsyncConnections.last();
+			conn->Initialize(sock_client, static_cast<size_t>(max(ReceiveBufSize, SendBufSize)), &AsyncTimers, NanoWaitTimeout);
+			UringPostReceive(conn);
 		}
-		conn->BufPos += static_cast<size_t>(bytes);
-		conn->Time = CTime::Now();
 	}
-	if(conn->Error || size != conn->BufPos) {
-		AsyncCloseClient(conn);
+	else if(-EINVAL == res && UringMultishotAccept) {
+		// 内核不支持multishot accept，改为每次接受后重新提交
+		UringMultishotAccept = false;
 	}
-	else {
-		conn->Status = SESS_SENT;
+	if(!(flags & IORING_CQE_F_MORE) && Started) {
+		UringArmAccept();
 	}
 }
 
-void CMoonDb::AsyncReceive(CConnection* conn)
+void CMoonDb::UringPostReceive(CConnection* conn)
 {
-	// 接收数据长度
-	if(SESS_CONNECTED == conn->Status || SESS_SENT == conn->Status) {
-		int64_t msg_len = 0;
-		int32_t recv_len = MoonSockRecv(conn->Socket, static_cast<char*>(static_cast<void*>(&msg_len)), 8);
-		if(SOCKET_ERROR == recv_len) {
-			if(MoonLastErrno() == SOCKET_WOULDBLOCK) {
-				return;
-			}
-			AsyncCloseClient(conn);
-			return;
-		}
+	// 直接接收到连接的接收缓冲区中，一次接收尽可能多的请求
+	uint64_t space = AsyncInputSpace(conn);
+	io_uring_sqe* sqe = UringGetSqe();
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = conn->Socket;
+	sqe->addr = reinterpret_cast<uint64_t>(static_cast<char*>(conn->Input.GetPointer()) + conn->Input.GetSize());
+	sqe->len = static_cast<uint32_t>(min(space, static_cast<uint64_t>(numeric_limits<int32_t>::max())));
+	sqe->user_data = reinterpret_cast<uint64_t>(conn) | UOP_RECV;
+	conn->Pending++;
+}
 
-		if(8 != recv_len || msg_len <= 0) {
-			if(SOCKET_ERROR == recv_len && ShowInfo) {
-				cout << "Receive Error: " << MoonLastError() << endl;
-			}
-			AsyncCloseClient(conn);
-			return;
-		}
-		if(msg_len > MaxAllowedPacket) {
-			SynchGenerateError(conn, "Exceed maximum bytes of allowed packet (" + num_to_string(MaxAllowedPacket) + " < " + num_to_string(msg_len) + ")");
-			return;
-		}
-		conn->BufPos = 0;
-		conn->Buffer.Reallocate(static_cast<size_t>(msg_len));
-		conn->Buffer.SetSize(static_cast<size_t>(msg_len));
-		conn->Buffer.Seek(0);
-		conn->Status = SESS_RECEIVING;
-		conn->Time = CTime::Now();
+void CMoonDb::UringReceived(CConnection* conn)
+{
+	int64_t msg_len = AsyncFrameLength(conn);
+	if(msg_len < 0) {
+		// 发送错误信息后关闭连接
+		UringSend(conn);
+		return;
 	}
-	// 如果已经开始接收那么进行接收超时检测
-	else if(conn->Time + AsyncRecvTimeout < CTime::Now()) {
-		AsyncCloseClient(conn);
+	if(0 == msg_len) {
+		conn->Status = SESS_RECEIVING;
+		UringPostReceive(conn);
 		return;
 	}
-	// 接收数据
-	size_t msg_len = conn->Buffer.GetSize();
-	while(true) {
-		int32_t cur_len = static_cast<int32_t>(min(static_cast<size_t>(ReceiveBufSize), msg_len - conn->BufPos));
-		int32_t recv_len = MoonSockRecv(conn->Socket, static_cast<char*>(conn->Buffer.GetPointer()) + conn->BufPos, cur_len);
-		if(recv_len > 0) {
-			conn->Time = CTime::Now();
-			conn->BufPos += static_cast<size_t>(recv_len);
-			if(msg_len == conn->BufPos) {
-				conn->Status = SESS_RECEIVED;
-				return;
-			}
-		}
-		else if(SOCKET_ERROR == recv_len) {
-			if(MoonLastErrno() == SOCKET_WOULDBLOCK) {
-				return;
-			}
-			else {
-				if(ShowInfo) {
-					cout << "Receive Error: " << MoonLastError() << endl;
-				}
-				AsyncCloseClient(conn);
-				return;
-			}
-		}
+	// 至少有一个完整的请求，客户端连续发送的其余请求一并处理
+	conn->Status = SESS_PROCESSING;
+	conn->Deadline = 0;
+	if(1 == MaxThreads) {
+		_AsyncQuery(conn, true);
+		UringSend(conn);
+	}
+	else {
+		ThreadMutex.lock();
+		AsyncNewConnections.push(conn);
+		AsyncCondVar.notify_one();
+		ThreadMutex.unlock();
 	}
 }
 
-void CMoonDb::SynchGenerateError(CConnection* conn, const string& text)
+void CMoonDb::UringSend(CConnection* conn)
 {
-	size_t size = text.size();
-	conn->Error = true;
-	conn->Buffer.Clear();
-	conn->Buffer.Reallocate(size + 10);
-	conn->Buffer.Put(static_cast<int64_t>(size + 2));
-	conn->Buffer.Put(static_cast<uint16_t>(RT_ERROR));
-	conn->Buffer.Write(text.c_str(), size);
+	if(SESS_DISCONNECTED == conn->Status) {
+		return;
+	}
+	conn->Status = SESS_SENDING;
+	conn->SetTimeout(AsyncSendTimeout);
+	// 发送后链接下一次接收，发送完成后内核直接开始接收，无需再次提交
+	io_uring_sqe* sqe = UringGetSqe(conn->Error ? 1 : 2);
+	sqe->opcode = IORING_OP_SEND;
+	sqe->fd = conn->Socket;
+	sqe->addr = reinterpret_cast<uint64_t>(conn->Buffer.GetPointer());
+	sqe->len = static_cast<uint32_t>(conn->Buffer.GetSize());
+	// MSG_WAITALL保证完整发送，否则链接的接收会被取消
+	sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+	sqe->user_data = reinterpret_cast<uint64_t>(conn) | UOP_SEND;
+	conn->Pending++;
+	if(!conn->Error) {
+		sqe->flags |= IOSQE_IO_LINK;
+		UringPostReceive(conn);
+	}
 }
 
-void CMoonDb::_AsyncQuery(CConnection* conn)
+void CMoonDb::UringRelease(CConnection* conn)
 {
-	/*__int128_t msg_len = 0;
-	cout << MoonSockRecv(sock_client, static_cast<char*>(static_cast<void*>(&msg_len)), 16) << endl;
-	cout << msg_len << endl;
-	MoonSockSend(sock_client, static_cast<const char*>(static_cast<const void*>(&msg_len)), 16);*/
-
-	try {
-		uint8_t apitype = 0;
-		conn->Buffer.Get(apitype);
-		if(1 == apitype) {
-			NoSQLQuery(conn->Buffer);
-		}
-		else if(2 == apitype) {
-			SQLQuery(conn->Buffer);
-		}
-		else {
-			ThrowError(ERR_WRONG_API_TYPE, "Wrong API type: " + num_to_string(apitype));
-			//return;
-		}
-	}
-	catch(exception& e) {
-		SynchGenerateError(conn, e.what());
+	if(SESS_DISCONNECTED == conn->Status && 0 == conn->Pending) {
+		AsyncConnections.erase(conn->Slot);
 	}
-	conn->Status = SESS_PROCESSED;
 }
 
-void CMoonDb::AsyncQuery()
+void CMoonDb::UringCompletion(uint64_t userdata, int32_t res, uint32_t flags)
 {
-	unique_lock<mutex> lck(ThreadMutex, defer_lock);
-	while(true) {
-		if(!Started) {
-			AsyncThreadNum--;
-			break;
+	CConnection* conn = reinterpret_cast<CConnection*>(userdata & ~static_cast<uint64_t>(UOP_MASK));
+	switch(static_cast<UringOperType>(userdata & UOP_MASK)) {
+	case UOP_ACCEPT:
+		UringAccepted(res, flags);
+		break;
+	case UOP_EVENT: {
+		queue<CConnection*> doneconns;
+		ThreadMutex.lock();
+		swap(doneconns, EpollDoneConnections);
+		ThreadMutex.unlock();
+		while(!doneconns.empty()) {
+			UringSend(doneconns.front());
+			doneconns.pop();
 		}
-		lck.lock();
-		while(AsyncNewConnections.size() == 0) {
-			if(!Started) {
-				break;
+		if(Started) {
+			UringArmEvent();
+		}
+		break;
+	}
+	case UOP_TIMEOUT:
+		// 只用于唤醒事件循环，超时连接由时间轮处理
+		if(Started) {
+			UringArmTimeout();
+		}
+		break;
+	case UOP_RECV:
+		conn->Pending--;
+		if(SESS_DISCONNECTED == conn->Status) {
+			UringRelease(conn);
+		}
+		else if(res <= 0) {
+			// 对方关闭连接、出错或者链接的发送失败
+			AsyncCloseClient(conn);
+			UringRelease(conn);
+		}
+		else {
+			conn->Input.SetSize(conn->Input.GetSize() + static_cast<size_t>(res));
+			conn->SetTimeout(AsyncRecvTimeout);
+			UringReceived(conn);
+		}
+		break;
+	case UOP_SEND:
+		conn->Pending--;
+		if(SESS_DISCONNECTED == conn->Status) {
+			UringRelease(conn);
+		}
+		else if(res < 0 || static_cast<size_t>(res) != conn->Buffer.GetSize() || conn->Error) {
+			if(res < 0 && ShowInfo) {
+				cout << "Send Error: " << ::strerror(-res) << endl;
 			}
-			AsyncCondVar.wait(lck);
+			AsyncCloseClient(conn);
+			UringRelease(conn);
 		}
-		if(!Started) {
-			AsyncThreadNum--;
-			break;
+		else {
+			// 链接的接收请求已在等待数据
+			conn->Buffer.Clear();
+			conn->Status = SESS_SENT;
+			conn->SetTimeout(NanoWaitTimeout);
 		}
-		CConnection* conn = AsyncNewConnections.front();
-		AsyncNewConnections.pop();
-		lck.unlock();
-		_AsyncQuery(conn);
-		AsyncThreadNum--;
+		break;
+	default:
+		break;
 	}
 }
+#endif
 
 CSQLite* CMoonDb::GetSQLite(const string& dbname)
 {
@@ -1511,7 +2710,7 @@ void CMoonDb::SQLiteQuery(CPack& pack)
 {
 	string sql;
 	pack.Get<uint32_t>(sql);
-	unordered_map<string, CAny> data;
+	CFieldMap data;
 	ParseStringMap(pack, data);
 	pack.Clear();
 	if("CONNECT" == to_upper_copy(sql)) {
@@ -1540,13 +2739,15 @@ void CMoonDb::SQLiteQuery(CPack& pack)
 	}
 }
 
-void CMoonDb::SQLQuery(CPack& pack)
+void CMoonDb::SQLQuery(CPack& pack, CPack& ret)
 {
 	string sql;
 	pack.Get<uint32_t>(sql);
-	unordered_map<string, CAny> data;
+	CFieldMap data;
 	ParseStringMap(pack, data);
-	pack.Clear();
+	if(&pack == &ret) {
+		ret.Clear();
+	}
 	vector<CSQLParser::CToken> tokens;
 	SQLParser.Parse(sql, tokens);
 	for(size_t i = 0; i < tokens.size(); i++) {
@@ -1557,10 +2758,12 @@ void CMoonDb::SQLQuery(CPack& pack)
 	}
 }
 
-void CMoonDb::NoSQLQuery(CPack& pack)
+void CMoonDb::NoSQLQuery(CPack& pack, CPack& ret, SOCKET sock, uint64_t* sent)
 {
 	uint16_t opertype = 0;
 	pack.Get(opertype);
+	bool fieldids = 0 != (opertype & OPER_FIELD_IDS);
+	opertype &= static_cast<uint16_t>(~OPER_FIELD_IDS);
 	if(opertype == 0 || opertype >= OPER_SIZE) {
 		ThrowError(ERR_WRONG_OPER_TYPE, "Wrong operation type: " + num_to_string(opertype));
 		return;
@@ -1577,7 +2780,9 @@ void CMoonDb::NoSQLQuery(CPack& pack)
 		ThrowError(ERR_WRONG_NAME, "Wrong table name: " + tablename);
 		return;
 	}
-	CDatabase* dbh = GetDatabase(dbname);
+	// 请求处理完之前持有数据库的句柄，数据库不会被关闭，表随数据库一起关闭，也不会被删除
+	CHandleRegistry<CDatabase>::CHandle dbhandle;
+	CDatabase* dbh = GetDatabase(dbname, dbhandle);
 	if(nullptr == dbh) {
 		ThrowError(ERR_DB_NOT_EXIST, "Database " + dbname + " doesn't exist.");
 		return;
@@ -1587,127 +2792,274 @@ void CMoonDb::NoSQLQuery(CPack& pack)
 		ThrowError(ERR_TABLE_NOT_EXIST, "Table " + tablename + " doesn't exist.");
 		return;
 	}
-	unordered_map<string, CAny> data;
-	ParseStringMap(pack, data);
-	pack.Clear();
-	shared_timed_mutex* mutex = dbh->GetMutex();
+	if(fieldids) {
+		if(OPER_RAW_SELECT == opertype || OPER_SCHEMA == opertype || OPER_STATS == opertype) {
+			ThrowError(ERR_WRONG_OPER_TYPE, "Operation type " + num_to_string(opertype) + " doesn't support field ids.");
+			return;
+		}
+		// 客户端缓存的表结构已过期，不执行请求，客户端重新读取表结构后重试
+		uint32_t stamp = 0;
+		pack.Get(stamp);
+		if(stamp != tableh->GetSchemaStamp()) {
+			if(&pack == &ret) {
+				ret.Clear();
+			}
+			ret.Put(static_cast<int64_t>(6));
+			ret.Put(static_cast<uint16_t>(RT_SCHEMA_CHANGED));
+			ret.Put(tableh->GetSchemaStamp());
+			return;
+		}
+	}
+	if(opertype >= OPER_MULTI_SELECT && opertype <= OPER_MULTI_REPLACE) {
+		NoSQLMultiQuery(pack, ret, static_cast<OperType>(opertype), dbh, tableh, fieldids);
+		return;
+	}
+	// 解析出的字段从当前线程的内存池分配，请求处理完后整体回收
+	CArena& arena = CArena::ThreadLocal();
+	CArena::CScope scope(arena);
+	CFieldMap data(0, CFieldMap::hasher(), CFieldMap::key_equal(), CFieldMap::allocator_type(&arena));
+	// 请求和结果不共用缓冲区时，字符串值直接引用请求中的数据，写入表时才复制
+	bool reference = &pack != &ret;
+	if(fieldids) {
+		ParseFieldIdMap(pack, data, tableh, OPER_INSERT == opertype, reference);
+	}
+	else {
+		ParseStringMap(pack, data, reference);
+	}
+	if(&pack == &ret) {
+		ret.Clear();
+	}
+	// 数据库锁只加读锁（只锁定当前线程对应的分组），行数据由表内按键分段的锁和序列号保护
+	shared_lock<CReadMostlyMutex> lck(*dbh->GetMutex());
 	switch(static_cast<OperType>(opertype)) {
 	case OPER_SELECT:
-		mutex->lock_shared();
-		try {
-			tableh->GetData(data["rowid"], pack);
-			mutex->unlock_shared();
+		if(fieldids) {
+			// 按字段序号读取时一行也返回批量读取结果，结果头中没有字段名
+			CRowIds rowids(1, data["rowid"], CRowIds::allocator_type(&arena));
+			tableh->GetMultiData(rowids, ret, false);
 		}
-		catch(runtime_error& e) {
-			mutex->unlock_shared();
-			throw e;
+		else {
+			tableh->GetData(data["rowid"], ret);
 		}
 		break;
+	case OPER_RAW_SELECT:
+		// 发送完成（或未发送的部分复制到ret）之前该行被pin，行数据不变，期间对该行的修改写入副本
+		tableh->GetRawData(data["rowid"], ret, [&](const void* row, uint64_t length) {
+			SendRawRow(sock, ret, row, length, sent);
+		});
+		break;
+	case OPER_SCHEMA:
+		tableh->SchemaResult(ret);
+		break;
+	case OPER_STATS:
+		tableh->StatsResult(ret);
+		break;
 	case OPER_INSERT:
-		mutex->lock();
-		try {
-			tableh->InsertData(data, pack);
-			mutex->unlock();
-		}
-		catch(runtime_error& e) {
-			mutex->unlock();
-			throw e;
-		}
+		tableh->InsertData(data, ret);
 		break;
 	case OPER_UPDATE:
-		mutex->lock();
-		try {
-			tableh->UpdateData(data["rowid"], data, pack);
-			mutex->unlock();
-		}
-		catch(runtime_error& e) {
-			mutex->unlock();
-			throw e;
-		}
+		tableh->UpdateData(data["rowid"], data, ret);
 		break;
 	case OPER_DELETE:
-		mutex->lock();
-		try {
-			tableh->DeleteData(data["rowid"], pack);
-			mutex->unlock();
-		}
-		catch(runtime_error& e) {
-			mutex->unlock();
-			throw e;
-		}
+		tableh->DeleteData(data["rowid"], ret);
 		break;
 	case OPER_REPLACE:
-		mutex->lock();
-		try {
-			tableh->ReplaceData(data["rowid"], data, pack);
-			mutex->unlock();
+		tableh->ReplaceData(data["rowid"], data, ret);
+		break;
+	default:
+		break;
+	}
+}
+
+void CMoonDb::SendRawRow(SOCKET sock, CPack& ret, const void* row, uint64_t length, uint64_t* sent)
+{
+	const char* data = static_cast<const char*>(row);
+#if !defined(_WIN32)
+	if(INVALID_SOCKET != sock) {
+		// ret中已有的响应和行数据一次发送，内核直接从表的内存复制，不经过ret；
+		// 不等待，发送不完的部分由常规的发送流程处理
+		iovec iov[2];
+		iov[0].iov_base = ret.GetPointer();
+		iov[0].iov_len = ret.GetSize();
+		iov[1].iov_base = const_cast<char*>(data);
+		iov[1].iov_len = length;
+		msghdr msg;
+		::memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = 2;
+		ssize_t result = ::sendmsg(sock, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if(result > 0) {
+			uint64_t bytes = static_cast<uint64_t>(result);
+			uint64_t size = ret.GetSize();
+			if(nullptr != sent) {
+				*sent += min(bytes, size);
+			}
+			if(bytes < size) {
+				char* buf = static_cast<char*>(ret.GetPointer());
+				::memmove(buf, buf + bytes, size - bytes);
+				ret.SetSize(size - bytes);
+				ret.Seek(0, CPack::POS_END);
+			}
+			else {
+				ret.Clear();
+				data += bytes - size;
+				length -= bytes - size;
+			}
 		}
-		catch(runtime_error& e) {
-			mutex->unlock();
-			throw e;
+	}
+#endif
+	if(length > 0) {
+		ret.Write(data, length);
+	}
+}
+
+void CMoonDb::NoSQLMultiQuery(CPack& pack, CPack& ret, OperType opertype, CDatabase* dbh, CTable* tableh, bool fieldids)
+{
+	// 行数之后，读取和删除每行只有rowid，插入、更新和替换每行的格式与单行请求相同
+	uint32_t count = 0;
+	pack.Get(count);
+	size_t reserved = min(static_cast<size_t>(count), static_cast<size_t>(pack.GetSize() - pack.Tell()));
+	CArena& arena = CArena::ThreadLocal();
+	CArena::CScope scope(arena);
+	CArenaAllocator<CAny> alloc(&arena);
+	CRowIds rowids(alloc);
+	CFieldMaps rows(alloc);
+	bool reference = &pack != &ret;
+	if(OPER_MULTI_SELECT == opertype || OPER_MULTI_DELETE == opertype) {
+		rowids.reserve(reserved);
+		for(uint32_t i = 0; i < count; i++) {
+			rowids.emplace_back();
+			rowids.back().Load(pack, reference);
 		}
+	}
+	else {
+		rows.reserve(reserved);
+		if(OPER_MULTI_INSERT != opertype) {
+			rowids.reserve(reserved);
+		}
+		for(uint32_t i = 0; i < count; i++) {
+			rows.emplace_back(0, CFieldMap::hasher(), CFieldMap::key_equal(), alloc);
+			if(fieldids) {
+				ParseFieldIdMap(pack, rows.back(), tableh, OPER_MULTI_INSERT == opertype, reference);
+			}
+			else {
+				ParseStringMap(pack, rows.back(), reference);
+			}
+			if(OPER_MULTI_INSERT != opertype) {
+				rowids.push_back(rows.back()["rowid"]);
+			}
+		}
+	}
+	if(&pack == &ret) {
+		ret.Clear();
+	}
+	// 整批只加一次数据库读锁，各行由表内的分段锁保护
+	shared_lock<CReadMostlyMutex> lck(*dbh->GetMutex());
+	switch(opertype) {
+	case OPER_MULTI_SELECT:
+		tableh->GetMultiData(rowids, ret, !fieldids);
+		break;
+	case OPER_MULTI_INSERT:
+		tableh->InsertMultiData(rows, ret);
+		break;
+	case OPER_MULTI_UPDATE:
+		tableh->UpdateMultiData(rowids, rows, ret);
+		break;
+	case OPER_MULTI_DELETE:
+		tableh->DeleteMultiData(rowids, ret);
+		break;
+	case OPER_MULTI_REPLACE:
+		tableh->ReplaceMultiData(rowids, rows, ret);
 		break;
 	default:
 		break;
 	}
 }
 
-void CMoonDb::ParseStringMap(CPack& pack, unordered_map<string, CAny>& data)
+void CMoonDb::ParseStringMap(CPack& pack, CFieldMap& data, bool reference)
 {
 	uint16_t count = 0;
 	pack.Get(count);
 	for(uint16_t i = 0; i < count; ++i) {
 		string key;
 		pack.Get<uint16_t>(key);
-		CAny value;
-		auto it = data.emplace(key, value);
+		auto it = data.emplace(std::move(key), CAny());
 		if(it.second) {
-			it.first->second.Load(pack);
+			it.first->second.Load(pack, reference);
+		}
+		else {
+			// 重复的字段只保留第一个，值仍要读过
+			CAny value;
+			value.Load(pack, true);
 		}
 		//data.insert(pair<string, CAny>(key, value));
 	}
 }
 
-CDatabase* CMoonDb::GetDatabase(const string& dbname)
+void CMoonDb::ParseFieldIdMap(CPack& pack, CFieldMap& data, const CTable* tableh, bool inserting, bool reference)
+{
+	static const string rowidkey = "rowid";
+	uint16_t count = 0;
+	pack.Get(count);
+	data.reserve(count);
+	for(uint16_t i = 0; i < count; ++i) {
+		uint16_t ordinal = 0;
+		pack.Get(ordinal);
+		const string* name = tableh->GetFieldName(ordinal);
+		if(nullptr == name) {
+			ThrowError(ERR_WRONG_NAME, "Wrong field id " + num_to_string(ordinal) + " of the table " + tableh->GetName() + ".");
+			return;
+		}
+		auto it = data.emplace(0 == ordinal && !inserting ? rowidkey : *name, CAny());
+		if(it.second) {
+			it.first->second.Load(pack, reference);
+		}
+		else {
+			CAny value;
+			value.Load(pack, true);
+		}
+	}
+}
+
+CDatabase* CMoonDb::GetDatabase(const string& dbname, CHandleRegistry<CDatabase>::CHandle& handle)
 {
+	if(CHandleRegistry<CDatabase>::LR_UNKNOWN != DatabaseHandles.acquire(dbname, handle) || LoadAllSchemasOnLoading) {
+		return handle.get();
+	}
+	lock_guard<shared_timed_mutex> lck(SchemaMutex);
+	// 可能已由其他线程打开或确认不存在
+	if(CHandleRegistry<CDatabase>::LR_UNKNOWN != DatabaseHandles.acquire(dbname, handle)) {
+		return handle.get();
+	}
 	CDatabase* dbobj = nullptr;
-	SchemaMutex.lock_shared();
-	auto it = Databases.find(dbname);
-	if(it != Databases.end()) {
-		dbobj = it->second;
+	string dbpath = DataDirectory + DIRECTORY_SEPARATOR + dbname;
+	if(!CFileSystem::Exists(dbpath)) {
+		DatabaseHandles.set_missing(dbname);
+		return nullptr;
 	}
-	SchemaMutex.unlock_shared();
-	if(!LoadAllSchemasOnLoading) {
-		string dbpath = DataDirectory + DIRECTORY_SEPARATOR + dbname;
-		if(CFileSystem::Exists(dbpath)) {
-			SchemaMutex.lock();
-			auto it = Databases.find(dbname);
-			if(it != Databases.end()) {
-				dbobj = it->second;
-			}
-			else {
-				try {
-					dbobj = new CDatabase(dbpath);
-					Databases.emplace(dbname, dbobj);
-					dbobj->SetMutex(ApplyForMutex());
-				}
-				catch(runtime_error& e) {
-					if(ShowInfo) {
-						cout << e.what() << endl;
-					}
-				}
-			}
-			SchemaMutex.unlock();
+	try {
+		dbobj = new CDatabase(dbpath);
+		Databases.emplace(dbname, dbobj);
+		dbobj->SetMutex(ApplyForMutex());
+		DatabaseHandles.insert(dbname, dbobj);
+	}
+	catch(runtime_error& e) {
+		if(ShowInfo) {
+			cout << e.what() << endl;
 		}
+		// 打开失败的数据库在负缓存有效期内不再重试
+		DatabaseHandles.set_missing(dbname);
+		return nullptr;
 	}
-	return dbobj;
+	DatabaseHandles.acquire(dbname, handle);
+	return handle.get();
 }
 
-shared_timed_mutex* CMoonDb::ApplyForMutex()
+CReadMostlyMutex* CMoonDb::ApplyForMutex()
 {
-	shared_timed_mutex* mutex = nullptr;
+	CReadMostlyMutex* mutex = nullptr;
 	if(DeletedDbMutexes.empty()) {
-		mutex = new shared_timed_mutex;
+		mutex = new CReadMostlyMutex;
 		DatabaseMutexes.insert(mutex);
 	}
 	else {
@@ -1717,7 +3069,7 @@ shared_timed_mutex* CMoonDb::ApplyForMutex()
 	return mutex;
 }
 
-void CMoonDb::ReleaseMutex(shared_timed_mutex* mutex)
+void CMoonDb::ReleaseMutex(CReadMostlyMutex* mutex)
 {
 	auto it = DatabaseMutexes.find(mutex);
 	if(it != DatabaseMutexes.end()) {
@@ -1735,6 +3087,7 @@ void CMoonDb::LoadSchemas()
 			CDatabase* db = new CDatabase(DataDirectory + DIRECTORY_SEPARATOR + dbnames[i]);
 			Databases.emplace(dbnames[i], db);
 			db->SetMutex(ApplyForMutex());
+			DatabaseHandles.insert(dbnames[i], db);
 		}
 		catch(runtime_error& e) {
 			if(ShowInfo) {
@@ -1749,9 +3102,15 @@ void CMoonDb::CloseDatabase(const string& dbname)
 	SchemaMutex.lock();
 	auto it = Databases.find(dbname);
 	if(it != Databases.end()) {
-		ReleaseMutex(it->second->GetMutex());
+		// 之后的请求查找不到，需要重新打开；已查找到该数据库的请求全部释放句柄后才返回
+		DatabaseHandles.invalidate(dbname);
+		// 后台线程持有SchemaMutex读锁遍历，此时已没有线程持有数据库读锁
+		CReadMostlyMutex* mutex = it->second->GetMutex();
+		mutex->lock();
 		delete it->second;
 		Databases.erase(it);
+		mutex->unlock();
+		ReleaseMutex(mutex);
 	}
 	SchemaMutex.unlock();
 }
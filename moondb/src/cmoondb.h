@@ -15,6 +15,10 @@
 	#include <netinet/tcp.h>
 	#include <sys/socket.h>
 	#include <arpa/inet.h>
+	#if defined(__linux__)
+		#include <sys/epoll.h>
+		#include <sys/eventfd.h>
+	#endif
 	#define SOCKET							int
 	#define SOCKET_ERROR					-1
 	#define MoonSockRecv(sock, buf, len)	::recv(sock, buf, len, MSG_NOSIGNAL)
@@ -31,6 +35,9 @@
 #include <atomic>
 #include <shared_mutex>
 #include "cqueue.hpp"
+#include "cringqueue.hpp"
+#include "ctimerwheel.hpp"
+#include "ciouring.hpp"
 #include "csqlparser.h"
 #include "cdatabase.h"
 #include "ctable.h"
@@ -54,6 +61,12 @@ public:
 	void Stop() noexcept;
 	bool IsStopped() const noexcept;
 
+	/**
+	 * @brief Query 按API类型处理一个请求（不含长度），结果写入ret；sock用于直接发送原始行数据，为INVALID_SOCKET时只写入ret
+	 * @param sent 不为nullptr时累加直接发送后从ret开头移除的字节数，出错时据此确定回退的位置
+	 */
+	void Query(CPack& request, CPack& ret, SOCKET sock = INVALID_SOCKET, uint64_t* sent = nullptr);
+
 protected:
 	enum TokenType {
 		TT_NONE,
@@ -74,8 +87,21 @@ protected:
 		OPER_UPDATE,
 		OPER_DELETE,
 		OPER_REPLACE,
+		OPER_MULTI_SELECT,		/**< 批量操作：一个请求包含多行数据，只查找一次表、加锁一次 */
+		OPER_MULTI_INSERT,
+		OPER_MULTI_UPDATE,
+		OPER_MULTI_DELETE,
+		OPER_MULTI_REPLACE,
+		OPER_RAW_SELECT,		/**< 读取一行，返回原始行数据，直接从表的内存发送 */
+		OPER_SCHEMA,			/**< 读取表结构，用于解码原始行数据 */
+		OPER_STATS,				/**< 读取表的行数、淘汰和到期删除的行数以及内存预算的使用情况 */
 		OPER_SIZE,
 	};
+	/**
+	 * 操作类型中的标志位：请求中的字段按表结构中的序号（0为rowid）而不是字段名表示，表名之后为客户端缓存的表结构校验值；
+	 * 读取的结果为不带字段名的批量读取结果（RT_MULTI_QUERY），字段按表结构中的顺序排列
+	 */
+	const static uint16_t OPER_FIELD_IDS = 0x8000;
 
 	enum InternetFamilyType {
 		IF_IPv4 = 1,
@@ -108,26 +134,71 @@ protected:
 		SOCKET Socket;
 		string Database;
 		string Username;
-		CPack Buffer;
+		CPack Buffer;					/**< 发送缓冲区，一次接收到的多个请求的响应依次写入 */
 		uint64_t BufPos;
+		CPack Input;					/**< 接收缓冲区，可能包含多个请求 */
+		uint64_t InputPos;				/**< 接收缓冲区中下一个未处理请求的位置 */
 		StatusType Status;
 		bool Error;
-		chrono::high_resolution_clock::rep Time;
-		CConnection() noexcept : Socket(INVALID_SOCKET), BufPos(0), Status(SESS_UNCONNECTED), Error(false), Time(0)
+		int64_t Deadline;				/**< 当前状态的超时时间，为0表示没有超时（处理请求期间） */
+		int64_t TimerDue;				/**< 本连接在时间轮中的到期时间，不在时间轮中时为最大值 */
+		CTimerWheel<CConnection*>* Timers;/**< 所属事件循环的时间轮 */
+		list<size_t>::iterator Slot;	/**< 在连接队列中的位置，epoll方式关闭连接时使用 */
+		uint32_t Pending;				/**< io_uring中未完成的请求数，为0后才能回收连接 */
+		CConnection() noexcept : Socket(INVALID_SOCKET), BufPos(0), InputPos(0), Status(SESS_UNCONNECTED), Error(false), Deadline(0),
+			TimerDue(numeric_limits<int64_t>::max()), Timers(nullptr), Pending(0)
 		{}
-		inline void Initialize(SOCKET socket) noexcept
+		inline void Initialize(SOCKET socket, size_t bufsize, CTimerWheel<CConnection*>* timers, int64_t timeout)
 		{
 			Socket = socket;
 			Username.clear();
+			// 连接对象重复使用，缓冲区只在第一次使用时分配
+			Buffer.Reallocate(bufsize);
 			Buffer.Clear();
 			BufPos = 0;
+			Input.Reallocate(bufsize);
+			Input.Clear();
+			InputPos = 0;
 			Database.clear();
 			Status = SESS_CONNECTED;
 			Error = false;
-			Time = CTime::Now();
+			Pending = 0;
+			// 连接对象重复使用时，时间轮中可能还有之前的项，到期时间不同即被忽略
+			Timers = timers;
+			TimerDue = numeric_limits<int64_t>::max();
+			SetTimeout(timeout);
+		}
+		/**
+		 * @brief SetTimeout 从当前时间（时间轮缓存的时间）开始计算超时时间
+		 * @param timeout 超时时长，单位为纳秒
+		 */
+		inline void SetTimeout(int64_t timeout)
+		{
+			Deadline = Timers->now() + timeout;
+			// 超时时间推后时只记录，时间轮中的项到期后再按新的时间重新加入；提前时另加一项
+			if(Deadline < TimerDue) {
+				TimerDue = Deadline;
+				Timers->schedule(this, Deadline);
+			}
 		}
 	};
 
+#if defined(__linux__)
+	/**
+	 * 分组异步方式（epoll）下每个工作线程的数据
+	 */
+	struct CGroupWorker
+	{
+		int EpollFd;						/**< 工作线程的epoll句柄 */
+		int EventFd;						/**< 有新连接时唤醒工作线程 */
+		CRingQueue<SOCKET> NewConnections;	/**< 接收线程写入、工作线程读取的新连接 */
+		SOCKET Listener;					/**< ReusePort方式下本线程的监听socket */
+		CTimerWheel<CConnection*> Timers;	/**< 本线程连接的超时 */
+		CGroupWorker() noexcept : EpollFd(-1), EventFd(-1), Listener(INVALID_SOCKET)
+		{}
+	};
+#endif
+
 	void LoadSchemas();
 
 	inline void Clear() noexcept;
@@ -137,57 +208,139 @@ protected:
 	inline SOCKET _CreateSocket(bool asyn);
 	inline void ListenAndSetting(SOCKET socksvr);
 
-	inline SOCKET Accept(bool& wrongip) const noexcept;
+	inline SOCKET Accept(SOCKET socksvr, bool& wrongip) const noexcept;
 	inline void AsyncAccept() noexcept;
 
 	inline uint32_t IPToLong(const string& ip) const noexcept;
+	inline bool CheckClientAddress(SOCKET sock) const noexcept;
 
 	void AsyncRun();
 	void SynchRun();
+	/**
+	 * @brief ExpireRun 后台线程：每隔ExpireInterval毫秒分批删除各表中到期的数据，某个表未处理完时不等待；等待时每10毫秒更新一次内存预算的时钟
+	 */
+	inline void ExpireRun();
+	/**
+	 * @brief PersistRun 后台线程（启用RedoLog时）：每10毫秒让各表按同步策略写入重做日志，到时间时生成快照
+	 * StopBackground通知后再执行最后一遍才退出
+	 */
+	inline void PersistRun();
+	/**
+	 * @brief StopBackground 通知并等待ExpireRun和PersistRun线程结束，在Clear删除数据库之前调用；
+	 * 之后删除数据库时各表析构，写入并同步重做日志缓冲区中剩余的记录
+	 */
+	inline void StopBackground() noexcept;
 	void GroupRun();
+#if defined(__linux__)
+	void EpollRun();
+	void EpollGroupRun();
+	inline void EpollQuery();
+	inline void EpollGroupQuery(uint32_t threadid);
+	inline void EpollGroupAdd(CGroupWorker& worker, CQueue<CConnection>& connections, SOCKET sock_client, vector<CConnection*>& closed);
+	inline void EpollAccept();
+	inline void EpollHandle(CConnection* conn, uint32_t events, vector<CConnection*>& closed, bool inlinequery);
+	inline void EpollCloseAll(CQueue<CConnection>& connections);
+	inline int EpollWaitMilliseconds() const noexcept;
+#endif
+#if defined(MOONDB_IO_URING)
+	/**
+	 * io_uring请求类型，保存在user_data的低3位，高位为连接指针
+	 */
+	enum UringOperType {
+		UOP_ACCEPT,
+		UOP_EVENT,
+		UOP_TIMEOUT,
+		UOP_RECV,
+		UOP_SEND,
+		UOP_MASK = 7
+	};
+	void UringRun();
+	inline io_uring_sqe* UringGetSqe(uint32_t reserve = 1);
+	inline void UringArmAccept();
+	inline void UringArmEvent();
+	inline void UringArmTimeout();
+	inline void UringAccepted(int32_t res, uint32_t flags);
+	inline void UringPostReceive(CConnection* conn);
+	inline void UringReceived(CConnection* conn);
+	inline void UringSend(CConnection* conn);
+	inline void UringRelease(CConnection* conn);
+	inline void UringCompletion(uint64_t userdata, int32_t res, uint32_t flags);
+#endif
 	inline void AsyncQuery();
-	inline void _AsyncQuery(CConnection* conn);
-	inline void SynchAcceptAndQuery(uint32_t threadid);
+	/**
+	 * @brief _AsyncQuery 处理连接接收缓冲区中全部完整的请求，响应追加到发送缓冲区
+	 * @param direct 调用线程是否负责该连接的socket读写，为true时原始行数据可以直接发送，工作线程调用时为false，全部交给事件循环发送
+	 */
+	inline void _AsyncQuery(CConnection* conn, bool direct);
+	/**
+	 * @brief SynchWorker 同步方式的工作线程，循环接收新连接并处理该连接的全部请求
+	 */
+	inline void SynchWorker(uint32_t threadid);
+	inline void SynchQuery(SOCKET sock_client, uint32_t threadid);
 	inline void GroupQuery(uint32_t threadid);
-	inline void SQLQuery(CPack& pack);
-	inline void NoSQLQuery(CPack& pack);
+	/**
+	 * @brief SQLQuery、NoSQLQuery 执行pack中的请求，结果追加到ret的当前位置，
+	 * 请求解析完后才写入结果，因此pack和ret可以是同一个对象
+	 */
+	inline void SQLQuery(CPack& pack, CPack& ret);
+	/**
+	 * sock有效时，原始行数据的响应连同ret中之前的响应直接从表的内存发送，未发送完的部分再复制到ret
+	 */
+	inline void NoSQLQuery(CPack& pack, CPack& ret, SOCKET sock = INVALID_SOCKET, uint64_t* sent = nullptr);
+	inline void NoSQLMultiQuery(CPack& pack, CPack& ret, OperType opertype, CDatabase* dbh, CTable* tableh, bool fieldids);
 	inline void SQLiteQuery(CPack& pack);
+	inline void SendRawRow(SOCKET sock, CPack& ret, const void* row, uint64_t length, uint64_t* sent);
 	inline void AsyncSend(CConnection* conn);
 	inline void AsyncReceive(CConnection* conn);
+	inline int64_t AsyncFrameLength(CConnection* conn);
+	inline uint64_t AsyncInputSpace(CConnection* conn);
 	inline void AsyncCloseClient(CConnection* conn);
+	/**
+	 * @brief AsyncTimerExpired 处理时间轮中到期的连接项，超时则关闭连接
+	 * @return 连接因超时被关闭返回true
+	 */
+	inline bool AsyncTimerExpired(CConnection* conn, int64_t due);
 	inline void SynchGenerateError(CConnection* conn, const string& text);
-	inline void ParseStringMap(CPack& pack, unordered_map<string, CAny>& data);
+	/**
+	 * @brief ParseStringMap 读取按字段名表示的字段；reference为true时字符串值引用pack中的数据，pack在data使用期间不能改写
+	 */
+	inline void ParseStringMap(CPack& pack, CFieldMap& data, bool reference = false);
+	/**
+	 * @brief ParseFieldIdMap 读取按字段序号表示的字段，字段名从表结构中取得；rowid字段在插入时使用表的rowid字段名，其他操作为“rowid”
+	 */
+	inline void ParseFieldIdMap(CPack& pack, CFieldMap& data, const CTable* tableh, bool inserting, bool reference = false);
 	inline void SynchSend(SOCKET sock_client, CPack& pack);
-	inline int64_t SynchReceive(SOCKET sock_client, CPack& pack);
+	/**
+	 * @brief SynchReceive 接收数据直到接收缓冲区中至少有一个完整的请求
+	 * @return 第一个请求的长度，对方关闭连接返回0，出错返回负数（请求长度错误时conn->Error为true）
+	 */
+	inline int64_t SynchReceive(CConnection* conn);
 	inline void SynchSendError(SOCKET sock_client, CPack& pack, const string& text);
 	inline void GroupDistributeConnection(const vector<SOCKET>& clientsocks, vector<pair<uint32_t, uint32_t>>& connnumperthread);
 
-	unordered_set<shared_timed_mutex*> DatabaseMutexes;	/**< 每个数据库一个互斥锁，这里存储着所有的数据库互斥锁 */
-	deque<shared_timed_mutex*> DeletedDbMutexes;		/**< 数据库被关闭后删除的互斥锁存在这里备用 */
-	inline shared_timed_mutex* ApplyForMutex();
-	inline void ReleaseMutex(shared_timed_mutex* mutex);
+	unordered_set<CReadMostlyMutex*> DatabaseMutexes;	/**< 每个数据库一个互斥锁，这里存储着所有的数据库互斥锁 */
+	deque<CReadMostlyMutex*> DeletedDbMutexes;		/**< 数据库被关闭后删除的互斥锁存在这里备用 */
+	inline CReadMostlyMutex* ApplyForMutex();
+	inline void ReleaseMutex(CReadMostlyMutex* mutex);
 	/**
-	 * @brief GetDatabase 返回数据库对象指针
+	 * @brief GetDatabase 返回数据库对象指针，已打开和近期确认不存在的数据库不加锁、不访问文件系统
 	 * @param dbname 数据库名称
+	 * @param handle 持有返回的数据库，释放之前数据库不会被关闭，请求处理完后释放
 	 * @return 数据库对象指针
 	 */
-	inline CDatabase* GetDatabase(const string& dbname);
+	inline CDatabase* GetDatabase(const string& dbname, CHandleRegistry<CDatabase>::CHandle& handle);
 	/**
-	 * @brief CloseDatabase 关闭数据库并从数据库列表中删除
+	 * @brief CloseDatabase 关闭数据库并从数据库列表中删除，等待正在使用该数据库的请求结束
 	 * @param dbname 数据库名称
 	 */
 	inline void CloseDatabase(const string& dbname);
 	inline CSQLite* GetSQLite(const string& dbname);
 
-	inline uint32_t SynchGetNewThreadNum();
-	inline void SynchDeleteThread(uint32_t threadid);
-
 	string ProgramDirectory;			/**< 程序所在目录 */
 	bool ShowInfo;						/**< 是否以服务方式运行 */
 	string ConfigFile;					/**< 配置文件 */
 	InternetFamilyType InternetFamily;	/**< ipv4或ipv6 */
 
-	int32_t BytesPerRead;				/**< 每次读取数据大小，单位字节 */
 	int32_t SendBufSize;				/**< socket发送缓冲区大小 */
 	int32_t ReceiveBufSize;				/**< socket接收缓冲区大小 */
 	uint32_t DataServerIPv4;			/**< 监听数据服务IP v4 */
@@ -209,8 +362,12 @@ protected:
 	uint32_t MaxThreads;				/**< 开启的最大线程数 */
 	uint32_t MaxConnections;			/**< 最大连接数 */
 	int64_t MaxAllowedPacket;			/**< 最大接收数据包 */
-	uint32_t Async;						/**< 运行方式，0：同步，1：全局异步，2：分组异步 */
+	uint32_t Async;						/**< 运行方式，0：同步，1：全局异步，2：分组异步，3：epoll边缘触发（仅linux） */
 	bool LoadAllSchemasOnLoading;		/**< 是否在启动时一次性加载全部数据库 */
+	bool ReusePort;						/**< 分组异步方式下每个线程各自绑定SO_REUSEPORT监听socket并接收连接（仅linux） */
+	bool IoUring;						/**< Async=3时使用io_uring代替epoll（仅linux） */
+	uint32_t ExpireInterval;			/**< 后台删除到期数据的时间间隔，单位为毫秒 */
+	uint32_t ExpireBatch;				/**< 后台每次删除到期数据时每个表最多处理的项数 */
 
 	// 如果接收指令停止运行Started置为false
 	atomic<bool> Started;
@@ -218,16 +375,20 @@ protected:
 	bool Restart;
 	// 已经停止
 	bool Stopped;
+	atomic<bool> BackgroundStarted;		/**< 后台线程是否继续运行，StopBackground置为false */
+	thread Expirer;						/**< 运行ExpireRun的后台线程 */
+	thread Persister;					/**< 启用RedoLog时运行PersistRun的后台线程 */
 
 	unordered_map<string, CDatabase*> Databases;/**< 已打开的数据库 */
+	CHandleRegistry<CDatabase> DatabaseHandles;	/**< 供请求查找的已打开的数据库和近期确认不存在的数据库名称，修改时持有SchemaMutex写锁 */
 	unordered_map<string, CSQLite*> SQLites;	/**< 已打开的数据库 */
 	CQueue<CConnection> AsyncConnections;		/**< 连接 */
+	CTimerWheel<CConnection*> AsyncTimers;		/**< 全局异步、epoll和io_uring方式下连接的超时 */
 	atomic<uint32_t> AsyncThreadNum;			/**< 当前线程数量 */
 	atomic<uint32_t> GroupConnectionNum;		/**< 当前连接数 */
-	uint32_t SynchThreadNum;					/**< 当前线程数量 */
+	atomic<uint32_t> SynchThreadNum;			/**< 当前线程数量 */
 	mutex ThreadMutex;							/**< 用于线程操作的互斥锁 */
-	queue<uint32_t> SynchIdleThreads;			/**< 空闲线程编号组 */
-	vector<CPack> SynchBuffers;					/**< 线程接收发送数据缓冲区 */
+	vector<CConnection> SynchConnections;		/**< 同步方式下每个线程的接收发送缓冲区 */
 	shared_timed_mutex SchemaMutex;				/**< 数据库互斥锁 */
 
 	queue<CConnection*> AsyncNewConnections;	/**< 新线程连接 */
@@ -236,6 +397,21 @@ protected:
 	vector<vector<SOCKET>> GroupNewConnections;	/**< 分组新连接 */
 	atomic<uint32_t>* GroupConnectionNumPerThread;/**< 每个组的连接数 */
 
+#if defined(__linux__)
+	int EpollFd;								/**< epoll句柄 */
+	int EpollEventFd;							/**< 工作线程处理完成后唤醒epoll_wait */
+	bool EpollAccepting;						/**< 监听socket是否在epoll中，连接数满时暂停监听 */
+	queue<CConnection*> EpollDoneConnections;	/**< 工作线程处理完成等待发送的连接 */
+	vector<CConnection*> EpollClosedConnections;/**< 本轮事件中关闭的连接，处理完事件后统一回收 */
+	CGroupWorker* GroupWorkers;					/**< 分组异步方式每个工作线程的epoll数据 */
+#endif
+#if defined(MOONDB_IO_URING)
+	CIoUring Uring;								/**< io_uring方式的提交、完成队列 */
+	uint64_t UringEventValue;					/**< 读取EpollEventFd的缓冲 */
+	__kernel_timespec UringTimeout;				/**< 定时唤醒事件循环，检查超时连接和停止指令 */
+	bool UringMultishotAccept;					/**< 内核是否支持multishot accept */
+#endif
+
 	CSQLParser SQLParser;
 };
 
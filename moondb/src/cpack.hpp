@@ -154,6 +154,23 @@ public:
 		}
 	}
 
+	/**
+	 * @brief Extend 在当前位置预留count字节并移到其后，返回预留部分的地址，由调用者直接写入
+	 */
+	inline char* Extend(size_t count)
+	{
+		uint64_t newposition = Position + count;
+		if(newposition > Capacity) {
+			Reallocate(static_cast<uint64_t>(newposition * 1.2));
+		}
+		char* p = static_cast<char*>(Cache) + Position;
+		Position = newposition;
+		if(newposition > Size) {
+			Size = newposition;
+		}
+		return p;
+	}
+
 	inline void Read(void* s, size_t count)
 	{
 		size_t newposition = Position + count;
@@ -164,6 +181,20 @@ public:
 		Position = newposition;
 	}
 
+	/**
+	 * @brief Skip 跳过count字节，返回跳过部分的地址，由调用者直接读取
+	 */
+	inline const char* Skip(size_t count)
+	{
+		size_t newposition = Position + count;
+		if(newposition > Size) {
+			ThrowError(ERR_EXCEED_MAXSIZE, "Exceed size(" + std::to_string(Size) + "," + std::to_string(count)  + "," +  std::to_string(newposition) + ").");
+		}
+		const char* p = static_cast<const char*>(Cache) + Position;
+		Position = newposition;
+		return p;
+	}
+
 	inline void* GetPointer() noexcept
 	{
 		return Cache;
@@ -335,12 +366,19 @@ public:
 	template<typename SizeType>
 	inline void Put(const std::string& val, size_t pad_length, char pad_char = '\0')
 	{
-		SizeType size = val.size();
-		this->Put(size);
-		this->Write(&val.front(), size);
+		PutString<SizeType>(val.data(), val.size(), pad_length, pad_char);
+	}
+
+	/**
+	 * @brief PutString 写入长度为SizeType的字符串，pad_length大于size时用pad_char补足
+	 */
+	template<typename SizeType>
+	inline void PutString(const char* data, size_t size, size_t pad_length = 0, char pad_char = '\0')
+	{
+		this->Put(static_cast<SizeType>(size));
+		this->Write(data, size);
 		if(pad_length > size) {
-			std::string pad_str(pad_length - size, pad_char);
-			this->Write(&pad_str.front(), pad_length - size);
+			::memset(this->Extend(pad_length - size), pad_char, pad_length - size);
 		}
 	}
 
@@ -382,6 +420,11 @@ public:
 		return Size;
 	}
 
+	inline size_t GetCapacity() const noexcept
+	{
+		return Capacity;
+	}
+
 	inline void SetSize(size_t newsize) noexcept
 	{
 		if(newsize <= Capacity) {
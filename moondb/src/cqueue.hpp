@@ -76,6 +76,14 @@ public:
 		return Keys.end();
 	}
 
+	/**
+	 * @brief last 返回最后一个元素（即最近push的元素）的位置
+	 */
+	inline typename std::list<size_t>::iterator last() noexcept
+	{
+		return std::prev(Keys.end());
+	}
+
 	inline T_Value* at(const typename std::list<size_t>::iterator& it)
 	{
 		return &Contents[*it];
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+
+namespace MoonDb {
+
+/**
+ * CReadMostlyMutex读多写少的读写锁：内部有SLOTS个读写锁，相邻的两个之间至少相隔一个缓存行，
+ * 读锁只锁定当前线程对应的一个，不同线程的读锁不修改同一个缓存行；写锁按顺序锁定全部。
+ * 用填充而不是alignas隔开各分组：C++14的new不保证超过16字节的对齐，包含该锁的对象大多在堆上创建
+ * 接口与std::shared_timed_mutex相同，可以用于std::shared_lock和std::unique_lock
+ */
+class CReadMostlyMutex
+{
+public:
+	const static uint32_t SLOTS = 16;		/**< 读锁分组数，必须为2的幂 */
+
+	CReadMostlyMutex() = default;
+	CReadMostlyMutex(const CReadMostlyMutex&) = delete;
+	CReadMostlyMutex& operator=(const CReadMostlyMutex&) = delete;
+
+	inline void lock()
+	{
+		for(uint32_t i = 0; i < SLOTS; i++) {
+			Slots[i].Mutex.lock();
+		}
+	}
+
+	inline void unlock()
+	{
+		for(uint32_t i = SLOTS; i > 0; i--) {
+			Slots[i - 1].Mutex.unlock();
+		}
+	}
+
+	inline void lock_shared()
+	{
+		Slots[SlotIndex()].Mutex.lock_shared();
+	}
+
+	inline void unlock_shared()
+	{
+		Slots[SlotIndex()].Mutex.unlock_shared();
+	}
+
+protected:
+	struct CSlot {
+		std::shared_timed_mutex Mutex;
+		char Pad[64];		/**< 与下一分组的锁之间相隔一个缓存行，不依赖对象的起始地址 */
+	};
+	CSlot Slots[SLOTS];
+
+	/**
+	 * @brief SlotIndex 线程第一次加读锁时按顺序分配分组，之后固定不变
+	 */
+	static inline uint32_t SlotIndex() noexcept
+	{
+		static std::atomic<uint32_t> next(0);
+		static thread_local uint32_t index = next.fetch_add(1, std::memory_order_relaxed) & (SLOTS - 1);
+		return index;
+	}
+};
+
+}
@@ -0,0 +1,417 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#if !defined(_WIN32)
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "crunningerror.hpp"
+#include "cflathashmap.hpp"
+#include "ctime.hpp"
+#include "functions.hpp"
+
+namespace MoonDb {
+
+/**
+ * CRedoLog内存表的重做日志：修改数据时在持有行锁期间调用Append把记录追加到内存缓冲区，同一行的记录在日志中的顺序与修改的顺序一致；
+ * 缓冲区由Flush写入文件，等待同步的写者在文件锁上排队，第一个取得文件锁的线程把此时缓冲区中全部的记录一起写入并同步，
+ * 之后的线程发现自己的记录已经同步就直接返回（组提交）。
+ * 每条记录为内容的字节数（uint32_t）、校验和（uint32_t）和内容，Replay读到不完整或校验和不符的记录时停止，文件末尾未写完的部分可以截去。
+ * 快照文件使用相同的记录格式
+ */
+class CRedoLog
+{
+public:
+	enum SyncPolicy {
+		SP_ALWAYS,		/**< 每次修改返回之前把日志同步写入磁盘 */
+		SP_INTERVAL,	/**< 每隔SyncInterval毫秒写入文件并同步一次 */
+		SP_NEVER		/**< 每隔SyncInterval毫秒写入文件，由系统写回磁盘 */
+	};
+
+	/**
+	 * 所有内存表共用的日志设置，加载数据之前设置
+	 */
+	struct CSettings {
+		bool Enabled = false;				/**< 是否为内存表记录重做日志，启动时从快照和日志恢复数据 */
+		SyncPolicy Sync = SP_INTERVAL;
+		uint32_t SyncInterval = 1000;		/**< SP_INTERVAL和SP_NEVER写入文件的时间间隔，单位为毫秒 */
+		uint32_t SnapshotInterval = 3600;	/**< 生成快照的时间间隔，单位为秒，0表示不按时间生成 */
+		uint64_t SnapshotLogSize = 0;		/**< 日志超过该字节数时生成快照，0表示不按大小生成 */
+	};
+
+	const static uint32_t HEADER_LENGTH = 8;			/**< 每条记录的字节数和校验和 */
+	const static uint32_t BUFFER_BYTES = 1 << 20;		/**< 缓冲区超过该字节数时由写者写入文件 */
+	const static uint32_t MAX_RECORD_BYTES = 1 << 30;	/**< 一条记录最多的字节数，超过时视为损坏 */
+
+	CRedoLog() noexcept : Fd(-1), Sync(SP_INTERVAL), SyncInterval(1000), Appended(0), Written(0), Durable(0), Bytes(0), LastFlush(0)
+	{}
+
+	CRedoLog(const CRedoLog&) = delete;
+	CRedoLog& operator=(const CRedoLog&) = delete;
+
+	~CRedoLog() noexcept
+	{
+		Close();
+	}
+
+	/**
+	 * @brief Open 打开或创建日志文件，记录追加在文件末尾
+	 * @param interval SP_INTERVAL和SP_NEVER写入文件的时间间隔，单位为毫秒
+	 */
+	void Open(const std::string& filename, SyncPolicy sync, uint32_t interval)
+	{
+		std::lock_guard<std::mutex> filelck(FileMutex);
+		Sync = sync;
+		SyncInterval = interval;
+		OpenFile(filename);
+		LastFlush = CTime::Now();
+	}
+
+	/**
+	 * @brief Close 关闭文件，缓冲区中未写入的记录丢弃，需要保留时先调用Flush
+	 */
+	void Close() noexcept
+	{
+#if !defined(_WIN32)
+		if(Fd >= 0) {
+			::close(Fd);
+			Fd = -1;
+		}
+#endif
+	}
+
+	/**
+	 * @brief Append 追加一条记录到缓冲区，不写入文件
+	 * @return 记录结束的位置，用于Commit和Flush，从打开日志开始计算，换文件后继续增加
+	 */
+	uint64_t Append(const void* data, uint32_t length)
+	{
+		uint32_t header[2] = {length, Checksum(data, length)};
+		std::lock_guard<std::mutex> lck(Mutex);
+		Buffer.append(reinterpret_cast<const char*>(header), HEADER_LENGTH);
+		Buffer.append(static_cast<const char*>(data), length);
+		Bytes.fetch_add(HEADER_LENGTH + length, std::memory_order_relaxed);
+		return Appended.fetch_add(HEADER_LENGTH + length, std::memory_order_relaxed) + HEADER_LENGTH + length;
+	}
+
+	/**
+	 * @brief Append 追加Frame编码的若干条记录到缓冲区
+	 */
+	uint64_t Append(const std::string& records)
+	{
+		std::lock_guard<std::mutex> lck(Mutex);
+		Buffer.append(records);
+		Bytes.fetch_add(records.size(), std::memory_order_relaxed);
+		return Appended.fetch_add(records.size(), std::memory_order_relaxed) + records.size();
+	}
+
+	/**
+	 * @brief Frame 把一条记录按日志格式（字节数、校验和、数据）追加到out
+	 */
+	static void Frame(std::string& out, const void* data, uint32_t length)
+	{
+		uint32_t header[2] = {length, Checksum(data, length)};
+		out.append(reinterpret_cast<const char*>(header), HEADER_LENGTH);
+		out.append(static_cast<const char*>(data), length);
+	}
+
+	/**
+	 * @brief Commit 修改数据之后、不再持有行锁时调用：SP_ALWAYS等待lsn之前的记录同步写入磁盘；
+	 * 其他策略只在缓冲区过大或者到了写入时间时写入文件，不等待其他线程正在进行的写入
+	 */
+	void Commit(uint64_t lsn)
+	{
+		if(SP_ALWAYS == Sync) {
+			Flush(lsn, true);
+		}
+		else if(Appended.load(std::memory_order_relaxed) - Written.load(std::memory_order_relaxed) >= BUFFER_BYTES) {
+			Flush(lsn, false);
+		}
+		else {
+			FlushIfDue();
+		}
+	}
+
+	/**
+	 * @brief Flush 把lsn之前的记录写入文件，sync为true时同步写入磁盘
+	 */
+	void Flush(uint64_t lsn, bool sync)
+	{
+		std::lock_guard<std::mutex> filelck(FileMutex);
+		WriteBuffer(lsn, sync);
+	}
+
+	/**
+	 * @brief Flush 把缓冲区中的全部记录写入文件
+	 */
+	void Flush(bool sync)
+	{
+		Flush(Appended.load(std::memory_order_relaxed), sync);
+	}
+
+	/**
+	 * @brief FlushIfDue 距离上次写入超过SyncInterval毫秒时写入缓冲区中的全部记录，SP_INTERVAL同时同步写入磁盘；
+	 * 由后台线程定期调用，其他线程正在写入时直接返回
+	 */
+	void FlushIfDue()
+	{
+		if(SP_ALWAYS == Sync || CTime::Now() - LastFlush.load(std::memory_order_relaxed) < static_cast<int64_t>(SyncInterval) * (CTime::NanoTime / 1000)) {
+			return;
+		}
+		std::unique_lock<std::mutex> filelck(FileMutex, std::try_to_lock);
+		if(!filelck.owns_lock()) {
+			return;
+		}
+		WriteBuffer(Appended.load(std::memory_order_relaxed), SP_INTERVAL == Sync);
+	}
+
+	/**
+	 * @brief Rotate 把缓冲区写入当前文件并同步，之后的记录写入新文件filename；
+	 * 返回之前追加的记录都在原来的文件中，之后追加的都在新文件中
+	 */
+	void Rotate(const std::string& filename)
+	{
+		std::lock_guard<std::mutex> filelck(FileMutex);
+		uint64_t end;
+		{
+			std::lock_guard<std::mutex> lck(Mutex);
+			Writing.swap(Buffer);
+			end = Appended.load(std::memory_order_relaxed);
+			Bytes.store(0, std::memory_order_relaxed);
+		}
+		WriteAll(Writing);
+		Writing.clear();
+		Written.store(end, std::memory_order_relaxed);
+		SyncFile();
+		Durable = end;
+		Close();
+		OpenFile(filename);
+	}
+
+	/**
+	 * @brief GetSize 当前文件的字节数，包括缓冲区中尚未写入的记录
+	 */
+	inline uint64_t GetSize() const noexcept
+	{
+		return Bytes.load(std::memory_order_relaxed);
+	}
+
+	/**
+	 * @brief Replay 按顺序对文件中的每条记录调用func(const char* data, uint32_t length)
+	 * @param repair 为true时截去文件末尾不完整或损坏的部分
+	 * @return 文件中的记录是否全部完整
+	 */
+	static bool Replay(const std::string& filename, const std::function<void(const char*, uint32_t)>& func, bool repair)
+	{
+#if defined(_WIN32)
+		ThrowError(ERR_FILE_OPEN, "Redo log " + filename + " isn't supported on this platform.");
+		return false;
+#else
+		int fd = ::open(filename.c_str(), O_RDONLY);
+		if(fd < 0) {
+			ThrowError(ERR_FILE_OPEN, "Can't open the file " + filename + ": " + ::strerror(errno));
+			return false;
+		}
+		::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+		const size_t chunk = 4 << 20;
+		std::vector<char> buffer(chunk);
+		size_t start = 0;
+		size_t end = 0;
+		uint64_t valid = 0;
+		bool complete = true;
+		bool eof = false;
+		while(!eof) {
+			// 未处理的部分移到开头，不够一条记录时扩大缓冲区
+			::memmove(buffer.data(), buffer.data() + start, end - start);
+			end -= start;
+			start = 0;
+			if(buffer.size() - end < chunk) {
+				buffer.resize(end + chunk);
+			}
+			ssize_t n = ::read(fd, buffer.data() + end, buffer.size() - end);
+			if(n < 0) {
+				if(EINTR == errno) {
+					continue;
+				}
+				::close(fd);
+				ThrowError(ERR_FILE_READ, "Can't read the file " + filename + ": " + ::strerror(errno));
+				return false;
+			}
+			eof = 0 == n;
+			end += static_cast<size_t>(n);
+			while(end - start >= HEADER_LENGTH) {
+				uint32_t header[2];
+				::memcpy(header, buffer.data() + start, HEADER_LENGTH);
+				if(header[0] > MAX_RECORD_BYTES) {
+					complete = false;
+					break;
+				}
+				if(end - start < HEADER_LENGTH + header[0]) {
+					break;
+				}
+				const char* data = buffer.data() + start + HEADER_LENGTH;
+				if(Checksum(data, header[0]) != header[1]) {
+					complete = false;
+					break;
+				}
+				try {
+					func(data, header[0]);
+				}
+				catch(...) {
+					::close(fd);
+					throw;
+				}
+				start += HEADER_LENGTH + header[0];
+				valid += HEADER_LENGTH + header[0];
+			}
+			if(!complete) {
+				break;
+			}
+		}
+		if(start != end) {
+			complete = false;
+		}
+		::close(fd);
+		if(!complete && repair && ::truncate(filename.c_str(), static_cast<off_t>(valid)) != 0) {
+			ThrowError(ERR_FILE_WRITE, "Can't truncate the file " + filename + ": " + ::strerror(errno));
+		}
+		return complete;
+#endif
+	}
+
+	/**
+	 * @brief SyncDirectory 同步目录，使其中新建和改名的文件写入磁盘
+	 */
+	static void SyncDirectory(const std::string& directory) noexcept
+	{
+#if !defined(_WIN32)
+		int fd = ::open(directory.c_str(), O_RDONLY);
+		if(fd >= 0) {
+			::fsync(fd);
+			::close(fd);
+		}
+#endif
+	}
+
+	/**
+	 * @brief Checksum 记录内容的校验和，每次处理8个字节
+	 */
+	static inline uint32_t Checksum(const void* data, uint32_t length) noexcept
+	{
+		const char* p = static_cast<const char*>(data);
+		uint64_t h = length;
+		uint32_t i = 0;
+		for(; i + 8 <= length; i += 8) {
+			uint64_t word;
+			::memcpy(&word, p + i, 8);
+			h = CFlatHash<uint64_t>::Mix(h ^ word);
+		}
+		if(i < length) {
+			uint64_t word = 0;
+			::memcpy(&word, p + i, length - i);
+			h = CFlatHash<uint64_t>::Mix(h ^ word ^ 0x80);
+		}
+		return static_cast<uint32_t>(h ^ (h >> 32));
+	}
+
+protected:
+	std::string Filename;
+	int Fd;
+	SyncPolicy Sync;
+	uint32_t SyncInterval;
+	std::mutex Mutex;						/**< 缓冲区的互斥锁，持有行锁时加锁 */
+	std::mutex FileMutex;					/**< 写入文件的互斥锁，先于Mutex加锁 */
+	std::string Buffer;						/**< 尚未写入文件的记录 */
+	std::string Writing;					/**< 正在写入文件的记录，与Buffer交换，持有FileMutex时使用 */
+	std::atomic<uint64_t> Appended;			/**< 已追加的字节数 */
+	std::atomic<uint64_t> Written;			/**< 已写入文件的字节数，持有FileMutex时修改 */
+	uint64_t Durable;						/**< 已同步写入磁盘的字节数，持有FileMutex时使用 */
+	std::atomic<uint64_t> Bytes;			/**< 当前文件的字节数，包括缓冲区 */
+	std::atomic<std::chrono::high_resolution_clock::rep> LastFlush;
+
+	/**
+	 * @brief WriteBuffer 调用时持有FileMutex
+	 */
+	void WriteBuffer(uint64_t lsn, bool sync)
+	{
+		if(Written.load(std::memory_order_relaxed) < lsn) {
+			uint64_t end;
+			{
+				std::lock_guard<std::mutex> lck(Mutex);
+				Writing.swap(Buffer);
+				end = Appended.load(std::memory_order_relaxed);
+			}
+			WriteAll(Writing);
+			Writing.clear();
+			Written.store(end, std::memory_order_relaxed);
+		}
+		if(sync && Durable < lsn) {
+			uint64_t end = Written.load(std::memory_order_relaxed);
+			SyncFile();
+			Durable = end;
+		}
+		LastFlush.store(CTime::Now(), std::memory_order_relaxed);
+	}
+
+	void OpenFile(const std::string& filename)
+	{
+		Filename = filename;
+#if defined(_WIN32)
+		ThrowError(ERR_FILE_OPEN, "Redo log " + Filename + " isn't supported on this platform.");
+#else
+		Fd = ::open(Filename.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+		if(Fd < 0) {
+			ThrowError(ERR_FILE_OPEN, "Can't open the file " + Filename + ": " + ::strerror(errno));
+			return;
+		}
+		struct stat st;
+		if(::fstat(Fd, &st) != 0) {
+			ThrowError(ERR_FILE_OPEN, "Can't stat the file " + Filename + ": " + ::strerror(errno));
+			return;
+		}
+		Bytes.fetch_add(static_cast<uint64_t>(st.st_size), std::memory_order_relaxed);
+#endif
+	}
+
+	void WriteAll(const std::string& data)
+	{
+#if !defined(_WIN32)
+		size_t done = 0;
+		while(done < data.size()) {
+			ssize_t n = ::write(Fd, data.data() + done, data.size() - done);
+			if(n < 0) {
+				if(EINTR == errno) {
+					continue;
+				}
+				ThrowError(ERR_FILE_WRITE, "Can't write the file " + Filename + ": " + ::strerror(errno));
+				return;
+			}
+			done += static_cast<size_t>(n);
+		}
+#endif
+	}
+
+	void SyncFile()
+	{
+#if !defined(_WIN32)
+#if defined(__linux__)
+		int ret = ::fdatasync(Fd);
+#else
+		int ret = ::fsync(Fd);
+#endif
+		if(0 != ret) {
+			ThrowError(ERR_FILE_WRITE, "Can't sync the file " + Filename + ": " + ::strerror(errno));
+		}
+#endif
+	}
+};
+
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+namespace MoonDb {
+
+/**
+ * CRingQueue为固定容量的无锁环形队列，只允许一个线程写入、一个线程读取（SPSC），
+ * 主要用于接收连接的线程向工作线程传递新连接
+ */
+template <typename T_Value>
+class CRingQueue
+{
+public:
+	CRingQueue() noexcept : Mask(0), Contents(nullptr), Head(0), Tail(0)
+	{}
+
+	explicit CRingQueue(size_t capacity) : Mask(0), Contents(nullptr), Head(0), Tail(0)
+	{
+		initialize(capacity);
+	}
+
+	CRingQueue(const CRingQueue&) = delete;
+	CRingQueue& operator=(const CRingQueue&) = delete;
+
+	~CRingQueue()
+	{
+		delete [] Contents;
+	}
+
+	/**
+	 * @brief initialize 分配空间，容量向上取整为2的幂，只能在读写线程启动前调用
+	 * @param capacity 最少容纳的元素个数
+	 */
+	inline void initialize(size_t capacity)
+	{
+		size_t size = 1;
+		while(size < capacity) {
+			size <<= 1;
+		}
+		delete [] Contents;
+		Contents = new T_Value[size];
+		Mask = size - 1;
+		Head = 0;
+		Tail = 0;
+	}
+
+	/**
+	 * @brief push 写入一个元素，只能在写线程中调用
+	 * @return 队列已满返回false
+	 */
+	inline bool push(const T_Value& value) noexcept
+	{
+		size_t tail = Tail.load(std::memory_order_relaxed);
+		if(tail - Head.load(std::memory_order_acquire) > Mask) {
+			return false;
+		}
+		Contents[tail & Mask] = value;
+		Tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * @brief pop 取出一个元素，只能在读线程中调用
+	 * @return 队列为空返回false
+	 */
+	inline bool pop(T_Value& value) noexcept
+	{
+		size_t head = Head.load(std::memory_order_relaxed);
+		if(head == Tail.load(std::memory_order_acquire)) {
+			return false;
+		}
+		value = Contents[head & Mask];
+		Head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	inline size_t size() const noexcept
+	{
+		return Tail.load(std::memory_order_acquire) - Head.load(std::memory_order_acquire);
+	}
+
+	inline bool empty() const noexcept
+	{
+		return 0 == size();
+	}
+
+	inline size_t capacity() const noexcept
+	{
+		return nullptr == Contents ? 0 : Mask + 1;
+	}
+
+protected:
+	size_t Mask;
+	T_Value* Contents;
+	std::atomic<size_t> Head;				/**< 读位置 */
+	char Padding[64 - sizeof(std::atomic<size_t>)];/**< 读写位置分开在不同缓存行，避免伪共享 */
+	std::atomic<size_t> Tail;				/**< 写位置 */
+};
+
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include "crunningerror.hpp"
+#include "functions.hpp"
+
+namespace MoonDb {
+
+/**
+ * CSlabHeap按大小分级的内存堆，用于存放变长数据：不超过MAX_CLASS_SIZE的块按大小分为CLASSES级，
+ * 128字节以内每8字节一级，之后每翻一倍分8级（每块最多浪费约1/8），同级的块从slab中顺序切分，
+ * 每级的slab从MIN_SLAB_BYTES（至少4块）开始每次加倍，最大MAX_SLAB_BYTES，数据很少的表不会每级都占用一个大slab；
+ * 释放后放入该级的空闲链表重复使用，slab在析构时才释放；更大的块直接malloc。
+ * 块没有头部，释放时由调用者提供申请时的大小。各级有自己的互斥锁，不同大小的分配和释放可以并行
+ */
+class CSlabHeap
+{
+public:
+	const static uint32_t MIN_SLAB_BYTES = 4096;	/**< 每级第一个slab的字节数 */
+	const static uint32_t MAX_SLAB_BYTES = 65536;	/**< slab的最大字节数 */
+	const static uint32_t MAX_CLASS_SIZE = 16384;	/**< 分级管理的最大块，更大的块直接malloc */
+	const static uint32_t CLASSES = 72;				/**< 级数 */
+
+	CSlabHeap() noexcept : Reserved(0), Used(0)
+	{
+		for(uint32_t i = 0; i < CLASSES; i++) {
+			Classes[i].Size = ClassSize(i);
+		}
+	}
+
+	CSlabHeap(const CSlabHeap&) = delete;
+	CSlabHeap& operator=(const CSlabHeap&) = delete;
+
+	~CSlabHeap() noexcept
+	{
+		for(uint32_t i = 0; i < CLASSES; i++) {
+			for(size_t j = 0; j < Classes[i].Slabs.size(); j++) {
+				::free(Classes[i].Slabs[j]);
+			}
+		}
+	}
+
+	/**
+	 * @brief allocate 分配size字节，size为0时按1字节分配
+	 */
+	void* allocate(size_t size)
+	{
+		if(size > MAX_CLASS_SIZE) {
+			void* p = ::malloc(size);
+			if(nullptr == p) {
+				ThrowError(ERR_MEMORY_ALLOCATE, "CSlabHeap failed to allocate " + num_to_string(uint64_t(size)) + " bytes.");
+				return nullptr;
+			}
+			Reserved += size;
+			Used += size;
+			return p;
+		}
+		CClass& cls = Classes[ClassIndex(size)];
+		std::lock_guard<std::mutex> lck(cls.Mutex);
+		void* p = cls.FreeList;
+		if(nullptr != p) {
+			cls.FreeList = *static_cast<void**>(p);
+		}
+		else {
+			if(cls.Next + cls.Size > cls.End) {
+				size_t bytes = std::max(static_cast<size_t>(MIN_SLAB_BYTES), cls.Size * 4) << std::min(cls.Slabs.size(), static_cast<size_t>(4));
+				bytes = std::max(std::min(bytes, static_cast<size_t>(MAX_SLAB_BYTES)), cls.Size * 4);
+				char* slab = static_cast<char*>(::malloc(bytes));
+				if(nullptr == slab) {
+					ThrowError(ERR_MEMORY_ALLOCATE, "CSlabHeap failed to allocate " + num_to_string(uint64_t(bytes)) + " bytes.");
+					return nullptr;
+				}
+				cls.Slabs.push_back(slab);
+				cls.Next = slab;
+				cls.End = slab + bytes;
+				Reserved += bytes;
+			}
+			p = cls.Next;
+			cls.Next += cls.Size;
+		}
+		Used += cls.Size;
+		return p;
+	}
+
+	/**
+	 * @brief free 释放allocate(size)分配的块
+	 */
+	void free(void* p, size_t size) noexcept
+	{
+		if(nullptr == p) {
+			return;
+		}
+		if(size > MAX_CLASS_SIZE) {
+			::free(p);
+			Reserved -= size;
+			Used -= size;
+			return;
+		}
+		CClass& cls = Classes[ClassIndex(size)];
+		std::lock_guard<std::mutex> lck(cls.Mutex);
+		*static_cast<void**>(p) = cls.FreeList;
+		cls.FreeList = p;
+		Used -= cls.Size;
+	}
+
+	/**
+	 * @brief usable_size 申请size字节实际占用的字节数
+	 */
+	static inline size_t usable_size(size_t size) noexcept
+	{
+		return size > MAX_CLASS_SIZE ? size : ClassSize(ClassIndex(size));
+	}
+
+	/**
+	 * @brief reserved 向系统申请的字节数（slab和大块）
+	 */
+	inline uint64_t reserved() const noexcept
+	{
+		return Reserved;
+	}
+
+	/**
+	 * @brief used 已分配块的字节数
+	 */
+	inline uint64_t used() const noexcept
+	{
+		return Used;
+	}
+
+protected:
+	struct CClass {
+		std::mutex Mutex;
+		size_t Size = 0;				/**< 块大小 */
+		void* FreeList = nullptr;		/**< 空闲块链表，每块的前8个字节为下一块的地址 */
+		char* Next = nullptr;			/**< 当前slab中下一个未使用的块 */
+		char* End = nullptr;
+		std::vector<char*> Slabs;
+		char Pad[64];					/**< 与下一级的字段之间相隔一个缓存行，不使用alignas，堆上的对象不保证按缓存行对齐 */
+	};
+	CClass Classes[CLASSES];
+	std::atomic<uint64_t> Reserved;
+	std::atomic<uint64_t> Used;
+
+	static inline uint32_t ClassIndex(size_t size) noexcept
+	{
+		if(size <= 128) {
+			return 0 == size ? 0 : static_cast<uint32_t>((size - 1) / 8);
+		}
+		// size在(2^p, 2^(p+1)]之间，该区间每2^(p-3)字节一级
+		uint32_t p = 63 - static_cast<uint32_t>(__builtin_clzll(size - 1));
+		return 16 + (p - 7) * 8 + static_cast<uint32_t>((size - 1 - (static_cast<size_t>(1) << p)) >> (p - 3));
+	}
+
+	static inline size_t ClassSize(uint32_t index) noexcept
+	{
+		if(index < 16) {
+			return (index + 1) * 8;
+		}
+		uint32_t p = 7 + (index - 16) / 8;
+		return (static_cast<size_t>(1) << p) + ((index - 16) % 8 + 1) * (static_cast<size_t>(1) << (p - 3));
+	}
+};
+
+}
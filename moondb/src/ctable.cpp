@@ -2,6 +2,9 @@
 
 namespace MoonDb {
 
+CMemoryBudget CTable::MemoryBudget;
+CRedoLog::CSettings CTable::RedoLogSettings;
+
 CTable::~CTable()
 {
 }
@@ -51,8 +54,11 @@ bool CTable::Open(const string& path, const string& name)
 	pack.Get(MinRows);
 	pack.Get(LifeTime);
 
-	// 读取字段
+	// 读取字段，Create之后再Open时替换Create中设置的字段和索引
 	pack.Get(FieldNum);
+	Fields = CMap<string, CField>();
+	Indexes.clear();
+	RowIdField.clear();
 	Fields.reserve(FieldNum);
 	for(uint16_t i = 0; i < FieldNum; ++i) {
 		string fieldname;
@@ -88,6 +94,7 @@ bool CTable::Open(const string& path, const string& name)
 	}
 
 	RowLength = ComputeFixedRowLength();
+	CompileCodec();
 
 	// 读取索引
 	uint8_t indexnum = 0;
@@ -174,6 +181,7 @@ bool CTable::Create(const string& path, const string& name, TableType engine, Fi
 	}
 
 	RowLength = ComputeFixedRowLength();
+	CompileCodec();
 
 	for(size_t i = 0; i < indexes.size(); ++i) {
 		const CIndex* index = &indexes[i];
@@ -236,6 +244,12 @@ bool CTable::Create(const string& path, const string& name, TableType engine, Fi
 
 size_t CTable::GetFieldLength(const CField& field) const noexcept
 {
+	if(TT_VARMEMORY == Engine && IsVarField(field.Type)) {
+		return VAR_REF_LENGTH;
+	}
+	if(TT_HARDDISK == Engine && IsVarField(field.Type)) {
+		return DISK_REF_LENGTH;
+	}
 	switch(field.Type) {
 	case FT_BOOL:
 		return 1;
@@ -345,6 +359,142 @@ size_t CTable::ComputeFixedRowLength() noexcept
 	return length;
 }
 
+void CTable::CompileCodec()
+{
+	Codec.clear();
+	// FNV-1a校验值，rowid字段名和类型也计入
+	CPack definition;
+	for(size_t i = 0; i < Fields.size(); ++i) {
+		const CField& field = Fields[i];
+		definition.Put<uint16_t>(0 == i ? RowIdField : field.Name);
+		definition.Put(static_cast<uint16_t>(field.Type));
+		definition.Put(field.Length);
+		definition.Put(field.Scale);
+	}
+	SchemaStamp = 2166136261U;
+	const unsigned char* p = static_cast<const unsigned char*>(definition.GetPointer());
+	for(size_t i = 0; i < definition.GetSize(); ++i) {
+		SchemaStamp = (SchemaStamp ^ p[i]) * 16777619U;
+	}
+	size_t fieldsize = Fields.size();
+	if(fieldsize < 2) {
+		return;
+	}
+	Codec.resize(fieldsize - 1);
+	bool fixed = true;
+	for(size_t i = 1; i < fieldsize; ++i) {
+		const CField& field = Fields[i];
+		CCodecField& cf = Codec[i - 1];
+		cf.Offset = field.Position;
+		cf.Fixed = fixed;
+		cf.Put = nullptr;
+		cf.Store = nullptr;
+		cf.RunLength = 0;
+		cf.RunBytes[0] = 0;
+		cf.RunBytes[1] = 0;
+		CPack header;
+		header.Put<uint16_t>(field.Name);
+		cf.NameBytes = header.GetSize();
+		// 按顺序读写的长度与GetFieldLength不同的类型（DATE、DATETIME写入的长度不同，SERIAL不读写，变长类型按实际长度），其后的字段只能顺序处理
+		switch(field.Type) {
+		case FT_BOOL:
+			cf.Put = &PutBytes<1>;
+			cf.Store = &StoreNumber<bool, FT_BOOL>;
+			break;
+		case FT_INT8:
+			cf.Put = &PutBytes<1>;
+			cf.Store = &StoreNumber<int8_t, FT_INT8>;
+			break;
+		case FT_UINT8:
+			cf.Put = &PutBytes<1>;
+			cf.Store = &StoreNumber<uint8_t, FT_UINT8>;
+			break;
+		case FT_INT16:
+			cf.Put = &PutBytes<2>;
+			cf.Store = &StoreNumber<int16_t, FT_INT16>;
+			break;
+		case FT_UINT16:
+			cf.Put = &PutBytes<2>;
+			cf.Store = &StoreNumber<uint16_t, FT_UINT16>;
+			break;
+		case FT_INT32:
+			cf.Put = &PutBytes<4>;
+			cf.Store = &StoreNumber<int32_t, FT_INT32>;
+			break;
+		case FT_UINT32:
+			cf.Put = &PutBytes<4>;
+			cf.Store = &StoreNumber<uint32_t, FT_UINT32>;
+			break;
+		case FT_INT64:
+			cf.Put = &PutBytes<8>;
+			cf.Store = &StoreNumber<int64_t, FT_INT64>;
+			break;
+		case FT_UINT64:
+			cf.Put = &PutBytes<8>;
+			cf.Store = &StoreNumber<uint64_t, FT_UINT64>;
+			break;
+		case FT_INT128:
+			cf.Put = &PutBytes<16>;
+			cf.Store = &StoreNumber<__int128_t, FT_INT128>;
+			break;
+		case FT_UINT128:
+			cf.Put = &PutBytes<16>;
+			cf.Store = &StoreNumber<__uint128_t, FT_UINT128>;
+			break;
+		case FT_FLOAT32:
+			cf.Put = &PutBytes<4>;
+			cf.Store = &StoreNumber<float, FT_FLOAT32>;
+			break;
+		case FT_FLOAT64:
+			cf.Put = &PutBytes<8>;
+			cf.Store = &StoreNumber<double, FT_FLOAT64>;
+			break;
+		case FT_TIMESTAMP:// 返回类型为INT64，输入可能是字符串，只编译读取
+			cf.Put = &PutBytes<8>;
+			break;
+		case FT_BIT:// 按16字节读写
+			fixed = fixed && 16 == GetFieldLength(field);
+			break;
+		case FT_FLOAT128:
+		case FT_DECIMAL64:
+		case FT_DECIMAL128:
+		case FT_ENUM:
+		case FT_TIME:
+		case FT_CHAR:
+		case FT_BINARY:
+			break;
+		default:
+			fixed = false;
+			break;
+		}
+		if(!cf.Fixed) {
+			cf.Put = nullptr;
+			cf.Store = nullptr;
+			continue;
+		}
+		if(nullptr != cf.Put) {
+			header.Put(static_cast<uint16_t>(FT_TIMESTAMP == field.Type ? FT_INT64 : field.Type));
+			cf.Header.assign(static_cast<const char*>(header.GetPointer()), header.GetSize());
+		}
+	}
+	// 从后向前统计连续可直接复制的字段
+	for(size_t i = Codec.size(); i-- > 0;) {
+		CCodecField& cf = Codec[i];
+		if(nullptr == cf.Put) {
+			continue;
+		}
+		uint64_t bytes = cf.Header.size() + GetFieldLength(Fields[i + 1]);
+		cf.RunLength = 1;
+		cf.RunBytes[0] = bytes - cf.NameBytes;
+		cf.RunBytes[1] = bytes;
+		if(i + 1 < Codec.size() && Codec[i + 1].RunLength > 0) {
+			cf.RunLength += Codec[i + 1].RunLength;
+			cf.RunBytes[0] += Codec[i + 1].RunBytes[0];
+			cf.RunBytes[1] += Codec[i + 1].RunBytes[1];
+		}
+	}
+}
+
 void CTable::GetInputValue(CPack& pack, bool ifexist, CAny* data, const string& fieldname, FieldType fieldtype, uint32_t length, uint32_t scale, CIconv::CharsetType charset, bool defdef, const CAny& defval, const unordered_map<string, uint16_t>& values)
 {
 	if(!ifexist) {
@@ -430,4 +580,278 @@ void CTable::EnumValuesToVector(const string& rawvalues, unordered_map<string, u
 	}
 }
 
+void CTable::SchemaResult(CPack& ret) const
+{
+	uint64_t start = BeginResult(ret, RT_SCHEMA);
+	ret.Put(static_cast<uint16_t>(GetIdType()));
+	ret.Put(RowLength);
+	ret.Put(static_cast<uint16_t>(FieldNum - 1));
+	for(uint16_t i = 1; i < FieldNum; i ++) {
+		const CField& field = Fields[i];
+		ret.Put<uint16_t>(field.Name);
+		ret.Put(static_cast<uint16_t>(field.Type));
+		ret.Put(field.Length);
+		ret.Put(field.Scale);
+		ret.Put(field.Position);
+		// ENUM按存储的编号顺序（从1开始）写入选项值
+		ret.Put(static_cast<uint16_t>(field.FlipValues.size()));
+		for(const string& value : field.FlipValues) {
+			ret.Put<uint16_t>(value);
+		}
+	}
+	ret.Put(SchemaStamp);
+	EndResult(ret, start);
+}
+
+void CTable::PutFieldValue(CPack& ret, const CField& field, CPack& row) const
+{
+	switch(field.Type) {
+	case FT_BOOL:
+	{
+		bool v;
+		row.Get(v);
+		ret.Put(static_cast<uint16_t>(FT_BOOL));
+		ret.Put(static_cast<uint8_t>(v));
+		break;
+	}
+	case FT_BIT:
+	{
+		char v[128];
+		__uint128_t bitint = 0;
+		row.Get(bitint);
+		uint32_t size = 0;
+		for(uint16_t i = 0; i < 128; ++i) {
+			if(bitint % 2 == 1) {
+				v[i] = '1';
+				size = i + 1;
+			}
+			else {
+				v[i] = '0';
+			}
+			bitint >>= 1;
+		}
+		ret.Put(static_cast<uint16_t>(FT_STRING));
+		ret.Put(size);
+		ret.Write(v, size);
+		break;
+	}
+	case FT_INT8:
+	{
+		int8_t v;
+		row.Get(v);
+		ret.Put(static_cast<uint16_t>(FT_INT8));
+		ret.Put(v);
+		break;
+	}
+	case FT_UINT8:
+	{
+		uint8_t v;
+		row.Get(v);
+		ret.Put(static_cast<uint16_t>(FT_UINT8));
+		ret.Put(v);
+		break;
+	}
+	case FT_INT16:
+	{
+		int16_t v;
+		row.Get(v);
+		ret.Put(static_cast<uint16_t>(FT_INT16));
+		ret.Put(v);
+		break;
+	}
+	case FT_UINT16:
+	{
+		uint16_t v;
+		row.Get(v);
+		ret.Put(static_cast<uint16_t>(FT_UINT16));
+		ret.Put(v);
+		break;
+	}
+	case FT_INT32:
+	{
+		int32_t v;
+		row.Get(v);
+		ret.Put(static_cast<uint16_t>(FT_INT32));
+		ret.Put(v);
+		break;
+	}
+	case FT_UINT32:
+	{
+		uint32_t v;
+		row.Get(v);
+		ret.Put(static_cast<uint16_t>(FT_UINT32));
+		ret.Put(v);
+		break;
+	}
+	case FT_INT64:
+	{
+		int64_t v;
+		row.Get(v);
+		ret.Put(static_cast<uint16_t>(FT_INT64));
+		ret.Put(v);
+		break;
+	}
+	case FT_UINT64:
+	{
+		uint64_t v;
+		row.Get(v);
+		ret.Put(static_cast<uint16_t>(FT_UINT64));
+		ret.Put(v);
+		break;
+	}
+	case FT_INT128:
+	{
+		__int128_t v;
+		row.Get(v);
+		ret.Put(static_cast<uint16_t>(FT_INT128));
+		ret.Put(v);
+		//ret.Put(static_cast<uint16_t>(FT_STRING));
+		//ret.Put<int32_t>(num_to_string(v));
+		break;
+	}
+	case FT_UINT128:
+	{
+		__uint128_t v;
+		row.Get(v);
+		ret.Put(static_cast<uint16_t>(FT_UINT128));
+		ret.Put(v);
+		//ret.Put(static_cast<uint16_t>(FT_STRING));
+		//ret.Put<int32_t>(num_to_string(v));
+		break;
+	}
+	case FT_FLOAT32:
+	{
+		float v;
+		row.Get(v);
+		ret.Put(static_cast<uint16_t>(FT_FLOAT32));
+		ret.Put(v);
+		break;
+	}
+	case FT_FLOAT64:
+	{
+		double v;
+		row.Get(v);
+		ret.Put(static_cast<uint16_t>(FT_FLOAT64));
+		ret.Put(v);
+		break;
+	}
+	case FT_FLOAT128:
+	{
+		__float128 v;
+		row.Get(v);
+		//ret.Put(static_cast<uint16_t>(FT_FLOAT128));
+		//ret.Put(v);
+		ret.Put(static_cast<uint16_t>(FT_STRING));
+		ret.Put<uint32_t>(num_to_string(v));
+		break;
+	}
+	case FT_DECIMAL64:
+	{
+		int64_t v;
+		row.Get(v);
+		CDecimal64 dec(field.Scale);
+		dec.SetData(v);
+		ret.Put(static_cast<uint16_t>(FT_STRING));
+		ret.Put<uint32_t>(dec.ToString(false));
+		break;
+	}
+	case FT_DECIMAL128:
+	{
+		__int128_t v;
+		row.Get(v);
+		CDecimal128 dec(field.Scale);
+		dec.SetData(v);
+		ret.Put(static_cast<uint16_t>(FT_STRING));
+		ret.Put<uint32_t>(dec.ToString(false));
+		break;
+	}
+	case FT_ENUM:
+	{
+		uint16_t v;
+		row.Get(v);
+		static const string empty;
+		ret.Put(static_cast<uint16_t>(FT_STRING));
+		ret.Put<uint32_t>(v > 0 && v <= field.FlipValues.size() ? field.FlipValues[v - 1] : empty);
+		break;
+	}
+	case FT_DATE:
+	{
+		CDate v;
+		row.Read(&v, sizeof(CDate));
+		ret.Put(static_cast<uint16_t>(FT_STRING));
+		ret.Put<uint32_t>(num_to_string(v.Year) + "-" + num_to_string(v.Month) + "-" + num_to_string(v.Day));
+		break;
+	}
+	case FT_TIME:
+	{
+		int64_t v;
+		row.Get(v);
+		__float128 ldv = static_cast<__float128>(v) / CTime::NanoTime;
+		v = static_cast<int64_t>(ldv);
+		double fraction = static_cast<double>(fabsq(ldv - v));
+		int64_t hour = v / 3600;
+		int32_t leftseconds = v % 3600;
+		int32_t minute = leftseconds / 60;
+		int32_t second = leftseconds % 60;
+		ret.Put(static_cast<uint16_t>(FT_STRING));
+		ret.Put<uint32_t>(num_to_string(hour) + ":" + pad_left_copy(num_to_string(::abs(minute)), 2, '0') + ":" + pad_left_copy(num_to_string(::abs(second)), 2, '0') + "." + num_to_string(fraction));
+		break;
+	}
+	case FT_DATETIME:
+	{
+		CDateTime v;
+		row.Read(&v, sizeof(CDate));
+		ret.Put(static_cast<uint16_t>(FT_STRING));
+		ret.Put<uint32_t>(v.to_string());
+		break;
+	}
+	case FT_TIMESTAMP:
+	{
+		int64_t v;
+		row.Get(v);
+		ret.Put(static_cast<uint16_t>(FT_INT64));
+		ret.Put(v);
+		break;
+	}
+	case FT_CHAR:
+	{
+		uint16_t chars;
+		row.Get(chars);
+		PutRowString<uint16_t>(ret, row, field.Length);
+		break;
+	}
+	case FT_VARCHAR:
+	{
+		uint16_t chars;
+		row.Get(chars);
+		PutRowString<uint16_t>(ret, row);
+		break;
+	}
+	case FT_TEXT:
+	{
+		uint32_t chars;
+		row.Get(chars);
+		PutRowString<uint32_t>(ret, row);
+		break;
+	}
+	case FT_BINARY:
+	{
+		PutRowString<uint16_t>(ret, row, field.Length);
+		break;
+	}
+	case FT_VARBINARY:
+	{
+		PutRowString<uint16_t>(ret, row);
+		break;
+	}
+	case FT_BLOB:
+	{
+		PutRowString<uint32_t>(ret, row);
+		break;
+	}
+	default:
+		break;
+	}
+}
+
 }
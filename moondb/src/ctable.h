@@ -1,10 +1,18 @@
 #pragma once
 
 #include "header.h"
+#include "cmemorybudget.hpp"
+#include "credolog.hpp"
+#include "carena.hpp"
 #include <shared_mutex>
+#include <functional>
 
 namespace MoonDb {
 
+typedef unordered_map<string, CAny, hash<string>, equal_to<string>, CArenaAllocator<pair<const string, CAny>>> CFieldMap;	/**< 请求中字段名到值的映射，处理请求时从内存池分配 */
+typedef vector<CFieldMap, CArenaAllocator<CFieldMap>> CFieldMaps;
+typedef vector<CAny, CArenaAllocator<CAny>> CRowIds;
+
 /*
  * 注意：sql在添加和更新数据时将CURRENT_TIMESTAMP()和NOW()都映射为将CURRENT_TIMESTAMP
  */
@@ -18,11 +26,50 @@ public:
 	virtual bool Open(const string& path, const string& name);
 
 	virtual ~CTable();
-	virtual void InsertData(unordered_map<string, CAny>& data, CPack& ret) = 0;
-	virtual void ReplaceData(const CAny& rowid, unordered_map<string, CAny>& data, CPack& ret) = 0;
-	virtual void UpdateData(const CAny& rowid, unordered_map<string, CAny>& data, CPack& ret) = 0;
+	virtual void InsertData(CFieldMap& data, CPack& ret) = 0;
+	virtual void ReplaceData(const CAny& rowid, CFieldMap& data, CPack& ret) = 0;
+	virtual void UpdateData(const CAny& rowid, CFieldMap& data, CPack& ret) = 0;
 	virtual void DeleteData(const CAny& rowid, CPack& ret) = 0;
 	virtual void GetData(const CAny& rowid, CPack& ret) = 0;
+	/**
+	 * 批量操作，按顺序处理各行，结果为每行一项的数组；某一行出错时停止，之前的行已生效
+	 */
+	virtual void InsertMultiData(CFieldMaps& rows, CPack& ret) = 0;
+	virtual void ReplaceMultiData(const CRowIds& rowids, CFieldMaps& rows, CPack& ret) = 0;
+	virtual void UpdateMultiData(const CRowIds& rowids, CFieldMaps& rows, CPack& ret) = 0;
+	virtual void DeleteMultiData(const CRowIds& rowids, CPack& ret) = 0;
+	/**
+	 * @brief GetMultiData 批量读取，withnames为false时结果头中不写入字段名，客户端按表结构的字段顺序解码
+	 */
+	virtual void GetMultiData(const CRowIds& rowids, CPack& ret, bool withnames = true) = 0;
+	/**
+	 * @brief GetRawData 在ret中写入原始行数据响应的头部，行数据不复制
+	 * @param sender 数据存在时以行数据在表内存中的地址和长度调用，调用期间行数据不变（内存表pin该行，不持有锁），地址在返回后失效
+	 * @return 数据是否存在
+	 */
+	virtual bool GetRawData(const CAny& rowid, CPack& ret, const function<void(const void*, uint64_t)>& sender) = 0;
+	/**
+	 * @brief ExpireRows 删除到期的数据，由后台线程定期调用
+	 * @param limit 本次最多处理的到期项数
+	 * @return 处理的到期项数，不小于limit时可能还有到期的项
+	 */
+	virtual size_t ExpireRows(size_t limit) = 0;
+	/**
+	 * @brief Persist 由后台线程定期调用：按同步策略把重做日志写入磁盘，到时间或日志过大时生成快照；只有启用重做日志的内存表需要
+	 */
+	virtual void Persist()
+	{}
+	/**
+	 * @brief SchemaResult 写入表结构：id类型、行长度，以及各字段的名称、类型、长度、小数位数、位置和ENUM选项，最后为表结构校验值
+	 */
+	void SchemaResult(CPack& ret) const;
+	/**
+	 * @brief StatsResult 写入表的统计信息，各项为名称和uint64_t值
+	 */
+	virtual void StatsResult(CPack& ret) = 0;
+
+	static CMemoryBudget MemoryBudget;	/**< 所有内存表共用的内存预算，加载数据之前设置 */
+	static CRedoLog::CSettings RedoLogSettings;	/**< 所有内存表共用的重做日志设置，加载数据之前设置 */
 
 	bool Create(const string& path, const string& name, TableType engine, FieldType rowidtype, const vector<CRawField>& fields,
 				const vector<CIndex>& indexes, uint64_t maxrows = 0, uint64_t minrows = 0, uint32_t lifetime = 0);
@@ -32,6 +79,25 @@ public:
 		return Name;
 	}
 
+	/**
+	 * @brief GetFieldName 按字段序号返回字段名，0为rowid字段，序号超出范围时返回nullptr
+	 */
+	const string* GetFieldName(uint16_t ordinal) const noexcept
+	{
+		if(ordinal >= FieldNum) {
+			return nullptr;
+		}
+		return 0 == ordinal ? &RowIdField : &Fields[ordinal].Name;
+	}
+
+	/**
+	 * @brief GetSchemaStamp 表结构的校验值，按字段序号访问的请求用它确认客户端缓存的表结构没有改变
+	 */
+	uint32_t GetSchemaStamp() const noexcept
+	{
+		return SchemaStamp;
+	}
+
 	void Test()
 	{
 		string str = "'a','b\\'', 'c',\"d\\\"\",'e'";
@@ -74,6 +140,16 @@ protected:
 		}
 	};
 
+	/**
+	 * @brief IsVarField 变长字段：TT_VARMEMORY和TT_HARDDISK表中行内只存放指向实际数据的引用
+	 */
+	static inline bool IsVarField(FieldType type) noexcept
+	{
+		return FT_VARCHAR == type || FT_VARBINARY == type || FT_TEXT == type || FT_BLOB == type;
+	}
+	const static uint32_t VAR_REF_LENGTH = sizeof(void*) + sizeof(uint32_t);	/**< 变长字段的引用：数据地址和字节数 */
+	const static uint32_t DISK_REF_LENGTH = sizeof(uint64_t) + sizeof(uint32_t);	/**< 硬盘表变长字段的引用：堆文件中的位置和字节数 */
+
 	size_t GetFieldLength(const CField& field) const noexcept;
 
 	size_t ComputeFixedRowLength() noexcept;
@@ -82,6 +158,130 @@ protected:
 
 	void EnumValuesToVector(const string& rawvalues, unordered_map<string, uint16_t>& values, vector<string>& flipvalues);
 
+	/**
+	 * @brief PutFieldValue 从row中读取一个字段的值，按返回给客户端的类型写入ret
+	 */
+	void PutFieldValue(CPack& ret, const CField& field, CPack& row) const;
+
+	/**
+	 * @brief PutRowString 把row中长度为SizeType的字符串直接复制到ret，不经过临时的string；pad_length为定长字段占用的字节数
+	 */
+	template<typename SizeType>
+	static inline void PutRowString(CPack& ret, CPack& row, size_t pad_length = 0)
+	{
+		SizeType size;
+		row.Get(size);
+		const char* p = row.Skip(size);
+		ret.Put(static_cast<uint16_t>(FT_STRING));
+		ret.Put(static_cast<uint32_t>(size));
+		ret.Write(p, size);
+		if(pad_length > size) {
+			row.Skip(pad_length - size);
+		}
+	}
+
+	/**
+	 * 编译后的字段编解码信息，打开或创建表时按字段生成：偏移固定的数值类型直接复制行数据，其他字段仍按类型逐个处理
+	 */
+	struct CCodecField {
+		uint64_t Offset;						/**< 在行数据中的位置，Fixed为false时无效 */
+		bool Fixed;								/**< 之前各字段顺序写入的长度都是固定的，Offset与Position相同 */
+		string Header;							/**< 结果中字段值之前的字节：字段名长度、字段名和返回类型 */
+		size_t NameBytes;						/**< Header中字段名长度和字段名的字节数，不带字段名时跳过 */
+		char* (*Put)(char* out, const char* src);		/**< 把行数据中的值复制到结果，为nullptr时按类型处理 */
+		bool (*Store)(const CAny& value, char* dst);	/**< 把输入值写入行数据，输入类型不能直接转换时返回false，为nullptr时按类型处理 */
+		uint32_t RunLength;						/**< 从该字段开始连续可以直接复制的字段数 */
+		uint64_t RunBytes[2];					/**< 这些字段在结果中的字节数，[0]不带字段名，[1]带字段名 */
+	};
+	vector<CCodecField> Codec;					/**< 除rowid之外各字段的编解码信息，与Fields[1]之后的字段对应 */
+	uint32_t SchemaStamp = 0;					/**< 各字段名称、类型、长度和小数位数的校验值，与Codec一起生成 */
+
+	/**
+	 * @brief CompileCodec 按字段定义和位置生成Codec和SchemaStamp，设置字段和RowLength之后调用
+	 */
+	void CompileCodec();
+
+	template <size_t N>
+	static char* PutBytes(char* out, const char* src) noexcept
+	{
+		::memcpy(out, src, N);
+		return out + N;
+	}
+
+	/**
+	 * @brief StoreNumber 与CAny::Store相同：类型相同时直接写入，整数字段可以输入INT64，FLOAT32字段可以输入FLOAT64
+	 */
+	template <typename T, FieldType FT>
+	static bool StoreNumber(const CAny& value, char* dst) noexcept
+	{
+		T v;
+		if(FT == value.GetType()) {
+			::memcpy(&v, &value.Data, sizeof(T));
+		}
+		else if(FT != FT_BOOL && FT != FT_FLOAT32 && FT != FT_FLOAT64 && FT_INT64 == value.GetType()) {
+			v = static_cast<T>(value.Data.Int64);
+		}
+		else if(FT == FT_FLOAT32 && FT_FLOAT64 == value.GetType()) {
+			v = static_cast<T>(value.Data.Float64);
+		}
+		else {
+			return false;
+		}
+		::memcpy(dst, &v, sizeof(T));
+		return true;
+	}
+
+	/**
+	 * @brief PutRowValues 按Codec依次写入行中各字段的返回类型和值，withnames为true时每个值之前写入字段名
+	 */
+	void PutRowValues(CPack& ret, CPack& row, bool withnames) const
+	{
+		const char* dp = static_cast<const char*>(row.GetPointer());
+		size_t num = Codec.size();
+		for(size_t i = 0; i < num;) {
+			const CCodecField& head = Codec[i];
+			if(head.RunLength > 0) {
+				// 连续的可直接复制的字段一次预留空间
+				char* out = ret.Extend(head.RunBytes[withnames ? 1 : 0]);
+				for(size_t end = i + head.RunLength; i < end; i++) {
+					const CCodecField& cf = Codec[i];
+					size_t skip = withnames ? 0 : cf.NameBytes;
+					::memcpy(out, cf.Header.data() + skip, cf.Header.size() - skip);
+					out = cf.Put(out + cf.Header.size() - skip, dp + cf.Offset);
+				}
+				continue;
+			}
+			const CField& field = Fields[i + 1];
+			if(withnames) {
+				ret.Put<uint16_t>(field.Name);
+			}
+			// 偏移不固定的字段接着前一个字段顺序读取
+			if(head.Fixed) {
+				row.Seek(static_cast<int64_t>(head.Offset));
+			}
+			PutFieldValue(ret, field, row);
+			i++;
+		}
+	}
+
+	/**
+	 * @brief BeginResult 在ret的当前位置写入响应头，返回响应开始的位置，写完数据后调用EndResult写入长度
+	 */
+	uint64_t BeginResult(CPack& ret, ResponseType type) const
+	{
+		uint64_t start = ret.Tell();
+		ret.Put(static_cast<int64_t>(0));
+		ret.Put(static_cast<uint16_t>(type));
+		return start;
+	}
+
+	void EndResult(CPack& ret, uint64_t start) const
+	{
+		ret.Seek(static_cast<int64_t>(start));
+		ret.Put(static_cast<int64_t>(ret.GetSize() - start - 8));
+		ret.Seek(0, CPack::POS_END);
+	}
+
 	virtual void IncreaseAutoInc(void* id) noexcept = 0;
 
 	template <typename IdType>
@@ -262,6 +462,8 @@ protected:
 	template <typename IdType>
 	void GetResult(CPack& ret, IdType id, CPack& row)
 	{
+		// 结果追加在ret当前位置之后，以便多个响应连续写入同一个缓冲区
+		uint64_t start = ret.Tell();
 		// 初始长度
 		ret.Put(static_cast<int64_t>(4));
 		// 返回类型
@@ -278,278 +480,56 @@ protected:
 		ret.Put(id);
 		// 按字段名逐一写入
 		ret.Put(static_cast<uint16_t>(FieldNum - 1));
+		PutRowValues(ret, row, true);
+		EndResult(ret, start);
+	}
+
+	/**
+	 * @brief MultiGetResultHeader 批量读取结果头：id类型、行数、字段数和字段名（withnames为false时不写入），之后每行依次为id（为0表示不存在）和各字段值
+	 */
+	uint64_t MultiGetResultHeader(CPack& ret, uint32_t rows, bool withnames = true)
+	{
+		uint64_t start = BeginResult(ret, RT_MULTI_QUERY);
+		ret.Put(static_cast<uint16_t>(GetIdType()));
+		ret.Put(rows);
+		ret.Put(static_cast<uint16_t>(FieldNum - 1));
+		if(!withnames) {
+			return start;
+		}
 		for(uint16_t i = 1; i < FieldNum; i ++) {
-			const CField* field = &Fields[i];
-			ret.Put<uint16_t>(field->Name);
-			switch(field->Type) {
-			case FT_BOOL:
-			{
-				bool v;
-				row.Get(v);
-				ret.Put(static_cast<uint16_t>(FT_BOOL));
-				ret.Put(static_cast<uint8_t>(v));
-				break;
-			}
-			case FT_BIT:
-			{
-				string v(128, '\0');
-				__uint128_t bitint = 0;
-				row.Get(bitint);
-				for(uint16_t i = 0; i < 128; ++i) {
-					if(bitint % 2 == 1) {
-						v[i] = '1';
-					}
-					else {
-						v[i] = '0';
-					}
-					bitint >>= 1;
-				}
-				rtrim(v, "0");
-				ret.Put(static_cast<uint16_t>(FT_STRING));
-				ret.Put<uint32_t>(v);
-				break;
-			}
-			case FT_INT8:
-			{
-				int8_t v;
-				row.Get(v);
-				ret.Put(static_cast<uint16_t>(FT_INT8));
-				ret.Put(v);
-				break;
-			}
-			case FT_UINT8:
-			{
-				uint8_t v;
-				row.Get(v);
-				ret.Put(static_cast<uint16_t>(FT_UINT8));
-				ret.Put(v);
-				break;
-			}
-			case FT_INT16:
-			{
-				int16_t v;
-				row.Get(v);
-				ret.Put(static_cast<uint16_t>(FT_INT16));
-				ret.Put(v);
-				break;
-			}
-			case FT_UINT16:
-			{
-				uint16_t v;
-				row.Get(v);
-				ret.Put(static_cast<uint16_t>(FT_UINT16));
-				ret.Put(v);
-				break;
-			}
-			case FT_INT32:
-			{
-				int32_t v;
-				row.Get(v);
-				ret.Put(static_cast<uint16_t>(FT_INT32));
-				ret.Put(v);
-				break;
-			}
-			case FT_UINT32:
-			{
-				uint32_t v;
-				row.Get(v);
-				ret.Put(static_cast<uint16_t>(FT_UINT32));
-				ret.Put(v);
-				break;
-			}
-			case FT_INT64:
-			{
-				int64_t v;
-				row.Get(v);
-				ret.Put(static_cast<uint16_t>(FT_INT64));
-				ret.Put(v);
-				break;
-			}
-			case FT_UINT64:
-			{
-				uint64_t v;
-				row.Get(v);
-				ret.Put(static_cast<uint16_t>(FT_UINT64));
-				ret.Put(v);
-				break;
-			}
-			case FT_INT128:
-			{
-				__int128_t v;
-				row.Get(v);
-				ret.Put(static_cast<uint16_t>(FT_INT128));
-				ret.Put(v);
-				//ret.Put(static_cast<uint16_t>(FT_STRING));
-				//ret.Put<int32_t>(num_to_string(v));
-				break;
-			}
-			case FT_UINT128:
-			{
-				__uint128_t v;
-				row.Get(v);
-				ret.Put(static_cast<uint16_t>(FT_UINT128));
-				ret.Put(v);
-				//ret.Put(static_cast<uint16_t>(FT_STRING));
-				//ret.Put<int32_t>(num_to_string(v));
-				break;
-			}
-			case FT_FLOAT32:
-			{
-				float v;
-				row.Get(v);
-				ret.Put(static_cast<uint16_t>(FT_FLOAT32));
-				ret.Put(v);
-				break;
-			}
-			case FT_FLOAT64:
-			{
-				double v;
-				row.Get(v);
-				ret.Put(static_cast<uint16_t>(FT_FLOAT64));
-				ret.Put(v);
-				break;
-			}
-			case FT_FLOAT128:
-			{
-				__float128 v;
-				row.Get(v);
-				//ret.Put(static_cast<uint16_t>(FT_FLOAT128));
-				//ret.Put(v);
-				ret.Put(static_cast<uint16_t>(FT_STRING));
-				ret.Put<uint32_t>(num_to_string(v));
-				break;
-			}
-			case FT_DECIMAL64:
-			{
-				int64_t v;
-				row.Get(v);
-				CDecimal64 dec(field->Scale);
-				dec.SetData(v);
-				ret.Put(static_cast<uint16_t>(FT_STRING));
-				ret.Put<uint32_t>(dec.ToString(false));
-				break;
-			}
-			case FT_DECIMAL128:
-			{
-				__int128_t v;
-				row.Get(v);
-				CDecimal128 dec(field->Scale);
-				dec.SetData(v);
-				ret.Put(static_cast<uint16_t>(FT_STRING));
-				ret.Put<uint32_t>(dec.ToString(false));
-				break;
-			}
-			case FT_ENUM:
-			{
-				uint16_t v;
-				row.Get(v);
-				string sv;
-				if(v > 0 && v <= field->FlipValues.size()) {
-					sv = string(field->FlipValues[v - 1]);
-				}
-				ret.Put(static_cast<uint16_t>(FT_STRING));
-				ret.Put<uint32_t>(sv);
-				break;
-			}
-			case FT_DATE:
-			{
-				CDate v;
-				row.Read(&v, sizeof(CDate));
-				ret.Put(static_cast<uint16_t>(FT_STRING));
-				ret.Put<uint32_t>(num_to_string(v.Year) + "-" + num_to_string(v.Month) + "-" + num_to_string(v.Day));
-				break;
-			}
-			case FT_TIME:
-			{
-				int64_t v;
-				row.Get(v);
-				__float128 ldv = static_cast<__float128>(v) / CTime::NanoTime;
-				v = static_cast<int64_t>(ldv);
-				double fraction = static_cast<double>(fabsq(ldv - v));
-				int64_t hour = v / 3600;
-				int32_t leftseconds = v % 3600;
-				int32_t minute = leftseconds / 60;
-				int32_t second = leftseconds % 60;
-				ret.Put(static_cast<uint16_t>(FT_STRING));
-				ret.Put<uint32_t>(num_to_string(hour) + ":" + pad_left_copy(num_to_string(::abs(minute)), 2, '0') + ":" + pad_left_copy(num_to_string(::abs(second)), 2, '0') + "." + num_to_string(fraction));
-				break;
-			}
-			case FT_DATETIME:
-			{
-				CDateTime v;
-				row.Read(&v, sizeof(CDate));
-				ret.Put(static_cast<uint16_t>(FT_STRING));
-				ret.Put<uint32_t>(v.to_string());
-				break;
-			}
-			case FT_TIMESTAMP:
-			{
-				int64_t v;
-				row.Get(v);
-				ret.Put(static_cast<uint16_t>(FT_INT64));
-				ret.Put(v);
-				break;
-			}
-			case FT_CHAR:
-			{
-				uint16_t chars;
-				row.Get(chars);
-				string v;
-				row.Get<uint16_t>(v, field->Length);
-				ret.Put(static_cast<uint16_t>(FT_STRING));
-				ret.Put<uint32_t>(v);
-				break;
-			}
-			case FT_VARCHAR:
-			{
-				uint16_t chars;
-				row.Get(chars);
-				string v;
-				row.Get<uint16_t>(v);
-				ret.Put(static_cast<uint16_t>(FT_STRING));
-				ret.Put<uint32_t>(v);
-				break;
-			}
-			case FT_TEXT:
-			{
-				uint32_t chars;
-				row.Get(chars);
-				string v;
-				row.Get<uint32_t>(v);
-				ret.Put(static_cast<uint16_t>(FT_STRING));
-				ret.Put<uint32_t>(v);
-				break;
-			}
-			case FT_BINARY:
-			{
-				string v;
-				row.Get<uint16_t>(v, field->Length);
-				ret.Put(static_cast<uint16_t>(FT_STRING));
-				ret.Put<uint32_t>(v);
-				break;
-			}
-			case FT_VARBINARY:
-			{
-				string v;
-				row.Get<uint16_t>(v);
-				ret.Put(static_cast<uint16_t>(FT_STRING));
-				ret.Put<uint32_t>(v);
-				break;
-			}
-			case FT_BLOB:
-			{
-				string v;
-				row.Get<uint32_t>(v);
-				ret.Put(static_cast<uint16_t>(FT_STRING));
-				ret.Put<uint32_t>(v);
-				break;
-			}
-			default:
-				break;
-			}
+			ret.Put<uint16_t>(Fields[i].Name);
+		}
+		return start;
+	}
+
+	/**
+	 * @brief StatsItem 写入一项统计信息，count为已写入的项数
+	 */
+	void StatsItem(CPack& ret, uint16_t& count, const string& name, uint64_t value) const
+	{
+		ret.Put<uint16_t>(name);
+		ret.Put(value);
+		count++;
+	}
+
+	template <typename IdType>
+	void RawResultHeader(CPack& ret, IdType id, uint64_t length)
+	{
+		// 行数据不在ret中，长度预先计入
+		ret.Put(static_cast<int64_t>(4 + sizeof(IdType) + length));
+		ret.Put(static_cast<uint16_t>(RT_RAW_QUERY));
+		ret.Put(static_cast<uint16_t>(GetIdType()));
+		ret.Put(id);
+	}
+
+	template <typename IdType>
+	void MultiGetResultRow(CPack& ret, IdType id, CPack& row)
+	{
+		ret.Put(id);
+		if(id == 0) {
+			return;
 		}
-		ret.Seek(0);
-		ret.Put(static_cast<int64_t>(ret.GetSize() - 8));
+		PutRowValues(ret, row, false);
 	}
 
 	string Path;				/**< 表所在目录 */
@@ -560,7 +540,7 @@ protected:
 	TableType Engine;			/**< 表引擎 */
 	string RowIdField;			/**< rowid字段名 */
 	FieldType RowIdType;		/**< rowid类型 */
-	uint64_t RowLength;			/**< 当此表为TT_MEMORY类型时，RowLength为每行数据的最大长度；当表为TT_HARDDISK类型时，RowLength为每行固定长度数据的总长度。 */
+	uint64_t RowLength;			/**< 当此表为TT_FIXMEMORY类型时，RowLength为每行数据的最大长度；为TT_VARMEMORY类型时，变长字段只计引用的长度；当表为TT_HARDDISK类型时，RowLength为每行固定长度数据和变长字段引用的总长度。 */
 	uint64_t MaxRows;			/**< 最大行数 */
 	uint64_t MinRows;			/**< 最小行数 */
 	uint32_t LifeTime;			/**< 数据的有效时间，为0表示长期有效，单位为秒 */
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+namespace MoonDb {
+
+/**
+ * CTimerWheel为分层时间轮，添加到期项为O(1)，推进时只取出已到期的项，不需要遍历全部项。
+ * 同时缓存一个粗粒度的当前时间，由事件循环每轮更新一次，其他地方读取缓存的时间而不是读取时钟。
+ * 不支持删除，到期项是否仍然有效由调用者在回调中判断（惰性删除）；只能在同一个线程中使用
+ */
+template <typename T_Value>
+class CTimerWheel
+{
+public:
+	CTimerWheel() noexcept : Tick(1000000), Current(0), CurrentTime(0), Count(0)
+	{}
+
+	CTimerWheel(const CTimerWheel&) = delete;
+	CTimerWheel& operator=(const CTimerWheel&) = delete;
+
+	/**
+	 * @brief initialize 清空时间轮并设置起始时间
+	 * @param now 当前时间，单位为纳秒
+	 * @param tick 时间精度，单位为纳秒，缺省为1毫秒
+	 */
+	inline void initialize(int64_t now, int64_t tick = 1000000)
+	{
+		Tick = tick > 0 ? tick : 1;
+		CurrentTime = now;
+		Current = now / Tick;
+		Count = 0;
+		for(uint32_t i = 0; i < LEVELS; i++) {
+			for(uint32_t j = 0; j < SLOTS; j++) {
+				Slots[i][j].clear();
+			}
+		}
+	}
+
+	/**
+	 * @brief now 返回缓存的当前时间
+	 */
+	inline int64_t now() const noexcept
+	{
+		return CurrentTime;
+	}
+
+	/**
+	 * @brief update 更新缓存的当前时间，每轮事件循环调用一次
+	 */
+	inline void update(int64_t now) noexcept
+	{
+		if(now > CurrentTime) {
+			CurrentTime = now;
+		}
+	}
+
+	/**
+	 * @brief schedule 添加一项，在due之后的第一次expire时取出
+	 * @param due 到期时间，单位为纳秒
+	 */
+	inline void schedule(const T_Value& value, int64_t due)
+	{
+		int64_t tick = TickOf(due);
+		if(tick <= Current) {
+			tick = Current + 1;
+		}
+		Insert(CEntry(value, due), tick);
+		Count++;
+	}
+
+	/**
+	 * @brief expire 推进到缓存的当前时间，依次取出到期的项
+	 * @param func 处理函数，参数为(value, due)，处理函数中可以继续调用schedule
+	 * @param limit 取出的项数达到limit后不再推进，同一个槽中的项总是全部取出
+	 * @return 取出的项数
+	 */
+	template <typename T_Func>
+	inline size_t expire(T_Func func, size_t limit = std::numeric_limits<size_t>::max())
+	{
+		int64_t target = CurrentTime / Tick;
+		size_t fired = 0;
+		while(Current < target && fired < limit) {
+			// 没有项时直接跳到当前时间
+			if(0 == Count) {
+				Current = target;
+				break;
+			}
+			Current++;
+			// 低层转完一圈时，把上层当前槽中的项分散到下层，从最高层开始
+			uint32_t level = 0;
+			while(level + 1 < LEVELS && 0 == (Current & ((static_cast<int64_t>(1) << ((level + 1) * BITS)) - 1))) {
+				level++;
+			}
+			for(; level > 0; level--) {
+				Cascade(level);
+			}
+			std::vector<CEntry>& slot = Slots[0][Current & MASK];
+			if(slot.empty()) {
+				continue;
+			}
+			Expired.swap(slot);
+			for(size_t i = 0; i < Expired.size(); i++) {
+				// 超出范围而提前放置的项，按实际时间重新放置
+				int64_t tick = TickOf(Expired[i].Due);
+				if(tick > Current) {
+					Insert(Expired[i], tick);
+					continue;
+				}
+				Count--;
+				fired++;
+				func(Expired[i].Value, Expired[i].Due);
+			}
+			Expired.clear();
+		}
+		return fired;
+	}
+
+	inline size_t size() const noexcept
+	{
+		return Count;
+	}
+
+	inline bool empty() const noexcept
+	{
+		return 0 == Count;
+	}
+
+protected:
+	const static uint32_t BITS = 6;
+	const static uint32_t SLOTS = 1 << BITS;
+	const static int64_t MASK = SLOTS - 1;
+	const static uint32_t LEVELS = 5;		/**< 精度为1毫秒时，最高层覆盖约12天，更远的项先放在最高层一圈的末尾，到时再按实际时间放置 */
+
+	struct CEntry {
+		T_Value Value;
+		int64_t Due;
+		CEntry(const T_Value& value, int64_t due)
+			: Value(value), Due(due) {}
+	};
+
+	/**
+	 * @brief TickOf 到期时间所在的Tick，向上取整，保证取出时已经到期
+	 */
+	inline int64_t TickOf(int64_t due) const noexcept
+	{
+		return (due + Tick - 1) / Tick;
+	}
+
+	inline void Insert(const CEntry& entry, int64_t tick)
+	{
+		const int64_t limit = (static_cast<int64_t>(1) << (LEVELS * BITS)) - 1;
+		if((tick ^ Current) > limit) {
+			tick = (Current & limit) == limit ? Current + 1 : (Current | limit);
+		}
+		// 按与当前时间不同的最高一段选择层，保证该槽在本圈中还没有被分散过
+		uint32_t level = 0;
+		while(level + 1 < LEVELS && 0 != ((tick ^ Current) >> ((level + 1) * BITS))) {
+			level++;
+		}
+		Slots[level][(tick >> (level * BITS)) & MASK].push_back(entry);
+	}
+
+	inline void Cascade(uint32_t level)
+	{
+		std::vector<CEntry>& slot = Slots[level][(Current >> (level * BITS)) & MASK];
+		if(slot.empty()) {
+			return;
+		}
+		Expired.swap(slot);
+		for(size_t i = 0; i < Expired.size(); i++) {
+			int64_t tick = TickOf(Expired[i].Due);
+			Insert(Expired[i], tick < Current ? Current : tick);
+		}
+		Expired.clear();
+	}
+
+	int64_t Tick;						/**< 时间精度，单位为纳秒 */
+	int64_t Current;					/**< 已推进到的时间，单位为Tick */
+	int64_t CurrentTime;				/**< 缓存的当前时间，单位为纳秒 */
+	size_t Count;						/**< 项数 */
+	std::vector<CEntry> Slots[LEVELS][SLOTS];
+	std::vector<CEntry> Expired;		/**< 取出的项，重复使用以避免分配内存 */
+};
+
+}
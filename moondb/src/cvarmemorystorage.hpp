@@ -0,0 +1,310 @@
+#pragma once
+
+#include "cfixedmemorystorage.hpp"
+#include "cslabheap.hpp"
+
+namespace MoonDb {
+
+/**
+ * CVarMemoryStorage变长内存表（TT_VARMEMORY）：固定长度的字段与CFixedMemoryStorage一样存放在行内，
+ * VARCHAR、VARBINARY、TEXT、BLOB在行内只存放引用（地址和字节数），数据按实际长度编码后存放在分级的内存堆中，
+ * 占用内存与实际数据大小成正比。变长数据在修改时释放，读取时加锁（find）而不是乐观复制，读取期间引用的数据不会被释放；
+ * 不支持原始行数据读取
+ */
+template <typename IdType>
+class CVarMemoryStorage : public CFixedMemoryStorage<IdType>
+{
+	typedef CFixedMemoryStorage<IdType> CBase;
+	using typename CTable::CField;
+	using CTable::Fields;
+	using CTable::FieldNum;
+	using CTable::RowLength;
+	using CTable::Name;
+	using CTable::MemoryBudget;
+	using CBase::Contents;
+
+public:
+	CVarMemoryStorage() = default;
+
+	~CVarMemoryStorage()
+	{
+		MemoryBudget.Release(Heap.used());
+	}
+
+	bool Open(const string& path, const string& name)
+	{
+		// 在打开之前设置，从日志恢复的行也需要清零和释放
+		Contents.set_releaser([this](void* dp) {
+			ReleaseRow(dp);
+		});
+		CBase::Open(path, name);
+		return true;
+	}
+
+	void GetData(const CAny& rowid, CPack& ret)
+	{
+		IdType id = this->template GetRowId<IdType>(false, rowid);
+		bool found = Contents.find(id, [&](const void* dp) {
+			uint64_t start = ret.Tell();
+			ret.Put(static_cast<int64_t>(4));
+			ret.Put(static_cast<uint16_t>(RT_QUERY));
+			ret.Put(static_cast<uint16_t>(1));
+			ret.Put(static_cast<uint16_t>(this->GetIdType()));
+			ret.Put(id);
+			ret.Put(static_cast<uint16_t>(FieldNum - 1));
+			PutRow(ret, dp, true);
+			this->EndResult(ret, start);
+		});
+		if(!found) {
+			CPack row;
+			this->template GetResult<IdType>(ret, 0, row);
+		}
+	}
+
+	void GetMultiData(const CRowIds& rowids, CPack& ret, bool withnames = true)
+	{
+		uint64_t start = this->MultiGetResultHeader(ret, static_cast<uint32_t>(rowids.size()), withnames);
+		for(size_t i = 0; i < rowids.size(); i++) {
+			IdType id = this->template GetRowId<IdType>(false, rowids[i]);
+			bool found = Contents.find(id, [&](const void* dp) {
+				ret.Put(id);
+				PutRow(ret, dp, false);
+			});
+			if(!found) {
+				ret.Put(static_cast<IdType>(0));
+			}
+		}
+		this->EndResult(ret, start);
+	}
+
+	bool GetRawData(const CAny&, CPack&, const function<void(const void*, uint64_t)>&)
+	{
+		ThrowError(ERR_WRONG_ENGINE, "The table " + Name + " with the engine VARMEMORY doesn't support raw reading.");
+		return false;
+	}
+
+protected:
+	CSlabHeap Heap;		/**< 变长字段的数据 */
+
+	/**
+	 * 变长字段在行内的引用
+	 */
+	struct CVarRef {
+		void* Data;
+		uint32_t Length;
+	};
+
+	static inline CVarRef GetRef(const void* dp, uint64_t position) noexcept
+	{
+		CVarRef ref;
+		const char* slot = static_cast<const char*>(dp) + position;
+		::memcpy(&ref.Data, slot, sizeof(void*));
+		::memcpy(&ref.Length, slot + sizeof(void*), sizeof(uint32_t));
+		return ref;
+	}
+
+	static inline void SetRef(void* dp, uint64_t position, void* data, uint32_t length) noexcept
+	{
+		char* slot = static_cast<char*>(dp) + position;
+		::memcpy(slot, &data, sizeof(void*));
+		::memcpy(slot + sizeof(void*), &length, sizeof(uint32_t));
+	}
+
+	inline void FreeRef(const CVarRef& ref) noexcept
+	{
+		if(nullptr != ref.Data) {
+			Heap.free(ref.Data, ref.Length);
+			MemoryBudget.Release(CSlabHeap::usable_size(ref.Length));
+		}
+	}
+
+	/**
+	 * @brief StoreField 写入一个字段：固定长度的字段写在行内，变长字段编码后存入内存堆，替换并释放原来的数据
+	 */
+	void StoreField(CPack& row, const CField& field, bool ifexist, CAny* data, bool defdef, const CAny& defval)
+	{
+		if(!CTable::IsVarField(field.Type)) {
+			row.Seek(static_cast<int64_t>(field.Position));
+			this->GetInputValue(row, ifexist, data, field.Name, field.Type, field.Length, field.Scale, field.Charset, defdef, defval, field.Values);
+			return;
+		}
+		CPack& encoder = Encoder();
+		encoder.Clear();
+		this->GetInputValue(encoder, ifexist, data, field.Name, field.Type, field.Length, field.Scale, field.Charset, defdef, defval, field.Values);
+		uint32_t length = static_cast<uint32_t>(encoder.GetSize());
+		void* p = Heap.allocate(length);
+		::memcpy(p, encoder.GetPointer(), length);
+		MemoryBudget.Charge(CSlabHeap::usable_size(length));
+		CVarRef old = GetRef(row.GetPointer(), field.Position);
+		SetRef(row.GetPointer(), field.Position, p, length);
+		FreeRef(old);
+	}
+
+	/**
+	 * @brief FillRow 按字段位置写入整行数据，新行的引用已清零，已有的行替换原来的变长数据
+	 */
+	void FillRow(CPack& pack, CFieldMap& data)
+	{
+		pack.SetSize(RowLength);
+		for(uint16_t i = 1; i < FieldNum; i ++) {
+			const CField& field = Fields[i];
+			auto dit = data.find(field.Name);
+			bool ifexist = dit != data.end();
+			StoreField(pack, field, ifexist, ifexist ? &dit->second : nullptr, field.DefaultDefined, field.DefaultValue);
+		}
+	}
+
+	void UpdateFields(void* dp, CFieldMap& data)
+	{
+		CPack row(dp, RowLength);
+		row.SetSize(RowLength);
+		for(uint16_t i = 1; i < FieldNum; i ++) {
+			const CField& field = Fields[i];
+			auto dit = data.find(field.Name);
+			bool ifexist = dit != data.end();
+			if(!ifexist && !field.OnUpdateDefined) {
+				continue;
+			}
+			StoreField(row, field, ifexist, ifexist ? &dit->second : nullptr, field.OnUpdateDefined, field.ValueOnUpdate);
+		}
+	}
+
+	/**
+	 * @brief PutRow 按返回给客户端的类型写入各字段的值，withnames为true时每个值之前写入字段名
+	 */
+	void PutRow(CPack& ret, const void* dp, bool withnames) const
+	{
+		CPack row(const_cast<void*>(dp), RowLength);
+		row.SetSize(RowLength);
+		for(uint16_t i = 1; i < FieldNum; i ++) {
+			const CField& field = Fields[i];
+			if(withnames) {
+				ret.Put<uint16_t>(field.Name);
+			}
+			if(CTable::IsVarField(field.Type)) {
+				CVarRef ref = GetRef(dp, field.Position);
+				CPack value(ref.Data, ref.Length);
+				value.SetSize(ref.Length);
+				this->PutFieldValue(ret, field, value);
+			}
+			else {
+				row.Seek(static_cast<int64_t>(field.Position));
+				this->PutFieldValue(ret, field, row);
+			}
+		}
+	}
+
+	/**
+	 * @brief ReleaseRow 删除行时释放各变长字段的数据
+	 */
+	void ReleaseRow(void* dp) noexcept
+	{
+		for(uint16_t i = 1; i < FieldNum; i ++) {
+			const CField& field = Fields[i];
+			if(CTable::IsVarField(field.Type)) {
+				FreeRef(GetRef(dp, field.Position));
+				SetRef(dp, field.Position, nullptr, 0);
+			}
+		}
+	}
+
+	/**
+	 * @brief EncodeRow 行内数据（引用清零）之后按字段顺序写入各变长字段的字节数和数据
+	 */
+	void EncodeRow(CPack& record, const void* dp)
+	{
+		uint64_t start = record.Tell();
+		record.Write(dp, RowLength);
+		char* row = static_cast<char*>(record.GetPointer()) + start;
+		for(uint16_t i = 1; i < FieldNum; i ++) {
+			const CField& field = Fields[i];
+			if(CTable::IsVarField(field.Type)) {
+				SetRef(row, field.Position, nullptr, 0);
+			}
+		}
+		for(uint16_t i = 1; i < FieldNum; i ++) {
+			const CField& field = Fields[i];
+			if(CTable::IsVarField(field.Type)) {
+				CVarRef ref = GetRef(dp, field.Position);
+				record.Put(ref.Length);
+				record.Write(ref.Data, ref.Length);
+			}
+		}
+	}
+
+	/**
+	 * @brief DecodeRow 覆盖行内数据，变长数据存入内存堆，之后释放原来的数据
+	 */
+	void DecodeRow(void* dp, const char* data, uint64_t length)
+	{
+		if(length < RowLength) {
+			ThrowError(ERR_FILE_READ, "The redo log of the table " + Name + " doesn't match its fields.");
+			return;
+		}
+		vector<CVarRef>& olds = OldRefs();
+		olds.clear();
+		for(uint16_t i = 1; i < FieldNum; i ++) {
+			if(CTable::IsVarField(Fields[i].Type)) {
+				olds.push_back(GetRef(dp, Fields[i].Position));
+			}
+		}
+		::memcpy(dp, data, RowLength);
+		uint64_t pos = RowLength;
+		for(uint16_t i = 1; i < FieldNum; i ++) {
+			const CField& field = Fields[i];
+			if(!CTable::IsVarField(field.Type)) {
+				continue;
+			}
+			uint32_t size = 0;
+			if(pos + sizeof(uint32_t) <= length) {
+				::memcpy(&size, data + pos, sizeof(uint32_t));
+			}
+			if(pos + sizeof(uint32_t) > length || pos + sizeof(uint32_t) + size > length) {
+				// 已写入的引用为新分配的数据，按空值结束，原来的数据仍然释放
+				for(uint16_t j = i; j < FieldNum; j ++) {
+					if(CTable::IsVarField(Fields[j].Type)) {
+						SetRef(dp, Fields[j].Position, nullptr, 0);
+					}
+				}
+				for(size_t j = 0; j < olds.size(); j++) {
+					FreeRef(olds[j]);
+				}
+				ThrowError(ERR_FILE_READ, "The redo log of the table " + Name + " doesn't match its fields.");
+				return;
+			}
+			pos += sizeof(uint32_t);
+			void* p = Heap.allocate(size);
+			::memcpy(p, data + pos, size);
+			MemoryBudget.Charge(CSlabHeap::usable_size(size));
+			SetRef(dp, field.Position, p, size);
+			pos += size;
+		}
+		for(size_t j = 0; j < olds.size(); j++) {
+			FreeRef(olds[j]);
+		}
+	}
+
+	static vector<CVarRef>& OldRefs()
+	{
+		static thread_local vector<CVarRef> refs;
+		return refs;
+	}
+
+	void StatsItems(CPack& ret, uint16_t& count)
+	{
+		CBase::StatsItems(ret, count);
+		this->StatsItem(ret, count, "heap_used", Heap.used());
+		this->StatsItem(ret, count, "heap_reserved", Heap.reserved());
+	}
+
+	/**
+	 * @brief Encoder 线程内复用的变长字段编码缓冲区
+	 */
+	static CPack& Encoder()
+	{
+		static thread_local CPack encoder(256);
+		return encoder;
+	}
+};
+
+}
@@ -79,6 +79,13 @@ namespace MoonDb {
 		RT_LAST_INSERT_ID,
 		RT_AFFECTED_ROWS,
 		RT_EXECUTE,
+		RT_MULTI_QUERY,			/**< 批量读取结果 */
+		RT_MULTI_INSERT_ID,		/**< 批量插入的各行id */
+		RT_MULTI_AFFECTED_ROWS,	/**< 批量更新、删除、替换各行的影响行数 */
+		RT_RAW_QUERY,			/**< 读取结果为按表结构存储的原始行数据，由客户端根据RT_SCHEMA解码 */
+		RT_SCHEMA,				/**< 表结构：各字段的类型、长度和在行中的位置 */
+		RT_STATS,				/**< 表的统计信息：名称和64位无符号整数值的列表 */
+		RT_SCHEMA_CHANGED,		/**< 按字段序号的请求中的表结构校验值与表不一致，请求未执行，之后为当前的校验值，客户端需重新读取表结构 */
 	};
 
 	struct CString {